@@ -0,0 +1,79 @@
+/**
+ * 颜色转换耗时对比：libswscale(SWS_FAST_BILINEAR) 和 SimdConvert 的各个指令集
+ * ./ColorConvertBench [iterations]
+ */
+#include "ColorConvert.h"
+#include "SliceScaler.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+struct Image {
+    uint8_t *data[4] = {NULL, NULL, NULL, NULL};
+    int linesize[4] = {0, 0, 0, 0};
+    Image(int width, int height, AVPixelFormat fmt)
+    {
+        av_image_alloc(data, linesize, width, height, fmt, 32);
+        int size = av_image_get_buffer_size(fmt, width, height, 32);
+        for (int i = 0; i < size; i++) {
+            data[0][i] = (uint8_t)(rand() & 0xff);
+        }
+    }
+    ~Image() { av_freep(&data[0]); }
+};
+template <typename F>
+static double TimeMs(int iterations, F func)
+{
+    func(); // 预热，创建上下文、分配内存
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+static void BenchOne(int width, int height, AVPixelFormat src_fmt, AVPixelFormat dst_fmt, int iterations)
+{
+    Image src(width, height, src_fmt);
+    Image dst(width, height, dst_fmt);
+    char name[64];
+    snprintf(name, sizeof(name), "%s->%s %dx%d", av_get_pix_fmt_name(src_fmt), av_get_pix_fmt_name(dst_fmt), width, height);
+
+    SwsContext *sws = sws_getContext(width, height, src_fmt, width, height, dst_fmt, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    double sws_ms = TimeMs(iterations, [&]() { sws_scale(sws, src.data, src.linesize, 0, height, dst.data, dst.linesize); });
+    sws_freeContext(sws);
+    printf("%-36s %-14s %8.3f ms\n", name, "sws", sws_ms);
+    for (int level = SIMD_LEVEL_SCALAR; level <= DetectSimdLevel(); level++) {
+        double ms = TimeMs(iterations, [&]() {
+            SimdConvert(src.data, src.linesize, src_fmt, dst.data, dst.linesize, dst_fmt, width, height, COLOR_MATRIX_BT601, (SimdLevel)level);
+        });
+        printf("%-36s %-14s %8.3f ms  x%.2f\n", name, SimdLevelName((SimdLevel)level), ms, sws_ms / ms);
+    }
+    // SliceScaler多线程时两种实现的对比
+    SliceScaler scaler;
+    double slice_sws_ms = TimeMs(iterations, [&]() { scaler.Scale(src.data, src.linesize, src_fmt, dst.data, dst.linesize, dst_fmt, width, height); });
+    scaler.SetKernel(SCALE_KERNEL_SIMD, COLOR_MATRIX_BT601);
+    double slice_simd_ms = TimeMs(iterations, [&]() { scaler.Scale(src.data, src.linesize, src_fmt, dst.data, dst.linesize, dst_fmt, width, height); });
+    printf("%-36s slice-sws(%d)   %8.3f ms\n", name, scaler.ThreadCount(), slice_sws_ms);
+    printf("%-36s slice-simd(%d)  %8.3f ms  x%.2f\n", name, scaler.ThreadCount(), slice_simd_ms, sws_ms / slice_simd_ms);
+    return;
+}
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 100;
+    if (iterations <= 0) {
+        iterations = 100;
+    }
+    printf("cpu simd level: %s, iterations: %d\n", SimdLevelName(DetectSimdLevel()), iterations);
+    const int sizes[][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    for (auto &size : sizes) {
+        BenchOne(size[0], size[1], AV_PIX_FMT_NV12, AV_PIX_FMT_BGR24, iterations);
+        BenchOne(size[0], size[1], AV_PIX_FMT_YUV420P, AV_PIX_FMT_BGR24, iterations);
+        BenchOne(size[0], size[1], AV_PIX_FMT_BGR24, AV_PIX_FMT_YUV420P, iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,816 @@
+/**
+ * 编解码相关热点路径的微基准测试，结果以JSON输出，方便不同版本、不同机器之间对比
+ * ./mcp_bench [--iterations=N] [--repeats=N] [--frames=N] [--filter=name] [--out=result.json]
+ * 每个用例跑repeats轮，每轮执行iterations次，记录每轮单次操作耗时的中位数和最小值
+ * 输入数据用固定种子生成，同一台机器上多次运行的结果可以直接比较
+ * 日志输出到stderr，没有--out时stdout只有JSON
+ */
+#include "AAC.h"
+#include "AACDecoder.h"
+#include "AACEncoder.h"
+#include "ColorConvert.h"
+#include "H264HardEncoder.h"
+#include "HardDecoder.h"
+#include "MediaMuxer.h"
+#include "NalScanner.h"
+#include "SliceScaler.h"
+#include "log_helpers.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+#define BENCH_SEED 20240601
+#define BENCH_FPS 30
+#define BENCH_SOURCE_FRAMES 8       // 预先生成的不同画面数，编码时循环使用
+#define BENCH_NAL_STREAM_BYTES (4 * 1024 * 1024)
+#define BENCH_ADTS_BATCH 1024       // ADTS头生成和解析单次耗时太短，每次调用批量处理
+#define BENCH_AUDIO_FRAMES 431      // 44.1kHz下10秒的AAC帧数
+#define BENCH_AUDIO_SAMPLES 1024    // LC-AAC单通道每帧采样点个数
+#define BENCH_PI 3.14159265358979
+
+struct BenchOptions {
+    int iterations = 100;
+    int repeats = 5;
+    int frames = 60; // 每个视频编解码用例的帧数，4K为四分之一
+    std::string filter;
+    std::string out;
+};
+// 每轮单次操作耗时(纳秒)
+struct Timing {
+    double median_ns = 0;
+    double min_ns = 0;
+};
+static Timing MakeTiming(std::vector<double> samples)
+{
+    Timing timing;
+    if (samples.empty()) {
+        return timing;
+    }
+    std::sort(samples.begin(), samples.end());
+    timing.median_ns = samples[samples.size() / 2];
+    timing.min_ns = samples[0];
+    return timing;
+}
+static double ElapsedNs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+// ops_per_call是每次调用func完成的操作数
+template <typename F>
+static Timing Measure(const BenchOptions &opt, int ops_per_call, F func)
+{
+    func(); // 预热，创建上下文、分配内存
+    std::vector<double> samples;
+    for (int r = 0; r < opt.repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < opt.iterations; i++) {
+            func();
+        }
+        samples.push_back(ElapsedNs(start) / ((double)opt.iterations * ops_per_call));
+    }
+    return MakeTiming(samples);
+}
+
+// 拼接JSON对象的成员，"key":value,...
+class JsonFields
+{
+public:
+    JsonFields &Add(const char *key, const std::string &value)
+    {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return Raw(key, "\"" + escaped + "\"");
+    }
+    JsonFields &Add(const char *key, const char *value) { return Add(key, std::string(value)); }
+    JsonFields &Add(const char *key, int64_t value) { return Raw(key, std::to_string(value)); }
+    JsonFields &Add(const char *key, int value) { return Add(key, (int64_t)value); }
+    JsonFields &Add(const char *key, double value)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.3f", value);
+        return Raw(key, buf);
+    }
+    const std::string &Str() const { return str_; }
+
+private:
+    JsonFields &Raw(const char *key, const std::string &value)
+    {
+        if (!str_.empty()) {
+            str_ += ",";
+        }
+        str_ += "\"";
+        str_ += key;
+        str_ += "\":";
+        str_ += value;
+        return *this;
+    }
+
+private:
+    std::string str_;
+};
+class BenchReport
+{
+public:
+    explicit BenchReport(const BenchOptions &opt) : opt_(opt) {}
+    bool Enabled(const std::string &name) const { return opt_.filter.empty() || name.find(opt_.filter) != std::string::npos; }
+    // metrics是用例自己的指标，例如fps、MB/s
+    void Add(const std::string &name, const JsonFields &params, int iterations, const Timing &timing, const JsonFields &metrics = JsonFields())
+    {
+        JsonFields result;
+        result.Add("name", name).Add("iterations", iterations).Add("repeats", opt_.repeats);
+        result.Add("ns_per_op", timing.median_ns).Add("min_ns_per_op", timing.min_ns);
+        result.Add("ops_per_sec", timing.median_ns > 0 ? 1e9 / timing.median_ns : 0.0);
+        std::string json = "{" + result.Str() + ",\"params\":{" + params.Str() + "}";
+        if (!metrics.Str().empty()) {
+            json += "," + metrics.Str();
+        }
+        json += "}";
+        results_.push_back(json);
+        fprintf(stderr, "%-40s %14.1f ns/op\n", name.c_str(), timing.median_ns);
+        return;
+    }
+    // 依赖的编解码器不存在时记录原因，不影响其他用例
+    void Skip(const std::string &name, const std::string &reason)
+    {
+        JsonFields result;
+        result.Add("name", name).Add("skipped", reason);
+        results_.push_back("{" + result.Str() + "}");
+        fprintf(stderr, "%-40s skipped: %s\n", name.c_str(), reason.c_str());
+        return;
+    }
+    std::string ToJson() const
+    {
+        JsonFields head;
+        head.Add("tool", "mcp_bench").Add("simd", SimdLevelName(DetectSimdLevel()));
+        head.Add("cpus", (int)std::thread::hardware_concurrency());
+        head.Add("iterations", opt_.iterations).Add("repeats", opt_.repeats).Add("frames", opt_.frames);
+        std::string json = "{" + head.Str() + ",\"results\":[\n";
+        for (size_t i = 0; i < results_.size(); i++) {
+            json += "  " + results_[i] + (i + 1 < results_.size() ? ",\n" : "\n");
+        }
+        json += "]}\n";
+        return json;
+    }
+
+private:
+    const BenchOptions &opt_;
+    std::vector<std::string> results_;
+};
+
+// ---------------------------------------------------------------- 起始码查找
+// 生成Annex-B码流：NALU负载中约1/8是0，按H.264规则插入防竞争字节，零字节密度接近真实码流
+static std::vector<uint8_t> MakeAnnexBStream(int total_bytes, int *nal_count)
+{
+    std::vector<uint8_t> stream;
+    stream.reserve(total_bytes + 64 * 1024);
+    *nal_count = 0;
+    while ((int)stream.size() < total_bytes) {
+        static const uint8_t start_code[4] = {0, 0, 0, 1};
+        stream.insert(stream.end(), start_code, start_code + 4);
+        stream.push_back(0x41); // non-IDR slice
+        int payload = 256 + rand() % (48 * 1024);
+        int zeros = 0;
+        for (int i = 0; i < payload; i++) {
+            uint8_t byte = (rand() & 7) == 0 ? 0 : (uint8_t)(rand() & 0xff);
+            if (zeros >= 2 && byte <= 3) {
+                stream.push_back(0x03);
+                zeros = 0;
+            }
+            stream.push_back(byte);
+            zeros = byte == 0 ? zeros + 1 : 0;
+        }
+        stream.push_back(0x80); // rbsp_stop_one_bit，NALU不以0结尾
+        (*nal_count)++;
+    }
+    return stream;
+}
+// 逐字节比较的起始码查找，作为对比基准
+static int CountStartCodesBytewise(const uint8_t *buf, int len)
+{
+    int count = 0;
+    for (int i = 0; i + 2 < len; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1) {
+            count++;
+            i += 2;
+        }
+    }
+    return count;
+}
+static void BenchNalScan(const BenchOptions &opt, BenchReport &report)
+{
+    int nal_count = 0;
+    std::vector<uint8_t> stream = MakeAnnexBStream(BENCH_NAL_STREAM_BYTES, &nal_count);
+    const uint8_t *begin = stream.data();
+    const uint8_t *end = begin + stream.size();
+    JsonFields params;
+    params.Add("bytes", (int64_t)stream.size()).Add("nalus", nal_count);
+    auto mb_per_sec = [&](const Timing &timing) {
+        JsonFields metrics;
+        metrics.Add("mb_per_sec", stream.size() / 1048576.0 / (timing.median_ns / 1e9));
+        return metrics;
+    };
+    volatile int sink = 0;
+    if (report.Enabled("nal_scan/bytewise")) {
+        Timing timing = Measure(opt, 1, [&]() { sink = CountStartCodesBytewise(begin, (int)stream.size()); });
+        report.Add("nal_scan/bytewise", params, opt.iterations, timing, mb_per_sec(timing));
+    }
+    if (report.Enabled("nal_scan/find_start_code")) {
+        Timing timing = Measure(opt, 1, [&]() {
+            int count = 0;
+            for (const uint8_t *pos = FindStartCode(begin, end); pos < end; pos = FindStartCode(pos + 3, end)) {
+                count++;
+            }
+            sink = count;
+        });
+        report.Add("nal_scan/find_start_code", params, opt.iterations, timing, mb_per_sec(timing));
+    }
+    if (report.Enabled("nal_scan/nal_iterator")) {
+        Timing timing = Measure(opt, 1, [&]() {
+            NalIterator it(begin, (int)stream.size());
+            NalUnit nal;
+            int count = 0;
+            while (it.Next(nal)) {
+                count++;
+            }
+            sink = count;
+        });
+        report.Add("nal_scan/nal_iterator", params, opt.iterations, timing, mb_per_sec(timing));
+    }
+    return;
+}
+
+// ---------------------------------------------------------------- ADTS
+static void BenchAdts(const BenchOptions &opt, BenchReport &report)
+{
+    std::vector<char> headers(BENCH_ADTS_BATCH * 7);
+    std::vector<int> data_lens(BENCH_ADTS_BATCH);
+    for (int i = 0; i < BENCH_ADTS_BATCH; i++) {
+        data_lens[i] = 128 + rand() % 1024;
+    }
+    int sample_rate_index = GetSampleRateIndex(44100);
+    JsonFields params;
+    params.Add("batch", BENCH_ADTS_BATCH).Add("sample_rate", 44100).Add("channels", 2);
+    if (report.Enabled("adts/generate")) {
+        Timing timing = Measure(opt, BENCH_ADTS_BATCH, [&]() {
+            for (int i = 0; i < BENCH_ADTS_BATCH; i++) {
+                GenerateAdtsHeader(&headers[i * 7], data_lens[i], 1, sample_rate_index, 2);
+            }
+        });
+        report.Add("adts/generate", params, opt.iterations, timing);
+    }
+    if (report.Enabled("adts/parse")) {
+        for (int i = 0; i < BENCH_ADTS_BATCH; i++) {
+            GenerateAdtsHeader(&headers[i * 7], data_lens[i], 1, sample_rate_index, 2);
+        }
+        volatile unsigned int sink = 0;
+        Timing timing = Measure(opt, BENCH_ADTS_BATCH, [&]() {
+            AdtsHeader header;
+            for (int i = 0; i < BENCH_ADTS_BATCH; i++) {
+                ParseAdtsHeader((uint8_t *)&headers[i * 7], &header);
+                sink = header.aacFrameLength;
+            }
+        });
+        report.Add("adts/parse", params, opt.iterations, timing);
+    }
+    return;
+}
+
+// ---------------------------------------------------------------- 颜色转换
+struct Image {
+    uint8_t *data[4] = {NULL, NULL, NULL, NULL};
+    int linesize[4] = {0, 0, 0, 0};
+    Image(int width, int height, AVPixelFormat fmt)
+    {
+        av_image_alloc(data, linesize, width, height, fmt, 32);
+        int size = av_image_get_buffer_size(fmt, width, height, 32);
+        for (int i = 0; i < size; i++) {
+            data[0][i] = (uint8_t)(rand() & 0xff);
+        }
+    }
+    ~Image() { av_freep(&data[0]); }
+};
+static void BenchColorOne(const BenchOptions &opt, BenchReport &report, int width, int height, AVPixelFormat src_fmt, AVPixelFormat dst_fmt)
+{
+    std::string name = std::string("color/") + av_get_pix_fmt_name(src_fmt) + "->" + av_get_pix_fmt_name(dst_fmt);
+    if (!report.Enabled(name)) {
+        return;
+    }
+    Image src(width, height, src_fmt);
+    Image dst(width, height, dst_fmt);
+    auto params = [&](const char *impl, int threads) {
+        JsonFields fields;
+        fields.Add("width", width).Add("height", height).Add("impl", impl).Add("threads", threads);
+        return fields;
+    };
+    SwsContext *sws = sws_getContext(width, height, src_fmt, width, height, dst_fmt, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    Timing sws_timing = Measure(opt, 1, [&]() { sws_scale(sws, src.data, src.linesize, 0, height, dst.data, dst.linesize); });
+    sws_freeContext(sws);
+    report.Add(name, params("sws", 1), opt.iterations, sws_timing);
+
+    SimdLevel level = DetectSimdLevel();
+    Timing simd_timing = Measure(opt, 1, [&]() {
+        SimdConvert(src.data, src.linesize, src_fmt, dst.data, dst.linesize, dst_fmt, width, height, COLOR_MATRIX_BT601, level);
+    });
+    report.Add(name, params(SimdLevelName(level), 1), opt.iterations, simd_timing);
+
+    SliceScaler scaler;
+    scaler.SetKernel(SCALE_KERNEL_SIMD, COLOR_MATRIX_BT601);
+    Timing slice_timing = Measure(opt, 1, [&]() { scaler.Scale(src.data, src.linesize, src_fmt, dst.data, dst.linesize, dst_fmt, width, height); });
+    report.Add(name, params("slice_simd", scaler.ThreadCount()), opt.iterations, slice_timing);
+    return;
+}
+static void BenchColor(const BenchOptions &opt, BenchReport &report)
+{
+    const int sizes[][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    for (auto &size : sizes) {
+        BenchColorOne(opt, report, size[0], size[1], AV_PIX_FMT_NV12, AV_PIX_FMT_BGR24);
+        BenchColorOne(opt, report, size[0], size[1], AV_PIX_FMT_YUV420P, AV_PIX_FMT_BGR24);
+        BenchColorOne(opt, report, size[0], size[1], AV_PIX_FMT_BGR24, AV_PIX_FMT_YUV420P);
+    }
+    return;
+}
+
+// ---------------------------------------------------------------- 视频软编解码
+// 编码输出的一个packet(一帧)，Annex-B格式，末尾保留AV_INPUT_BUFFER_PADDING_SIZE个0给解码器
+struct EncodedPacket {
+    std::vector<uint8_t> data;
+    int size;
+    int64_t pts;
+    int64_t dts;
+};
+// 渐变背景随帧移动，叠加固定噪声，避免编码器遇到纯色画面时耗时失真
+static std::vector<AVFrame *> MakeSourceFrames(int width, int height)
+{
+    std::vector<AVFrame *> frames;
+    for (int n = 0; n < BENCH_SOURCE_FRAMES; n++) {
+        AVFrame *frame = av_frame_alloc();
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = width;
+        frame->height = height;
+        av_frame_get_buffer(frame, 32);
+        for (int y = 0; y < height; y++) {
+            uint8_t *row = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < width; x++) {
+                row[x] = (uint8_t)((x + y) / 4 + n * 6 + (rand() & 7));
+            }
+        }
+        for (int plane = 1; plane < 3; plane++) {
+            for (int y = 0; y < height / 2; y++) {
+                uint8_t *row = frame->data[plane] + y * frame->linesize[plane];
+                for (int x = 0; x < width / 2; x++) {
+                    row[x] = (uint8_t)(128 + (plane == 1 ? x : y) / 16 - n);
+                }
+            }
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+static void FreeSourceFrames(std::vector<AVFrame *> &frames)
+{
+    for (AVFrame *frame : frames) {
+        av_frame_free(&frame);
+    }
+    frames.clear();
+    return;
+}
+static void ReceivePackets(AVCodecContext *ctx, AVPacket *pkt, std::vector<EncodedPacket> *out)
+{
+    while (avcodec_receive_packet(ctx, pkt) == 0) {
+        EncodedPacket packet;
+        packet.data.assign(pkt->data, pkt->data + pkt->size);
+        packet.data.resize(pkt->size + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+        packet.size = pkt->size;
+        packet.pts = pkt->pts;
+        packet.dts = pkt->dts;
+        out->push_back(packet);
+        av_packet_unref(pkt);
+    }
+    return;
+}
+// 和H264FFSoftEncoder的参数一致，返回编码耗时(毫秒，不含打开编码器)，失败返回-1
+static double EncodeStream(std::vector<AVFrame *> &sources, int frames, EncProfile profile, std::vector<EncodedPacket> *out)
+{
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        return -1;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    ctx->codec_type = AVMEDIA_TYPE_VIDEO;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->width = sources[0]->width;
+    ctx->height = sources[0]->height;
+    ctx->time_base.num = 1;
+    ctx->time_base.den = BENCH_FPS;
+    ctx->gop_size = 2 * BENCH_FPS;
+    ctx->flags |= AV_CODEC_FLAG2_LOCAL_HEADER;
+    AVDictionary *param = NULL;
+    ApplyEncProfile(ctx, profile, &param);
+    int ret = avcodec_open2(ctx, codec, &param);
+    av_dict_free(&param);
+    if (ret < 0) {
+        avcodec_free_context(&ctx);
+        return -1;
+    }
+    out->clear();
+    AVPacket *pkt = av_packet_alloc();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        AVFrame *frame = sources[i % sources.size()];
+        frame->pts = i;
+        avcodec_send_frame(ctx, frame);
+        ReceivePackets(ctx, pkt, out);
+    }
+    avcodec_send_frame(ctx, NULL);
+    ReceivePackets(ctx, pkt, out);
+    double elapsed_ms = ElapsedNs(start) / 1e6;
+    av_packet_free(&pkt);
+    avcodec_free_context(&ctx);
+    return elapsed_ms;
+}
+// 返回解码耗时(毫秒，不含打开解码器)，失败返回-1
+static double DecodeStream(const std::vector<EncodedPacket> &packets, DecThreadOption option, int *decoded)
+{
+    AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        return -1;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    ApplyDecThreadOption(ctx, option);
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        avcodec_free_context(&ctx);
+        return -1;
+    }
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    *decoded = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i <= packets.size(); i++) {
+        if (i < packets.size()) {
+            pkt->data = (uint8_t *)packets[i].data.data();
+            pkt->size = packets[i].size;
+            pkt->pts = packets[i].pts;
+            pkt->dts = packets[i].dts;
+            avcodec_send_packet(ctx, pkt);
+        } else {
+            avcodec_send_packet(ctx, NULL); // 刷新帧级多线程缓存的帧
+        }
+        while (avcodec_receive_frame(ctx, frame) == 0) {
+            (*decoded)++;
+            av_frame_unref(frame);
+        }
+    }
+    double elapsed_ms = ElapsedNs(start) / 1e6;
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&ctx);
+    return elapsed_ms;
+}
+static const char *EncProfileName(EncProfile profile)
+{
+    switch (profile) {
+    case ENC_PROFILE_BALANCED:
+        return "balanced";
+    case ENC_PROFILE_OFFLINE:
+        return "offline";
+    case ENC_PROFILE_LOW_LATENCY:
+    default:
+        return "low_latency";
+    }
+}
+// 编码、解码一帧的耗时，同时给出fps；repeats轮每轮重新打开编解码器
+static void BenchVideoOne(const BenchOptions &opt, BenchReport &report, int width, int height, std::vector<EncodedPacket> *keep_stream)
+{
+    int frames = width >= 3840 ? std::max(opt.frames / 4, BENCH_SOURCE_FRAMES) : opt.frames;
+    bool need_stream = keep_stream != NULL || report.Enabled("video/decode");
+    if (!report.Enabled("video/encode") && !need_stream) {
+        return;
+    }
+    std::vector<AVFrame *> sources = MakeSourceFrames(width, height);
+    const EncProfile profiles[] = {ENC_PROFILE_LOW_LATENCY, ENC_PROFILE_OFFLINE};
+    std::vector<EncodedPacket> stream; // 低延时配置编码的码流，和管线实时模式的输出一致，用于解码和封装测试
+    for (EncProfile profile : profiles) {
+        bool measure = report.Enabled("video/encode");
+        if (!measure && profile != ENC_PROFILE_LOW_LATENCY) {
+            continue;
+        }
+        std::vector<EncodedPacket> packets;
+        std::vector<double> samples;
+        int rounds = measure ? opt.repeats : 1;
+        for (int r = 0; r < rounds; r++) {
+            double elapsed_ms = EncodeStream(sources, frames, profile, &packets);
+            if (elapsed_ms < 0) {
+                break;
+            }
+            samples.push_back(elapsed_ms * 1e6 / frames);
+        }
+        if (samples.empty()) {
+            report.Skip("video/encode", "h264 encoder not available");
+            break;
+        }
+        if (profile == ENC_PROFILE_LOW_LATENCY) {
+            stream = packets;
+        }
+        if (measure) {
+            Timing timing = MakeTiming(samples);
+            JsonFields params;
+            params.Add("codec", avcodec_find_encoder(AV_CODEC_ID_H264)->name).Add("width", width).Add("height", height);
+            params.Add("profile", EncProfileName(profile)).Add("frames", frames);
+            int64_t bytes = 0;
+            for (auto &packet : packets) {
+                bytes += packet.size;
+            }
+            JsonFields metrics;
+            metrics.Add("fps", 1e9 / timing.median_ns).Add("kbps", bytes * 8.0 * BENCH_FPS / frames / 1000);
+            report.Add("video/encode", params, frames, timing, metrics);
+        }
+    }
+    FreeSourceFrames(sources);
+    if (stream.empty()) {
+        return;
+    }
+    if (report.Enabled("video/decode")) {
+        const char *preset_names[] = {"low_delay", "throughput"};
+        DecThreadOption presets[] = {DecThreadPresetLowDelay(), DecThreadPresetThroughput()};
+        for (int p = 0; p < 2; p++) {
+            std::vector<double> samples;
+            int decoded = 0;
+            for (int r = 0; r < opt.repeats; r++) {
+                double elapsed_ms = DecodeStream(stream, presets[p], &decoded);
+                if (elapsed_ms < 0 || decoded <= 0) {
+                    break;
+                }
+                samples.push_back(elapsed_ms * 1e6 / decoded);
+            }
+            if (samples.empty()) {
+                report.Skip("video/decode", "h264 decoder not available");
+                break;
+            }
+            Timing timing = MakeTiming(samples);
+            JsonFields params;
+            params.Add("width", width).Add("height", height).Add("threads", preset_names[p]).Add("frames", decoded);
+            JsonFields metrics;
+            metrics.Add("fps", 1e9 / timing.median_ns);
+            report.Add("video/decode", params, decoded, timing, metrics);
+        }
+    }
+    if (keep_stream) {
+        keep_stream->swap(stream);
+    }
+    return;
+}
+
+// ---------------------------------------------------------------- 封装
+// 把码流按NALU送入Muxer::SendPacket写mp4，耗时包含av_interleaved_write_frame和文件写入
+static void BenchMuxer(const BenchOptions &opt, BenchReport &report, const std::vector<EncodedPacket> &stream, int width, int height)
+{
+    if (!report.Enabled("muxer/send_packet")) {
+        return;
+    }
+    if (stream.empty()) {
+        report.Skip("muxer/send_packet", "no encoded stream");
+        return;
+    }
+    ExtraData extra;
+    struct MuxNalu {
+        const uint8_t *data; // 不含起始码
+        int len;
+        int64_t frame; // 所属帧的序号
+    };
+    std::vector<MuxNalu> nalus;
+    for (size_t i = 0; i < stream.size(); i++) {
+        NalIterator it(stream[i].data.data(), stream[i].size);
+        NalUnit nal;
+        while (it.Next(nal)) {
+            const uint8_t *payload = nal.data + nal.start_code;
+            int payload_len = nal.len - nal.start_code;
+            if (H264NalType(payload) == 7 && extra.sps == NULL) {
+                extra.sps = (uint8_t *)payload;
+                extra.sps_len = payload_len;
+            } else if (H264NalType(payload) == 8 && extra.pps == NULL) {
+                extra.pps = (uint8_t *)payload;
+                extra.pps_len = payload_len;
+            }
+            MuxNalu mux_nal = {payload, payload_len, (int64_t)i};
+            nalus.push_back(mux_nal);
+        }
+    }
+    if (extra.sps == NULL || extra.pps == NULL) {
+        report.Skip("muxer/send_packet", "sps/pps not found");
+        return;
+    }
+    const char *path = "mcp_bench_mux.mp4";
+    int64_t frame_duration = 90000 / BENCH_FPS; // Muxer的视频时间基是1/90000
+    int passes = std::max(opt.iterations / 10, 1); // 码流重复写入的次数，时间戳连续递增
+    std::vector<double> samples;
+    int64_t sent = 0;
+    for (int r = 0; r < opt.repeats; r++) {
+        Muxer *muxer = new Muxer();
+        if (muxer->Init(path) < 0 || muxer->AddVideo(90000, VIDEO_H264, extra, width, height, BENCH_FPS) < 0 || muxer->Open() < 0 ||
+            muxer->SendHeader() < 0) {
+            delete muxer;
+            break;
+        }
+        int stream_index = muxer->GetVideoStreamIndex();
+        sent = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; pass++) {
+            for (auto &nal : nalus) {
+                int64_t ts = ((int64_t)pass * stream.size() + nal.frame) * frame_duration;
+                muxer->SendPacket((unsigned char *)nal.data, nal.len, ts, ts, stream_index);
+                sent++;
+            }
+        }
+        samples.push_back(ElapsedNs(start) / sent);
+        muxer->SendTrailer();
+        delete muxer;
+    }
+    remove(path);
+    if (samples.empty()) {
+        report.Skip("muxer/send_packet", "open mp4 muxer failed");
+        return;
+    }
+    Timing timing = MakeTiming(samples);
+    JsonFields params;
+    params.Add("width", width).Add("height", height).Add("format", "mp4").Add("nalus", sent).Add("frames", (int64_t)(stream.size() * passes));
+    JsonFields metrics;
+    metrics.Add("frames_per_sec", 1e9 / timing.median_ns * sent / (stream.size() * passes));
+    report.Add("muxer/send_packet", params, (int)sent, timing, metrics);
+    return;
+}
+static void BenchVideo(const BenchOptions &opt, BenchReport &report)
+{
+    const int sizes[][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    for (auto &size : sizes) {
+        bool mux = size[0] == 1920 && report.Enabled("muxer/send_packet");
+        std::vector<EncodedPacket> stream;
+        BenchVideoOne(opt, report, size[0], size[1], mux ? &stream : NULL);
+        if (mux) {
+            BenchMuxer(opt, report, stream, size[0], size[1]);
+        }
+    }
+    return;
+}
+
+// ---------------------------------------------------------------- AAC
+// 编解码模块的回调，只计数；编码输出的ADTS帧保留下来给解码测试
+class AudioSink : public EncDataCallListner, public DecDataCallListner
+{
+public:
+    void OnVideoEncData(unsigned char *data, int data_len, int64_t pts) {}
+    void OnAudioEncData(unsigned char *data, int data_len)
+    {
+        if (keep_) {
+            adts_.push_back(std::vector<uint8_t>(data, data + data_len));
+        }
+        frames_++;
+    }
+    void OnRGBData(cv::Mat frame) {}
+    void OnPCMData(unsigned char **data, int data_len) { frames_++; }
+
+public:
+    bool keep_ = false;
+    std::atomic<int> frames_{0};
+    std::vector<std::vector<uint8_t>> adts_;
+};
+// 单帧耗时包括入队、重采样和编解码线程的调度，即管线中实际的每帧开销；离线模式不丢帧，delete等待队列处理完
+static void BenchAudio(const BenchOptions &opt, BenchReport &report)
+{
+    if (!report.Enabled("aac/encode") && !report.Enabled("aac/decode")) {
+        return;
+    }
+    std::vector<int16_t> pcm(BENCH_AUDIO_SAMPLES * 2 * BENCH_AUDIO_FRAMES);
+    for (size_t i = 0; i < pcm.size() / 2; i++) {
+        int16_t sample = (int16_t)(8000 * sin(2 * BENCH_PI * 440 * i / 44100.0) + (rand() % 64));
+        pcm[i * 2] = sample;
+        pcm[i * 2 + 1] = sample;
+    }
+    int frame_bytes = BENCH_AUDIO_SAMPLES * 2 * sizeof(int16_t);
+    std::vector<double> samples;
+    std::vector<std::vector<uint8_t>> adts;
+    for (int r = 0; r < opt.repeats; r++) {
+        AudioSink sink;
+        sink.keep_ = adts.empty();
+        AACEncoder *encoder = new AACEncoder();
+        if (encoder->Init(AV_SAMPLE_FMT_S16, 2, 44100, BENCH_AUDIO_SAMPLES) < 0) { // 没有libfdk_aac
+            delete encoder;
+            report.Skip("aac/encode", "libfdk_aac not available");
+            return;
+        }
+        encoder->SetCallback(&sink);
+        encoder->SetOfflineMode(true);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BENCH_AUDIO_FRAMES; i++) {
+            encoder->AddPCMFrame((unsigned char *)&pcm[i * BENCH_AUDIO_SAMPLES * 2], frame_bytes);
+        }
+        delete encoder;
+        samples.push_back(ElapsedNs(start) / BENCH_AUDIO_FRAMES);
+        if (sink.keep_) {
+            adts.swap(sink.adts_);
+        }
+    }
+    JsonFields params;
+    params.Add("codec", "libfdk_aac").Add("sample_rate", 44100).Add("channels", 2).Add("frames", BENCH_AUDIO_FRAMES);
+    if (report.Enabled("aac/encode")) {
+        report.Add("aac/encode", params, BENCH_AUDIO_FRAMES, MakeTiming(samples));
+    }
+    if (!report.Enabled("aac/decode")) {
+        return;
+    }
+    if (adts.empty()) {
+        report.Skip("aac/decode", "no encoded aac frames");
+        return;
+    }
+    samples.clear();
+    for (int r = 0; r < opt.repeats; r++) {
+        AudioSink sink;
+        AACDecoder *decoder = new AACDecoder();
+        decoder->SetResampleArg(AV_SAMPLE_FMT_S16, 2, 44100);
+        decoder->SetCallback(&sink);
+        decoder->SetOfflineMode(true);
+        auto start = std::chrono::steady_clock::now();
+        for (auto &frame : adts) {
+            decoder->InputAACData(frame.data(), (int)frame.size());
+        }
+        delete decoder;
+        samples.push_back(ElapsedNs(start) / adts.size());
+    }
+    JsonFields dec_params;
+    dec_params.Add("sample_rate", 44100).Add("channels", 2).Add("frames", (int)adts.size());
+    report.Add("aac/decode", dec_params, (int)adts.size(), MakeTiming(samples));
+    return;
+}
+
+static bool ParseArg(const char *arg, const char *key, std::string *value)
+{
+    size_t len = strlen(key);
+    if (strncmp(arg, key, len) != 0 || arg[len] != '=') {
+        return false;
+    }
+    *value = arg + len + 1;
+    return true;
+}
+int main(int argc, char **argv)
+{
+    spdlog::set_default_logger(spdlog::stderr_color_mt("mcp_bench")); // stdout只输出JSON
+    spdlog::set_level(spdlog::level::warn);
+    av_log_set_level(AV_LOG_FATAL);
+    BenchOptions opt;
+    for (int i = 1; i < argc; i++) {
+        std::string value;
+        if (ParseArg(argv[i], "--iterations", &value)) {
+            opt.iterations = std::max(atoi(value.c_str()), 1);
+        } else if (ParseArg(argv[i], "--repeats", &value)) {
+            opt.repeats = std::max(atoi(value.c_str()), 1);
+        } else if (ParseArg(argv[i], "--frames", &value)) {
+            opt.frames = std::max(atoi(value.c_str()), 1);
+        } else if (ParseArg(argv[i], "--filter", &value)) {
+            opt.filter = value;
+        } else if (ParseArg(argv[i], "--out", &value)) {
+            opt.out = value;
+        } else {
+            fprintf(stderr, "./mcp_bench [--iterations=N] [--repeats=N] [--frames=N] [--filter=name] [--out=result.json]\n");
+            fprintf(stderr, "cases: nal_scan/ adts/ color/ video/encode video/decode muxer/send_packet aac/encode aac/decode\n");
+            return -1;
+        }
+    }
+    srand(BENCH_SEED);
+    BenchReport report(opt);
+    BenchNalScan(opt, report);
+    BenchAdts(opt, report);
+    BenchColor(opt, report);
+    BenchVideo(opt, report);
+    BenchAudio(opt, report);
+
+    std::string json = report.ToJson();
+    if (opt.out.empty()) {
+        fputs(json.c_str(), stdout);
+        return 0;
+    }
+    FILE *fp = fopen(opt.out.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "open %s failed\n", opt.out.c_str());
+        return -1;
+    }
+    fputs(json.c_str(), fp);
+    fclose(fp);
+    return 0;
+}
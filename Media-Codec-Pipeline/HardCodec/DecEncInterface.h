@@ -5,18 +5,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <opencv2/opencv.hpp>
+#include "BoundedQueue.h"
+#include "SpscRing.h"
+#include "VideoFrame.h"
+// 离线模式下编解码模块内部队列的最大长度，队列满了生产者等待，不丢帧
+#define OFFLINE_QUEUE_SIZE 8
+// 实时模式下编解码输入队列的容量，满了丢弃最旧的数据，防止下游卡住时内存无限增长
+#define CODEC_INPUT_QUEUE_SIZE 256
+#define CODEC_INPUT_QUEUE_BYTES (32 * 1024 * 1024)
+// 模块内部线程之间(解码->转换，重采样->编码)的队列容量，满了上一级等待
+#define CODEC_FRAME_QUEUE_SIZE 8
+// 解码器输出图像的格式
+enum DecOutputType {
+    DEC_OUTPUT_BGR, // 转换成BGR后通过OnRGBData输出
+    DEC_OUTPUT_YUV, // 解码器原生格式通过OnVideoFrame输出，不做颜色转换
+};
 // 解码后数据接口
 class DecDataCallListner
 {
 public:
     virtual void OnRGBData(cv::Mat frame) = 0; // frame中的格式是opencv的默认格式，即BGR
+    virtual void OnRGBData(cv::Mat frame, int64_t pts) { OnRGBData(frame); } // pts是这一帧在InputVideoData时传入的pts，没有时为AV_NOPTS_VALUE
     virtual void OnPCMData(unsigned char **data, int data_len) = 0; // data是原生的输出数据，指针数组，data_len是单通道样本个数
+    virtual void OnVideoFrame(VideoFrame frame) {} // DEC_OUTPUT_YUV模式下的输出，frame引用解码器的原始图像
 };
 // 编码后数据接口
 class EncDataCallListner
 {
 public:
     virtual void OnVideoEncData(unsigned char *data, int data_len, int64_t pts /*deprecated*/) = 0;
+    // pts是这一帧在AddVideoFrame时传入的时间戳(微秒)，没有传入时按帧率生成；dts按编码顺序生成，单位相同
+    virtual void OnVideoEncData(unsigned char *data, int data_len, int64_t pts, int64_t dts) { OnVideoEncData(data, data_len, pts); }
     virtual void OnAudioEncData(unsigned char *data, int data_len) = 0;
 };
 #endif
\ No newline at end of file
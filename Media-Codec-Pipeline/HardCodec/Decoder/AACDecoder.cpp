@@ -4,20 +4,18 @@ static const uint64_t NANO_SECOND = UINT64_C(1000000000);
 AACDecoder::AACDecoder()
 {
 
+    // 打开失败时只设置error_，其余成员照常初始化，由调用者通过HasError结束这一路
     audio_codec_ = avcodec_find_decoder(AV_CODEC_ID_AAC);
     if (!audio_codec_) {
-        fprintf(stderr, "Codec not found\n");
-        exit(1);
-    }
-    audio_codec_ctx_ = avcodec_alloc_context3(audio_codec_);
-    if (!audio_codec_ctx_) {
-        fprintf(stderr, "Could not allocate audio codec context\n");
-        exit(1);
-    }
-    int ret = avcodec_open2(audio_codec_ctx_, audio_codec_, NULL);
-    if (ret < 0) {
-        fprintf(stderr, "Could not open codec\n");
-        exit(1);
+        log_error("Codec not found");
+        error_ = true;
+    } else if ((audio_codec_ctx_ = avcodec_alloc_context3(audio_codec_)) == NULL) {
+        log_error("Could not allocate audio codec context");
+        error_ = true;
+    } else if (avcodec_open2(audio_codec_ctx_, audio_codec_, NULL) < 0) {
+        log_error("Could not open codec");
+        avcodec_free_context(&audio_codec_ctx_);
+        error_ = true;
     }
     // av_init_packet(&packet_);
     memset(&packet_, 0, sizeof(packet_));
@@ -25,27 +23,27 @@ AACDecoder::AACDecoder()
     swr_ctx_ = NULL;
     aborted_ = false;
     time_inited_ = 0;
-    dec_thread_id_ = std::thread(AACDecoder::AACDecodeThread, this);
-    sws_thread_id_ = std::thread(AACDecoder::AACScaleThread, this);
+    es_packets_.SetSizeFunc([](AACDataNode *const &node) { return (size_t)node->es_data_len; });
+    es_packets_.SetReleaseFunc([](AACDataNode *&node) { delete node; });
+    SetOfflineMode(false);
+    decode_task_ = new SerialTask([this]() { DecodeTask(); });
 }
 AACDecoder::~AACDecoder()
 {
     aborted_ = true;
-    dec_thread_id_.join();
-    sws_thread_id_.join();
+    es_packets_.Close();
+    decode_task_->Notify(); // 处理完队列中剩余的数据
+    decode_task_->Wait();
+    delete decode_task_;
+    decode_task_ = NULL;
+    log_info("AACDecodeTask Finished ");
+    // 刷新缓冲区
+    AACDataNode *node = new AACDataNode();
+    DecodeAudio(node);
+    delete node;
 
-    for (std::list<AVFrame *>::iterator it = yuv_frames_.begin(); it != yuv_frames_.end(); ++it) {
-        AVFrame *frame = *it;
-        // uint8_t* p=frame->data[0];
-        // av_freep(&p);
-        av_frame_free(&frame);
-    }
-    yuv_frames_.clear();
-    for (std::list<AACDataNode *>::iterator it = es_packets_.begin(); it != es_packets_.end(); ++it) {
-        AACDataNode *packet = *it;
-        delete packet;
-    }
-    es_packets_.clear();
+    es_packets_.Clear();
+    log_debug("AACDecoder drop packets:{}", es_packets_.DropCount());
 
     if (audio_codec_ctx_) {
         if (audio_codec_ctx_->extradata) {
@@ -71,28 +69,53 @@ AACDecoder::~AACDecoder()
     log_debug("~AACDecoder");
 }
 
-void AACDecoder::InputAACData(unsigned char *data, int data_len)
+void AACDecoder::InputAACData(unsigned char *data, int data_len, AVBufferRef *buf)
 {
-
-    AACDataNode *node = new AACDataNode();
-    node->es_data = (unsigned char *)malloc(data_len);
-    memcpy(node->es_data, data, data_len);
-    node->es_data_len = data_len;
-    std::unique_lock<std::mutex> guard(packet_mutex_);
-    es_packets_.push_back(node);
-    guard.unlock();
-    packet_cond_.notify_one();
+    if (error_) {
+        return;
+    }
+    AACDataNode *node = new AACDataNode(data, data_len, buf);
+    es_packets_.Push(node);
+    decode_task_->Notify();
     return;
 }
+bool AACDecoder::HasError()
+{
+    return error_;
+}
 void AACDecoder::SetCallback(DecDataCallListner *call_func)
 {
     callback_ = call_func;
     return;
 }
+void AACDecoder::SetOfflineMode(bool offline)
+{
+    offline_ = offline;
+    if (offline_) { // 队列满了等待解码线程消费，不丢帧
+        es_packets_.SetCapacity(OFFLINE_QUEUE_SIZE);
+        es_packets_.SetPolicy(QUEUE_BLOCK);
+    } else { // 下游处理不过来时丢弃最旧的数据，防止内存一直增长；每个ADTS帧可以单独解码，丢包不影响后面的帧
+        es_packets_.SetCapacity(CODEC_INPUT_QUEUE_SIZE, CODEC_INPUT_QUEUE_BYTES);
+        es_packets_.SetPolicy(QUEUE_DROP_OLDEST);
+    }
+    return;
+}
+void AACDecoder::SetMetrics(StageMetrics *metrics)
+{
+    metrics_ = metrics;
+    es_packets_.SetMetrics(metrics);
+    return;
+}
 void AACDecoder::DecodeAudio(AACDataNode *data)
 {
+    if (error_) { // 解码器没有打开或者重采样失败，丢弃剩余的数据
+        return;
+    }
     packet_.data = data->es_data;
     packet_.size = data->es_data_len;
+    if (data->es_buf) { // 带引用计数的packet，avcodec_send_packet内部不会再拷贝数据
+        packet_.buf = av_buffer_ref(data->es_buf);
+    }
     int ret;
     ret = avcodec_send_packet(audio_codec_ctx_, &packet_);
     while (ret >= 0) {
@@ -113,42 +136,28 @@ void AACDecoder::DecodeAudio(AACDataNode *data)
         src_ratio_ = frame_->sample_rate;
         src_nb_samples_ = frame_->nb_samples;
 
-        std::unique_lock<std::mutex> guard(frame_mutex_);
-        yuv_frames_.push_back(frame_);
+        ScaleAudio(frame_); // 重采样之后释放frame
         frame_ = NULL;
-        guard.unlock();
-        frame_cond_.notify_one();
     }
     av_packet_unref(&packet_);
     return;
 }
-void *AACDecoder::AACDecodeThread(void *arg)
+// 每次最多处理SERIAL_TASK_BATCH个包，剩余的数据重新排队，其它流的任务可以插进来执行
+void AACDecoder::DecodeTask()
 {
-    AACDecoder *self = (AACDecoder *)arg;
-    while (!self->aborted_) {
-        std::unique_lock<std::mutex> guard(self->packet_mutex_);
-        if (!self->es_packets_.empty()) {
-            AACDataNode *packet = self->es_packets_.front();
-            self->es_packets_.pop_front();
-            guard.unlock();
-            self->DecodeAudio(packet);
-
-            delete packet;
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->packet_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+    for (int i = 0; i < SERIAL_TASK_BATCH; i++) {
+        AACDataNode *packet = NULL;
+        if (!es_packets_.Pop(packet, 0)) {
+            return;
         }
+        StageTimer timer(metrics_);
+        DecodeAudio(packet);
+        delete packet;
     }
-    log_info("AACDecodeThread Finished ");
-    // 刷新缓冲区
-    AACDataNode *node = new AACDataNode();
-    node->es_data = NULL;
-    node->es_data_len = 0;
-    self->DecodeAudio(node);
-    delete node;
-    return NULL;
+    if (!es_packets_.Empty()) {
+        decode_task_->Notify();
+    }
+    return;
 }
 void AACDecoder::SetResampleArg(enum AVSampleFormat fmt, int channels, int ratio)
 {
@@ -169,7 +178,9 @@ void AACDecoder::ScaleAudio(AVFrame *frame)
         if (ret != 0) {
             swr_free(&swr_ctx_);
             log_critical("swr_ctx_ alloc & set error");
-            exit(1);
+            error_ = true;
+            av_frame_free(&frame);
+            return;
         }
         dst_nb_samples_ = av_rescale_rnd(src_nb_samples_, dst_ratio_, src_ratio_, AV_ROUND_UP);
     }
@@ -230,24 +241,4 @@ void AACDecoder::ScaleAudio(AVFrame *frame)
     // av_freep(&p);
     av_frame_free(&frame);
     return;
-}
-void *AACDecoder::AACScaleThread(void *arg)
-{
-    AACDecoder *self = (AACDecoder *)arg;
-    while (!self->aborted_) {
-        std::unique_lock<std::mutex> guard(self->frame_mutex_);
-        if (!self->yuv_frames_.empty()) {
-            AVFrame *frame = self->yuv_frames_.front();
-            self->yuv_frames_.pop_front();
-            guard.unlock();
-            self->ScaleAudio(frame);
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->frame_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
-        }
-    }
-    log_info("AACScaleThread Finished ");
-    return NULL;
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #define AAC_DEC_H
 
 #include "DecEncInterface.h"
+#include "TaskExecutor.h"
 #include "log_helpers.h"
+#include <atomic>
 #include <list>
 #include <opencv2/core.hpp>
 #include <opencv2/opencv.hpp>
@@ -32,13 +34,32 @@ extern "C" {
 typedef struct AACDataNodeSt {
     unsigned char *es_data;
     int es_data_len;
+    AVBufferRef *es_buf; // 不为NULL时es_data指向es_buf引用的内存
     AACDataNodeSt()
     {
         es_data = NULL;
         es_data_len = 0;
+        es_buf = NULL;
+    }
+    // buf不为NULL时只增加引用计数，否则拷贝一份数据
+    AACDataNodeSt(unsigned char *data, int data_len, AVBufferRef *buf)
+    {
+        es_data_len = data_len;
+        if (buf) {
+            es_buf = av_buffer_ref(buf);
+            es_data = data;
+        } else {
+            es_buf = NULL;
+            es_data = (unsigned char *)malloc(data_len);
+            memcpy(es_data, data, data_len);
+        }
     }
     virtual ~AACDataNodeSt()
     {
+        if (es_buf) {
+            av_buffer_unref(&es_buf);
+            es_data = NULL;
+        }
         if (es_data) {
             free(es_data);
             es_data = NULL;
@@ -54,12 +75,14 @@ public:
     virtual ~AACDecoder();
     void SetCallback(DecDataCallListner *call_func);
     void SetResampleArg(enum AVSampleFormat fmt, int channels, int ratio);
-    void InputAACData(unsigned char *data, int data_len);
+    void InputAACData(unsigned char *data, int data_len, AVBufferRef *buf = NULL); // buf不为NULL时不拷贝数据
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和解码耗时
+    void SetOfflineMode(bool offline); // 离线模式：队列满了阻塞输入，不丢帧
+    bool HasError(); // 解码器打开失败或者重采样参数不支持，调用者应该结束这一路
 
 private:
-    static void *AACDecodeThread(void *arg);
+    void DecodeTask();
     void DecodeAudio(AACDataNode *data);
-    static void *AACScaleThread(void *arg);
     void ScaleAudio(AVFrame *frame);
 
 public:
@@ -82,16 +105,13 @@ public:
 
     DecDataCallListner *callback_ = NULL;
 
-    std::list<AACDataNode *> es_packets_;
-    std::list<AVFrame *> yuv_frames_;
-    std::mutex packet_mutex_;
-    std::condition_variable packet_cond_;
-    std::condition_variable frame_cond_;
-    std::mutex frame_mutex_;
-
-    std::thread dec_thread_id_;
-    std::thread sws_thread_id_;
-    bool aborted_;
+    BoundedQueue<AACDataNode *> es_packets_;
+    StageMetrics *metrics_ = NULL;
+    // 在共享执行器上解码和重采样，不再为每一路音频单独开线程
+    SerialTask *decode_task_ = NULL;
+    std::atomic<bool> aborted_;
+    std::atomic<bool> error_ = {false};
+    bool offline_ = false;
     int now_frames_;
     int pre_frames_;
     std::chrono::steady_clock::time_point time_now_;
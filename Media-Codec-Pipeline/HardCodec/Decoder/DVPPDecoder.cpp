@@ -3,20 +3,35 @@
 #include <atomic>
 static const uint64_t NANO_SECOND = UINT64_C(1000000000);
 static std::atomic<int32_t> channel_id = {-1};
+// 解码和释放时出错只打印日志；创建通道时用*_RET版本返回-1，由Init设置失败标志，不退出进程
 #define CHECK_ACL(ret) \
     do { \
-        if ((ret) != ACL_SUCCESS) { \
-            fprintf(stderr, "Error: ACL returned %d in file %s at line %d\n", \
-                    (ret), __FILE__, __LINE__); \
-            exit(1); \
+        int check_ret = (ret); \
+        if (check_ret != ACL_SUCCESS) { \
+            log_error("ACL returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
         } \
     } while (0)
 #define CHECK_DVPP_MPI(ret) \
     do { \
-        if ((ret) != HI_SUCCESS) { \
-            fprintf(stderr, "Error: ACL DVPP MPI returned %d in file %s at line %d\n", \
-                    (ret), __FILE__, __LINE__); \
-            exit(1); \
+        int check_ret = (ret); \
+        if (check_ret != HI_SUCCESS) { \
+            log_error("ACL DVPP MPI returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
+        } \
+    } while (0)
+#define CHECK_ACL_RET(ret) \
+    do { \
+        int check_ret = (ret); \
+        if (check_ret != ACL_SUCCESS) { \
+            log_error("ACL returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
+            return -1; \
+        } \
+    } while (0)
+#define CHECK_DVPP_MPI_RET(ret) \
+    do { \
+        int check_ret = (ret); \
+        if (check_ret != HI_SUCCESS) { \
+            log_error("ACL DVPP MPI returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
+            return -1; \
         } \
     } while (0)
 static int32_t GetChannedId(){
@@ -28,6 +43,7 @@ static int32_t GetChannedId(){
 }
 HardVideoDecoder::HardVideoDecoder(bool is_h265)
 {
+    gop_gate_.SetCodec(is_h265);
     if(is_h265){
         chn_attr_.type = HI_PT_H265;
     }
@@ -37,24 +53,33 @@ HardVideoDecoder::HardVideoDecoder(bool is_h265)
     callback_ = NULL;
     time_inited_ = 0;
     now_frames_ = pre_frames_ = 0;
+    es_packets_.SetSizeFunc([](HardDataNode *const &node) { return (size_t)node->es_data_len; });
+    es_packets_.SetReleaseFunc([](HardDataNode *&node) { delete node; });
+    frame_pool_ = FramePool::Create(DEC_FRAME_POOL_SIZE);
+    SetOfflineMode(false);
 }
 HardVideoDecoder::~HardVideoDecoder()
 {
     Stop();
-    for (std::list<HardDataNode *>::iterator it = es_packets_.begin(); it != es_packets_.end(); ++it){
-        HardDataNode *packet = *it;
-        delete packet;
-    }
-    es_packets_.clear();
+    es_packets_.Clear();
+    log_debug("HardVideoDecoder drop packets:{}", es_packets_.DropCount());
     log_debug("~HardVideoDecoder");
 }
 void HardVideoDecoder::Stop(){
     CHECK_ACL(aclrtSetDevice(device_id_));
     abort_ = true;
-    send_stream_thread_id_.join();
-    get_pic_thread_id_.join();
-    CHECK_DVPP_MPI(hi_mpi_vdec_stop_recv_stream(channel_id_));
-    CHECK_DVPP_MPI(hi_mpi_vdec_destroy_chn(channel_id_));
+    es_packets_.Close();
+    frame_pool_->Close(); // 下游可能还持有图像，转换线程不能卡在GetFrame
+    if (send_stream_thread_id_.joinable()) { // Init失败时线程没有启动
+        send_stream_thread_id_.join();
+    }
+    if (get_pic_thread_id_.joinable()) {
+        get_pic_thread_id_.join();
+    }
+    if (channel_id_ >= 0) {
+        CHECK_DVPP_MPI(hi_mpi_vdec_stop_recv_stream(channel_id_));
+        CHECK_DVPP_MPI(hi_mpi_vdec_destroy_chn(channel_id_));
+    }
     while (!out_buffer_pool_.empty()) {
         void* out_buffer = out_buffer_pool_.front();
         out_buffer_pool_.pop_front();
@@ -65,15 +90,14 @@ void HardVideoDecoder::Stop(){
         CHECK_DVPP_MPI(hi_mpi_dvpp_free(in_es_buffer_));
         in_es_buffer_ = NULL;
     }
-    CHECK_DVPP_MPI(hi_mpi_vpc_destroy_chn(channel_id_color_));
+    if (channel_id_color_ >= 0) {
+        CHECK_DVPP_MPI(hi_mpi_vpc_destroy_chn(channel_id_color_));
+    }
     if(output_pic_.picture_address){
         CHECK_DVPP_MPI(hi_mpi_dvpp_free(output_pic_.picture_address));
         output_pic_.picture_address = NULL;
     }
-    if(image_ptr_){
-        free(image_ptr_);
-        image_ptr_ = NULL;
-    }
+    frame_pool_->Release(); // 还在使用的图像释放之后内存池自动删除
     return;
 
 }
@@ -81,41 +105,52 @@ void HardVideoDecoder::Init(int32_t device_id, int width, int height){
     device_id_ = device_id;
     width_ = width;
     height_ = height;
-    CHECK_ACL(aclrtSetDevice(device_id_));
+    if (CreateChannel() < 0) {
+        log_error("dvpp decoder init failed");
+        error_ = true;
+        return;
+    }
+    send_stream_thread_id_ = std::thread(HardVideoDecoder::SendStream, this);
+    get_pic_thread_id_ = std::thread(HardVideoDecoder::GetPic, this);
+    return;
+}
+int HardVideoDecoder::CreateChannel(){
+    CHECK_ACL_RET(aclrtSetDevice(device_id_));
     chn_attr_.mode = HI_VDEC_SEND_MODE_FRAME; // Only support frame mode
-    chn_attr_.pic_width = width;
-    chn_attr_.pic_height = height;
-    chn_attr_.stream_buf_size = width * height * 3 / 2;
+    chn_attr_.pic_width = width_;
+    chn_attr_.pic_height = height_;
+    chn_attr_.stream_buf_size = width_ * height_ * 3 / 2;
     chn_attr_.frame_buf_cnt = 1;
-    hi_pic_buf_attr buf_attr{width, height, 0, bit_width_, out_format_, HI_COMPRESS_MODE_NONE};
+    hi_pic_buf_attr buf_attr{width_, height_, 0, bit_width_, out_format_, HI_COMPRESS_MODE_NONE};
     chn_attr_.frame_buf_size = hi_vdec_get_pic_buf_size(chn_attr_.type, &buf_attr);
     chn_attr_.video_attr.ref_frame_num = 1;
     chn_attr_.video_attr.temporal_mvp_en = HI_TRUE;
-    chn_attr_.video_attr.tmv_buf_size = hi_vdec_get_tmv_buf_size(chn_attr_.type, width, height);
-    channel_id_ = GetChannedId();
-    CHECK_DVPP_MPI(hi_mpi_vdec_create_chn(channel_id_, &chn_attr_));
+    chn_attr_.video_attr.tmv_buf_size = hi_vdec_get_tmv_buf_size(chn_attr_.type, width_, height_);
+    int32_t vdec_channel = GetChannedId();
+    CHECK_DVPP_MPI_RET(hi_mpi_vdec_create_chn(vdec_channel, &chn_attr_));
+    channel_id_ = vdec_channel; // 创建成功之后Stop才销毁通道
 
     hi_vdec_chn_param chn_param;
-    CHECK_DVPP_MPI(hi_mpi_vdec_get_chn_param(channel_id_, &chn_param));
+    CHECK_DVPP_MPI_RET(hi_mpi_vdec_get_chn_param(channel_id_, &chn_param));
     chn_param.video_param.dec_mode = HI_VIDEO_DEC_MODE_IPB;
     chn_param.video_param.compress_mode = HI_COMPRESS_MODE_HFBC;
     chn_param.video_param.video_format = HI_VIDEO_FORMAT_TILE_64x16;
     chn_param.display_frame_num = 1; 
     chn_param.video_param.out_order = HI_VIDEO_OUT_ORDER_DISPLAY; // Display sequence
-    CHECK_DVPP_MPI(hi_mpi_vdec_set_chn_param(channel_id_, &chn_param));
-    CHECK_DVPP_MPI(hi_mpi_vdec_start_recv_stream(channel_id_));
+    CHECK_DVPP_MPI_RET(hi_mpi_vdec_set_chn_param(channel_id_, &chn_param));
+    CHECK_DVPP_MPI_RET(hi_mpi_vdec_start_recv_stream(channel_id_));
 
-    out_buffer_size_ = width * height * 3 / 2; // YUV420P
+    out_buffer_size_ = width_ * height_ * 3 / 2; // YUV420P
     for (uint32_t i = 0; i < pool_num_; i++) {
         void* out_buffer = NULL;
-        CHECK_DVPP_MPI(hi_mpi_dvpp_malloc(device_id_, &out_buffer, out_buffer_size_));
+        CHECK_DVPP_MPI_RET(hi_mpi_dvpp_malloc(device_id_, &out_buffer, out_buffer_size_));
         out_buffer_pool_.push_back(out_buffer);
     }
 
     // color convert
     hi_vpc_chn_attr st_chn_attr {};
     st_chn_attr.attr = 0;
-    CHECK_DVPP_MPI(hi_mpi_vpc_sys_create_chn(&channel_id_color_, &st_chn_attr));
+    CHECK_DVPP_MPI_RET(hi_mpi_vpc_sys_create_chn(&channel_id_color_, &st_chn_attr));
     input_pic_.picture_width = width_;
     input_pic_.picture_height = height_;
     input_pic_.picture_format = out_format_;
@@ -129,30 +164,19 @@ void HardVideoDecoder::Init(int32_t device_id, int width, int height){
     output_pic_.picture_width_stride = width_ * 3;
     output_pic_.picture_height_stride = height_;
     output_pic_.picture_buffer_size = width_ * height_ * 3;
-    CHECK_DVPP_MPI(hi_mpi_dvpp_malloc(device_id_, &output_pic_.picture_address, output_pic_.picture_buffer_size));
+    CHECK_DVPP_MPI_RET(hi_mpi_dvpp_malloc(device_id_, &output_pic_.picture_address, output_pic_.picture_buffer_size));
 
     
-    CHECK_DVPP_MPI(hi_mpi_dvpp_malloc(device_id_, &in_es_buffer_, in_es_buffer_size_));
-    send_stream_thread_id_ = std::thread(HardVideoDecoder::SendStream, this);
-    get_pic_thread_id_ = std::thread(HardVideoDecoder::GetPic, this);
-    return;
+    CHECK_DVPP_MPI_RET(hi_mpi_dvpp_malloc(device_id_, &in_es_buffer_, in_es_buffer_size_));
+    return 1;
 }
 void *HardVideoDecoder::GetOutAddr(){
-    while(!abort_){
-        std::unique_lock<std::mutex> guard(out_buffer_pool_mutex_);
-        if (!out_buffer_pool_.empty()) {
-            void *addr = out_buffer_pool_.front();
-            out_buffer_pool_.pop_front();
-            guard.unlock();
-            return addr;
-        } else {
-            auto now = std::chrono::system_clock::now();
-            out_buffer_pool_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
-        }
-    }
-    return NULL;
+    std::unique_lock<std::mutex> guard(out_buffer_pool_mutex_);
+    // 等待取图线程归还内存；退出时送流线程还要处理剩余数据，这里不能因为abort_提前返回
+    out_buffer_pool_cond_.wait(guard, [this] { return !out_buffer_pool_.empty(); });
+    void *addr = out_buffer_pool_.front();
+    out_buffer_pool_.pop_front();
+    return addr;
 }
 void HardVideoDecoder::PutOutAddr(void *addr){
     if(!addr){
@@ -170,32 +194,44 @@ void HardVideoDecoder::VdecResetChn(){
     CHECK_DVPP_MPI(hi_mpi_vdec_start_recv_stream(channel_id_));
     return;
 }
+bool HardVideoDecoder::HasError()
+{
+    return error_;
+}
 void HardVideoDecoder::SetFrameFetchCallback(DecDataCallListner *call_func)
 {
     callback_ = call_func;
     return;
 }
-
-void HardVideoDecoder::InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts)
+void HardVideoDecoder::SetOfflineMode(bool offline)
 {
-    HardDataNode *node = new HardDataNode();
-    node->es_data = (unsigned char *)malloc(data_len);
-    memcpy(node->es_data, data, data_len);
-    node->es_data_len = data_len;
-
-    std::unique_lock<std::mutex> guard(packet_mutex_);
-    es_packets_.push_back(node);
-    guard.unlock();
-    packet_cond_.notify_one();
+    offline_ = offline;
+    if (offline_) { // 队列满了等待解码线程消费，不丢帧
+        es_packets_.SetCapacity(OFFLINE_QUEUE_SIZE);
+        es_packets_.SetPolicy(QUEUE_BLOCK);
+    } else { // 下游处理不过来时丢弃最旧的数据，防止内存一直增长；丢包之后解码线程丢弃到下一个关键帧(gop_gate_)
+        es_packets_.SetCapacity(CODEC_INPUT_QUEUE_SIZE, CODEC_INPUT_QUEUE_BYTES);
+        es_packets_.SetPolicy(QUEUE_DROP_OLDEST);
+    }
     return;
 }
-static uint64_t GetCurrentTimeUs()
+void HardVideoDecoder::SetMetrics(StageMetrics *metrics)
 {
-    auto now = std::chrono::steady_clock::now();
-    auto time_us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
-    return static_cast<uint64_t>(time_us);
+    metrics_ = metrics;
+    es_packets_.SetMetrics(metrics);
+    return;
 }
 
+void HardVideoDecoder::InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts, AVBufferRef *buf)
+{
+    if (error_) { // Init失败，没有解码线程消费
+        return;
+    }
+    HardDataNode *node = new HardDataNode(data, data_len, buf);
+    node->pts = pts;
+    es_packets_.Push(node);
+    return;
+}
 void HardVideoDecoder::DecodeVideo(HardDataNode *data){
     hi_vdec_stream stream;
     hi_vdec_pic_info out_pic_info;
@@ -209,7 +245,7 @@ void HardVideoDecoder::DecodeVideo(HardDataNode *data){
         hi_mpi_vdec_send_stream(channel_id_, &stream, &out_pic_info, -1);
         return;
     }
-    stream.pts = GetCurrentTimeUs();
+    stream.pts = (uint64_t)data->pts; // 解码器原样带到输出图像
     stream.addr = in_es_buffer_; // Configure input stream address
     CHECK_ACL(aclrtMemcpy(stream.addr, in_es_buffer_size_, data->es_data, data->es_data_len, ACL_MEMCPY_HOST_TO_DEVICE));
     stream.len = data->es_data_len; // Configure input stream size
@@ -234,20 +270,22 @@ void HardVideoDecoder::DecodeVideo(HardDataNode *data){
 void *HardVideoDecoder::SendStream(void *arg){
     HardVideoDecoder *self = (HardVideoDecoder*)arg;
     CHECK_ACL(aclrtSetDevice(self->device_id_));
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->packet_mutex_);
-        if (!self->es_packets_.empty()) {
-            HardDataNode *pVideoPacket = self->es_packets_.front();
-            self->es_packets_.pop_front();
-            guard.unlock();
+    while (1) {
+        HardDataNode *pVideoPacket = NULL;
+        if (self->es_packets_.Pop(pVideoPacket, -1)) {
+            if (!self->gop_gate_.Admit(pVideoPacket->es_data, pVideoPacket->es_data_len, self->es_packets_.DropCount())) {
+                delete pVideoPacket;
+                if (self->metrics_) {
+                    self->metrics_->Drop();
+                }
+                continue;
+            }
+            StageTimer timer(self->metrics_);
             self->DecodeVideo(pVideoPacket);
 
             delete pVideoPacket;
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->packet_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+        } else { // 队列已经关闭并且剩余的数据已经解码完
+            break;
         }
     }
     // 刷新缓冲区
@@ -256,6 +294,7 @@ void *HardVideoDecoder::SendStream(void *arg){
     node->es_data_len = 0;
     self->DecodeVideo(node);
     delete node;
+    self->send_finished_ = true;
     log_info("SendStream Finished");
     return NULL;
 }
@@ -266,26 +305,25 @@ void *HardVideoDecoder::GetPic(void *arg){
     hi_vdec_stream stream;
     hi_vdec_supplement_info st_supplement{};
     int ret;
-    while (!self->abort_) {
+    while (1) {
         ret = hi_mpi_vdec_get_frame(self->channel_id_, &frame, &st_supplement, &stream, 1000);
+        if (ret != HI_SUCCESS && self->send_finished_) { // 结束标志已经送入并且取不到图像了
+            break;
+        }
         void *output_buffer = NULL;
         if(ret == HI_SUCCESS){       
             output_buffer = (void*)frame.v_frame.virt_addr[0];
             int32_t dec_result = frame.v_frame.frame_flag;
             if((dec_result == 0) && (output_buffer != NULL)){ // get frame
-                uint64_t pts = frame.v_frame.pts; // stream.pts
+                int64_t pts = (int64_t)frame.v_frame.pts; // stream.pts
                 // color convert
                 self->input_pic_.picture_address = output_buffer;
                 uint32_t task_id;
                 CHECK_DVPP_MPI(hi_mpi_vpc_convert_color(self->channel_id_color_, &self->input_pic_, &self->output_pic_, &task_id, -1));
                 CHECK_DVPP_MPI(hi_mpi_vpc_get_process_result(self->channel_id_color_, task_id, -1));
                 int size = self->width_ * self->height_ * 3;
-                if(!self->image_ptr_){
-                    self->image_ptr_ = (unsigned char *)malloc(size);
-                }
-                CHECK_ACL(aclrtMemcpy(self->image_ptr_ , size, self->output_pic_.picture_address, size, ACL_MEMCPY_DEVICE_TO_HOST));
-                cv::Mat frame_mat(self->height_, self->width_, CV_8UC3, self->image_ptr_);
-                cv::Mat frame_ret = frame_mat.clone();
+                cv::Mat frame_ret = self->frame_pool_->GetFrame(self->height_, self->width_, CV_8UC3); // 池中内存用完时等待下游释放图像
+                CHECK_ACL(aclrtMemcpy(frame_ret.data, size, self->output_pic_.picture_address, size, ACL_MEMCPY_DEVICE_TO_HOST)); // 直接拷贝到输出图像，不需要再clone
                 if (self->callback_ != NULL) {
                     self->now_frames_++;
                     if (!self->time_inited_) {
@@ -302,7 +340,7 @@ void *HardVideoDecoder::GetPic(void *arg){
                             self->pre_frames_ = self->now_frames_;
                         }
                     }
-                    self->callback_->OnRGBData(frame_ret);
+                    self->callback_->OnRGBData(frame_ret, pts);
                 }
             }
             if(output_buffer != NULL){
@@ -89,6 +89,7 @@ int HardVideoDecoder::HardDecInit(bool is_h265)
         const AVCodecHWConfig *config = avcodec_get_hw_config(codec_, i);
         if (!config) {
             log_error("get config error");
+            codec_ = NULL; // 退回软件解码
             return -1;
         }
         if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX &&
@@ -152,59 +153,63 @@ int HardVideoDecoder::SoftDecInit(bool is_h265)
     codec_->capabilities |= AV_CODEC_CAP_DELAY;
 #endif
     codec_ctx_ = avcodec_alloc_context3(codec_);
-    codec_ctx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
-    if (is_h265) {
-        codec_ctx_->thread_count = 3;
-    } else {
-        codec_ctx_->thread_count = 1;
-    }
+    ApplyDecThreadOption(codec_ctx_, thread_option_);
     if (avcodec_open2(codec_ctx_, codec_, NULL) < 0) {
         log_error("no decodec can be used");
         avcodec_close(codec_ctx_);
         avcodec_free_context(&codec_ctx_);
-        exit(1);
+        codec_ = NULL;
+        return -1;
     }
-    log_info("open soft dec ok");
+    log_info("open soft dec ok thread_count:{} thread_type:{}", codec_ctx_->thread_count, codec_ctx_->thread_type);
     return 1;
 }
-HardVideoDecoder::HardVideoDecoder(bool is_h265)
+HardVideoDecoder::HardVideoDecoder(bool is_h265, DecThreadOption thread_option)
 {
+    thread_option_ = thread_option;
+    gop_gate_.SetCodec(is_h265);
     codec_ctx_ = NULL;
     codec_ = NULL;
-    if (HardDecInit(is_h265) < 0) {
-        SoftDecInit(is_h265);
+    if (HardDecInit(is_h265) < 0 && SoftDecInit(is_h265) < 0) {
+        error_ = true; // 不启动解码线程，由调用者通过HasError结束这一路
     }
     abort_ = false;
     // av_init_packet(&packet_);
     memset(&packet_, 0, sizeof(packet_));
     frame_ = NULL;
     sw_frame_ = NULL;
-    img_convert_ctx_ = NULL;
+    scaler_ = NULL;
     callback_ = NULL;
     time_inited_ = 0;
     now_frames_ = pre_frames_ = 0;
+    es_packets_.SetSizeFunc([](HardDataNode *const &node) { return (size_t)node->es_data_len; });
+    es_packets_.SetReleaseFunc([](HardDataNode *&node) { delete node; });
+    yuv_frames_.SetCapacity(CODEC_FRAME_QUEUE_SIZE);
+    yuv_frames_.SetReleaseFunc([](AVFrame *&frame) { av_frame_free(&frame); });
+    frame_pool_ = FramePool::Create(DEC_FRAME_POOL_SIZE);
+    SetOfflineMode(false);
+    if (error_) {
+        return;
+    }
     dec_thread_id_ = std::thread(HardVideoDecoder::DecodeThread, this);
     sws_thread_id_ = std::thread(HardVideoDecoder::ScaleThread, this);
 }
 HardVideoDecoder::~HardVideoDecoder()
 {
     abort_ = true;
+    es_packets_.Close();
+    frame_pool_->Close(); // 下游可能还持有图像，转换线程不能卡在GetFrame
 
-    dec_thread_id_.join();
-    sws_thread_id_.join();
-
-    for (std::list<AVFrame *>::iterator it = yuv_frames_.begin(); it != yuv_frames_.end(); ++it) {
-        AVFrame *frame = *it;
-        uint8_t *p = frame->data[0];
-        av_freep(&p);
-        av_frame_free(&frame);
+    if (dec_thread_id_.joinable()) { // 初始化失败时线程没有启动
+        dec_thread_id_.join();
     }
-    yuv_frames_.clear();
-    for (std::list<HardDataNode *>::iterator it = es_packets_.begin(); it != es_packets_.end(); ++it) {
-        HardDataNode *packet = *it;
-        delete packet;
+    if (sws_thread_id_.joinable()) {
+        sws_thread_id_.join();
     }
-    es_packets_.clear();
+
+    yuv_frames_.Clear();
+    es_packets_.Clear();
+    log_debug("HardVideoDecoder drop packets:{}", es_packets_.DropCount());
 
     if (codec_ctx_) {
         if (codec_ctx_->extradata) {
@@ -227,44 +232,79 @@ HardVideoDecoder::~HardVideoDecoder()
         av_frame_free(&sw_frame_);
         sw_frame_ = NULL;
     }
-    if (img_convert_ctx_ != NULL) {
-        sws_freeContext(img_convert_ctx_);
-        img_convert_ctx_ = NULL;
+    if (scaler_ != NULL) {
+        delete scaler_;
+        scaler_ = NULL;
     }
     if (hw_device_ctx_) {
         av_buffer_unref(&hw_device_ctx_);
     }
     av_packet_unref(&packet_);
-    if(image_ptr_){
-        free(image_ptr_);
-        image_ptr_ = NULL;
-    }
+    frame_pool_->Release(); // 还在使用的图像释放之后内存池自动删除
     log_debug("~HardVideoDecoder");
 }
+bool HardVideoDecoder::HasError()
+{
+    return error_;
+}
 void HardVideoDecoder::SetFrameFetchCallback(DecDataCallListner *call_func)
 {
     callback_ = call_func;
     return;
 }
-
-void HardVideoDecoder::InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts)
+void HardVideoDecoder::SetOfflineMode(bool offline)
 {
+    offline_ = offline;
+    if (offline_) { // 队列满了等待解码线程消费，不丢帧
+        es_packets_.SetCapacity(OFFLINE_QUEUE_SIZE);
+        es_packets_.SetPolicy(QUEUE_BLOCK);
+    } else { // 下游处理不过来时丢弃最旧的数据，防止内存一直增长；丢包之后解码线程丢弃到下一个关键帧(gop_gate_)
+        es_packets_.SetCapacity(CODEC_INPUT_QUEUE_SIZE, CODEC_INPUT_QUEUE_BYTES);
+        es_packets_.SetPolicy(QUEUE_DROP_OLDEST);
+    }
+    return;
+}
+void HardVideoDecoder::SetMetrics(StageMetrics *metrics)
+{
+    metrics_ = metrics;
+    es_packets_.SetMetrics(metrics);
+    return;
+}
+void HardVideoDecoder::SetOutputType(DecOutputType type)
+{
+    output_type_ = type;
+    return;
+}
+void HardVideoDecoder::SetScaleThreads(int thread_count)
+{
+    scale_threads_ = thread_count;
+    return;
+}
+void HardVideoDecoder::SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix)
+{
+    scale_kernel_ = kernel;
+    scale_matrix_ = matrix;
+    return;
+}
 
-    HardDataNode *node = new HardDataNode();
-    node->es_data = (unsigned char *)malloc(data_len);
-    memcpy(node->es_data, data, data_len);
-    node->es_data_len = data_len;
-
-    std::unique_lock<std::mutex> guard(packet_mutex_);
-    es_packets_.push_back(node);
-    guard.unlock();
-    packet_cond_.notify_one();
+void HardVideoDecoder::InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts, AVBufferRef *buf)
+{
+    if (error_) { // 解码器没有打开，没有解码线程消费
+        return;
+    }
+    HardDataNode *node = new HardDataNode(data, data_len, buf);
+    node->pts = pts;
+    es_packets_.Push(node);
     return;
 }
 void HardVideoDecoder::DecodeVideo(HardDataNode *data)
 {
     packet_.data = data->es_data;
     packet_.size = data->es_data_len;
+    packet_.pts = data->pts; // 解码器按显示顺序输出图像时带出对应的pts
+    if (data->es_buf) { // 带引用计数的packet，avcodec_send_packet内部不会再拷贝数据
+        packet_.buf = av_buffer_ref(data->es_buf);
+    }
     int ret = avcodec_send_packet(codec_ctx_, &packet_);
     if (ret != 0) {
         av_packet_unref(&packet_);
@@ -350,10 +390,10 @@ void HardVideoDecoder::DecodeVideo(HardDataNode *data)
         frame_nv12->format = out_pix_fmt_;
         av_image_fill_arrays(frame_nv12->data, frame_nv12->linesize, buffer, 
                             (AVPixelFormat)frame_nv12->format, frame_nv12->width, frame_nv12->height, 1);
-        std::unique_lock<std::mutex> guard(frame_mutex_);
-        yuv_frames_.push_back(frame_nv12);
-        guard.unlock();
-        frame_cond_.notify_one();
+        // buffer交给frame_nv12的引用计数管理，可以直接作为VideoFrame输出
+        frame_nv12->buf[0] = av_buffer_create(buffer, size, av_buffer_default_free, NULL, 0);
+        frame_nv12->pts = frame_->pts;
+        yuv_frames_.Push(frame_nv12); // 队列满了等待转换线程消费
 
         if (frame_) {
             av_frame_free(&frame_);
@@ -364,7 +404,7 @@ void HardVideoDecoder::DecodeVideo(HardDataNode *data)
             sw_frame_ = NULL;
         }
         cnt++;
-        // av_freep(&buffer);//调用avpicture_fill之后就不需要再这里释放，由后续流程释放
+        // av_freep(&buffer);//buffer由frame_nv12->buf[0]管理，av_frame_free时释放
     }
     return;
 }
@@ -372,20 +412,22 @@ void *HardVideoDecoder::DecodeThread(void *arg)
 {
 
     HardVideoDecoder *self = (HardVideoDecoder *)arg;
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->packet_mutex_);
-        if (!self->es_packets_.empty()) {
-            HardDataNode *pVideoPacket = self->es_packets_.front();
-            self->es_packets_.pop_front();
-            guard.unlock();
+    while (1) {
+        HardDataNode *pVideoPacket = NULL;
+        if (self->es_packets_.Pop(pVideoPacket, -1)) {
+            if (!self->gop_gate_.Admit(pVideoPacket->es_data, pVideoPacket->es_data_len, self->es_packets_.DropCount())) {
+                delete pVideoPacket;
+                if (self->metrics_) {
+                    self->metrics_->Drop();
+                }
+                continue;
+            }
+            StageTimer timer(self->metrics_);
             self->DecodeVideo(pVideoPacket);
 
             delete pVideoPacket;
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->packet_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+        } else { // 队列已经关闭并且剩余的数据已经解码完
+            break;
         }
     }
     log_info("DecodeThread Finished ");
@@ -395,18 +437,25 @@ void *HardVideoDecoder::DecodeThread(void *arg)
     node->es_data_len = 0;
     self->DecodeVideo(node);
     delete node;
+    self->yuv_frames_.Close();
     return NULL;
 }
 
 void HardVideoDecoder::ScaleVideo(AVFrame *frame)
 {
-    if (!img_convert_ctx_) {
-        img_convert_ctx_ = sws_getContext(frame->width, frame->height, out_pix_fmt_, frame->width, frame->height, AV_PIX_FMT_BGR24, SWS_FAST_BILINEAR, NULL, NULL, NULL); // YUV(NV12)-->RGB
+    if (output_type_ == DEC_OUTPUT_YUV) { // 只增加引用计数交给下游，是否转换由下游决定
+        if (callback_ != NULL) {
+            callback_->OnVideoFrame(VideoFrame(frame));
+        }
+        av_frame_free(&frame);
+        return;
     }
-    int size = frame->width * frame->height * 3;
-    if(!image_ptr_){
-        image_ptr_ = (unsigned char *)malloc(size);
+    if (!scaler_) {
+        scaler_ = new SliceScaler(scale_threads_);
+        scaler_->SetKernel(scale_kernel_, scale_matrix_);
+        log_debug("scale threads:{} kernel:{} matrix:{}", scaler_->ThreadCount(), scale_kernel_ == SCALE_KERNEL_SIMD ? SimdLevelName(DetectSimdLevel()) : "sws", ColorMatrixName(scale_matrix_));
     }
+    cv::Mat frame_ret = frame_pool_->GetFrame(frame->height, frame->width, CV_8UC3); // 池中内存用完时等待下游释放图像
     /**
      * linesize[]数组中保存的是对应通道的数据宽度 ， 输出BGR为packed格式，所以指定linesize[0]既可，如果是planar格式，例如YUV420P
      * linesize[0]——-Y分量的宽度
@@ -414,11 +463,11 @@ void HardVideoDecoder::ScaleVideo(AVFrame *frame)
      * linesize[2]——-V分量的宽度
      * linesize[i]的值并不一定等于图片的宽度，有时候为了对齐各解码器的CPU，实际尺寸会大于图片的宽度
      */
-    int linesize[4] = {3 * frame->width, 0, 0, 0};
+    int linesize[4] = {(int)frame_ret.step[0], 0, 0, 0};
+    uint8_t *dst[4] = {frame_ret.data, NULL, NULL, NULL};
 
-    sws_scale(img_convert_ctx_, frame->data, frame->linesize, 0, frame->height, (uint8_t **)&image_ptr_, linesize); // 处理后的数据放到image_ptr_中
-    cv::Mat frame_mat(frame->height, frame->width, CV_8UC3, image_ptr_);
-    cv::Mat frame_ret = frame_mat.clone();
+    // YUV(NV12)-->RGB，处理后的数据直接放到输出图像中，不需要再clone
+    scaler_->Scale(frame->data, frame->linesize, (AVPixelFormat)frame->format, dst, linesize, AV_PIX_FMT_BGR24, frame->width, frame->height);
     if (callback_ != NULL) {
         now_frames_++;
         if (!time_inited_) {
@@ -435,10 +484,8 @@ void HardVideoDecoder::ScaleVideo(AVFrame *frame)
                 pre_frames_ = now_frames_;
             }
         }
-        callback_->OnRGBData(frame_ret);
+        callback_->OnRGBData(frame_ret, frame->pts);
     }
-    uint8_t *p = frame->data[0];
-    av_freep(&p);
     av_frame_free(&frame);
     return;
 }
@@ -446,18 +493,12 @@ void HardVideoDecoder::ScaleVideo(AVFrame *frame)
 void *HardVideoDecoder::ScaleThread(void *arg)
 {
     HardVideoDecoder *self = (HardVideoDecoder *)arg;
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->frame_mutex_);
-        if (!self->yuv_frames_.empty()) {
-            AVFrame *frame = self->yuv_frames_.front();
-            self->yuv_frames_.pop_front();
-            guard.unlock();
+    while (1) {
+        AVFrame *frame = NULL;
+        if (self->yuv_frames_.Pop(frame, -1)) {
             self->ScaleVideo(frame);
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->frame_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+        } else { // 解码线程已经退出并且剩余的图像已经处理完
+            break;
         }
     }
 
@@ -3,6 +3,10 @@
 
 #include "DecEncInterface.h"
 #include "log_helpers.h"
+#include "FramePool.h"
+#include "SliceScaler.h"
+#include "GopDropGate.h"
+#include <atomic>
 #include <list>
 #include <opencv2/core.hpp>
 #include <opencv2/opencv.hpp>
@@ -28,16 +32,86 @@ extern "C" {
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 }
+// 解码输出图像内存池的大小，下游同时持有的图像超过这个数时解码线程等待
+#define DEC_FRAME_POOL_SIZE 16
+// 软件解码自动选择线程数时的上限，帧级多线程每多一个线程多缓存一帧
+#define DEC_MAX_AUTO_THREADS 16
+// 软件解码的多线程方式
+enum DecThreadMode {
+    DEC_THREAD_AUTO,  // 帧级+slice级，由FFmpeg按码流选择
+    DEC_THREAD_FRAME, // 帧级多线程：吞吐量高，每个线程增加一帧解码延时
+    DEC_THREAD_SLICE, // slice级多线程：不增加延时，码流有多个slice(或H265 WPP)时才有效果
+};
+struct DecThreadOption {
+    DecThreadMode mode;
+    int thread_count; // 小于等于0时按CPU核数选择
+};
+// 实时流预设：只用slice级多线程，保持AV_CODEC_FLAG_LOW_DELAY，解码不缓存帧
+static inline DecThreadOption DecThreadPresetLowDelay()
+{
+    DecThreadOption option = {DEC_THREAD_SLICE, 4};
+    return option;
+}
+// 离线转码预设：帧级+slice级多线程，线程数按CPU核数，用延时换吞吐量
+static inline DecThreadOption DecThreadPresetThroughput()
+{
+    DecThreadOption option = {DEC_THREAD_AUTO, 0};
+    return option;
+}
+// 在avcodec_open2之前调用
+static inline void ApplyDecThreadOption(AVCodecContext *ctx, DecThreadOption option)
+{
+    int thread_count = option.thread_count;
+    if (thread_count <= 0) {
+        thread_count = (int)std::thread::hardware_concurrency();
+        if (thread_count < 1) {
+            thread_count = 1;
+        } else if (thread_count > DEC_MAX_AUTO_THREADS) {
+            thread_count = DEC_MAX_AUTO_THREADS;
+        }
+    }
+    ctx->thread_count = thread_count;
+    if (option.mode == DEC_THREAD_SLICE) {
+        ctx->thread_type = FF_THREAD_SLICE;
+        ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    } else { // 设置了AV_CODEC_FLAG_LOW_DELAY时FFmpeg不会使用帧级多线程
+        ctx->thread_type = (option.mode == DEC_THREAD_FRAME) ? FF_THREAD_FRAME : (FF_THREAD_FRAME | FF_THREAD_SLICE);
+        ctx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+    }
+    return;
+}
 typedef struct HardDataNodeSt {
     unsigned char *es_data;
     int es_data_len;
+    AVBufferRef *es_buf; // 不为NULL时es_data指向es_buf引用的内存
+    int64_t pts;         // InputVideoData传入的pts，随解码后的图像输出
     HardDataNodeSt()
     {
         es_data = NULL;
         es_data_len = 0;
+        es_buf = NULL;
+        pts = AV_NOPTS_VALUE;
+    }
+    // buf不为NULL时只增加引用计数，否则拷贝一份数据
+    HardDataNodeSt(unsigned char *data, int data_len, AVBufferRef *buf)
+    {
+        es_data_len = data_len;
+        pts = AV_NOPTS_VALUE;
+        if (buf) {
+            es_buf = av_buffer_ref(buf);
+            es_data = data;
+        } else {
+            es_buf = NULL;
+            es_data = (unsigned char *)malloc(data_len);
+            memcpy(es_data, data, data_len);
+        }
     }
     virtual ~HardDataNodeSt()
     {
+        if (es_buf) {
+            av_buffer_unref(&es_buf);
+            es_data = NULL;
+        }
         if (es_data) {
             free(es_data);
             es_data = NULL;
@@ -51,10 +125,16 @@ class HardVideoDecoder
 {
 
 public:
-    HardVideoDecoder(bool is_h265 = false);
+    HardVideoDecoder(bool is_h265 = false, DecThreadOption thread_option = DecThreadPresetLowDelay()); // thread_option只在退回软件解码时使用
     virtual ~HardVideoDecoder();
     void SetFrameFetchCallback(DecDataCallListner *call_func);
-    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts);
+    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts, AVBufferRef *buf = NULL); // buf不为NULL时不拷贝数据；pts随解码后的图像输出
+    void SetOfflineMode(bool offline); // 离线模式：队列满了阻塞输入，不丢帧
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和解码耗时；在输入数据之前调用
+    void SetOutputType(DecOutputType type); // 在输入数据之前调用
+    void SetScaleThreads(int thread_count); // YUV->BGR转换的线程数，小于等于0时自动选择；在输入数据之前调用
+    void SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix = COLOR_MATRIX_BT601); // YUV->BGR转换的实现；在输入数据之前调用
+    bool HasError(); // 解码器打开失败，调用者应该结束这一路
 
 private:
     int HardDecInit(bool is_h265 = false);
@@ -75,22 +155,27 @@ private:
     AVPacket packet_;
     AVFrame *frame_ = NULL;
     AVFrame *sw_frame_ = NULL;
-    struct SwsContext *img_convert_ctx_ = NULL;
+    SliceScaler *scaler_ = NULL; // 按条带并行做YUV->BGR转换，第一帧时创建
+    int scale_threads_ = 0;
+    ScaleKernel scale_kernel_ = SCALE_KERNEL_SWS;
+    ColorMatrix scale_matrix_ = COLOR_MATRIX_BT601;
     enum AVPixelFormat out_pix_fmt_ = AV_PIX_FMT_NONE;
     // hard dec
     enum AVHWDeviceType type_ = AV_HWDEVICE_TYPE_NONE;
     enum AVPixelFormat hw_pix_fmt_;
     AVBufferRef *hw_device_ctx_ = NULL;
 
-    std::mutex packet_mutex_;
-    std::condition_variable packet_cond_;
-    std::condition_variable frame_cond_;
-    std::mutex frame_mutex_;
-    std::list<HardDataNode *> es_packets_;
-    std::list<AVFrame *> yuv_frames_;
+    BoundedQueue<HardDataNode *> es_packets_;
+    GopDropGate gop_gate_; // 输入队列丢包之后丢弃到下一个关键帧
+    StageMetrics *metrics_ = NULL;
+    SpscRing<AVFrame *> yuv_frames_;
     std::thread dec_thread_id_;
     std::thread sws_thread_id_;
-    bool abort_;
+    std::atomic<bool> abort_;
+    bool error_ = false;
+    bool offline_ = false;
+    DecThreadOption thread_option_;
+    DecOutputType output_type_ = DEC_OUTPUT_BGR;
 
     int now_frames_;
     int pre_frames_;
@@ -98,7 +183,7 @@ private:
     std::chrono::steady_clock::time_point time_pre_;
     int time_inited_;
 
-    unsigned char *image_ptr_ = NULL;
+    FramePool *frame_pool_ = NULL; // 输出BGR图像的内存池
 };
 #endif
 #ifdef USE_FFMPEG_SOFT
@@ -106,10 +191,16 @@ class HardVideoDecoder
 {
 
 public:
-    HardVideoDecoder(bool is_h265 = false);
+    HardVideoDecoder(bool is_h265 = false, DecThreadOption thread_option = DecThreadPresetLowDelay());
     virtual ~HardVideoDecoder();
     void SetFrameFetchCallback(DecDataCallListner *call_func);
-    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts);
+    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts, AVBufferRef *buf = NULL); // buf不为NULL时不拷贝数据；pts随解码后的图像输出
+    void SetOfflineMode(bool offline); // 离线模式：队列满了阻塞输入，不丢帧
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和解码耗时；在输入数据之前调用
+    void SetOutputType(DecOutputType type); // 在输入数据之前调用
+    void SetScaleThreads(int thread_count); // YUV->BGR转换的线程数，小于等于0时自动选择；在输入数据之前调用
+    void SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix = COLOR_MATRIX_BT601); // YUV->BGR转换的实现；在输入数据之前调用
+    bool HasError(); // 解码器打开失败，调用者应该结束这一路
 
 private:
     int SoftDecInit(bool is_h265 = false);
@@ -126,18 +217,23 @@ private:
 
     AVPacket packet_;
     AVFrame *frame_ = NULL;
-    struct SwsContext *img_convert_ctx_ = NULL;
+    SliceScaler *scaler_ = NULL; // 按条带并行做YUV->BGR转换，第一帧时创建
+    int scale_threads_ = 0;
+    ScaleKernel scale_kernel_ = SCALE_KERNEL_SWS;
+    ColorMatrix scale_matrix_ = COLOR_MATRIX_BT601;
     enum AVPixelFormat out_pix_fmt_ = AV_PIX_FMT_NONE;
 
-    std::mutex packet_mutex_;
-    std::condition_variable packet_cond_;
-    std::condition_variable frame_cond_;
-    std::mutex frame_mutex_;
-    std::list<HardDataNode *> es_packets_;
-    std::list<AVFrame *> yuv_frames_;
+    BoundedQueue<HardDataNode *> es_packets_;
+    GopDropGate gop_gate_; // 输入队列丢包之后丢弃到下一个关键帧
+    StageMetrics *metrics_ = NULL;
+    SpscRing<AVFrame *> yuv_frames_;
     std::thread dec_thread_id_;
     std::thread sws_thread_id_;
-    bool abort_;
+    std::atomic<bool> abort_;
+    bool error_ = false;
+    bool offline_ = false;
+    DecThreadOption thread_option_;
+    DecOutputType output_type_ = DEC_OUTPUT_BGR;
 
     int now_frames_;
     int pre_frames_;
@@ -145,7 +241,7 @@ private:
     std::chrono::steady_clock::time_point time_pre_;
     int time_inited_;
 
-    unsigned char *image_ptr_ = NULL;
+    FramePool *frame_pool_ = NULL; // 输出BGR图像的内存池
 };
 #endif
 #ifdef USE_DVPP_MPI
@@ -160,11 +256,15 @@ class HardVideoDecoder
 public:
     HardVideoDecoder(bool is_h265 = false);
     virtual ~HardVideoDecoder();
-    void Init(int32_t device_id, int width, int height);
+    void Init(int32_t device_id, int width, int height); // 失败时HasError返回true
     void SetFrameFetchCallback(DecDataCallListner *call_func);
-    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts);
+    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts, AVBufferRef *buf = NULL); // buf不为NULL时不拷贝数据；pts随解码后的图像输出
+    void SetOfflineMode(bool offline); // 离线模式：队列满了阻塞输入，不丢帧
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和解码耗时；在输入数据之前调用
+    bool HasError(); // 初始化失败，调用者应该结束这一路
 
 private:
+    int CreateChannel();
     void VdecResetChn();
     static void *SendStream(void *arg);
     void DecodeVideo(HardDataNode *data);
@@ -176,7 +276,7 @@ private:
     int32_t device_id_ = 0;
     int width_;
     int height_;
-    int32_t channel_id_;
+    int32_t channel_id_ = -1;
     hi_vdec_chn_attr chn_attr_;
     hi_data_bit_width bit_width_ = HI_DATA_BIT_WIDTH_8;// HI_DATA_BIT_WIDTH_8、HI_DATA_BIT_WIDTH_10， 默认是HI_DATA_BIT_WIDTH_8
     hi_pixel_format out_format_ = HI_PIXEL_FORMAT_YUV_SEMIPLANAR_420;
@@ -191,11 +291,11 @@ private:
     std::condition_variable out_buffer_pool_cond_;
 
     // color convert
-    hi_vpc_chn channel_id_color_;
+    hi_vpc_chn channel_id_color_ = -1;
     hi_pixel_format out_format_color_ = HI_PIXEL_FORMAT_BGR_888;
-    hi_vpc_pic_info input_pic_;
-    hi_vpc_pic_info output_pic_;
-    unsigned char *image_ptr_ = NULL;
+    hi_vpc_pic_info input_pic_ {};
+    hi_vpc_pic_info output_pic_ {};
+    FramePool *frame_pool_ = NULL; // 输出BGR图像的内存池
 
 
     std::thread send_stream_thread_id_;
@@ -203,10 +303,13 @@ private:
 
 
     DecDataCallListner *callback_ = NULL;
-    std::mutex packet_mutex_;
-    std::condition_variable packet_cond_;
-    std::list<HardDataNode *> es_packets_;
-    bool abort_ = false;
+    BoundedQueue<HardDataNode *> es_packets_;
+    GopDropGate gop_gate_; // 输入队列丢包之后丢弃到下一个关键帧
+    StageMetrics *metrics_ = NULL;
+    std::atomic<bool> abort_ = {false};
+    std::atomic<bool> error_ = {false};
+    bool offline_ = false;
+    std::atomic<bool> send_finished_ = {false}; // 送流线程已经发送完剩余数据和结束标志
 
     int now_frames_;
     int pre_frames_;
@@ -228,9 +331,12 @@ class HardVideoDecoder
 public:
     HardVideoDecoder(bool is_h265 = false);
     virtual ~HardVideoDecoder();
-    void Init(int32_t device_id, int width, int height);
+    void Init(int32_t device_id, int width, int height); // 失败时HasError返回true
     void SetFrameFetchCallback(DecDataCallListner *call_func);
-    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts);
+    void InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts, AVBufferRef *buf = NULL); // buf不为NULL时不拷贝数据；pts随解码后的图像输出
+    void SetOfflineMode(bool offline); // 离线模式：队列满了阻塞输入，不丢帧
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和解码耗时；在输入数据之前调用
+    bool HasError(); // 初始化失败，调用者应该结束这一路
 
 private:
     static void *DecodeThread(void *arg);
@@ -243,15 +349,17 @@ private:
     cudaVideoCodec type_;
     void *device_frame_ = NULL;
     void *device_color_frame_ = NULL;
-    void* host_frame_ = NULL;
+    FramePool *frame_pool_ = NULL; // 输出BGR图像的内存池
 
     std::thread dec_thread_id_;
 
     DecDataCallListner *callback_ = NULL;
-    std::mutex packet_mutex_;
-    std::condition_variable packet_cond_;
-    std::list<HardDataNode *> es_packets_;
-    bool abort_ = false;
+    BoundedQueue<HardDataNode *> es_packets_;
+    GopDropGate gop_gate_; // 输入队列丢包之后丢弃到下一个关键帧
+    StageMetrics *metrics_ = NULL;
+    std::atomic<bool> abort_ = {false};
+    std::atomic<bool> error_ = {false};
+    bool offline_ = false;
 
     int now_frames_;
     int pre_frames_;
@@ -27,6 +27,7 @@ static void CreateCudaContext(CUcontext *cuContext, int iGpu, unsigned int flags
 
 HardVideoDecoder::HardVideoDecoder(bool is_h265)
 {
+    gop_gate_.SetCodec(is_h265);
     if(is_h265){
         type_ = cudaVideoCodec_HEVC;
     }
@@ -37,26 +38,28 @@ HardVideoDecoder::HardVideoDecoder(bool is_h265)
     callback_ = NULL;
     time_inited_ = 0;
     now_frames_ = pre_frames_ = 0;
+    es_packets_.SetSizeFunc([](HardDataNode *const &node) { return (size_t)node->es_data_len; });
+    es_packets_.SetReleaseFunc([](HardDataNode *&node) { delete node; });
+    frame_pool_ = FramePool::Create(DEC_FRAME_POOL_SIZE);
+    SetOfflineMode(false);
 }
 HardVideoDecoder::~HardVideoDecoder()
 {
     abort_ = true;
-    dec_thread_id_.join();
+    es_packets_.Close();
+    frame_pool_->Close(); // 下游可能还持有图像，解码线程不能卡在GetFrame
+    if (dec_thread_id_.joinable()) { // Init失败时线程没有启动
+        dec_thread_id_.join();
+    }
     if(dec_){
         delete dec_;
         dec_ = NULL;
     }
     CHECK_CUDA(cudaFree(device_frame_));
     CHECK_CUDA(cudaFree(device_color_frame_));
-    if(host_frame_){
-        free(host_frame_);
-        host_frame_ = NULL;
-    }
-    for (std::list<HardDataNode *>::iterator it = es_packets_.begin(); it != es_packets_.end(); ++it){
-        HardDataNode *packet = *it;
-        delete packet;
-    }
-    es_packets_.clear();
+    frame_pool_->Release(); // 还在使用的图像释放之后内存池自动删除
+    es_packets_.Clear();
+    log_debug("HardVideoDecoder drop packets:{}", es_packets_.DropCount());
     log_debug("~HardVideoDecoder");
 }
 void HardVideoDecoder::Init(int32_t device_id, int width, int height){
@@ -68,43 +71,61 @@ void HardVideoDecoder::Init(int32_t device_id, int width, int height){
     std::call_once(flag, [this] {
         CreateCudaContext(&cuContext, this->device_id_, 0);
     });
-    dec_ = new NvDecoder(cuContext, true, type_, true);
+    try {
+        dec_ = new NvDecoder(cuContext, true, type_, true);
+    } catch (NVDECException &e) { // 显卡不支持或者解码器资源不足
+        log_error("create NvDecoder failed: {}", e.what());
+        error_ = true;
+        return;
+    }
     CHECK_CUDA(cudaMalloc(&device_frame_, width_ * height_ * 4));
     CHECK_CUDA(cudaMalloc(&device_color_frame_, width_ * height_ * 3));
-    host_frame_ = malloc(width_ * height_ * 3);
     dec_thread_id_ = std::thread(HardVideoDecoder::DecodeThread, this);
     return;
 }
+bool HardVideoDecoder::HasError()
+{
+    return error_;
+}
 void HardVideoDecoder::SetFrameFetchCallback(DecDataCallListner *call_func)
 {
     callback_ = call_func;
     return;
 }
-
-void HardVideoDecoder::InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts)
+void HardVideoDecoder::SetOfflineMode(bool offline)
 {
-    HardDataNode *node = new HardDataNode();
-    node->es_data = (unsigned char *)malloc(data_len);
-    memcpy(node->es_data, data, data_len);
-    node->es_data_len = data_len;
-
-    std::unique_lock<std::mutex> guard(packet_mutex_);
-    es_packets_.push_back(node);
-    guard.unlock();
-    packet_cond_.notify_one();
+    offline_ = offline;
+    if (offline_) { // 队列满了等待解码线程消费，不丢帧
+        es_packets_.SetCapacity(OFFLINE_QUEUE_SIZE);
+        es_packets_.SetPolicy(QUEUE_BLOCK);
+    } else { // 下游处理不过来时丢弃最旧的数据，防止内存一直增长；丢包之后解码线程丢弃到下一个关键帧(gop_gate_)
+        es_packets_.SetCapacity(CODEC_INPUT_QUEUE_SIZE, CODEC_INPUT_QUEUE_BYTES);
+        es_packets_.SetPolicy(QUEUE_DROP_OLDEST);
+    }
     return;
 }
-static uint64_t GetCurrentTimeUs()
+void HardVideoDecoder::SetMetrics(StageMetrics *metrics)
 {
-    auto now = std::chrono::steady_clock::now();
-    auto time_us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
-    return static_cast<uint64_t>(time_us);
+    metrics_ = metrics;
+    es_packets_.SetMetrics(metrics);
+    return;
+}
+
+void HardVideoDecoder::InputVideoData(unsigned char *data, int data_len, int64_t duration, int64_t pts, AVBufferRef *buf)
+{
+    if (error_) { // Init失败，没有解码线程消费
+        return;
+    }
+    HardDataNode *node = new HardDataNode(data, data_len, buf);
+    node->pts = pts;
+    es_packets_.Push(node);
+    return;
 }
 void HardVideoDecoder::DecodeVideo(HardDataNode *data)
 {
     uint8_t *p_frame;
     int n_frame_returned = 0;
-    n_frame_returned = dec_->Decode(data->es_data, data->es_data_len, CUVID_PKT_ENDOFPICTURE | CUVID_PKT_TIMESTAMP, GetCurrentTimeUs()); // CUVID_PKT_ENDOFPICTURE解码器立即输出，没有缓存，没有解码缓存时延;CUVID_PKT_TIMESTAMP返回原始时间戳
+    n_frame_returned = dec_->Decode(data->es_data, data->es_data_len, CUVID_PKT_ENDOFPICTURE | CUVID_PKT_TIMESTAMP, data->pts); // CUVID_PKT_ENDOFPICTURE解码器立即输出，没有缓存，没有解码缓存时延;CUVID_PKT_TIMESTAMP返回原始时间戳
     int i_matrix = dec_->GetVideoFormatInfo().video_signal_description.matrix_coefficients;
     for (int i = 0; i < n_frame_returned; i++) {
         int64_t timestamp;
@@ -116,9 +137,8 @@ void HardVideoDecoder::DecodeVideo(HardDataNode *data)
         if(status != NPP_SUCCESS){
             log_error("NPP BGRA->BGR failed: {}", (int)status);
         }
-        CHECK_CUDA(cudaMemcpy(host_frame_, device_color_frame_, width_ * height_ * 3, cudaMemcpyDeviceToHost));
-        cv::Mat frame_mat(height_, width_, CV_8UC3, host_frame_);
-        cv::Mat frame_ret = frame_mat.clone();
+        cv::Mat frame_ret = frame_pool_->GetFrame(height_, width_, CV_8UC3); // 池中内存用完时等待下游释放图像
+        CHECK_CUDA(cudaMemcpy(frame_ret.data, device_color_frame_, width_ * height_ * 3, cudaMemcpyDeviceToHost)); // 直接拷贝到输出图像，不需要再clone
         if (callback_ != NULL) {
             now_frames_++;
             if (!time_inited_) {
@@ -135,7 +155,7 @@ void HardVideoDecoder::DecodeVideo(HardDataNode *data)
                     pre_frames_ = now_frames_;
                 }
             }
-            callback_->OnRGBData(frame_ret);
+            callback_->OnRGBData(frame_ret, timestamp);
         }
     }
     return;
@@ -144,20 +164,22 @@ void *HardVideoDecoder::DecodeThread(void *arg)
 {
     HardVideoDecoder *self = (HardVideoDecoder *)arg;
     CHECK_CUDA(cudaSetDevice(self->device_id_));
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->packet_mutex_);
-        if (!self->es_packets_.empty()) {
-            HardDataNode *pVideoPacket = self->es_packets_.front();
-            self->es_packets_.pop_front();
-            guard.unlock();
+    while (1) {
+        HardDataNode *pVideoPacket = NULL;
+        if (self->es_packets_.Pop(pVideoPacket, -1)) {
+            if (!self->gop_gate_.Admit(pVideoPacket->es_data, pVideoPacket->es_data_len, self->es_packets_.DropCount())) {
+                delete pVideoPacket;
+                if (self->metrics_) {
+                    self->metrics_->Drop();
+                }
+                continue;
+            }
+            StageTimer timer(self->metrics_);
             self->DecodeVideo(pVideoPacket);
 
             delete pVideoPacket;
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->packet_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+        } else { // 队列已经关闭并且剩余的数据已经解码完
+            break;
         }
     }
     log_info("DecodeThread Finished ");
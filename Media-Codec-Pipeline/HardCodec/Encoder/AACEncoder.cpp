@@ -9,14 +9,23 @@ AACEncoder::AACEncoder()
     abort_ = false;
     // av_init_packet(&pkt_enc_);
     memset(&pkt_enc_, 0, sizeof(pkt_enc_));
-    encode_id_ = std::thread(AACEncoder::AACEncThread, this);
-    scale_id_ = std::thread(AACEncoder::AACScaleThread, this);
+    pcm_frames_.SetSizeFunc([](AACPCMNode *const &node) { return (size_t)node->data_len; });
+    pcm_frames_.SetReleaseFunc([](AACPCMNode *&node) { delete node; });
+    SetOfflineMode(false);
+    encode_task_ = new SerialTask([this]() { EncodeTask(); });
 }
 AACEncoder::~AACEncoder()
 {
     abort_ = true;
-    encode_id_.join();
-    scale_id_.join();
+    pcm_frames_.Close();
+    encode_task_->Notify(); // 处理完队列中剩余的数据
+    encode_task_->Wait();
+    delete encode_task_;
+    encode_task_ = NULL;
+    if (c_ctx_) { // 清空缓冲区
+        EncodeFrame(NULL);
+    }
+    log_info("AACEncodeTask exit");
     if (encode_swr_ctx_) {
         swr_free(&encode_swr_ctx_);
         encode_swr_ctx_ = NULL;
@@ -26,19 +35,8 @@ AACEncoder::~AACEncoder()
         avcodec_free_context(&c_ctx_);
         c_ctx_ = NULL;
     }
-    for (std::list<AACPCMNode *>::iterator it = pcm_frames_.begin(); it != pcm_frames_.end(); ++it) {
-        AACPCMNode *node = *it;
-        delete node;
-    }
-    pcm_frames_.clear();
-    for (std::list<AVFrame *>::iterator it = dec_frames_.begin(); it != dec_frames_.end(); ++it) {
-        AVFrame *frame = *it;
-        // if(frame->data[0]){
-        //     av_freep(&frame->data[0]);
-        // }
-        av_frame_free(&frame);
-    }
-    dec_frames_.clear();
+    pcm_frames_.Clear();
+    log_debug("AACEncoder drop pcm:{}", pcm_frames_.DropCount());
     log_debug("~AACEncoder");
 }
 void AACEncoder::SetCallback(EncDataCallListner *call_func)
@@ -46,6 +44,24 @@ void AACEncoder::SetCallback(EncDataCallListner *call_func)
     callback_ = call_func;
     return;
 }
+void AACEncoder::SetOfflineMode(bool offline)
+{
+    offline_ = offline;
+    if (offline_) { // 队列满了等待编码任务消费，不丢帧
+        pcm_frames_.SetCapacity(OFFLINE_QUEUE_SIZE);
+        pcm_frames_.SetPolicy(QUEUE_BLOCK);
+    } else { // 下游处理不过来时丢弃最旧的数据，防止内存一直增长
+        pcm_frames_.SetCapacity(CODEC_INPUT_QUEUE_SIZE, CODEC_INPUT_QUEUE_BYTES);
+        pcm_frames_.SetPolicy(QUEUE_DROP_OLDEST);
+    }
+    return;
+}
+void AACEncoder::SetMetrics(StageMetrics *metrics)
+{
+    metrics_ = metrics;
+    pcm_frames_.SetMetrics(metrics);
+    return;
+}
 int AACEncoder::Init(enum AVSampleFormat fmt, int channels, int ratio, int nb_samples)
 {
     src_sample_fmt_ = fmt;
@@ -62,7 +78,7 @@ int AACEncoder::Init(enum AVSampleFormat fmt, int channels, int ratio, int nb_sa
         if (ret < 0) {
             swr_free(&encode_swr_ctx_);
             log_error("encode_swr_ctx_ alloc & set error");
-            exit(1);
+            return -1;
         }
         src_nb_samples_ = nb_samples;
         dst_nb_samples_ = av_rescale_rnd(src_nb_samples_, dst_ratio_, src_ratio_, AV_ROUND_UP); // 1024
@@ -72,7 +88,7 @@ int AACEncoder::Init(enum AVSampleFormat fmt, int channels, int ratio, int nb_sa
         codec_ = avcodec_find_encoder_by_name("libfdk_aac");
         if (!codec_) {
             log_error("EnCodec not found");
-            exit(1);
+            return -1;
         }
         c_ctx_ = avcodec_alloc_context3(codec_);
         c_ctx_->sample_fmt = dst_sample_fmt_; // fdk_aac需要16位的音频输
@@ -90,7 +106,9 @@ int AACEncoder::Init(enum AVSampleFormat fmt, int channels, int ratio, int nb_sa
         }
         if (avcodec_open2(c_ctx_, codec_, NULL) < 0) {
             log_error("audio_encode_init error");
-            exit(1);
+            avcodec_free_context(&c_ctx_);
+            codec_ = NULL;
+            return -1;
         }
         log_info("audio_encode_init ok");
     }
@@ -112,19 +130,20 @@ void AACEncoder::GetAudioCon(int &channels, int &sample_rate, int &profile){
 }
 int AACEncoder::AddPCMFrame(unsigned char *data, int data_len)
 {
-    std::unique_lock<std::mutex> guard(pcm_mutex_);
-#if 0
-    // 丢帧处理
-    while (pcm_frames_.size() > 5) {
-        AACPCMNode *node = pcm_frames_.front();
-        delete node;
-        pcm_frames_.pop_front();
+    if (c_ctx_ == NULL) { // Init失败
+        return -1;
     }
-#endif
     AACPCMNode *pcm_data = new AACPCMNode(data, data_len);
-    pcm_frames_.push_back(pcm_data);
-    guard.unlock();
-    pcm_cond_.notify_one();
+    if (offline_ && TaskExecutor::InWorkerThread()) {
+        // 解码回调在执行器线程中调用，阻塞等待可能占满所有工作线程，队列满了在当前线程编码
+        while (pcm_frames_.Size() >= OFFLINE_QUEUE_SIZE) {
+            if (!encode_task_->RunInline()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    pcm_frames_.Push(pcm_data);
+    encode_task_->Notify();
 
     if (!time_inited_) {
         time_inited_ = 1;
@@ -143,114 +162,68 @@ int AACEncoder::AddPCMFrame(unsigned char *data, int data_len)
     }
     return 1;
 }
-void *AACEncoder::AACScaleThread(void *arg)
+// 每次最多处理SERIAL_TASK_BATCH个PCM帧，剩余的数据重新排队
+void AACEncoder::EncodeTask()
 {
-    AACEncoder *self = (AACEncoder *)arg;
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->pcm_mutex_);
-        if (!self->pcm_frames_.empty()) {
-            AACPCMNode *pcm_node = self->pcm_frames_.front();
-            self->pcm_frames_.pop_front();
-            guard.unlock();
-#if 1
-            /**
-             * FFmpeg真正进行重采样的函数是swr_convert。它的返回值就是重采样输出的点数。
-             * 使用FFmpeg进行重采样时内部是有缓存的，而内部缓存了多少个采样点，可以用函数swr_get_delay获取。
-             * 也就是说调用函数swr_convert时你传递进去的第三个参数表示你希望输出的采样点数，
-             * 但是函数swr_convert的返回值才是真正输出的采样点数，这个返回值一定是小于或等于你希望输出的采样点数。
-             */
-            int64_t delay = swr_get_delay(self->encode_swr_ctx_, self->src_ratio_);
-            int64_t real_dst_nb_samples = av_rescale_rnd(delay + self->src_nb_samples_, self->dst_ratio_, self->src_ratio_, AV_ROUND_UP);
-            if (real_dst_nb_samples > self->dst_nb_samples_) {
-                log_debug("change dst_nb_samples_");
-                self->dst_nb_samples_ = real_dst_nb_samples;
-            }
-#endif
-            AVFrame *frame_enc = av_frame_alloc();
-            frame_enc->nb_samples = self->dst_nb_samples_;
-            frame_enc->format = self->dst_sample_fmt_;
-            frame_enc->channels = self->dst_nb_channels_;
-            frame_enc->channel_layout = av_get_default_channel_layout(self->dst_nb_channels_);
-            av_frame_get_buffer(frame_enc, 1);
-            int ret = swr_convert(self->encode_swr_ctx_, frame_enc->data, frame_enc->nb_samples, (const uint8_t **)&pcm_node->pcm_data, self->src_nb_samples_);
-
-            std::unique_lock<std::mutex> guard(self->frame_mutex_);
-            self->dec_frames_.push_back(frame_enc);
-            guard.unlock();
-            self->frame_cond_.notify_one();
-            delete pcm_node;
-
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->pcm_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+    for (int i = 0; i < SERIAL_TASK_BATCH; i++) {
+        AACPCMNode *pcm_node = NULL;
+        if (!pcm_frames_.Pop(pcm_node, 0)) {
+            return;
         }
+        StageTimer timer(metrics_);
+        EncodePCM(pcm_node);
+        delete pcm_node;
+    }
+    if (!pcm_frames_.Empty()) {
+        encode_task_->Notify();
     }
-    log_info("AACScaleThread exit");
-    return NULL;
+    return;
 }
-void *AACEncoder::AACEncThread(void *arg)
+void AACEncoder::EncodePCM(AACPCMNode *pcm_node)
 {
-    AACEncoder *self = (AACEncoder *)arg;
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->frame_mutex_);
-        if (!self->dec_frames_.empty()) {
-            AVFrame *frame = self->dec_frames_.front();
-            self->dec_frames_.pop_front();
-            guard.unlock();
-
-            int ret;
-            ret = avcodec_send_frame(self->c_ctx_, frame);
-            if (ret < 0) {
-                log_warn("Error sending the frame to the encoder\n");
-                // uint8_t* p=frame->data[0];
-                // if(p){
-                //     av_freep(&p);
-                // }
-
-                av_frame_free(&frame);
-                continue;
-            }
-            while (ret >= 0) {
-                ret = avcodec_receive_packet(self->c_ctx_, &self->pkt_enc_);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF || ret < 0) {
-                    av_frame_free(&frame);
-                    av_packet_unref(&self->pkt_enc_);
-                    continue;
-                }
-                // 解码后的数据已经带了adts
-                if (self->callback_) {
-                    self->callback_->OnAudioEncData(self->pkt_enc_.data, self->pkt_enc_.size);
-                }
-                av_packet_unref(&self->pkt_enc_);
-            }
-            // uint8_t* p=frame->data[0];
-            // if(p){
-            //     av_freep(&p);
-            // }
-            av_frame_free(&frame);
-
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->frame_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
-        }
+#if 1
+    /**
+     * FFmpeg真正进行重采样的函数是swr_convert。它的返回值就是重采样输出的点数。
+     * 使用FFmpeg进行重采样时内部是有缓存的，而内部缓存了多少个采样点，可以用函数swr_get_delay获取。
+     * 也就是说调用函数swr_convert时你传递进去的第三个参数表示你希望输出的采样点数，
+     * 但是函数swr_convert的返回值才是真正输出的采样点数，这个返回值一定是小于或等于你希望输出的采样点数。
+     */
+    int64_t delay = swr_get_delay(encode_swr_ctx_, src_ratio_);
+    int64_t real_dst_nb_samples = av_rescale_rnd(delay + src_nb_samples_, dst_ratio_, src_ratio_, AV_ROUND_UP);
+    if (real_dst_nb_samples > dst_nb_samples_) {
+        log_debug("change dst_nb_samples_");
+        dst_nb_samples_ = real_dst_nb_samples;
+    }
+#endif
+    AVFrame *frame_enc = av_frame_alloc();
+    frame_enc->nb_samples = dst_nb_samples_;
+    frame_enc->format = dst_sample_fmt_;
+    frame_enc->channels = dst_nb_channels_;
+    frame_enc->channel_layout = av_get_default_channel_layout(dst_nb_channels_);
+    av_frame_get_buffer(frame_enc, 1);
+    swr_convert(encode_swr_ctx_, frame_enc->data, frame_enc->nb_samples, (const uint8_t **)&pcm_node->pcm_data, src_nb_samples_);
+    EncodeFrame(frame_enc);
+    av_frame_free(&frame_enc);
+    return;
+}
+void AACEncoder::EncodeFrame(AVFrame *frame)
+{
+    int ret = avcodec_send_frame(c_ctx_, frame);
+    if (ret < 0) {
+        log_warn("Error sending the frame to the encoder\n");
+        return;
     }
-    // 清空缓冲区
-    int ret = avcodec_send_frame(self->c_ctx_, NULL);
     while (ret >= 0) {
-        ret = avcodec_receive_packet(self->c_ctx_, &self->pkt_enc_);
+        ret = avcodec_receive_packet(c_ctx_, &pkt_enc_);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF || ret < 0) {
-            av_packet_unref(&self->pkt_enc_);
+            av_packet_unref(&pkt_enc_);
             continue;
         }
-        if (self->callback_) {
-            self->callback_->OnAudioEncData(self->pkt_enc_.data, self->pkt_enc_.size);
+        // 解码后的数据已经带了adts
+        if (callback_) {
+            callback_->OnAudioEncData(pkt_enc_.data, pkt_enc_.size);
         }
-        av_packet_unref(&self->pkt_enc_);
+        av_packet_unref(&pkt_enc_);
     }
-    log_info("AACEncThread exit");
-    return NULL;
+    return;
 }
\ No newline at end of file
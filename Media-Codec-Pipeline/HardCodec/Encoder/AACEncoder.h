@@ -2,10 +2,12 @@
 #define AACENCODECER_H
 
 #include "DecEncInterface.h"
+#include "TaskExecutor.h"
 #include "log_helpers.h"
 #include <opencv2/opencv.hpp>
 #include <string.h>
 #include <list>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <chrono>
@@ -46,13 +48,16 @@ public:
     AACEncoder();
     ~AACEncoder();
     int AddPCMFrame(unsigned char *data, int data_len);
-    int Init(enum AVSampleFormat fmt, int channels, int ratio, int nb_samples);
+    int Init(enum AVSampleFormat fmt, int channels, int ratio, int nb_samples); // 失败返回-1
     void SetCallback(EncDataCallListner *call_func);
     void GetAudioCon(int &channels, int &sample_rate, int &profile);
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和编码耗时
+    void SetOfflineMode(bool offline); // 离线模式：不丢帧，队列满了阻塞AddPCMFrame
 
 private:
-    static void *AACScaleThread(void *arg);
-    static void *AACEncThread(void *arg);
+    void EncodeTask();
+    void EncodePCM(AACPCMNode *pcm_node);
+    void EncodeFrame(AVFrame *frame); // frame为NULL时刷新编码器
 
 private:
     EncDataCallListner *callback_ = NULL;
@@ -70,16 +75,13 @@ private:
     AVCodec *codec_ = NULL;
     AVPacket pkt_enc_;
 
-    std::mutex pcm_mutex_;
-    std::condition_variable pcm_cond_;
-    std::list<AACPCMNode *> pcm_frames_;
-    std::mutex frame_mutex_;
-    std::condition_variable frame_cond_;
-    std::list<AVFrame *> dec_frames_;
-    std::thread scale_id_;
-    std::thread encode_id_;
+    BoundedQueue<AACPCMNode *> pcm_frames_;
+    StageMetrics *metrics_ = NULL;
+    // 在共享执行器上重采样和编码，不再为每一路音频单独开线程
+    SerialTask *encode_task_ = NULL;
 
-    bool abort_;
+    std::atomic<bool> abort_;
+    bool offline_ = false;
     std::chrono::steady_clock::time_point time_now_;
     std::chrono::steady_clock::time_point time_pre_;
     int time_inited_;
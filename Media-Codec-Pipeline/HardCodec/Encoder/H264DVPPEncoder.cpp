@@ -4,20 +4,35 @@
 
 static const uint64 NANO_SECOND = UINT64_C(1000000000);
 static std::atomic<int32_t> channel_id = {-1};
+// 编码和释放时出错只打印日志；Init中用*_RET版本返回-1，由调用者把这一路设置为失败，不退出进程
 #define CHECK_ACL(ret) \
     do { \
-        if ((ret) != ACL_SUCCESS) { \
-            fprintf(stderr, "Error: ACL returned %d in file %s at line %d\n", \
-                    (ret), __FILE__, __LINE__); \
-            exit(1); \
+        int check_ret = (ret); \
+        if (check_ret != ACL_SUCCESS) { \
+            log_error("ACL returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
         } \
     } while (0)
 #define CHECK_DVPP_MPI(ret) \
     do { \
-        if ((ret) != HI_SUCCESS) { \
-            fprintf(stderr, "Error: ACL DVPP MPI returned %d in file %s at line %d\n", \
-                    (ret), __FILE__, __LINE__); \
-            exit(1); \
+        int check_ret = (ret); \
+        if (check_ret != HI_SUCCESS) { \
+            log_error("ACL DVPP MPI returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
+        } \
+    } while (0)
+#define CHECK_ACL_RET(ret) \
+    do { \
+        int check_ret = (ret); \
+        if (check_ret != ACL_SUCCESS) { \
+            log_error("ACL returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
+            return -1; \
+        } \
+    } while (0)
+#define CHECK_DVPP_MPI_RET(ret) \
+    do { \
+        int check_ret = (ret); \
+        if (check_ret != HI_SUCCESS) { \
+            log_error("ACL DVPP MPI returned {} in file {} at line {}", check_ret, __FILE__, __LINE__); \
+            return -1; \
         } \
     } while (0)
 static int32_t GetChannedId(){
@@ -33,33 +48,67 @@ HardVideoEncoder::HardVideoEncoder()
     callback_ = NULL;
     nframe_counter_ = 0;
     nframe_counter_recv_ = 0;
-    time_ts_accum_ = 0;
     time_inited_ = 0;
+    yuv_frames_.SetReleaseFunc([this](DvppYuvFrame &frame) { PutColorAddr(frame.addr); });
+    yuv_frames_.SetCapacity(ENC_QUEUE_SIZE);
+    SetOfflineMode(false);
 }
 void HardVideoEncoder::SetDataCallback(EncDataCallListner *call_func)
 {
     callback_ = call_func;
     return;
 }
+void HardVideoEncoder::SetOfflineMode(bool offline)
+{
+    offline_ = offline;
+    QueuePolicy policy = QUEUE_BLOCK; // 离线模式不丢帧，队列满了等待
+#ifdef DROP_FRAME
+    if (!offline_) {
+        policy = QUEUE_DROP_OLDEST; // 丢帧处理
+    }
+#endif
+    bgr_frames_.SetCapacity(ENC_QUEUE_SIZE);
+    bgr_frames_.SetPolicy(policy);
+    return;
+}
+void HardVideoEncoder::SetMetrics(StageMetrics *metrics)
+{
+    metrics_ = metrics;
+    bgr_frames_.SetMetrics(metrics);
+    return;
+}
 HardVideoEncoder::~HardVideoEncoder()
 {
     abort_ = true;
-    encode_id_.join();
-    scale_id_.join();
-    bgr_frames_.clear();
-    yuv_frames_.clear();
+    bgr_frames_.Close();
+    std::unique_lock<std::mutex> guard(out_buffer_pool_mutex_);
+    guard.unlock();
+    out_buffer_pool_cond_.notify_all(); // 唤醒等待内存池的转换线程
+    if (encode_id_.joinable()) { // Init失败时线程没有启动
+        encode_id_.join();
+    }
+    if (scale_id_.joinable()) {
+        scale_id_.join();
+    }
+    bgr_frames_.Clear();
+    yuv_frames_.Clear(); // 剩余的内存还给内存池，下面统一释放
+    log_debug("HardVideoEncoder drop bgr:{}", bgr_frames_.DropCount());
     while (!out_buffer_pool_.empty()) {
         void* out_buffer = out_buffer_pool_.front();
         out_buffer_pool_.pop_front();
         CHECK_DVPP_MPI(hi_mpi_dvpp_free(out_buffer));
     }
     out_buffer_pool_.clear();
-    CHECK_DVPP_MPI(hi_mpi_vpc_destroy_chn(channel_id_color_));
+    if (channel_id_color_ >= 0) {
+        CHECK_DVPP_MPI(hi_mpi_vpc_destroy_chn(channel_id_color_));
+    }
     if(in_img_buffer_){
         CHECK_DVPP_MPI(hi_mpi_dvpp_free(in_img_buffer_));
         in_img_buffer_ = NULL;
     }
-    venc_mng_delete(enc_handle_);
+    if (enc_handle_) {
+        venc_mng_delete(enc_handle_);
+    }
     if(image_ptr_){
         free(image_ptr_);
         image_ptr_ = NULL;
@@ -92,6 +141,11 @@ void vencStreamOut(uint32_t channelId, void* buffer, void *arg){
     HardVideoEncoder *self = (HardVideoEncoder *)arg;
     hi_venc_stream* venc_stream = (hi_venc_stream*)buffer;
     int ret;
+    // 一次回调是一帧的所有pack，没有B帧时输出顺序和输入顺序一致，按输出的帧计数取回源时间戳
+    int64_t pts, dts;
+    std::unique_lock<std::mutex> guard(self->timestamps_mutex_);
+    self->timestamps_.Get(self->nframe_counter_recv_++, AV_NOPTS_VALUE, pts, dts);
+    guard.unlock();
     for (int i = 0; i < venc_stream->pack_cnt; i++) {
         uint64_t data_len = venc_stream->pack[i].len - venc_stream->pack[i].offset;
         if(self->image_ptr_ == NULL){
@@ -109,18 +163,9 @@ void vencStreamOut(uint32_t channelId, void* buffer, void *arg){
                 venc_stream->pack[i].addr, venc_stream->pack[i].offset);
             return;
         }
-        self->nframe_counter_recv_++;
-        self->time_now_ = std::chrono::steady_clock::now();
-        if (self->nframe_counter_recv_ - 1 == 0) {
-            self->time_pre_ = self->time_now_;
-            self->time_ts_accum_ = 0;
-        }
-        uint64_t duration = = std::chrono::duration_cast<std::chrono::milliseconds>(self->time_now_ - self->time_pre_).count();
-        self->time_ts_accum_ += duration;
         if (self->callback_) {
-            self->callback_->OnVideoEncData(self->image_ptr_, data_len, self->time_ts_accum_);
+            self->callback_->OnVideoEncData(self->image_ptr_, data_len, pts, dts);
         }
-        self->time_pre_ = self->time_now_;
     }
     return;
 }
@@ -152,24 +197,25 @@ void HardVideoEncoder::InitEncParams(VencParam* encParam)
     encParam->frameGop = 2 * fps_;
     return;
 }
-int HardVideoEncoder::Init(cv::Mat bgr_frame, int fps)
+int HardVideoEncoder::Init(cv::Mat bgr_frame, int fps, EncProfile profile)
 {
-    CHECK_ACL(aclrtSetDevice(device_id_));
+    CHECK_ACL_RET(aclrtSetDevice(device_id_));
     width_ = bgr_frame.cols;
     height_ = bgr_frame.rows;
     fps_ = fps;
+    timestamps_.SetFrameRate(fps);
     // color
     in_img_buffer_size_ = bgr_frame.cols * bgr_frame.rows * 3;
-    CHECK_DVPP_MPI(hi_mpi_dvpp_malloc(device_id_, &in_img_buffer_, in_img_buffer_size_));
+    CHECK_DVPP_MPI_RET(hi_mpi_dvpp_malloc(device_id_, &in_img_buffer_, in_img_buffer_size_));
     out_buffer_size_ = width_ * height_ * 3 / 2; // YUV420P
     for (uint32_t i = 0; i < pool_num_; i++) {
         void* out_buffer = NULL;
-        CHECK_DVPP_MPI(hi_mpi_dvpp_malloc(device_id_, &out_buffer, out_buffer_size_));
+        CHECK_DVPP_MPI_RET(hi_mpi_dvpp_malloc(device_id_, &out_buffer, out_buffer_size_));
         out_buffer_pool_.push_back(out_buffer);
     }
     hi_vpc_chn_attr st_chn_attr {};
     st_chn_attr.attr = 0;
-    CHECK_DVPP_MPI(hi_mpi_vpc_sys_create_chn(&channel_id_color_, &st_chn_attr));
+    CHECK_DVPP_MPI_RET(hi_mpi_vpc_sys_create_chn(&channel_id_color_, &st_chn_attr));
     input_pic_.picture_width = width_;
     input_pic_.picture_height = height_;
     input_pic_.picture_format = in_format_;
@@ -192,28 +238,26 @@ int HardVideoEncoder::Init(cv::Mat bgr_frame, int fps)
     enc_param_.channelId = enc_channel_;
     enc_param_.highPriority = 0; // 0:普通、非0：高优先级
     int32_t ret = venc_mng_create(&enc_handle_, &enc_param_, device_id_);
-    HMEV_HISDK_CHECK_RET_EXPRESS(ret != HMEV_SUCCESS, "venc_mng_create fail!");
+    if (ret != HMEV_SUCCESS) {
+        log_error("venc_mng_create fail:{:#x}", ret);
+        enc_handle_ = NULL;
+        return -1;
+    }
 
     scale_id_ = std::thread(HardVideoEncoder::VideoScaleThread, this);
     encode_id_ = std::thread(HardVideoEncoder::VideoEncThread, this);
     return 1;
 }
 void *HardVideoEncoder::GetColorAddr(){
-    while(!abort_){
-        std::unique_lock<std::mutex> guard(out_buffer_pool_mutex_);
-        if (!out_buffer_pool_.empty()) {
-            void *addr = out_buffer_pool_.front();
-            out_buffer_pool_.pop_front();
-            guard.unlock();
-            return addr;
-        } else {
-            auto now = std::chrono::system_clock::now();
-            out_buffer_pool_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
-        }
+    std::unique_lock<std::mutex> guard(out_buffer_pool_mutex_);
+    // 等待编码线程归还内存，析构时abort_置位后被唤醒
+    out_buffer_pool_cond_.wait(guard, [this] { return abort_ || !out_buffer_pool_.empty(); });
+    if (out_buffer_pool_.empty()) {
+        return NULL;
     }
-    return NULL;
+    void *addr = out_buffer_pool_.front();
+    out_buffer_pool_.pop_front();
+    return addr;
 }
 void HardVideoEncoder::PutColorAddr(void *addr){
     if(!addr){
@@ -225,18 +269,19 @@ void HardVideoEncoder::PutColorAddr(void *addr){
     out_buffer_pool_cond_.notify_one();
     return;
 }
-int HardVideoEncoder::AddVideoFrame(cv::Mat bgr_frame)
+int HardVideoEncoder::AddVideoFrame(VideoFrame yuv_frame, int64_t pts)
 {
-    std::unique_lock<std::mutex> guard(bgr_mutex_);
-#ifdef DROP_FRAME
-	// 丢帧处理
-    if (bgr_frames_.size() > 5) {
-        bgr_frames_.clear();
+    return AddVideoFrame(yuv_frame.ToBGR(), pts); // DVPP编码输入是BGR，先在CPU上转换
+}
+int HardVideoEncoder::AddVideoFrame(cv::Mat bgr_frame, int64_t pts)
+{
+    if (!encode_id_.joinable()) { // Init失败
+        return -1;
     }
-#endif
-    bgr_frames_.push_back(bgr_frame);
-    guard.unlock();
-    bgr_cond_.notify_one();
+    EncInputFrame in_frame;
+    in_frame.bgr = bgr_frame;
+    in_frame.pts = pts;
+    bgr_frames_.Push(in_frame); // 队列满了丢弃最旧的图像(DROP_FRAME)或者等待
     if (!time_inited_) {
         time_inited_ = 1;
         time_now_1_ = std::chrono::steady_clock::now();
@@ -259,13 +304,14 @@ void *HardVideoEncoder::VideoScaleThread(void *arg)
 {
     HardVideoEncoder *self = (HardVideoEncoder *)arg;
     CHECK_ACL(aclrtSetDevice(self->device_id_));
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->bgr_mutex_);
-        if (!self->bgr_frames_.empty()) {
-            cv::Mat bgr_frame = self->bgr_frames_.front();
-            self->bgr_frames_.pop_front();
-            guard.unlock();
+    while (1) {
+        EncInputFrame in_frame;
+        if (self->bgr_frames_.Pop(in_frame, -1)) {
+            cv::Mat bgr_frame = in_frame.bgr;
             void *addr = self->GetColorAddr();
+            if (addr == NULL) { // 退出时内存池已经没有可用的内存
+                continue;
+            }
             CHECK_ACL(aclrtMemcpy(self->in_img_buffer_ , self->in_img_buffer_size_, bgr_frame.data, self->in_img_buffer_size_, ACL_MEMCPY_HOST_TO_DEVICE));
             self->input_pic_.picture_address = self->in_img_buffer_;
             self->output_pic_.picture_address = addr;
@@ -273,27 +319,15 @@ void *HardVideoEncoder::VideoScaleThread(void *arg)
             CHECK_DVPP_MPI(hi_mpi_vpc_convert_color(self->channel_id_color_, &self->input_pic_, &self->output_pic_, &task_id, -1));
             CHECK_DVPP_MPI(hi_mpi_vpc_get_process_result(self->channel_id_color_, task_id, -1));
 
-            std::unique_lock<std::mutex> guard(self->yuv_mutex_);
-#ifdef DROP_FRAME
-			// 丢帧处理
-            if (self->yuv_frames_.size() > 5) {
-                for (std::list<void *>::iterator it = self->yuv_frames_.begin();
-                    it != self->yuv_frames_.end(); ++it) {
-                    void *frame = *it;
-                    self->PutColorAddr(frame);
-                }
-                self->yuv_frames_.clear();
-            }
-#endif
-            self->yuv_frames_.push_back(addr);
-            guard.unlock();
-            self->yuv_cond_.notify_one();
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->bgr_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
+            DvppYuvFrame yuv_frame;
+            yuv_frame.addr = addr;
+            yuv_frame.pts = in_frame.pts;
+            self->yuv_frames_.Push(yuv_frame);
+        } else { // 队列已经关闭并且剩余的图像已经转换完
+            break;
         }
     }
+    self->yuv_frames_.Close();
     log_info("VideoScaleThread exit");
     return NULL;
 }
@@ -313,20 +347,21 @@ void *HardVideoEncoder::VideoEncThread(void *arg)
     hi_u32 align = DEFAULT_ALIGN;
     hi_video_frame_info* video_frame_info = NULL;
 
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->yuv_mutex_);
-        if (!self->yuv_frames_.empty()) {
-            void *yuv_frame = self->yuv_frames_.front();
-            self->yuv_frames_.pop_front();
-            guard.unlock();
+    while (1) {
+        DvppYuvFrame yuv_frame;
+        if (self->yuv_frames_.Pop(yuv_frame, -1)) {
+            StageTimer timer(self->metrics_);
             int ret = enc->dequeue_input_buffer(self->width_, self->height_, pixel_format, bit_width, cmp_mode, align, &video_frame_info);
             if (ret != HMEV_SUCCESS) {
                 HMEV_HISDK_PRT(DEBUG, "dequeue_input_buffer fail");
                 std::this_thread::sleep_for(std::chrono::microseconds(2000)); // sleep 2000 us
                 continue;
             }
-            CHECK_ACL(aclrtMemcpy(video_frame_info->v_frame.virt_addr[0] , self->out_buffer_size_, yuv_frame, self->out_buffer_size_, ACL_MEMCPY_DEVICE_TO_DEVICE));
+            CHECK_ACL(aclrtMemcpy(video_frame_info->v_frame.virt_addr[0] , self->out_buffer_size_, yuv_frame.addr, self->out_buffer_size_, ACL_MEMCPY_DEVICE_TO_DEVICE));
             video_frame_info->v_frame.time_ref = self->nframe_counter_ * 2;
+            std::unique_lock<std::mutex> guard(self->timestamps_mutex_); // 编码输出在回调线程，送入之前记录，避免回调先于Put
+            self->timestamps_.Put(self->nframe_counter_, yuv_frame.pts);
+            guard.unlock();
             ret = venc_mng_process_buffer((IHWCODEC_HANDLE)enc_handle, (void*)video_frame_info);
             if (ret != HMEV_SUCCESS) {
                 HMEV_HISDK_PRT(ERROR, "Chn[%d] hi_mpi_venc_send_frame failed, s32Ret:0x%x\n", self->enc_channel_, ret);
@@ -334,13 +369,10 @@ void *HardVideoEncoder::VideoEncThread(void *arg)
                 continue;
             }
             self->nframe_counter_++;
-            self->PutColorAddr(yuv_frame);
+            self->PutColorAddr(yuv_frame.addr);
 
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->yuv_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+        } else { // 转换线程已经退出并且剩余的图像已经编码完
+            break;
         }
     }
     log_info("VideoEncThread exit");
@@ -11,8 +11,10 @@ HardVideoEncoder::HardVideoEncoder()
     abort_ = false;
     callback_ = NULL;
     nframe_counter_ = 0;
-    time_ts_accum_ = 0;
     time_inited_ = 0;
+    yuv_frames_.SetReleaseFunc([](AVFrame *&frame) { av_frame_free(&frame); });
+    yuv_frames_.SetCapacity(ENC_QUEUE_SIZE);
+    SetOfflineMode(false);
     scale_id_ = std::thread(HardVideoEncoder::VideoScaleThread, this);
     encode_id_ = std::thread(HardVideoEncoder::VideoEncThread, this);
 }
@@ -21,19 +23,45 @@ void HardVideoEncoder::SetDataCallback(EncDataCallListner *call_func)
     callback_ = call_func;
     return;
 }
+void HardVideoEncoder::SetScaleThreads(int thread_count)
+{
+    scale_threads_ = thread_count;
+    return;
+}
+void HardVideoEncoder::SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix)
+{
+    scale_kernel_ = kernel;
+    scale_matrix_ = matrix;
+    return;
+}
+void HardVideoEncoder::SetOfflineMode(bool offline)
+{
+    offline_ = offline;
+    QueuePolicy policy = QUEUE_BLOCK; // 离线模式不丢帧，队列满了等待
+#ifdef DROP_FRAME
+    if (!offline_) {
+        policy = QUEUE_DROP_OLDEST; // 丢帧处理
+    }
+#endif
+    in_frames_.SetCapacity(ENC_QUEUE_SIZE);
+    in_frames_.SetPolicy(policy);
+    return;
+}
+void HardVideoEncoder::SetMetrics(StageMetrics *metrics)
+{
+    metrics_ = metrics;
+    in_frames_.SetMetrics(metrics);
+    return;
+}
 HardVideoEncoder::~HardVideoEncoder()
 {
     abort_ = true;
+    in_frames_.Close();
     encode_id_.join();
     scale_id_.join();
-    bgr_frames_.clear();
-
-    for (std::list<AVFrame *>::iterator it = yuv_frames_.begin(); it != yuv_frames_.end(); ++it) {
-        AVFrame *frame = *it;
-        av_freep(&frame->data[0]);
-        av_frame_free(&frame);
-    }
-    yuv_frames_.clear();
+    in_frames_.Clear();
+    yuv_frames_.Clear();
+    log_debug("HardVideoEncoder drop frames:{}", in_frames_.DropCount());
 
     if (h264_codec_ctx_ != NULL) {
         avcodec_close(h264_codec_ctx_);
@@ -44,6 +72,17 @@ HardVideoEncoder::~HardVideoEncoder()
         sws_freeContext(sws_context_);
         sws_context_ = NULL;
     }
+    if (yuv_sws_context_ != NULL) {
+        sws_freeContext(yuv_sws_context_);
+        yuv_sws_context_ = NULL;
+    }
+    if (scaler_ != NULL) {
+        delete scaler_;
+        scaler_ = NULL;
+    }
+    if (yuv_pool_ != NULL) { // 还被引用的内存在最后一次释放的时候删除
+        av_buffer_pool_uninit(&yuv_pool_);
+    }
 
     log_info("~HardVideoEncoder");
 }
@@ -91,6 +130,7 @@ int HardVideoEncoder::HardEncInit(int width, int height, int fps)
     h264_codec_ctx_->time_base.den = fps;
     h264_codec_ctx_->bit_rate = 4000000;
     h264_codec_ctx_->gop_size = 2 * fps;
+    timestamps_.SetFrameRate(fps); // 没有源时间戳时按帧率生成
     h264_codec_ctx_->thread_count = 1;
     h264_codec_ctx_->slices = 1; // int slice_count; // slice数 int slices; // 切片数量。 表示图片细分的数量。 用于并行解码。
     /**
@@ -120,7 +160,7 @@ int HardVideoEncoder::HardEncInit(int width, int height, int fps)
     log_info("using hard enc");
     return 1;
 }
-int HardVideoEncoder::SoftEncInit(int width, int height, int fps)
+int HardVideoEncoder::SoftEncInit(int width, int height, int fps, EncProfile profile)
 {
     if (h264_codec_) {
         log_warn("has been init Encoder...");
@@ -136,40 +176,35 @@ int HardVideoEncoder::SoftEncInit(int width, int height, int fps)
     h264_codec_ctx_->height = height;
     h264_codec_ctx_->time_base.num = 1;
     h264_codec_ctx_->time_base.den = fps;
-    h264_codec_ctx_->bit_rate = 4000000;
     h264_codec_ctx_->gop_size = 2 * fps;
-    h264_codec_ctx_->thread_count = 1;
-    h264_codec_ctx_->slices = 1; // int slice_count; // slice数 int slices; // 切片数量。 表示图片细分的数量。 用于并行解码。
+    timestamps_.SetFrameRate(fps); // 没有源时间戳时按帧率生成
     /**
      * 遇到问题：编码得到的h264文件播放时提示"non-existing PPS 0 referenced"
      * 分析原因：未将pps sps 等信息写入
      * 解决方案：加入标记AV_CODEC_FLAG2_LOCAL_HEADER
      */
     h264_codec_ctx_->flags |= AV_CODEC_FLAG2_LOCAL_HEADER;
-    h264_codec_ctx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
     AVDictionary *param = 0;
-    // priv_data  属于每个编码器特有的设置域，用av_opt_set 设置
-    av_opt_set(h264_codec_ctx_->priv_data, "preset", "ultrafast", 0);
-    av_opt_set(h264_codec_ctx_->priv_data, "tune", "zerolatency", 0);
-    av_dict_set(&param, "preset", "ultrafast", 0);
-    av_dict_set(&param, "profile", "baseline", 0);
+    ApplyEncProfile(h264_codec_ctx_, profile, &param); // 线程、slice、lookahead、B帧、preset和码率控制
     if (avcodec_open2(h264_codec_ctx_, h264_codec_, &param) < 0) {
         log_error("Failed to open encoder!");
+        av_dict_free(&param);
         avcodec_close(h264_codec_ctx_);
         avcodec_free_context(&h264_codec_ctx_);
         h264_codec_ = NULL;
         h264_codec_ctx_ = NULL;
         log_error("no decodec can be used");
-        exit(1);
+        return -1;
     }
-    log_info("using soft enc");
+    av_dict_free(&param);
+    log_info("using soft enc profile:{} thread_count:{}", (int)profile, h264_codec_ctx_->thread_count);
     return 1;
 }
-int HardVideoEncoder::Init(cv::Mat bgr_frame, int fps)
+int HardVideoEncoder::Init(cv::Mat bgr_frame, int fps, EncProfile profile)
 {
     if (!h264_codec_) {
-        if (HardEncInit(bgr_frame.cols, bgr_frame.rows, fps) < 0) {
-            SoftEncInit(bgr_frame.cols, bgr_frame.rows, fps);
+        if (HardEncInit(bgr_frame.cols, bgr_frame.rows, fps) < 0 && SoftEncInit(bgr_frame.cols, bgr_frame.rows, fps, profile) < 0) {
+            return -1; // 硬件和软件编码器都打开失败，由调用者结束这一路
         }
     }
     if (!sws_context_) {
@@ -180,18 +215,87 @@ int HardVideoEncoder::Init(cv::Mat bgr_frame, int fps)
     return 1;
 }
 
+AVFrame *HardVideoEncoder::GetYuvFrame()
+{
+    int width = h264_codec_ctx_->width;
+    int height = h264_codec_ctx_->height;
+    if (!yuv_pool_) { // Init之后编码的宽高和像素格式不再变化，内存池只需要创建一次
+        int size = av_image_get_buffer_size(sw_pix_format_, width, height, YUV_FRAME_ALIGN);
+        yuv_pool_ = av_buffer_pool_init(size, av_buffer_alloc);
+    }
+    AVFrame *yuv_frame = av_frame_alloc();
+    yuv_frame->width = width;
+    yuv_frame->height = height;
+    yuv_frame->format = sw_pix_format_;
+    // 图像内存由buf[0]引用计数管理，avcodec_send_frame只增加引用不拷贝，最后一个引用释放时回到池中
+    yuv_frame->buf[0] = av_buffer_pool_get(yuv_pool_);
+    if (yuv_frame->buf[0] == NULL) {
+        log_critical("Alloc image date buffer failed");
+        av_frame_free(&yuv_frame);
+        return NULL;
+    }
+    av_image_fill_arrays(yuv_frame->data, yuv_frame->linesize, yuv_frame->buf[0]->data, sw_pix_format_, width, height, YUV_FRAME_ALIGN);
+    return yuv_frame;
+}
+AVFrame *HardVideoEncoder::ConvertYuvFrame(const VideoFrame &frame)
+{
+    const AVFrame *src = frame.GetAVFrame();
+    int width = h264_codec_ctx_->width;
+    int height = h264_codec_ctx_->height;
+    if (src->format == sw_pix_format_ && src->width == width && src->height == height) {
+        // 格式和尺寸与编码器一致，只增加引用计数，不拷贝也不转换
+        AVFrame *yuv_frame = av_frame_clone(src);
+        if (yuv_frame) { // 解码器的帧类型不能带到编码器
+            yuv_frame->pict_type = AV_PICTURE_TYPE_NONE;
+            yuv_frame->key_frame = 0;
+        }
+        return yuv_frame;
+    }
+    // YUV->YUV只转换像素格式或尺寸，比经过BGR少一次转换
+    AVFrame *yuv_frame = GetYuvFrame();
+    if (yuv_frame == NULL) {
+        return NULL;
+    }
+    if (src->width == width && src->height == height) { // 尺寸不变时按条带并行转换
+        if (scaler_->Scale(src->data, src->linesize, (AVPixelFormat)src->format, yuv_frame->data, yuv_frame->linesize, sw_pix_format_, width, height) < 0) {
+            log_error("unsupported input pix_fmt:{}", src->format);
+            av_frame_free(&yuv_frame);
+        }
+        return yuv_frame;
+    }
+    yuv_sws_context_ = sws_getCachedContext(yuv_sws_context_, src->width, src->height, (AVPixelFormat)src->format, width, height, sw_pix_format_,
+                                            SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!yuv_sws_context_) {
+        log_error("unsupported input pix_fmt:{}", src->format);
+        av_frame_free(&yuv_frame);
+        return NULL;
+    }
+    sws_scale(yuv_sws_context_, src->data, src->linesize, 0, src->height, yuv_frame->data, yuv_frame->linesize);
+    return yuv_frame;
+}
 void *HardVideoEncoder::VideoScaleThread(void *arg)
 {
 
     HardVideoEncoder *self = (HardVideoEncoder *)arg;
     int last_width;
     long local_cnt = 0;
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->bgr_mutex_);
-        if (!self->bgr_frames_.empty()) {
-            cv::Mat bgr_frame = self->bgr_frames_.front();
-            self->bgr_frames_.pop_front();
-            guard.unlock();
+    while (1) {
+        EncInputFrame in_frame;
+        if (self->in_frames_.Pop(in_frame, -1)) {
+            if (!self->scaler_) {
+                self->scaler_ = new SliceScaler(self->scale_threads_);
+                self->scaler_->SetKernel(self->scale_kernel_, self->scale_matrix_);
+                log_debug("scale threads:{} kernel:{} matrix:{}", self->scaler_->ThreadCount(), self->scale_kernel_ == SCALE_KERNEL_SIMD ? SimdLevelName(DetectSimdLevel()) : "sws", ColorMatrixName(self->scale_matrix_));
+            }
+            if (!in_frame.yuv.Empty()) { // 解码器原生格式的图像，不经过BGR
+                AVFrame *yuv_frame = self->ConvertYuvFrame(in_frame.yuv);
+                if (yuv_frame != NULL) {
+                    yuv_frame->pts = in_frame.pts;
+                    self->yuv_frames_.Push(yuv_frame);
+                }
+                continue;
+            }
+            cv::Mat bgr_frame = in_frame.bgr;
             // 如果尺寸发生变化需要重新初始化
             if (local_cnt == 0) {
                 last_width = self->h264_codec_ctx_->width;
@@ -213,40 +317,25 @@ void *HardVideoEncoder::VideoScaleThread(void *arg)
             av_image_fill_arrays(mat_frame.data, mat_frame.linesize, bgr_frame.data, 
                                 (AVPixelFormat)mat_frame.format, mat_frame.width, mat_frame.height, 1);
 
-            AVFrame *yuv_frame = av_frame_alloc();
-            yuv_frame->width = self->h264_codec_ctx_->width;
-            yuv_frame->height = self->h264_codec_ctx_->height;
-            yuv_frame->format = self->sw_pix_format_;
-            // av_image_alloc()函数的功能是按照指定的宽、高、像素格式来分析图像内存。
-            int tmpRet = av_image_alloc(yuv_frame->data, yuv_frame->linesize, yuv_frame->width, yuv_frame->height, self->sw_pix_format_, 1);
-            if (tmpRet < 0) {
-                log_critical("Alloc image date buffer failed");
+            AVFrame *yuv_frame = self->GetYuvFrame();
+            if (yuv_frame == NULL) {
+                continue;
             }
 
-            sws_scale(self->sws_context_, mat_frame.data, mat_frame.linesize, 0, mat_frame.height,
-                      yuv_frame->data, yuv_frame->linesize);
-            std::unique_lock<std::mutex> guard(self->yuv_mutex_);
-#ifdef DROP_FRAME
-			// 丢帧处理
-            if (self->yuv_frames_.size() > 5) {
-                for (std::list<AVFrame *>::iterator it = self->yuv_frames_.begin();
-                     it != self->yuv_frames_.end(); ++it) {
-                    AVFrame *frame = *it;
-                    av_freep(&frame->data[0]);
-                    av_frame_free(&frame);
-                }
-                self->yuv_frames_.clear();
+            if (mat_frame.width == self->h264_codec_ctx_->width && mat_frame.height == self->h264_codec_ctx_->height) { // 尺寸不变时按条带并行转换
+                self->scaler_->Scale(mat_frame.data, mat_frame.linesize, AV_PIX_FMT_BGR24, yuv_frame->data, yuv_frame->linesize, self->sw_pix_format_,
+                                     mat_frame.width, mat_frame.height);
+            } else {
+                sws_scale(self->sws_context_, mat_frame.data, mat_frame.linesize, 0, mat_frame.height,
+                          yuv_frame->data, yuv_frame->linesize);
             }
-#endif
-            self->yuv_frames_.push_back(yuv_frame);
-            guard.unlock();
-            self->yuv_cond_.notify_one();
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->bgr_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
+            yuv_frame->pts = in_frame.pts;
+            self->yuv_frames_.Push(yuv_frame);
+        } else { // 队列已经关闭并且剩余的图像已经转换完
+            break;
         }
     }
+    self->yuv_frames_.Close();
     log_info("VideoScaleThread exit");
     return NULL;
 }
@@ -255,24 +344,22 @@ void *HardVideoEncoder::VideoEncThread(void *arg)
 {
     HardVideoEncoder *self = (HardVideoEncoder *)arg;
     int ret = 0;
-    while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->yuv_mutex_);
-        if (!self->yuv_frames_.empty()) {
-            AVFrame *yuv_frame = self->yuv_frames_.front();
-            self->yuv_frames_.pop_front();
-            guard.unlock();
+    while (1) {
+        AVFrame *yuv_frame = NULL;
+        if (self->yuv_frames_.Pop(yuv_frame, -1)) {
+            StageTimer timer(self->metrics_);
 
+            self->timestamps_.Put(self->nframe_counter_, yuv_frame->pts); // 转换线程把源时间戳放在pts中
+            yuv_frame->pts = self->nframe_counter_; // lookahead和B帧需要递增的pts，必须在send之前设置
             ret = avcodec_send_frame(self->h264_codec_ctx_, yuv_frame);
             if (ret < 0) {
                 log_error("Error sending a frame for encoding");
-                av_freep(&yuv_frame->data[0]);
                 av_frame_free(&yuv_frame);
                 continue;
             }
             AVPacket *packet = av_packet_alloc();
             packet->data = NULL;
             packet->size = 0;
-            yuv_frame->pts = self->nframe_counter_;
             self->nframe_counter_++;
             if (self->nframe_counter_ % self->h264_codec_ctx_->gop_size == 0) {
                 yuv_frame->key_frame = 1;
@@ -286,32 +373,25 @@ void *HardVideoEncoder::VideoEncThread(void *arg)
                     log_error("Error during encoding");
                     break;
                 }
-                self->time_now_ = std::chrono::steady_clock::now();
-                if (self->nframe_counter_ - 1 == 0) {
-                    self->time_pre_ = self->time_now_;
-                    self->time_ts_accum_ = 0;
-                }
                 // 编码后的数据sps pps也直接在packet->data里面,并且包含了起始码
                 packet->stream_index = 0;
-                packet->duration = std::chrono::duration_cast<std::chrono::milliseconds>(self->time_now_ - self->time_pre_).count();
-                self->time_ts_accum_ += packet->duration;
-                packet->pts = self->time_ts_accum_;
+                int64_t pts, dts;
+                self->timestamps_.Get(packet->pts, packet->dts, pts, dts); // 编码器输出包的pts/dts是输入图像的帧计数，换回源时间戳
                 if (self->callback_) {
-                    self->callback_->OnVideoEncData((unsigned char *)packet->data, packet->size, packet->pts);
+                    self->callback_->OnVideoEncData((unsigned char *)packet->data, packet->size, pts, dts);
                 }
                 av_packet_unref(packet);
-                self->time_pre_ = self->time_now_;
             }
-            av_freep(&yuv_frame->data[0]);
-            av_frame_free(&yuv_frame);
+            av_frame_free(&yuv_frame); // 编码器不再引用时内存回到池中
             av_packet_free(&packet);
-        } else {
-            auto now = std::chrono::system_clock::now();
-            self->yuv_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            guard.unlock();
-            continue;
+        } else { // 转换线程已经退出并且剩余的图像已经编码完
+            break;
         }
     }
+    if (self->h264_codec_ctx_ == NULL) { // Init失败，没有需要清空的数据
+        log_info("VideoEncThread exit");
+        return NULL;
+    }
     // 清空缓冲区 TODO 代码优化，这部分代码有点重复了
     ret = avcodec_send_frame(self->h264_codec_ctx_, NULL);
     AVPacket *packet = av_packet_alloc();
@@ -325,21 +405,14 @@ void *HardVideoEncoder::VideoEncThread(void *arg)
             log_error("Error during encoding");
             break;
         }
-        self->time_now_ = std::chrono::steady_clock::now();
-        if (self->nframe_counter_ - 1 == 0) {
-            self->time_pre_ = self->time_now_;
-            self->time_ts_accum_ = 0;
-        }
         // 编码后的数据sps pps也直接在packet->data里面,并且包含了起始码
         packet->stream_index = 0;
-        packet->duration = std::chrono::duration_cast<std::chrono::milliseconds>(self->time_now_ - self->time_pre_).count();
-        self->time_ts_accum_ += packet->duration;
-        packet->pts = self->time_ts_accum_;
+        int64_t pts, dts;
+        self->timestamps_.Get(packet->pts, packet->dts, pts, dts);
         if (self->callback_) {
-            self->callback_->OnVideoEncData((unsigned char *)packet->data, packet->size, packet->pts);
+            self->callback_->OnVideoEncData((unsigned char *)packet->data, packet->size, pts, dts);
         }
         av_packet_unref(packet);
-        self->time_pre_ = self->time_now_;
     }
     av_packet_free(&packet);
 
@@ -347,18 +420,26 @@ void *HardVideoEncoder::VideoEncThread(void *arg)
     return NULL;
 }
 
-int HardVideoEncoder::AddVideoFrame(cv::Mat bgr_frame)
+int HardVideoEncoder::AddVideoFrame(cv::Mat bgr_frame, int64_t pts)
 {
-    std::unique_lock<std::mutex> guard(bgr_mutex_);
-#ifdef DROP_FRAME
-	// 丢帧处理
-    if (bgr_frames_.size() > 5) {
-        bgr_frames_.clear();
+    EncInputFrame in_frame;
+    in_frame.bgr = bgr_frame;
+    in_frame.pts = pts;
+    return AddInputFrame(in_frame);
+}
+int HardVideoEncoder::AddVideoFrame(VideoFrame yuv_frame, int64_t pts)
+{
+    EncInputFrame in_frame;
+    in_frame.yuv = yuv_frame;
+    in_frame.pts = pts;
+    return AddInputFrame(in_frame);
+}
+int HardVideoEncoder::AddInputFrame(EncInputFrame in_frame)
+{
+    if (h264_codec_ctx_ == NULL) { // Init失败
+        return -1;
     }
-#endif
-    bgr_frames_.push_back(bgr_frame);
-    guard.unlock();
-    bgr_cond_.notify_one();
+    in_frames_.Push(in_frame); // 队列满了丢弃最旧的图像(DROP_FRAME)或者等待
     if (!time_inited_) {
         time_inited_ = 1;
         time_now_1_ = std::chrono::steady_clock::now();
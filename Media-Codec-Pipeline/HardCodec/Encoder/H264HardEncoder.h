@@ -2,12 +2,15 @@
 #define H264_HARD_ENC_H
 
 #include "DecEncInterface.h"
+#include "SliceScaler.h"
 #include <opencv2/opencv.hpp>
 #include <string.h>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <chrono>
 #include <list>
+#include <map>
 #include <condition_variable>
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -24,47 +27,182 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 #define DROP_FRAME
+// 编码模块队列的容量，输入队列定义了DROP_FRAME时满了丢弃最旧的图像，否则等待；内部队列满了总是等待
+#define ENC_QUEUE_SIZE 6
+// 编码输入YUV图像的对齐字节数，sws_scale按行对齐的内存处理更快
+#define YUV_FRAME_ALIGN 32
+// 编码输入队列中的图像，bgr和yuv只有一个有效
+struct EncInputFrame {
+    cv::Mat bgr;
+    VideoFrame yuv;
+    int64_t pts = AV_NOPTS_VALUE; // AddVideoFrame传入的源时间戳(微秒)
+};
+/**
+ * 编码器内部的帧计数到源时间戳的映射，编码器按帧计数编码(time_base为1/fps)，输出时换回源时间戳
+ * B帧重排序之后按输出包的pts找回这一帧的时间戳，dts取编码顺序上对应帧的时间戳，开头的负dts按帧间隔外推
+ * 输入没有时间戳时按帧计数和帧率生成，输出时间戳和处理速度无关
+ */
+class EncTimestamps
+{
+public:
+    void SetFrameRate(int fps)
+    {
+        frame_duration_ = AV_TIME_BASE / (fps > 0 ? fps : 25);
+    }
+    void Put(int64_t counter, int64_t pts)
+    {
+        if (pts == AV_NOPTS_VALUE) {
+            pts = counter * frame_duration_;
+        }
+        if (counter == 0) {
+            first_pts_ = pts;
+        }
+        pts_[counter] = pts;
+    }
+    // packet_pts/packet_dts是编码器输出包的帧计数，packet_dts为AV_NOPTS_VALUE时dts等于pts
+    void Get(int64_t packet_pts, int64_t packet_dts, int64_t &pts, int64_t &dts)
+    {
+        pts = Lookup(packet_pts);
+        dts = (packet_dts == AV_NOPTS_VALUE) ? pts : Lookup(packet_dts);
+        if (last_dts_ != AV_NOPTS_VALUE && dts <= last_dts_) { // 源时间戳有重复或者回退时保证dts递增
+            dts = last_dts_ + 1;
+        }
+        last_dts_ = dts;
+        // dts递增，帧计数小于dts的帧都已经输出，不会再被查询
+        int64_t done = (packet_dts == AV_NOPTS_VALUE) ? packet_pts + 1 : packet_dts;
+        pts_.erase(pts_.begin(), pts_.lower_bound(done));
+    }
+
+private:
+    int64_t Lookup(int64_t counter)
+    {
+        std::map<int64_t, int64_t>::iterator it = pts_.find(counter);
+        if (it != pts_.end()) {
+            return it->second;
+        }
+        int64_t base = (first_pts_ == AV_NOPTS_VALUE) ? 0 : first_pts_;
+        return base + counter * frame_duration_;
+    }
+
+private:
+    std::map<int64_t, int64_t> pts_;
+    int64_t frame_duration_ = AV_TIME_BASE / 25;
+    int64_t first_pts_ = AV_NOPTS_VALUE; // 帧计数0的时间戳，外推开头的负dts
+    int64_t last_dts_ = AV_NOPTS_VALUE;
+};
+// 编码性能配置，Init时传入；只对libx264软件编码生效，硬件编码器忽略
+enum EncProfile {
+    ENC_PROFILE_LOW_LATENCY,  // 实时流：不缓存帧，slice级多线程
+    ENC_PROFILE_BALANCED,     // 允许少量缓存帧，换取更好的压缩率
+    ENC_PROFILE_OFFLINE,      // 离线转码：帧级多线程、lookahead、B帧，吞吐量和压缩率优先
+};
+struct EncProfileParams {
+    int thread_count;    // 0表示由x264按CPU核数选择
+    int slices;          // 每帧的slice数，低延时模式下每个slice一个线程
+    int rc_lookahead;    // 码率控制向前看的帧数，每一帧都会增加编码延时
+    int max_b_frames;
+    const char *preset;
+    const char *tune;    // NULL不设置
+    const char *profile;
+    int bit_rate;        // crf为0时使用平均码率
+    int crf;             // 大于0时使用CRF码率控制
+    bool low_delay;      // AV_CODEC_FLAG_LOW_DELAY
+};
+static inline EncProfileParams GetEncProfileParams(EncProfile profile)
+{
+    switch (profile) {
+    case ENC_PROFILE_BALANCED: {
+        EncProfileParams params = {0, 1, 10, 2, "veryfast", NULL, "main", 4000000, 0, false};
+        return params;
+    }
+    case ENC_PROFILE_OFFLINE: {
+        EncProfileParams params = {0, 1, 40, 3, "medium", NULL, "high", 0, 23, false};
+        return params;
+    }
+    case ENC_PROFILE_LOW_LATENCY:
+    default: {
+        EncProfileParams params = {4, 4, 0, 0, "ultrafast", "zerolatency", "baseline", 4000000, 0, true};
+        return params;
+    }
+    }
+}
+// 在avcodec_open2之前调用，preset和profile放到param中
+static inline void ApplyEncProfile(AVCodecContext *ctx, EncProfile profile, AVDictionary **param)
+{
+    EncProfileParams params = GetEncProfileParams(profile);
+    ctx->thread_count = params.thread_count;
+    ctx->slices = params.slices; // int slice_count; // slice数 int slices; // 切片数量。 表示图片细分的数量。 用于并行解码。
+    ctx->max_b_frames = params.max_b_frames;
+    if (params.low_delay) {
+        ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+    // priv_data  属于每个编码器特有的设置域，用av_opt_set 设置
+    av_opt_set(ctx->priv_data, "preset", params.preset, 0);
+    if (params.tune) {
+        av_opt_set(ctx->priv_data, "tune", params.tune, 0);
+    }
+    av_opt_set_int(ctx->priv_data, "rc-lookahead", params.rc_lookahead, 0);
+    if (params.crf > 0) {
+        ctx->bit_rate = 0;
+        av_opt_set_double(ctx->priv_data, "crf", params.crf, 0);
+    } else {
+        ctx->bit_rate = params.bit_rate;
+    }
+    av_dict_set(param, "preset", params.preset, 0);
+    av_dict_set(param, "profile", params.profile, 0);
+    return;
+}
 #ifdef USE_FFMPEG_NVIDIA
 class HardVideoEncoder
 {
 public:
     HardVideoEncoder();
     ~HardVideoEncoder();
-    int AddVideoFrame(cv::Mat bgr_frame);
-    int Init(cv::Mat init_frame, int fps);
+    int AddVideoFrame(cv::Mat bgr_frame, int64_t pts = AV_NOPTS_VALUE); // pts是源时间戳(微秒)，编码后通过OnVideoEncData输出
+    int AddVideoFrame(VideoFrame yuv_frame, int64_t pts = AV_NOPTS_VALUE); // 解码器原生格式的图像，格式和尺寸一致时不做转换
+    int Init(cv::Mat init_frame, int fps, EncProfile profile = ENC_PROFILE_LOW_LATENCY); // 失败返回-1
     void SetDataCallback(EncDataCallListner *call_func);
+    void SetOfflineMode(bool offline); // 离线模式：不丢帧，队列满了阻塞AddVideoFrame
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和编码耗时；在输入图像之前调用
+    void SetScaleThreads(int thread_count); // BGR->YUV转换的线程数，小于等于0时自动选择；在输入图像之前调用
+    void SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix = COLOR_MATRIX_BT601); // BGR->YUV转换的实现；在输入图像之前调用
 
 private:
     int HardEncInit(int width, int height, int fps);
-    int SoftEncInit(int width, int height, int fps);
+    int SoftEncInit(int width, int height, int fps, EncProfile profile);
     static void *VideoScaleThread(void *arg);
     static void *VideoEncThread(void *arg);
+    AVFrame *GetYuvFrame();
+    AVFrame *ConvertYuvFrame(const VideoFrame &frame);
+    int AddInputFrame(EncInputFrame in_frame);
 
 private:
     EncDataCallListner *callback_ = NULL;
     AVCodecContext *h264_codec_ctx_ = NULL;
     AVCodec *h264_codec_ = NULL;
     SwsContext *sws_context_ = NULL;
+    SwsContext *yuv_sws_context_ = NULL; // VideoFrame输入的尺寸和编码器不一致时使用
+    SliceScaler *scaler_ = NULL;         // 尺寸不变时按条带并行转换，转换线程中创建
+    int scale_threads_ = 0;
+    ScaleKernel scale_kernel_ = SCALE_KERNEL_SWS;
+    ColorMatrix scale_matrix_ = COLOR_MATRIX_BT601;
     enum AVPixelFormat sw_pix_format_ = AV_PIX_FMT_YUV420P;
     // hard enc
     enum AVHWDeviceType type_ = AV_HWDEVICE_TYPE_NONE;
     bool is_hard_enc_ = false;
     enum AVCodecID decodec_id_;
 
-    std::list<cv::Mat> bgr_frames_;
-    std::list<AVFrame *> yuv_frames_;
-    std::mutex bgr_mutex_;
-    std::condition_variable bgr_cond_;
-    std::mutex yuv_mutex_;
-    std::condition_variable yuv_cond_;
+    BoundedQueue<EncInputFrame> in_frames_;
+    StageMetrics *metrics_ = NULL;
+    SpscRing<AVFrame *> yuv_frames_; // 转换线程把源时间戳放在pts中，编码线程取出后改成帧计数
+    AVBufferPool *yuv_pool_ = NULL; // 转换后YUV图像的内存池，按编码宽高和像素格式分配
+    EncTimestamps timestamps_; // 只在编码线程中访问
     std::thread scale_id_;
     std::thread encode_id_;
 
-    bool abort_;
+    std::atomic<bool> abort_;
+    bool offline_ = false;
     uint64_t nframe_counter_;
-    std::chrono::steady_clock::time_point time_now_;
-    std::chrono::steady_clock::time_point time_pre_;
-    uint64_t time_ts_accum_;
 
     std::chrono::steady_clock::time_point time_now_1_;
     std::chrono::steady_clock::time_point time_pre_1_;
@@ -79,37 +217,47 @@ class HardVideoEncoder
 public:
     HardVideoEncoder();
     ~HardVideoEncoder();
-    int AddVideoFrame(cv::Mat bgr_frame);
-    int Init(cv::Mat init_frame, int fps);
+    int AddVideoFrame(cv::Mat bgr_frame, int64_t pts = AV_NOPTS_VALUE); // pts是源时间戳(微秒)，编码后通过OnVideoEncData输出
+    int AddVideoFrame(VideoFrame yuv_frame, int64_t pts = AV_NOPTS_VALUE); // 解码器原生格式的图像，格式和尺寸一致时不做转换
+    int Init(cv::Mat init_frame, int fps, EncProfile profile = ENC_PROFILE_LOW_LATENCY); // 失败返回-1
     void SetDataCallback(EncDataCallListner *call_func);
+    void SetOfflineMode(bool offline); // 离线模式：不丢帧，队列满了阻塞AddVideoFrame
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和编码耗时；在输入图像之前调用
+    void SetScaleThreads(int thread_count); // BGR->YUV转换的线程数，小于等于0时自动选择；在输入图像之前调用
+    void SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix = COLOR_MATRIX_BT601); // BGR->YUV转换的实现；在输入图像之前调用
 
 private:
-    int SoftEncInit(int width, int height, int fps);
+    int SoftEncInit(int width, int height, int fps, EncProfile profile);
     static void *VideoScaleThread(void *arg);
     static void *VideoEncThread(void *arg);
+    AVFrame *GetYuvFrame();
+    AVFrame *ConvertYuvFrame(const VideoFrame &frame);
+    int AddInputFrame(EncInputFrame in_frame);
 
 private:
     EncDataCallListner *callback_ = NULL;
     AVCodecContext *h264_codec_ctx_ = NULL;
     AVCodec *h264_codec_ = NULL;
     SwsContext *sws_context_ = NULL;
+    SwsContext *yuv_sws_context_ = NULL; // VideoFrame输入的尺寸和编码器不一致时使用
+    SliceScaler *scaler_ = NULL;         // 尺寸不变时按条带并行转换，转换线程中创建
+    int scale_threads_ = 0;
+    ScaleKernel scale_kernel_ = SCALE_KERNEL_SWS;
+    ColorMatrix scale_matrix_ = COLOR_MATRIX_BT601;
     enum AVPixelFormat sw_pix_format_ = AV_PIX_FMT_YUV420P;
     enum AVCodecID decodec_id_;
 
-    std::list<cv::Mat> bgr_frames_;
-    std::list<AVFrame *> yuv_frames_;
-    std::mutex bgr_mutex_;
-    std::condition_variable bgr_cond_;
-    std::mutex yuv_mutex_;
-    std::condition_variable yuv_cond_;
+    BoundedQueue<EncInputFrame> in_frames_;
+    StageMetrics *metrics_ = NULL;
+    SpscRing<AVFrame *> yuv_frames_; // 转换线程把源时间戳放在pts中，编码线程取出后改成帧计数
+    AVBufferPool *yuv_pool_ = NULL; // 转换后YUV图像的内存池，按编码宽高和像素格式分配
+    EncTimestamps timestamps_; // 只在编码线程中访问
     std::thread scale_id_;
     std::thread encode_id_;
 
-    bool abort_;
+    std::atomic<bool> abort_;
+    bool offline_ = false;
     uint64_t nframe_counter_;
-    std::chrono::steady_clock::time_point time_now_;
-    std::chrono::steady_clock::time_point time_pre_;
-    uint64_t time_ts_accum_;
 
     std::chrono::steady_clock::time_point time_now_1_;
     std::chrono::steady_clock::time_point time_pre_1_;
@@ -128,15 +276,22 @@ private:
 // w-Integer multiples of 16 
 // h-Integer multiples of 2
 void vencStreamOut(uint32_t channelId, void* buffer, void *arg);
+struct DvppYuvFrame {
+    void *addr = NULL; // 内存池中的YUV图像
+    int64_t pts = AV_NOPTS_VALUE;
+};
 class HardVideoEncoder
 {
 public:
     HardVideoEncoder();
     ~HardVideoEncoder();
-    int AddVideoFrame(cv::Mat bgr_frame);
+    int AddVideoFrame(cv::Mat bgr_frame, int64_t pts = AV_NOPTS_VALUE); // pts是源时间戳(微秒)，编码后通过OnVideoEncData输出
+    int AddVideoFrame(VideoFrame yuv_frame, int64_t pts = AV_NOPTS_VALUE); // 解码器原生格式的图像，格式和尺寸一致时不做转换
     void SetDevice(int device_id);
-    int Init(cv::Mat init_frame, int fps);
+    int Init(cv::Mat init_frame, int fps, EncProfile profile = ENC_PROFILE_LOW_LATENCY); // 失败返回-1
     void SetDataCallback(EncDataCallListner *call_func);
+    void SetOfflineMode(bool offline); // 离线模式：不丢帧，队列满了阻塞AddVideoFrame
+    void SetMetrics(StageMetrics *metrics); // 上报输入队列深度、丢弃个数和编码耗时；在输入图像之前调用
 
 private:
     friend void vencStreamOut(uint32_t channelId, void* buffer, void *arg);
@@ -149,13 +304,11 @@ private:
     int32_t device_id_ = 0;
     EncDataCallListner *callback_ = NULL;
 
-    std::list<cv::Mat> bgr_frames_;
-    std::list<void *> yuv_frames_;
-    std::mutex bgr_mutex_;
-    std::condition_variable bgr_cond_;
-    std::mutex yuv_mutex_;
-    std::condition_variable yuv_cond_;
-    bool abort_;
+    BoundedQueue<EncInputFrame> bgr_frames_;
+    StageMetrics *metrics_ = NULL;
+    SpscRing<DvppYuvFrame> yuv_frames_;
+    std::atomic<bool> abort_;
+    bool offline_ = false;
     std::thread scale_id_;
     std::thread encode_id_;
     // color convert
@@ -175,7 +328,7 @@ private:
     // color output
     hi_pixel_format out_format_ = HI_PIXEL_FORMAT_YUV_SEMIPLANAR_420;
     // color context
-    hi_vpc_chn channel_id_color_;
+    hi_vpc_chn channel_id_color_ = -1;
     hi_vpc_pic_info input_pic_;
     hi_vpc_pic_info output_pic_;
 
@@ -183,7 +336,7 @@ private:
     int32_t enc_channel_;
     int32_t codec_type_;
     int32_t bit_rate_ = 0;
-    IHWCODEC_HANDLE enc_handle_;
+    IHWCODEC_HANDLE enc_handle_ = NULL;
     VencParam enc_param_;
 
     unsigned char *image_ptr_ = NULL;
@@ -191,9 +344,8 @@ private:
 
     uint64_t nframe_counter_;
     uint64_t nframe_counter_recv_;
-    std::chrono::steady_clock::time_point time_now_;
-    std::chrono::steady_clock::time_point time_pre_;
-    uint64_t time_ts_accum_;
+    EncTimestamps timestamps_;
+    std::mutex timestamps_mutex_; // 编码线程送入，回调线程取出
 
     std::chrono::steady_clock::time_point time_now_1_;
     std::chrono::steady_clock::time_point time_pre_1_;
@@ -211,48 +363,63 @@ class HardVideoEncoder
 {
 public:
     virtual ~HardVideoEncoder() {}
-    virtual int AddVideoFrame(cv::Mat bgr_frame) = 0;
+    virtual int AddVideoFrame(cv::Mat bgr_frame, int64_t pts = AV_NOPTS_VALUE) = 0; // pts是源时间戳(微秒)，编码后通过OnVideoEncData输出
+    virtual int AddVideoFrame(VideoFrame yuv_frame, int64_t pts = AV_NOPTS_VALUE) = 0;
     virtual void SetDevice(int device_id) = 0;
-    virtual int Init(cv::Mat init_frame, int fps) = 0;
+    virtual int Init(cv::Mat init_frame, int fps, EncProfile profile = ENC_PROFILE_LOW_LATENCY) = 0; // 失败返回-1
     virtual void SetDataCallback(EncDataCallListner *call_func) = 0;
+    virtual void SetOfflineMode(bool offline) = 0; // 离线模式：不丢帧，队列满了阻塞AddVideoFrame
+    virtual void SetMetrics(StageMetrics *metrics) = 0; // 上报输入队列深度、丢弃个数和编码耗时；在输入图像之前调用
+    virtual void SetScaleThreads(int thread_count) = 0; // BGR->YUV转换的线程数，小于等于0时自动选择；在输入图像之前调用
+    virtual void SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix = COLOR_MATRIX_BT601) = 0; // BGR->YUV转换的实现；在输入图像之前调用
 };
 class NVSoftVideoEncoder: public HardVideoEncoder
 {
 public:
     NVSoftVideoEncoder();
     virtual ~NVSoftVideoEncoder();
-    int AddVideoFrame(cv::Mat bgr_frame) override;
+    int AddVideoFrame(cv::Mat bgr_frame, int64_t pts = AV_NOPTS_VALUE) override;
+    int AddVideoFrame(VideoFrame yuv_frame, int64_t pts = AV_NOPTS_VALUE) override;
     virtual void SetDevice(int device_id) override;
-    int Init(cv::Mat init_frame, int fps) override;
+    int Init(cv::Mat init_frame, int fps, EncProfile profile = ENC_PROFILE_LOW_LATENCY) override;
     void SetDataCallback(EncDataCallListner *call_func) override;
+    void SetOfflineMode(bool offline) override;
+    void SetMetrics(StageMetrics *metrics) override;
+    void SetScaleThreads(int thread_count) override;
+    void SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix = COLOR_MATRIX_BT601) override;
 
 private:
-    int SoftEncInit(int width, int height, int fps);
+    int SoftEncInit(int width, int height, int fps, EncProfile profile);
     static void *VideoScaleThread(void *arg);
     static void *VideoEncThread(void *arg);
+    AVFrame *GetYuvFrame();
+    AVFrame *ConvertYuvFrame(const VideoFrame &frame);
+    int AddInputFrame(EncInputFrame in_frame);
 
 private:
     EncDataCallListner *callback_ = NULL;
     AVCodecContext *h264_codec_ctx_ = NULL;
     AVCodec *h264_codec_ = NULL;
     SwsContext *sws_context_ = NULL;
+    SwsContext *yuv_sws_context_ = NULL; // VideoFrame输入的尺寸和编码器不一致时使用
+    SliceScaler *scaler_ = NULL;         // 尺寸不变时按条带并行转换，转换线程中创建
+    int scale_threads_ = 0;
+    ScaleKernel scale_kernel_ = SCALE_KERNEL_SWS;
+    ColorMatrix scale_matrix_ = COLOR_MATRIX_BT601;
     enum AVPixelFormat sw_pix_format_ = AV_PIX_FMT_YUV420P;
     enum AVCodecID decodec_id_;
 
-    std::list<cv::Mat> bgr_frames_;
-    std::list<AVFrame *> yuv_frames_;
-    std::mutex bgr_mutex_;
-    std::condition_variable bgr_cond_;
-    std::mutex yuv_mutex_;
-    std::condition_variable yuv_cond_;
+    BoundedQueue<EncInputFrame> in_frames_;
+    StageMetrics *metrics_ = NULL;
+    SpscRing<AVFrame *> yuv_frames_; // 转换线程把源时间戳放在pts中，编码线程取出后改成帧计数
+    AVBufferPool *yuv_pool_ = NULL; // 转换后YUV图像的内存池，按编码宽高和像素格式分配
+    EncTimestamps timestamps_; // 只在编码线程中访问
     std::thread scale_id_;
     std::thread encode_id_;
 
-    bool abort_;
+    std::atomic<bool> abort_;
+    bool offline_ = false;
     uint64_t nframe_counter_;
-    std::chrono::steady_clock::time_point time_now_;
-    std::chrono::steady_clock::time_point time_pre_;
-    uint64_t time_ts_accum_;
 
     std::chrono::steady_clock::time_point time_now_1_;
     std::chrono::steady_clock::time_point time_pre_1_;
@@ -265,10 +432,15 @@ class NVHardVideoEncoder: public HardVideoEncoder
 public:
     NVHardVideoEncoder();
     virtual ~NVHardVideoEncoder();
-    int AddVideoFrame(cv::Mat bgr_frame) override;
+    int AddVideoFrame(cv::Mat bgr_frame, int64_t pts = AV_NOPTS_VALUE) override;
+    int AddVideoFrame(VideoFrame yuv_frame, int64_t pts = AV_NOPTS_VALUE) override;
     void SetDevice(int device_id) override;
-    int Init(cv::Mat init_frame, int fps) override;
+    int Init(cv::Mat init_frame, int fps, EncProfile profile = ENC_PROFILE_LOW_LATENCY) override;
     void SetDataCallback(EncDataCallListner *call_func) override;
+    void SetOfflineMode(bool offline) override;
+    void SetMetrics(StageMetrics *metrics) override;
+    void SetScaleThreads(int thread_count) override;
+    void SetScaleKernel(ScaleKernel kernel, ColorMatrix matrix = COLOR_MATRIX_BT601) override;
 
 private:
     static void *VideoEncThread(void *arg);
@@ -276,9 +448,8 @@ private:
     int32_t device_id_ = 0;
     EncDataCallListner *callback_ = NULL;
 
-    std::list<cv::Mat> bgr_frames_;
-    std::mutex bgr_mutex_;
-    std::condition_variable bgr_cond_;
+    BoundedQueue<EncInputFrame> bgr_frames_;
+    StageMetrics *metrics_ = NULL;
 
     NvEncoderInitParam init_param_;
     NV_ENC_BUFFER_FORMAT eformat_;
@@ -286,7 +457,8 @@ private:
     void *ptr_image_bgra_device_ = NULL;
     NvEncoderCuda *enc_ = NULL;
     
-    bool abort_;
+    std::atomic<bool> abort_;
+    bool offline_ = false;
     std::thread encode_id_;
     
     int width_;
@@ -294,9 +466,8 @@ private:
     int fps_;
     
     uint64_t nframe_counter_;
-    std::chrono::steady_clock::time_point time_now_;
-    std::chrono::steady_clock::time_point time_pre_;
-    uint64_t time_ts_accum_;
+    uint64_t nframe_output_ = 0;
+    EncTimestamps timestamps_; // 只在编码线程中访问
 
     std::chrono::steady_clock::time_point time_now_1_;
     std::chrono::steady_clock::time_point time_pre_1_;
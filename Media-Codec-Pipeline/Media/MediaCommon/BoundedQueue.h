@@ -0,0 +1,225 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include "Metrics.h"
+
+// 队列满了之后的处理策略
+enum QueuePolicy {
+    QUEUE_BLOCK,       // 生产者等待，不丢数据
+    QUEUE_DROP_OLDEST, // 丢弃队列中最旧的数据，保证实时性
+    QUEUE_DROP_NEWEST, // 丢弃新放入的数据
+};
+
+/**
+ * 有界队列，模块之间传递数据使用
+ * 容量可以按个数(max_items)或者字节数(max_bytes)限制，0表示不限制；按字节限制时需要设置SizeFunc
+ * 被丢弃的数据和Clear时剩余的数据通过ReleaseFunc释放
+ * Close之后Push失败，Pop可以继续取出剩余的数据
+ * 绑定StageMetrics之后上报队列深度和丢弃个数
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    typedef std::function<void(T &)> ReleaseFunc;
+    typedef std::function<size_t(const T &)> SizeFunc;
+
+    BoundedQueue(size_t max_items = 0, QueuePolicy policy = QUEUE_BLOCK)
+    {
+        max_items_ = max_items;
+        policy_ = policy;
+    }
+    virtual ~BoundedQueue()
+    {
+        Clear();
+    }
+    void SetCapacity(size_t max_items, size_t max_bytes = 0)
+    {
+        std::unique_lock<std::mutex> guard(mutex_);
+        max_items_ = max_items;
+        max_bytes_ = max_bytes;
+        guard.unlock();
+        not_full_cond_.notify_all();
+        return;
+    }
+    void SetPolicy(QueuePolicy policy)
+    {
+        std::unique_lock<std::mutex> guard(mutex_);
+        policy_ = policy;
+        guard.unlock();
+        not_full_cond_.notify_all();
+        return;
+    }
+    void SetReleaseFunc(ReleaseFunc func) { release_func_ = func; }
+    void SetSizeFunc(SizeFunc func) { size_func_ = func; }
+    // metrics为NULL时解除绑定；指标对象的生命周期由调用者保证
+    void SetMetrics(StageMetrics *metrics)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        metrics_ = metrics;
+        if (metrics_) {
+            metrics_->QueueDepth(items_.size());
+        }
+        return;
+    }
+
+    // 返回false表示数据被丢弃，数据已经通过ReleaseFunc释放
+    bool Push(T item)
+    {
+        size_t item_bytes = size_func_ ? size_func_(item) : 0;
+        std::unique_lock<std::mutex> guard(mutex_);
+        while (!closed_ && IsFull(item_bytes)) {
+            if (policy_ == QUEUE_BLOCK) {
+                not_full_cond_.wait(guard);
+            } else if (policy_ == QUEUE_DROP_OLDEST) {
+                T oldest = items_.front();
+                items_.pop_front();
+                bytes_ -= size_func_ ? size_func_(oldest) : 0;
+                dropped_++;
+                if (metrics_) {
+                    metrics_->Drop();
+                }
+                Release(oldest); // 持有锁的情况下释放，ReleaseFunc里面不能再操作本队列
+            } else {
+                break;
+            }
+        }
+        if (closed_ || IsFull(item_bytes)) { // 已关闭或者QUEUE_DROP_NEWEST
+            dropped_++;
+            if (metrics_) {
+                metrics_->Drop();
+            }
+            guard.unlock();
+            Release(item);
+            return false;
+        }
+        items_.push_back(item);
+        bytes_ += item_bytes;
+        if (metrics_) {
+            metrics_->QueueDepth(items_.size());
+        }
+        guard.unlock();
+        not_empty_cond_.notify_one();
+        return true;
+    }
+    // 队列为空时最多等待timeout_ms毫秒，小于0一直等到有数据或者Close，没有取到数据返回false
+    bool Pop(T &item, int timeout_ms)
+    {
+        std::unique_lock<std::mutex> guard(mutex_);
+        if (timeout_ms < 0) {
+            not_empty_cond_.wait(guard, [this] { return !items_.empty() || closed_; });
+        } else if (items_.empty() && !closed_) {
+            not_empty_cond_.wait_for(guard, std::chrono::milliseconds(timeout_ms));
+        }
+        if (items_.empty()) {
+            return false;
+        }
+        item = items_.front();
+        items_.pop_front();
+        bytes_ -= size_func_ ? size_func_(item) : 0;
+        if (metrics_) {
+            metrics_->QueueDepth(items_.size());
+        }
+        guard.unlock();
+        not_full_cond_.notify_one();
+        return true;
+    }
+    // 唤醒所有等待的线程，之后不能再放入数据
+    void Close()
+    {
+        std::unique_lock<std::mutex> guard(mutex_);
+        closed_ = true;
+        guard.unlock();
+        not_empty_cond_.notify_all();
+        not_full_cond_.notify_all();
+        return;
+    }
+    // 释放队列中剩余的数据
+    void Clear()
+    {
+        std::unique_lock<std::mutex> guard(mutex_);
+        std::list<T> items;
+        items.swap(items_);
+        bytes_ = 0;
+        if (metrics_) {
+            metrics_->QueueDepth(0);
+        }
+        guard.unlock();
+        not_full_cond_.notify_all();
+        for (typename std::list<T>::iterator it = items.begin(); it != items.end(); ++it) {
+            Release(*it);
+        }
+        return;
+    }
+    size_t Size()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return items_.size();
+    }
+    bool Empty()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return items_.empty();
+    }
+    size_t Bytes()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return bytes_;
+    }
+    uint64_t DropCount()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return dropped_;
+    }
+    // 已经关闭并且剩余的数据已经取完，消费线程可以退出
+    bool IsFinished()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return closed_ && items_.empty();
+    }
+
+private:
+    // 队列为空时总是可以放入，避免单个数据超过max_bytes_时一直等待
+    bool IsFull(size_t item_bytes)
+    {
+        if (items_.empty()) {
+            return false;
+        }
+        if (max_items_ > 0 && items_.size() >= max_items_) {
+            return true;
+        }
+        if (max_bytes_ > 0 && bytes_ + item_bytes > max_bytes_) {
+            return true;
+        }
+        return false;
+    }
+    void Release(T &item)
+    {
+        if (release_func_) {
+            release_func_(item);
+        }
+        return;
+    }
+
+private:
+    std::list<T> items_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_cond_;
+    std::condition_variable not_full_cond_;
+    size_t max_items_ = 0;
+    size_t max_bytes_ = 0;
+    size_t bytes_ = 0;
+    QueuePolicy policy_ = QUEUE_BLOCK;
+    bool closed_ = false;
+    uint64_t dropped_ = 0;
+    ReleaseFunc release_func_;
+    SizeFunc size_func_;
+    StageMetrics *metrics_ = NULL;
+};
+#endif
@@ -0,0 +1,404 @@
+#include "ColorConvert.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLOR_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * 定点数系数，SIMD和C实现使用完全相同的整数运算
+ * YUV->BGR：Y按(Y-16)<<7、UV按(UV-128)<<8做mulhrs，结果都是6位小数
+ * BGR->YUV：8位小数，和libyuv/BT.601的常用整数公式一致
+ */
+struct YuvToBgrCoef {
+    int16_t y;
+    int16_t ub;
+    int16_t ug;
+    int16_t vg;
+    int16_t vr;
+};
+struct BgrToYuvCoef {
+    int16_t yb, yg, yr;
+    int16_t ub, ug, ur;
+    int16_t vb, vg, vr;
+};
+static const YuvToBgrCoef kYuvToBgr[2] = {
+    {19077, 16525, 3209, 6660, 13075}, // BT.601: 1.164 2.017 0.392 0.813 1.596
+    {19077, 17305, 1747, 4366, 14686}, // BT.709: 1.164 2.112 0.213 0.533 1.793
+};
+static const BgrToYuvCoef kBgrToYuv[2] = {
+    {25, 129, 66, 112, -74, -38, -18, -94, 112}, // BT.601
+    {16, 157, 47, 112, -86, -26, -10, -102, 112}, // BT.709
+};
+
+typedef void (*YuvToBgrRowFunc)(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *bgr, int width, const YuvToBgrCoef &c);
+typedef void (*BgrToYuvRowFunc)(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int uv_step, int width, const BgrToYuvCoef &c);
+
+static inline int MulHrs(int a, int b)
+{
+    return (a * b + 0x4000) >> 15; // 和_mm_mulhrs_epi16相同的舍入
+}
+static inline uint8_t Clamp255(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+// 从第x个像素开始转换一行，SIMD实现用它处理行尾
+static void YuvToBgrRowFrom_C(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *bgr, int x, int width, const YuvToBgrCoef &c)
+{
+    for (; x < width; x++) {
+        int ys = MulHrs((y[x] - 16) * 128, c.y) + 32;
+        int cu = (u[(x >> 1) * uv_step] - 128) * 256;
+        int cv = (v[(x >> 1) * uv_step] - 128) * 256;
+        bgr[3 * x] = Clamp255((ys + MulHrs(cu, c.ub)) >> 6);
+        bgr[3 * x + 1] = Clamp255((ys - (MulHrs(cu, c.ug) + MulHrs(cv, c.vg))) >> 6);
+        bgr[3 * x + 2] = Clamp255((ys + MulHrs(cv, c.vr)) >> 6);
+    }
+    return;
+}
+static void YuvToBgrRow_C(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *bgr, int width, const YuvToBgrCoef &c)
+{
+    YuvToBgrRowFrom_C(y, u, v, uv_step, bgr, 0, width, c);
+    return;
+}
+static inline uint8_t BgrToY(const uint8_t *p, const BgrToYuvCoef &c)
+{
+    return (uint8_t)(((c.yb * p[0] + c.yg * p[1] + c.yr * p[2] + 128) >> 8) + 16);
+}
+// 两行BGR转换成两行Y和一行UV，y1为NULL时只有一行(奇数高度的最后一行)，bgr1此时和bgr0相同
+static void BgrToYuvRowFrom_C(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int uv_step, int x, int width, const BgrToYuvCoef &c)
+{
+    for (; x < width; x += 2) {
+        int x1 = x + 1 < width ? x + 1 : x;
+        const uint8_t *p00 = bgr0 + 3 * x;
+        const uint8_t *p01 = bgr0 + 3 * x1;
+        const uint8_t *p10 = bgr1 + 3 * x;
+        const uint8_t *p11 = bgr1 + 3 * x1;
+        y0[x] = BgrToY(p00, c);
+        if (x1 != x) {
+            y0[x1] = BgrToY(p01, c);
+        }
+        if (y1) {
+            y1[x] = BgrToY(p10, c);
+            if (x1 != x) {
+                y1[x1] = BgrToY(p11, c);
+            }
+        }
+        int b = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+        int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+        int r = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+        u[(x >> 1) * uv_step] = (uint8_t)(((c.ub * b + c.ug * g + c.ur * r + 128) >> 8) + 128);
+        v[(x >> 1) * uv_step] = (uint8_t)(((c.vb * b + c.vg * g + c.vr * r + 128) >> 8) + 128);
+    }
+    return;
+}
+static void BgrToYuvRow_C(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int uv_step, int width, const BgrToYuvCoef &c)
+{
+    BgrToYuvRowFrom_C(bgr0, bgr1, y0, y1, u, v, uv_step, 0, width, c);
+    return;
+}
+
+#ifdef COLOR_CONVERT_X86
+// BGR24和三个平面之间交织/解交织的pshufb表，-1的位置输出0
+alignas(16) static const int8_t kBgrSplit[3][3][16] = {
+    {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+    {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+    {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}},
+};
+alignas(16) static const int8_t kBgrMerge[3][3][16] = {
+    {{0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5},
+     {-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1},
+     {-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1}},
+    {{-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1},
+     {5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10},
+     {-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1}},
+    {{-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1},
+     {-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1},
+     {10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15}},
+};
+// NV12的UV交织数据展开成每个像素一个U/V
+alignas(16) static const int8_t kNv12DupU[16] = {0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14};
+alignas(16) static const int8_t kNv12DupV[16] = {1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15};
+
+__attribute__((target("sse4.1"))) static inline __m128i LoadMask(const int8_t *mask)
+{
+    return _mm_load_si128((const __m128i *)mask);
+}
+// 16个像素的B、G、R平面写成48字节BGR24
+__attribute__((target("sse4.1"))) static inline void StoreBgr16(uint8_t *dst, __m128i b, __m128i g, __m128i r)
+{
+    for (int n = 0; n < 3; n++) {
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, LoadMask(kBgrMerge[n][0])), _mm_shuffle_epi8(g, LoadMask(kBgrMerge[n][1]))),
+                                   _mm_shuffle_epi8(r, LoadMask(kBgrMerge[n][2])));
+        _mm_storeu_si128((__m128i *)(dst + 16 * n), out);
+    }
+    return;
+}
+// 48字节BGR24拆成16个像素的B、G、R平面
+__attribute__((target("sse4.1"))) static inline void LoadBgr16(const uint8_t *src, __m128i *b, __m128i *g, __m128i *r)
+{
+    __m128i in0 = _mm_loadu_si128((const __m128i *)src);
+    __m128i in1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i in2 = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i *out[3] = {b, g, r};
+    for (int k = 0; k < 3; k++) {
+        *out[k] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, LoadMask(kBgrSplit[k][0])), _mm_shuffle_epi8(in1, LoadMask(kBgrSplit[k][1]))),
+                               _mm_shuffle_epi8(in2, LoadMask(kBgrSplit[k][2])));
+    }
+    return;
+}
+// 读取16个像素对应的U、V，每个像素一个字节
+__attribute__((target("sse4.1"))) static inline void LoadUv16(const uint8_t *u, const uint8_t *v, int uv_step, int x, __m128i *u8, __m128i *v8)
+{
+    if (uv_step == 2) {
+        __m128i uv = _mm_loadu_si128((const __m128i *)(u + x));
+        *u8 = _mm_shuffle_epi8(uv, LoadMask(kNv12DupU));
+        *v8 = _mm_shuffle_epi8(uv, LoadMask(kNv12DupV));
+    } else {
+        __m128i us = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+        __m128i vs = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+        *u8 = _mm_unpacklo_epi8(us, us);
+        *v8 = _mm_unpacklo_epi8(vs, vs);
+    }
+    return;
+}
+// 两行的2x2块求平均后计算8个U和8个V
+__attribute__((target("sse4.1"))) static inline void StoreUv16(__m128i b0, __m128i g0, __m128i r0, __m128i b1, __m128i g1, __m128i r1,
+                                                               uint8_t *u, uint8_t *v, int uv_step, int x, const BgrToYuvCoef &c)
+{
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i k2 = _mm_set1_epi16(2);
+    const __m128i k128 = _mm_set1_epi16(128);
+    __m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_maddubs_epi16(b0, ones), _mm_maddubs_epi16(b1, ones)), k2), 2);
+    __m128i g = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_maddubs_epi16(g0, ones), _mm_maddubs_epi16(g1, ones)), k2), 2);
+    __m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_maddubs_epi16(r0, ones), _mm_maddubs_epi16(r1, ones)), k2), 2);
+    __m128i cu = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(c.ub)), _mm_mullo_epi16(g, _mm_set1_epi16(c.ug))),
+                               _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(c.ur)), k128));
+    __m128i cv = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(c.vb)), _mm_mullo_epi16(g, _mm_set1_epi16(c.vg))),
+                               _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(c.vr)), k128));
+    cu = _mm_add_epi16(_mm_srai_epi16(cu, 8), k128);
+    cv = _mm_add_epi16(_mm_srai_epi16(cv, 8), k128);
+    __m128i u8 = _mm_packus_epi16(cu, cu);
+    __m128i v8 = _mm_packus_epi16(cv, cv);
+    if (uv_step == 2) {
+        _mm_storeu_si128((__m128i *)(u + x), _mm_unpacklo_epi8(u8, v8));
+    } else {
+        _mm_storel_epi64((__m128i *)(u + x / 2), u8);
+        _mm_storel_epi64((__m128i *)(v + x / 2), v8);
+    }
+    return;
+}
+
+// 8个像素，16位定点
+__attribute__((target("sse4.1"))) static inline void YuvToBgr8_SSE4(__m128i y, __m128i u, __m128i v, const YuvToBgrCoef &c, __m128i *b, __m128i *g, __m128i *r)
+{
+    __m128i ys = _mm_add_epi16(_mm_mulhrs_epi16(_mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), 7), _mm_set1_epi16(c.y)), _mm_set1_epi16(32));
+    __m128i cu = _mm_slli_epi16(_mm_sub_epi16(u, _mm_set1_epi16(128)), 8);
+    __m128i cv = _mm_slli_epi16(_mm_sub_epi16(v, _mm_set1_epi16(128)), 8);
+    *b = _mm_srai_epi16(_mm_adds_epi16(ys, _mm_mulhrs_epi16(cu, _mm_set1_epi16(c.ub))), 6);
+    *g = _mm_srai_epi16(_mm_subs_epi16(ys, _mm_add_epi16(_mm_mulhrs_epi16(cu, _mm_set1_epi16(c.ug)), _mm_mulhrs_epi16(cv, _mm_set1_epi16(c.vg)))), 6);
+    *r = _mm_srai_epi16(_mm_adds_epi16(ys, _mm_mulhrs_epi16(cv, _mm_set1_epi16(c.vr))), 6);
+    return;
+}
+__attribute__((target("sse4.1"))) static void YuvToBgrRow_SSE4(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *bgr, int width, const YuvToBgrCoef &c)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i u8, v8;
+        LoadUv16(u, v, uv_step, x, &u8, &v8);
+        __m128i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+        YuvToBgr8_SSE4(_mm_cvtepu8_epi16(y8), _mm_cvtepu8_epi16(u8), _mm_cvtepu8_epi16(v8), c, &b_lo, &g_lo, &r_lo);
+        YuvToBgr8_SSE4(_mm_unpackhi_epi8(y8, zero), _mm_unpackhi_epi8(u8, zero), _mm_unpackhi_epi8(v8, zero), c, &b_hi, &g_hi, &r_hi);
+        StoreBgr16(bgr + 3 * x, _mm_packus_epi16(b_lo, b_hi), _mm_packus_epi16(g_lo, g_hi), _mm_packus_epi16(r_lo, r_hi));
+    }
+    YuvToBgrRowFrom_C(y, u, v, uv_step, bgr, x, width, c);
+    return;
+}
+__attribute__((target("sse4.1"))) static inline __m128i BgrToY8_SSE4(__m128i b, __m128i g, __m128i r, const BgrToYuvCoef &c)
+{
+    // 乘积之和最大56228，按无符号16位计算不会溢出
+    __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(c.yb)), _mm_mullo_epi16(g, _mm_set1_epi16(c.yg))),
+                                _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(c.yr)), _mm_set1_epi16(128)));
+    return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+__attribute__((target("sse4.1"))) static inline void StoreY16_SSE4(uint8_t *dst, __m128i b, __m128i g, __m128i r, const BgrToYuvCoef &c)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = BgrToY8_SSE4(_mm_cvtepu8_epi16(b), _mm_cvtepu8_epi16(g), _mm_cvtepu8_epi16(r), c);
+    __m128i hi = BgrToY8_SSE4(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(r, zero), c);
+    _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+    return;
+}
+__attribute__((target("sse4.1"))) static void BgrToYuvRow_SSE4(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int uv_step, int width, const BgrToYuvCoef &c)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i b0, g0, r0, b1, g1, r1;
+        LoadBgr16(bgr0 + 3 * x, &b0, &g0, &r0);
+        LoadBgr16(bgr1 + 3 * x, &b1, &g1, &r1);
+        StoreY16_SSE4(y0 + x, b0, g0, r0, c);
+        if (y1) {
+            StoreY16_SSE4(y1 + x, b1, g1, r1, c);
+        }
+        StoreUv16(b0, g0, r0, b1, g1, r1, u, v, uv_step, x, c);
+    }
+    BgrToYuvRowFrom_C(bgr0, bgr1, y0, y1, u, v, uv_step, x, width, c);
+    return;
+}
+
+// AVX2一次算16个像素的16位定点，BGR24交织仍然用128位的pshufb
+__attribute__((target("avx2"))) static inline __m128i PackU8_AVX2(__m256i v)
+{
+    return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+__attribute__((target("avx2"))) static void YuvToBgrRow_AVX2(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *bgr, int width, const YuvToBgrCoef &c)
+{
+    const __m256i k16 = _mm256_set1_epi16(16);
+    const __m256i k32 = _mm256_set1_epi16(32);
+    const __m256i k128 = _mm256_set1_epi16(128);
+    const __m256i cy = _mm256_set1_epi16(c.y);
+    const __m256i cub = _mm256_set1_epi16(c.ub);
+    const __m256i cug = _mm256_set1_epi16(c.ug);
+    const __m256i cvg = _mm256_set1_epi16(c.vg);
+    const __m256i cvr = _mm256_set1_epi16(c.vr);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i u8, v8;
+        LoadUv16(u, v, uv_step, x, &u8, &v8);
+        __m256i ys = _mm256_add_epi16(_mm256_mulhrs_epi16(_mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(y8), k16), 7), cy), k32);
+        __m256i cu = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(u8), k128), 8);
+        __m256i cv = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(v8), k128), 8);
+        __m256i b = _mm256_srai_epi16(_mm256_adds_epi16(ys, _mm256_mulhrs_epi16(cu, cub)), 6);
+        __m256i g = _mm256_srai_epi16(_mm256_subs_epi16(ys, _mm256_add_epi16(_mm256_mulhrs_epi16(cu, cug), _mm256_mulhrs_epi16(cv, cvg))), 6);
+        __m256i r = _mm256_srai_epi16(_mm256_adds_epi16(ys, _mm256_mulhrs_epi16(cv, cvr)), 6);
+        StoreBgr16(bgr + 3 * x, PackU8_AVX2(b), PackU8_AVX2(g), PackU8_AVX2(r));
+    }
+    YuvToBgrRowFrom_C(y, u, v, uv_step, bgr, x, width, c);
+    return;
+}
+__attribute__((target("avx2"))) static inline void StoreY16_AVX2(uint8_t *dst, __m128i b, __m128i g, __m128i r, const BgrToYuvCoef &c)
+{
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(b), _mm256_set1_epi16(c.yb)),
+                                                    _mm256_mullo_epi16(_mm256_cvtepu8_epi16(g), _mm256_set1_epi16(c.yg))),
+                                   _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(r), _mm256_set1_epi16(c.yr)), _mm256_set1_epi16(128)));
+    __m256i y = _mm256_add_epi16(_mm256_srli_epi16(sum, 8), _mm256_set1_epi16(16));
+    _mm_storeu_si128((__m128i *)dst, PackU8_AVX2(y));
+    return;
+}
+__attribute__((target("avx2"))) static void BgrToYuvRow_AVX2(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int uv_step, int width, const BgrToYuvCoef &c)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i b0, g0, r0, b1, g1, r1;
+        LoadBgr16(bgr0 + 3 * x, &b0, &g0, &r0);
+        LoadBgr16(bgr1 + 3 * x, &b1, &g1, &r1);
+        StoreY16_AVX2(y0 + x, b0, g0, r0, c);
+        if (y1) {
+            StoreY16_AVX2(y1 + x, b1, g1, r1, c);
+        }
+        StoreUv16(b0, g0, r0, b1, g1, r1, u, v, uv_step, x, c);
+    }
+    BgrToYuvRowFrom_C(bgr0, bgr1, y0, y1, u, v, uv_step, x, width, c);
+    return;
+}
+#endif
+
+static SimdLevel DetectSimdLevelOnce()
+{
+#ifdef COLOR_CONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_LEVEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SIMD_LEVEL_SSE4;
+    }
+#endif
+    return SIMD_LEVEL_SCALAR;
+}
+SimdLevel DetectSimdLevel()
+{
+    static SimdLevel level = DetectSimdLevelOnce();
+    return level;
+}
+const char *SimdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SIMD_LEVEL_AVX2:
+        return "avx2";
+    case SIMD_LEVEL_SSE4:
+        return "sse4";
+    default:
+        return "scalar";
+    }
+}
+const char *ColorMatrixName(ColorMatrix matrix)
+{
+    return matrix == COLOR_MATRIX_BT709 ? "bt709" : "bt601";
+}
+bool SimdConvertSupported(AVPixelFormat src_fmt, AVPixelFormat dst_fmt)
+{
+    if (dst_fmt == AV_PIX_FMT_BGR24) {
+        return src_fmt == AV_PIX_FMT_NV12 || src_fmt == AV_PIX_FMT_YUV420P;
+    }
+    if (src_fmt == AV_PIX_FMT_BGR24) {
+        return dst_fmt == AV_PIX_FMT_NV12 || dst_fmt == AV_PIX_FMT_YUV420P;
+    }
+    return false;
+}
+int SimdConvert(const uint8_t *const src[], const int src_stride[], AVPixelFormat src_fmt,
+                uint8_t *const dst[], const int dst_stride[], AVPixelFormat dst_fmt, int width, int height,
+                ColorMatrix matrix, SimdLevel level)
+{
+    if (!SimdConvertSupported(src_fmt, dst_fmt) || width <= 0 || height <= 0) {
+        return -1;
+    }
+    if (level > DetectSimdLevel()) {
+        level = DetectSimdLevel();
+    }
+    int m = matrix == COLOR_MATRIX_BT709 ? 1 : 0;
+    if (dst_fmt == AV_PIX_FMT_BGR24) {
+        YuvToBgrRowFunc row = YuvToBgrRow_C;
+#ifdef COLOR_CONVERT_X86
+        if (level == SIMD_LEVEL_AVX2) {
+            row = YuvToBgrRow_AVX2;
+        } else if (level == SIMD_LEVEL_SSE4) {
+            row = YuvToBgrRow_SSE4;
+        }
+#endif
+        bool nv12 = src_fmt == AV_PIX_FMT_NV12;
+        for (int i = 0; i < height; i++) {
+            const uint8_t *u = src[1] + (i >> 1) * src_stride[1];
+            const uint8_t *v = nv12 ? u + 1 : src[2] + (i >> 1) * src_stride[2];
+            row(src[0] + i * src_stride[0], u, v, nv12 ? 2 : 1, dst[0] + i * dst_stride[0], width, kYuvToBgr[m]);
+        }
+    } else {
+        BgrToYuvRowFunc row = BgrToYuvRow_C;
+#ifdef COLOR_CONVERT_X86
+        if (level == SIMD_LEVEL_AVX2) {
+            row = BgrToYuvRow_AVX2;
+        } else if (level == SIMD_LEVEL_SSE4) {
+            row = BgrToYuvRow_SSE4;
+        }
+#endif
+        bool nv12 = dst_fmt == AV_PIX_FMT_NV12;
+        for (int i = 0; i < height; i += 2) {
+            bool pair = i + 1 < height;
+            const uint8_t *bgr0 = src[0] + i * src_stride[0];
+            const uint8_t *bgr1 = pair ? bgr0 + src_stride[0] : bgr0;
+            uint8_t *y0 = dst[0] + i * dst_stride[0];
+            uint8_t *y1 = pair ? y0 + dst_stride[0] : NULL;
+            uint8_t *u = dst[1] + (i >> 1) * dst_stride[1];
+            uint8_t *v = nv12 ? u + 1 : dst[2] + (i >> 1) * dst_stride[2];
+            row(bgr0, bgr1, y0, y1, u, v, nv12 ? 2 : 1, width, kBgrToYuv[m]);
+        }
+    }
+    return 0;
+}
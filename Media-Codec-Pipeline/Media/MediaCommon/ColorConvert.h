@@ -0,0 +1,40 @@
+#ifndef COLOR_CONVERT_H
+#define COLOR_CONVERT_H
+#include <stdint.h>
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+// 宽高不变的颜色转换使用的实现
+enum ScaleKernel {
+    SCALE_KERNEL_SWS = 0, // libswscale
+    SCALE_KERNEL_SIMD,    // 手写的SIMD转换，格式不支持时退回libswscale
+};
+// YUV和RGB之间的转换矩阵，YUV都是16-235的tv range
+enum ColorMatrix {
+    COLOR_MATRIX_BT601 = 0, // 标清，libswscale的默认值
+    COLOR_MATRIX_BT709,     // 高清
+};
+enum SimdLevel {
+    SIMD_LEVEL_SCALAR = 0,
+    SIMD_LEVEL_SSE4,
+    SIMD_LEVEL_AVX2,
+};
+
+// 当前CPU支持的最高指令集，非x86平台返回SIMD_LEVEL_SCALAR
+SimdLevel DetectSimdLevel();
+const char *SimdLevelName(SimdLevel level);
+const char *ColorMatrixName(ColorMatrix matrix);
+/**
+ * 支持的转换：NV12/YUV420P -> BGR24, BGR24 -> YUV420P/NV12
+ * 色度下采样取2x2的平均值，上采样直接复制；各指令集的结果逐字节一致
+ */
+bool SimdConvertSupported(AVPixelFormat src_fmt, AVPixelFormat dst_fmt);
+/**
+ * 宽高不变的颜色转换，level高于CPU支持的指令集时自动降级
+ * 返回0成功，格式不支持返回-1
+ */
+int SimdConvert(const uint8_t *const src[], const int src_stride[], AVPixelFormat src_fmt,
+                uint8_t *const dst[], const int dst_stride[], AVPixelFormat dst_fmt, int width, int height,
+                ColorMatrix matrix, SimdLevel level);
+#endif
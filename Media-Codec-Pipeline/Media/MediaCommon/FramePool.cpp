@@ -0,0 +1,136 @@
+#include "FramePool.h"
+#include <stdlib.h>
+
+FramePool *FramePool::Create(int max_frames)
+{
+    return new FramePool(max_frames);
+}
+FramePool::FramePool(int max_frames)
+{
+    max_frames_ = max_frames > 0 ? max_frames : 1;
+}
+FramePool::~FramePool()
+{
+    for (std::list<unsigned char *>::iterator it = idle_buffers_.begin(); it != idle_buffers_.end(); ++it) {
+        free(*it);
+    }
+    idle_buffers_.clear();
+}
+cv::Mat FramePool::GetFrame(int height, int width, int type)
+{
+    cv::Mat frame;
+    frame.allocator = this;
+    frame.create(height, width, type);
+    frame.allocator = NULL; // 之后由frame.u->currAllocator负责归还内存，拷贝出去的cv::Mat不会再从池中分配
+    return frame;
+}
+void FramePool::Close()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    closed_ = true;
+    cond_.notify_all();
+    return;
+}
+// Release和最后一个PutBuffer可能并发，只有在锁内判断出内存池已经没人使用的一方删除
+// notify也在锁内调用，解锁之后不再访问任何成员，delete是最后一条语句
+void FramePool::Release()
+{
+    std::unique_lock<std::mutex> guard(mutex_);
+    closed_ = true;
+    released_ = true;
+    cond_.notify_all();
+    bool unused = (outstanding_ == 0);
+    guard.unlock();
+    if (unused) {
+        delete this;
+    }
+    return;
+}
+unsigned char *FramePool::GetBuffer(size_t size) const
+{
+    std::unique_lock<std::mutex> guard(mutex_);
+    if (size != buffer_size_) { // 分辨率变化，旧的内存不能再用
+        for (std::list<unsigned char *>::iterator it = idle_buffers_.begin(); it != idle_buffers_.end(); ++it) {
+            free(*it);
+            allocated_--;
+        }
+        idle_buffers_.clear();
+        buffer_size_ = size;
+    }
+    cond_.wait(guard, [this] { return closed_ || !idle_buffers_.empty() || allocated_ < max_frames_; });
+    unsigned char *buffer = NULL;
+    if (!idle_buffers_.empty()) {
+        buffer = idle_buffers_.front();
+        idle_buffers_.pop_front();
+    } else {
+        buffer = (unsigned char *)malloc(size);
+        allocated_++;
+    }
+    outstanding_++;
+    return buffer;
+}
+void FramePool::PutBuffer(unsigned char *buffer, size_t size) const
+{
+    std::unique_lock<std::mutex> guard(mutex_);
+    outstanding_--;
+    if (size == buffer_size_ && !released_ && allocated_ <= max_frames_) {
+        idle_buffers_.push_back(buffer);
+    } else {
+        free(buffer);
+        allocated_--;
+    }
+    cond_.notify_one();
+    bool unused = released_ && (outstanding_ == 0);
+    guard.unlock();
+    if (unused) { // 模块已经析构，最后一个图像释放时删除内存池
+        delete const_cast<FramePool *>(this);
+    }
+    return;
+}
+// 和opencv默认的StdMatAllocator一致，只是内存从池中获取
+cv::UMatData *FramePool::allocate(int dims, const int *sizes, int type, void *data0, size_t *step, FramePoolAccessFlag flags, cv::UMatUsageFlags usage_flags) const
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+    uchar *data = data0 ? (uchar *)data0 : GetBuffer(total);
+    cv::UMatData *u = new cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0) {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+}
+bool FramePool::allocate(cv::UMatData *u, FramePoolAccessFlag access_flags, cv::UMatUsageFlags usage_flags) const
+{
+    if (!u) {
+        return false;
+    }
+    return true;
+}
+void FramePool::deallocate(cv::UMatData *u) const
+{
+    if (!u) {
+        return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    bool user_allocated = (u->flags & cv::UMatData::USER_ALLOCATED) != 0;
+    unsigned char *buffer = u->origdata;
+    size_t size = u->size;
+    delete u;
+    if (!user_allocated) {
+        PutBuffer(buffer, size); // 可能删除内存池本身，放在最后
+    }
+    return;
+}
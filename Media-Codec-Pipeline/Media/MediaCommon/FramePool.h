@@ -0,0 +1,52 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <opencv2/core.hpp>
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag FramePoolAccessFlag;
+#else
+typedef int FramePoolAccessFlag;
+#endif
+
+/**
+ * 解码输出图像的内存池，作为cv::Mat的allocator使用
+ * GetFrame返回的cv::Mat直接使用池中的内存，最后一个引用释放的时候内存回到池中，不需要malloc和clone
+ * 池中内存都被占用时GetFrame等待，下游处理不过来时解码线程自然被阻塞
+ * cv::Mat可能比解码模块活得更久，所以内存池通过Create创建，模块析构时调用Release，所有图像释放之后自动删除
+ */
+class FramePool : public cv::MatAllocator
+{
+public:
+    static FramePool *Create(int max_frames);
+    // 分配连续内存的图像，池中内存用完时等待
+    cv::Mat GetFrame(int height, int width, int type);
+    // 不再等待，内存用完之后直接分配；模块析构时在join线程之前调用，避免线程卡在GetFrame
+    void Close();
+    // 模块不再使用内存池，必须在最后一次GetFrame之后调用
+    void Release();
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, FramePoolAccessFlag flags, cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData *data, FramePoolAccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData *data) const override;
+
+private:
+    FramePool(int max_frames);
+    virtual ~FramePool();
+    unsigned char *GetBuffer(size_t size) const;
+    void PutBuffer(unsigned char *buffer, size_t size) const;
+
+private:
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cond_;
+    mutable std::list<unsigned char *> idle_buffers_;
+    mutable size_t buffer_size_ = 0; // 图像大小变化时重新分配
+    mutable int allocated_ = 0;      // 池中已经分配的内存个数
+    mutable int outstanding_ = 0;    // 正在被cv::Mat使用的内存个数
+    int max_frames_;
+    bool closed_ = false;
+    bool released_ = false;
+};
+#endif
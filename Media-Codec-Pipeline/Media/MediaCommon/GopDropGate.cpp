@@ -0,0 +1,62 @@
+#include "GopDropGate.h"
+#include "NalScanner.h"
+
+void GopDropGate::SetCodec(bool is_h265)
+{
+    is_h265_ = is_h265;
+    return;
+}
+bool GopDropGate::Admit(const uint8_t *data, int len, uint64_t drop_count)
+{
+    if (drop_count != drop_count_) {
+        drop_count_ = drop_count;
+        waiting_ = true;
+        param_seen_ = false;
+    }
+    if (!waiting_) {
+        return true;
+    }
+    bool has_param = false;
+    bool has_sps = false;
+    bool key_frame = false;
+    bool non_key = false; // 非关键帧的slice，和参数集在同一个包中时整个包丢弃
+    NalIterator nal_iter(data, len);
+    NalUnit nal;
+    while (nal_iter.Next(nal)) {
+        if (nal.len <= nal.start_code) {
+            continue;
+        }
+        const uint8_t *nal_data = nal.data + nal.start_code;
+        if (is_h265_) {
+            int type = H265NalType(nal_data);
+            if (type >= 32 && type <= 34) { // VPS SPS PPS
+                has_param = true;
+                has_sps = has_sps || type == 33;
+            } else if (type >= 16 && type <= 21) { // IRAP
+                key_frame = true;
+            } else if (type < 32) {
+                non_key = true;
+            }
+        } else {
+            int type = H264NalType(nal_data);
+            if (type == 7 || type == 8) {
+                has_param = true;
+                has_sps = has_sps || type == 7;
+            } else if (type == 5) {
+                key_frame = true;
+            } else if (type >= 1 && type <= 4) {
+                non_key = true;
+            }
+        }
+    }
+    if (key_frame && (param_seen_ || has_sps)) {
+        waiting_ = false;
+        return true;
+    }
+    if (has_param && !key_frame && !non_key) {
+        param_seen_ = param_seen_ || has_sps;
+        return true;
+    }
+    discarded_++;
+    return false;
+}
@@ -0,0 +1,25 @@
+#ifndef GOP_DROP_GATE_H
+#define GOP_DROP_GATE_H
+#include <stdint.h>
+
+/**
+ * 实时模式下ES输入队列丢弃最旧的包之后，后面到下一个关键帧之前的帧都引用了被丢弃的数据，送给解码器会花屏
+ * 解码线程取出每个包时调用Admit，发现队列有新的丢弃之后一直丢弃到下一个带参数集的关键帧(IDR/IRAP)
+ * 参数集总是放行，可以和关键帧在同一个包中，也可以在关键帧之前单独送入
+ * 只在解码线程中使用，不加锁
+ */
+class GopDropGate
+{
+public:
+    void SetCodec(bool is_h265);
+    bool Admit(const uint8_t *data, int len, uint64_t drop_count); // data是Annex-B码流，drop_count是队列累计丢弃个数；返回false时丢弃这个包
+    uint64_t Discarded() { return discarded_; }                    // 等待关键帧期间丢弃的包数
+
+private:
+    bool is_h265_ = false;
+    bool waiting_ = false;
+    bool param_seen_ = false; // 等待期间是否放行了SPS
+    uint64_t drop_count_ = 0;
+    uint64_t discarded_ = 0;
+};
+#endif
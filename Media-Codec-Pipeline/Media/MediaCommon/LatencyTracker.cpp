@@ -0,0 +1,157 @@
+#include "LatencyTracker.h"
+#include "log_helpers.h"
+#include <chrono>
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+static const char *stage_latency_name = "mcp_frame_stage_latency_seconds";
+static const char *total_latency_name = "mcp_frame_latency_seconds";
+static const char *over_budget_name = "mcp_frame_over_budget_total";
+static const char *lost_name = "mcp_frame_untracked_total";
+
+static std::vector<double> FrameLatencyBuckets()
+{
+    return {0.001, 0.005, 0.01, 0.02, 0.05, 0.1, 0.15, 0.2, 0.3, 0.5, 1, 2, 5};
+}
+const char *LatencyStageName(LatencyStage stage)
+{
+    switch (stage) {
+    case LATENCY_INGEST:
+        return "ingest";
+    case LATENCY_DEMUX:
+        return "demux";
+    case LATENCY_DECODE:
+        return "decode";
+    case LATENCY_PROCESS:
+        return "process";
+    case LATENCY_ENCODE:
+        return "encode";
+    case LATENCY_OUTPUT:
+        return "output";
+    default:
+        return "unknown";
+    }
+}
+LatencyTracker::LatencyTracker(const std::string &channel, int budget_ms)
+{
+    channel_ = channel;
+    budget_us_ = (int64_t)budget_ms * 1000;
+    MetricsRegistry *registry = MetricsRegistry::Instance();
+    MetricLabels labels = {{"channel", channel_}};
+    for (int i = LATENCY_DEMUX; i < LATENCY_STAGE_COUNT; i++) {
+        MetricLabels stage_labels = {{"channel", channel_}, {"stage", LatencyStageName((LatencyStage)i)}};
+        stage_latency_[i] = registry->GetHistogram(stage_latency_name, "Per-frame time spent in each stage", FrameLatencyBuckets(), stage_labels);
+    }
+    total_latency_ = registry->GetHistogram(total_latency_name, "Per-frame latency from ingest to output", FrameLatencyBuckets(), labels);
+    over_budget_ = registry->GetCounter(over_budget_name, "Frames whose total latency exceeded the budget", labels);
+    lost_ = registry->GetCounter(lost_name, "Frames dropped or never matched before output", labels);
+}
+LatencyTracker::~LatencyTracker()
+{
+    MetricsRegistry *registry = MetricsRegistry::Instance();
+    for (int i = LATENCY_DEMUX; i < LATENCY_STAGE_COUNT; i++) {
+        registry->Remove(stage_latency_name, {{"channel", channel_}, {"stage", LatencyStageName((LatencyStage)i)}});
+    }
+    registry->Remove(total_latency_name, {{"channel", channel_}});
+    registry->Remove(over_budget_name, {{"channel", channel_}});
+    registry->Remove(lost_name, {{"channel", channel_}});
+}
+int64_t LatencyTracker::NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+bool LatencyTracker::Ingest(int64_t frame_id, int64_t ingest_us, int64_t pts)
+{
+    if (frame_id < 0) {
+        return false;
+    }
+    Entry entry;
+    entry.ingest_us = ingest_us;
+    entry.last_us = ingest_us;
+    entry.pts = pts;
+    entry.stage = LATENCY_INGEST;
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        entry.stage_us[i] = 0;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    // 按NALU输出时同一帧会重复调用，保留第一次的时间
+    bool inserted = entries_.insert(std::make_pair(frame_id, entry)).second;
+    if (inserted && pts != AV_NOPTS_VALUE) {
+        pts_index_[pts] = frame_id;
+    }
+    while (entries_.size() > LATENCY_MAX_PENDING) {
+        Erase(entries_.begin());
+        lost_->Add();
+    }
+    return inserted;
+}
+int64_t LatencyTracker::FrameIdByPts(int64_t pts)
+{
+    if (pts == AV_NOPTS_VALUE) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::map<int64_t, int64_t>::iterator it = pts_index_.find(pts);
+    if (it == pts_index_.end()) {
+        return -1;
+    }
+    return it->second;
+}
+int64_t LatencyTracker::Mark(int64_t frame_id, LatencyStage stage)
+{
+    int64_t now_us = NowUs();
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::map<int64_t, Entry>::iterator it;
+    if (frame_id >= 0) {
+        it = entries_.find(frame_id);
+    } else { // 按顺序匹配：还停在上一阶段的最早的帧
+        for (it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->second.stage == stage - 1) {
+                break;
+            }
+        }
+    }
+    if (it == entries_.end()) {
+        return -1;
+    }
+    frame_id = it->first;
+    Entry &entry = it->second;
+    int64_t stage_us = now_us - entry.last_us;
+    entry.stage_us[stage] = stage_us;
+    entry.last_us = now_us;
+    entry.stage = stage;
+    stage_latency_[stage]->Observe(stage_us / 1e6);
+    if (stage == LATENCY_OUTPUT) {
+        Finish(frame_id, entry, now_us);
+        Erase(it);
+    }
+    return frame_id;
+}
+void LatencyTracker::Erase(std::map<int64_t, Entry>::iterator it)
+{
+    if (it->second.pts != AV_NOPTS_VALUE) {
+        std::map<int64_t, int64_t>::iterator index = pts_index_.find(it->second.pts);
+        if (index != pts_index_.end() && index->second == it->first) { // 源时间戳重复时索引已经指向后面的帧
+            pts_index_.erase(index);
+        }
+    }
+    entries_.erase(it);
+    return;
+}
+void LatencyTracker::Finish(int64_t frame_id, Entry &entry, int64_t now_us)
+{
+    int64_t total_us = now_us - entry.ingest_us;
+    total_latency_->Observe(total_us / 1e6);
+    if (budget_us_ <= 0 || total_us <= budget_us_) {
+        return;
+    }
+    over_budget_->Add();
+    if (now_us - last_warn_us_ >= 1000000) { // 每秒最多打印一次，方便定位超出预算的阶段
+        last_warn_us_ = now_us;
+        log_warn("[{}] frame {} latency {}ms over budget {}ms, demux:{}ms decode:{}ms process:{}ms encode:{}ms output:{}ms", channel_, frame_id,
+                 total_us / 1000, budget_us_ / 1000, entry.stage_us[LATENCY_DEMUX] / 1000, entry.stage_us[LATENCY_DECODE] / 1000,
+                 entry.stage_us[LATENCY_PROCESS] / 1000, entry.stage_us[LATENCY_ENCODE] / 1000, entry.stage_us[LATENCY_OUTPUT] / 1000);
+    }
+    return;
+}
@@ -0,0 +1,67 @@
+#ifndef LATENCY_TRACKER_H
+#define LATENCY_TRACKER_H
+#include "Metrics.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+// 最多跟踪的未完成帧数，超过后最旧的帧按丢失处理(队列丢帧、解码失败的帧不会再出现)
+#define LATENCY_MAX_PENDING 1024
+
+// 一帧经过的阶段，每个阶段的耗时是从上一个阶段结束到本阶段结束
+enum LatencyStage {
+    LATENCY_INGEST,  // 读文件的同步线程或rtsp收到一帧，记录接收时间
+    LATENCY_DEMUX,   // 到达MediaWrapper
+    LATENCY_DECODE,  // 解码输出(包括解码队列等待和颜色转换)
+    LATENCY_PROCESS, // 用户处理完成，送入编码器
+    LATENCY_ENCODE,  // 编码输出(包括编码队列等待和颜色转换)
+    LATENCY_OUTPUT,  // 写入文件或者封装器
+    LATENCY_STAGE_COUNT,
+};
+const char *LatencyStageName(LatencyStage stage);
+
+/**
+ * 按帧统计端到端延时，帧由输入端分配的frame_id标识
+ * 每个阶段调用Mark记录完成时间，到LATENCY_OUTPUT时统计总延时并删除这一帧
+ * 编解码器只传递源时间戳，通过FrameIdByPts找回frame_id；找不到时传入-1，按顺序匹配上一阶段最早的帧
+ * 总延时超过预算时计数，并且每秒最多打印一次各阶段的耗时
+ */
+class LatencyTracker
+{
+public:
+    LatencyTracker(const std::string &channel, int budget_ms);
+    ~LatencyTracker();
+    // steady_clock的微秒数，输入端记录接收时间时使用
+    static int64_t NowUs();
+    // pts是源时间戳，不是AV_NOPTS_VALUE时建立时间戳到frame_id的索引；新加入的帧返回true，同一帧重复调用返回false
+    bool Ingest(int64_t frame_id, int64_t ingest_us, int64_t pts);
+    // 没有找到返回-1
+    int64_t FrameIdByPts(int64_t pts);
+    // 返回实际匹配到的frame_id，没有匹配到返回-1
+    int64_t Mark(int64_t frame_id, LatencyStage stage);
+
+private:
+    struct Entry {
+        int64_t ingest_us;
+        int64_t last_us;
+        int64_t pts;
+        LatencyStage stage;
+        int64_t stage_us[LATENCY_STAGE_COUNT];
+    };
+    void Finish(int64_t frame_id, Entry &entry, int64_t now_us);
+    void Erase(std::map<int64_t, Entry>::iterator it);
+
+private:
+    std::string channel_;
+    int64_t budget_us_;
+    std::mutex mutex_;
+    std::map<int64_t, Entry> entries_;
+    std::map<int64_t, int64_t> pts_index_; // 源时间戳到frame_id
+    int64_t last_warn_us_ = 0;
+    std::shared_ptr<MetricHistogram> stage_latency_[LATENCY_STAGE_COUNT];
+    std::shared_ptr<MetricHistogram> total_latency_;
+    std::shared_ptr<MetricCounter> over_budget_;
+    std::shared_ptr<MetricCounter> lost_;
+};
+#endif
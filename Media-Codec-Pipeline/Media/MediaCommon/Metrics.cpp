@@ -0,0 +1,380 @@
+#include "Metrics.h"
+#include "log_helpers.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void AppendSample(std::string &out, const std::string &name, const std::string &labels, const char *value)
+{
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " ";
+    out += value;
+    out += "\n";
+    return;
+}
+static std::string FormatDouble(double value)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+void MetricCounter::Write(std::string &out, const std::string &name, const std::string &labels)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%" PRIu64, Value());
+    AppendSample(out, name, labels, buf);
+    return;
+}
+void MetricGauge::Add(double delta)
+{
+    double old = value_;
+    while (!value_.compare_exchange_weak(old, old + delta)) {
+    }
+    return;
+}
+void MetricGauge::Write(std::string &out, const std::string &name, const std::string &labels)
+{
+    AppendSample(out, name, labels, FormatDouble(Value()).c_str());
+    return;
+}
+MetricHistogram::MetricHistogram(const std::vector<double> &bounds)
+{
+    bounds_ = bounds;
+    buckets_.reset(new std::atomic<uint64_t>[bounds_.size() + 1]);
+    for (size_t i = 0; i <= bounds_.size(); i++) {
+        buckets_[i] = 0;
+    }
+}
+void MetricHistogram::Observe(double value)
+{
+    size_t i = 0;
+    while (i < bounds_.size() && value > bounds_[i]) {
+        i++;
+    }
+    buckets_[i]++;
+    count_++;
+    sum_ns_ += (uint64_t)(value > 0 ? value * 1e9 : 0);
+    return;
+}
+double MetricHistogram::Sum() const
+{
+    return sum_ns_ / 1e9;
+}
+void MetricHistogram::Write(std::string &out, const std::string &name, const std::string &labels)
+{
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    uint64_t total = 0;
+    char buf[32];
+    for (size_t i = 0; i <= bounds_.size(); i++) {
+        total += buckets_[i];
+        std::string le = i < bounds_.size() ? FormatDouble(bounds_[i]) : "+Inf";
+        snprintf(buf, sizeof(buf), "%" PRIu64, total);
+        AppendSample(out, name + "_bucket", prefix + "le=\"" + le + "\"", buf);
+    }
+    AppendSample(out, name + "_sum", labels, FormatDouble(Sum()).c_str());
+    snprintf(buf, sizeof(buf), "%" PRIu64, total); // 和+Inf桶一致，不单独读count_
+    AppendSample(out, name + "_count", labels, buf);
+    return;
+}
+
+MetricsRegistry *MetricsRegistry::Instance()
+{
+    static MetricsRegistry registry;
+    return &registry;
+}
+std::string MetricsRegistry::FormatLabels(const MetricLabels &labels)
+{
+    std::string out;
+    for (size_t i = 0; i < labels.size(); i++) {
+        if (i > 0) {
+            out += ",";
+        }
+        out += labels[i].first + "=\"";
+        for (char c : labels[i].second) { // 标签值中的反斜杠、双引号和换行需要转义
+            if (c == '\\' || c == '"') {
+                out += '\\';
+                out += c;
+            } else if (c == '\n') {
+                out += "\\n";
+            } else {
+                out += c;
+            }
+        }
+        out += "\"";
+    }
+    return out;
+}
+std::shared_ptr<Metric> MetricsRegistry::GetMetric(const std::string &name, const std::string &help, MetricType type, const MetricLabels &labels,
+                                                   const std::vector<double> *bounds)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto family_it = families_.find(name);
+    if (family_it == families_.end()) {
+        Family family;
+        family.help = help;
+        family.type = type;
+        family_it = families_.insert(std::make_pair(name, family)).first;
+    } else if (family_it->second.type != type) {
+        log_error("metric {} registered with another type", name);
+        return NULL;
+    }
+    std::string key = FormatLabels(labels);
+    std::shared_ptr<Metric> &metric = family_it->second.series[key];
+    if (!metric) {
+        if (type == METRIC_COUNTER) {
+            metric = std::make_shared<MetricCounter>();
+        } else if (type == METRIC_GAUGE) {
+            metric = std::make_shared<MetricGauge>();
+        } else {
+            metric = std::make_shared<MetricHistogram>(*bounds);
+        }
+    }
+    return metric;
+}
+std::shared_ptr<MetricCounter> MetricsRegistry::GetCounter(const std::string &name, const std::string &help, const MetricLabels &labels)
+{
+    return std::static_pointer_cast<MetricCounter>(GetMetric(name, help, METRIC_COUNTER, labels, NULL));
+}
+std::shared_ptr<MetricGauge> MetricsRegistry::GetGauge(const std::string &name, const std::string &help, const MetricLabels &labels)
+{
+    return std::static_pointer_cast<MetricGauge>(GetMetric(name, help, METRIC_GAUGE, labels, NULL));
+}
+std::shared_ptr<MetricHistogram> MetricsRegistry::GetHistogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+                                                               const MetricLabels &labels)
+{
+    return std::static_pointer_cast<MetricHistogram>(GetMetric(name, help, METRIC_HISTOGRAM, labels, &bounds));
+}
+void MetricsRegistry::Remove(const std::string &name, const MetricLabels &labels)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto family_it = families_.find(name);
+    if (family_it == families_.end()) {
+        return;
+    }
+    family_it->second.series.erase(FormatLabels(labels));
+    if (family_it->second.series.empty()) {
+        families_.erase(family_it);
+    }
+    return;
+}
+std::string MetricsRegistry::Export()
+{
+    static const char *type_names[] = {"counter", "gauge", "histogram"};
+    std::string out;
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto &family_it : families_) {
+        const std::string &name = family_it.first;
+        Family &family = family_it.second;
+        out += "# HELP " + name + " " + family.help + "\n";
+        out += "# TYPE " + name + " " + type_names[family.type] + "\n";
+        for (auto &series_it : family.series) {
+            series_it.second->Write(out, name, series_it.first);
+        }
+    }
+    return out;
+}
+int MetricsRegistry::ExportToFile(const std::string &path)
+{
+    std::string text = Export();
+    std::string tmp_path = path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    size_t written = fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+    if (written != text.size() || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+std::vector<double> MetricsLatencyBuckets()
+{
+    return {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1};
+}
+
+StageMetrics::StageMetrics(const std::string &channel, const std::string &stage)
+{
+    labels_ = {{"channel", channel}, {"stage", stage}};
+    MetricsRegistry *registry = MetricsRegistry::Instance();
+    frames_in_ = registry->GetCounter("mcp_stage_frames_in_total", "Packets or frames received by the stage", labels_);
+    frames_out_ = registry->GetCounter("mcp_stage_frames_out_total", "Packets or frames produced by the stage", labels_);
+    bytes_in_ = registry->GetCounter("mcp_stage_bytes_in_total", "Bytes received by the stage", labels_);
+    bytes_out_ = registry->GetCounter("mcp_stage_bytes_out_total", "Bytes produced by the stage", labels_);
+    drops_ = registry->GetCounter("mcp_stage_drops_total", "Items dropped by the stage input queue", labels_);
+    queue_depth_ = registry->GetGauge("mcp_stage_queue_depth", "Items waiting in the stage input queue", labels_);
+    fps_ = registry->GetGauge("mcp_stage_fps", "Output frames per second over the last second", labels_);
+    process_seconds_ = registry->GetHistogram("mcp_stage_process_seconds", "Time spent processing one item", MetricsLatencyBuckets(), labels_);
+    fps_time_ = std::chrono::steady_clock::now();
+}
+StageMetrics::~StageMetrics()
+{
+    static const char *names[] = {"mcp_stage_frames_in_total", "mcp_stage_frames_out_total", "mcp_stage_bytes_in_total", "mcp_stage_bytes_out_total",
+                                  "mcp_stage_drops_total",     "mcp_stage_queue_depth",      "mcp_stage_fps",            "mcp_stage_process_seconds"};
+    for (const char *name : names) {
+        MetricsRegistry::Instance()->Remove(name, labels_);
+    }
+}
+void StageMetrics::Input(size_t bytes)
+{
+    frames_in_->Add();
+    bytes_in_->Add(bytes);
+    return;
+}
+void StageMetrics::Output(size_t bytes)
+{
+    frames_out_->Add();
+    bytes_out_->Add(bytes);
+    std::lock_guard<std::mutex> guard(fps_mutex_);
+    fps_frames_++;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - fps_time_).count();
+    if (elapsed >= 1.0) {
+        fps_->Set(fps_frames_ / elapsed);
+        fps_time_ = now;
+        fps_frames_ = 0;
+    }
+    return;
+}
+void StageMetrics::Drop(uint64_t count)
+{
+    drops_->Add(count);
+    return;
+}
+void StageMetrics::QueueDepth(size_t depth)
+{
+    queue_depth_->Set((double)depth);
+    return;
+}
+void StageMetrics::Process(double seconds)
+{
+    process_seconds_->Observe(seconds);
+    return;
+}
+
+MetricsExporter::MetricsExporter()
+{
+}
+MetricsExporter::~MetricsExporter()
+{
+    Stop();
+}
+int MetricsExporter::Start(int port, const std::string &path, int interval_ms)
+{
+    path_ = path;
+    interval_ms_ = interval_ms > 0 ? interval_ms : 1000;
+    if (port > 0) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd_ < 0) {
+            log_error("metrics socket error:{}", strerror(errno));
+            return -1;
+        }
+        int on = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // 只对本机开放
+        if (bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 8) < 0) {
+            log_error("metrics listen 127.0.0.1:{} error:{}", port, strerror(errno));
+            close(listen_fd_);
+            listen_fd_ = -1;
+            return -1;
+        }
+        log_info("metrics http://127.0.0.1:{}/metrics", port);
+    }
+    if (listen_fd_ < 0 && path_.empty()) {
+        return 0;
+    }
+    abort_ = false;
+    thread_ = std::thread(MetricsExporter::ExportThread, this);
+    return 0;
+}
+void MetricsExporter::Stop()
+{
+    abort_ = true;
+    if (!thread_.joinable()) {
+        return;
+    }
+    thread_.join();
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+    if (!path_.empty()) { // 退出前写一次最终结果
+        MetricsRegistry::Instance()->ExportToFile(path_);
+    }
+    return;
+}
+void MetricsExporter::HandleClient(int fd)
+{
+    // 只需要请求行，请求一般在一个包内到达，最多等待1秒
+    char request[1024];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int len = 0;
+    if (poll(&pfd, 1, 1000) > 0) {
+        len = recv(fd, request, sizeof(request) - 1, 0);
+    }
+    if (len <= 0) {
+        return;
+    }
+    request[len] = '\0';
+    std::string response;
+    if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        std::string body = MetricsRegistry::Instance()->Export();
+        response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" +
+                   body;
+    } else {
+        response = "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    }
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t ret = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            break;
+        }
+        sent += ret;
+    }
+    return;
+}
+void MetricsExporter::ExportThread(MetricsExporter *self)
+{
+    std::chrono::steady_clock::time_point next_write = std::chrono::steady_clock::now();
+    while (!self->abort_) {
+        if (!self->path_.empty() && std::chrono::steady_clock::now() >= next_write) {
+            if (MetricsRegistry::Instance()->ExportToFile(self->path_) < 0) {
+                log_warn("metrics write {} failed", self->path_);
+            }
+            next_write += std::chrono::milliseconds(self->interval_ms_);
+        }
+        if (self->listen_fd_ < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        struct pollfd pfd = {self->listen_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) { // 超时检查退出标志和写文件时间
+            continue;
+        }
+        int fd = accept(self->listen_fd_, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        self->HandleClient(fd);
+        close(fd);
+    }
+    log_info("MetricsExporter exit");
+    return;
+}
@@ -0,0 +1,182 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 标签按顺序输出，例如 {{"channel", "0"}, {"stage", "video_decode"}}
+typedef std::vector<std::pair<std::string, std::string>> MetricLabels;
+
+class Metric
+{
+public:
+    virtual ~Metric() {}
+    // 按Prometheus文本格式输出一条(直方图是多条)样本，labels是已经格式化好的"k=\"v\",..."
+    virtual void Write(std::string &out, const std::string &name, const std::string &labels) = 0;
+};
+// 只增不减的计数
+class MetricCounter : public Metric
+{
+public:
+    void Add(uint64_t n = 1) { value_ += n; }
+    uint64_t Value() const { return value_; }
+    void Write(std::string &out, const std::string &name, const std::string &labels) override;
+
+private:
+    std::atomic<uint64_t> value_ = {0};
+};
+// 可增可减的当前值
+class MetricGauge : public Metric
+{
+public:
+    void Set(double value) { value_ = value; }
+    void Add(double delta);
+    double Value() const { return value_; }
+    void Write(std::string &out, const std::string &name, const std::string &labels) override;
+
+private:
+    std::atomic<double> value_ = {0};
+};
+// 固定分桶的直方图，bounds是每个桶的上限(升序)，超过最后一个上限的计入+Inf
+class MetricHistogram : public Metric
+{
+public:
+    explicit MetricHistogram(const std::vector<double> &bounds);
+    void Observe(double value);
+    uint64_t Count() const { return count_; }
+    double Sum() const;
+    void Write(std::string &out, const std::string &name, const std::string &labels) override;
+
+private:
+    std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_; // 不累加，导出时再累加
+    std::atomic<uint64_t> count_ = {0};
+    std::atomic<uint64_t> sum_ns_ = {0}; // 按纳秒累加，避免double的原子加
+};
+
+/**
+ * 进程内的指标注册表，同名同标签返回同一个对象
+ * 返回的shared_ptr由调用者持有，模块销毁时调用Remove删除自己的序列，否则最后的值一直保留在导出结果中
+ */
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry *Instance();
+    std::shared_ptr<MetricCounter> GetCounter(const std::string &name, const std::string &help, const MetricLabels &labels = MetricLabels());
+    std::shared_ptr<MetricGauge> GetGauge(const std::string &name, const std::string &help, const MetricLabels &labels = MetricLabels());
+    std::shared_ptr<MetricHistogram> GetHistogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+                                                  const MetricLabels &labels = MetricLabels());
+    void Remove(const std::string &name, const MetricLabels &labels);
+    // Prometheus text format 0.0.4
+    std::string Export();
+    // 先写临时文件再改名，读文件的一方不会读到一半的内容
+    int ExportToFile(const std::string &path);
+
+private:
+    enum MetricType {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+    };
+    struct Family {
+        std::string help;
+        MetricType type;
+        std::map<std::string, std::shared_ptr<Metric>> series; // key是格式化后的标签
+    };
+    std::shared_ptr<Metric> GetMetric(const std::string &name, const std::string &help, MetricType type, const MetricLabels &labels,
+                                      const std::vector<double> *bounds);
+    static std::string FormatLabels(const MetricLabels &labels);
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+// 处理耗时直方图的分桶(秒)
+std::vector<double> MetricsLatencyBuckets();
+
+/**
+ * 一个处理阶段(解封装、解码、编码、封装)的指标，标签为channel和stage
+ * 帧数、字节数、丢弃数是计数；队列深度和输出帧率是当前值；处理耗时是直方图
+ * 输出帧率每秒更新一次，也可以在Prometheus中用rate(mcp_stage_frames_out_total[1m])计算
+ */
+class StageMetrics
+{
+public:
+    StageMetrics(const std::string &channel, const std::string &stage);
+    ~StageMetrics(); // 从注册表中删除本阶段的序列
+    void Input(size_t bytes);
+    void Output(size_t bytes);
+    void Drop(uint64_t count = 1);
+    void QueueDepth(size_t depth);
+    void Process(double seconds);
+
+private:
+    MetricLabels labels_;
+    std::shared_ptr<MetricCounter> frames_in_;
+    std::shared_ptr<MetricCounter> frames_out_;
+    std::shared_ptr<MetricCounter> bytes_in_;
+    std::shared_ptr<MetricCounter> bytes_out_;
+    std::shared_ptr<MetricCounter> drops_;
+    std::shared_ptr<MetricGauge> queue_depth_;
+    std::shared_ptr<MetricGauge> fps_;
+    std::shared_ptr<MetricHistogram> process_seconds_;
+    std::mutex fps_mutex_;
+    std::chrono::steady_clock::time_point fps_time_;
+    uint64_t fps_frames_ = 0;
+};
+
+// 作用域内的处理耗时，metrics为NULL时不统计
+class StageTimer
+{
+public:
+    explicit StageTimer(StageMetrics *metrics)
+    {
+        metrics_ = metrics;
+        if (metrics_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~StageTimer()
+    {
+        if (metrics_) {
+            metrics_->Process(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+        }
+    }
+
+private:
+    StageMetrics *metrics_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * 导出注册表：HTTP只监听127.0.0.1，GET /metrics 返回文本格式；文件按固定间隔覆盖写
+ * 两种方式都在同一个后台线程中完成
+ */
+class MetricsExporter
+{
+public:
+    MetricsExporter();
+    ~MetricsExporter();
+    // port小于等于0不启动HTTP，path为空不写文件；返回-1表示端口监听失败
+    int Start(int port, const std::string &path, int interval_ms = 1000);
+    void Stop();
+
+private:
+    static void ExportThread(MetricsExporter *self);
+    void HandleClient(int fd);
+
+private:
+    int listen_fd_ = -1;
+    std::string path_;
+    int interval_ms_ = 1000;
+    std::atomic<bool> abort_ = {false};
+    std::thread thread_;
+};
+#endif
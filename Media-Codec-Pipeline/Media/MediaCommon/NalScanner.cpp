@@ -0,0 +1,112 @@
+#include "NalScanner.h"
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define NAL_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+// 每次比较p[2]：大于1说明p、p+1、p+2都不可能是起始码的开始，直接跳过3个字节
+static const uint8_t *FindStartCodeC(const uint8_t *p, const uint8_t *end)
+{
+    while (p + 2 < end) {
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[1]) {
+            p += 2;
+        } else if (p[0] || p[2] != 1) {
+            p++;
+        } else {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef NAL_SCANNER_X86
+// 一次比较16个位置：p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1
+__attribute__((target("sse2"))) static const uint8_t *FindStartCodeSSE2(const uint8_t *p, const uint8_t *end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    while (end - p >= 16 + 2) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
+        __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, one));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return FindStartCodeC(p, end);
+}
+__attribute__((target("avx2"))) static const uint8_t *FindStartCodeAVX2(const uint8_t *p, const uint8_t *end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    while (end - p >= 32 + 2) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(p + 1));
+        __m256i b2 = _mm256_loadu_si256((const __m256i *)(p + 2));
+        __m256i hit = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)), _mm256_cmpeq_epi8(b2, one));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return FindStartCodeSSE2(p, end);
+}
+#endif
+
+typedef const uint8_t *(*FindStartCodeFunc)(const uint8_t *, const uint8_t *);
+static FindStartCodeFunc SelectFindStartCode()
+{
+#ifdef NAL_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return FindStartCodeAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return FindStartCodeSSE2;
+    }
+#endif
+    return FindStartCodeC;
+}
+const uint8_t *FindStartCode(const uint8_t *buf, const uint8_t *end)
+{
+    static const FindStartCodeFunc func = SelectFindStartCode(); // 只在第一次调用时检测CPU
+    if (end - buf < 3) {
+        return end;
+    }
+    return func(buf, end);
+}
+
+NalIterator::NalIterator(const uint8_t *buf, int len)
+{
+    buf_ = buf;
+    end_ = buf + (len > 0 ? len : 0);
+    pos_ = buf;
+}
+bool NalIterator::Next(NalUnit &nal)
+{
+    const uint8_t *start = FindStartCode(pos_, end_);
+    if (start == end_) {
+        pos_ = end_;
+        return false;
+    }
+    const uint8_t *begin = start;
+    if (begin > buf_ && begin[-1] == 0) { // 00 00 00 01
+        begin--;
+    }
+    const uint8_t *next = FindStartCode(start + 3, end_);
+    const uint8_t *nal_end = next;
+    if (next != end_ && next[-1] == 0) { // 下一个是4字节起始码，前导0不属于当前NALU
+        nal_end--;
+    }
+    nal.data = begin;
+    nal.len = (int)(nal_end - begin);
+    nal.start_code = (int)(start + 3 - begin);
+    pos_ = next;
+    return true;
+}
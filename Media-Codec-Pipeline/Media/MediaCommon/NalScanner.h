@@ -0,0 +1,45 @@
+#ifndef NAL_SCANNER_H
+#define NAL_SCANNER_H
+#include <stdint.h>
+
+/**
+ * Annex-B起始码查找，x86上根据CPU选择AVX2/SSE2实现，其他平台使用跳跃比较的C实现
+ * 返回[buf, end)中第一个00 00 01的位置，没有找到返回end；4字节起始码返回的是后3个字节的位置
+ */
+const uint8_t *FindStartCode(const uint8_t *buf, const uint8_t *end);
+
+// 一个NALU，data包含起始码
+struct NalUnit {
+    const uint8_t *data;
+    int len;        // 包含起始码的长度
+    int start_code; // 起始码长度，3或4
+};
+
+/**
+ * 按顺序遍历buffer中的NALU，buffer在遍历期间必须有效
+ * NalIterator it(data, len);
+ * NalUnit nal;
+ * while (it.Next(nal)) { ... }
+ */
+class NalIterator
+{
+public:
+    NalIterator(const uint8_t *buf, int len);
+    bool Next(NalUnit &nal); // 没有更多NALU返回false
+
+private:
+    const uint8_t *buf_;
+    const uint8_t *end_;
+    const uint8_t *pos_; // 下一个起始码的位置
+};
+
+// 输入为NALU头(不含起始码)
+static inline int H264NalType(const uint8_t *nal)
+{
+    return nal[0] & 0x1f;
+}
+static inline int H265NalType(const uint8_t *nal)
+{
+    return (nal[0] >> 1) & 0x3f;
+}
+#endif
@@ -0,0 +1,124 @@
+#include "SliceScaler.h"
+#include <algorithm>
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+SliceScaler::SliceScaler(int thread_count, TaskExecutor *executor)
+{
+    executor_ = executor;
+    if (thread_count <= 0) {
+        thread_count = std::min(executor_->ThreadCount(), SCALE_MAX_AUTO_THREADS);
+    }
+    thread_count_ = std::max(thread_count, 1);
+    simd_level_ = DetectSimdLevel();
+    bands_.resize(thread_count_);
+}
+SliceScaler::~SliceScaler()
+{
+    for (size_t i = 0; i < bands_.size(); i++) {
+        if (bands_[i].ctx) {
+            sws_freeContext(bands_[i].ctx);
+            bands_[i].ctx = NULL;
+        }
+    }
+}
+// 把平面指针移动到第y行，色度平面按垂直采样比例换算
+static void OffsetPlanes(AVPixelFormat fmt, const uint8_t *const in[], const int stride[], int y, const uint8_t *out[4])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    int planes = av_pix_fmt_count_planes(fmt);
+    for (int p = 0; p < 4; p++) {
+        if (p < planes) {
+            int shift = (p == 1 || p == 2) ? desc->log2_chroma_h : 0;
+            out[p] = in[p] + (y >> shift) * stride[p];
+        } else {
+            out[p] = NULL;
+        }
+    }
+    return;
+}
+void SliceScaler::SetKernel(ScaleKernel kernel, ColorMatrix matrix)
+{
+    kernel_ = kernel;
+    matrix_ = matrix;
+    return;
+}
+int SliceScaler::ScaleBand(int index)
+{
+    Band &band = bands_[index];
+    if (kernel_ == SCALE_KERNEL_SIMD && SimdConvertSupported(src_fmt_, dst_fmt_)) {
+        const uint8_t *src[4];
+        const uint8_t *dst[4];
+        OffsetPlanes(src_fmt_, src_, src_stride_, band.y, src);
+        OffsetPlanes(dst_fmt_, (const uint8_t *const *)dst_, dst_stride_, band.y, dst);
+        return SimdConvert(src, src_stride_, src_fmt_, (uint8_t *const *)dst, dst_stride_, dst_fmt_, width_, band.height, matrix_, simd_level_);
+    }
+    band.ctx = sws_getCachedContext(band.ctx, width_, band.height, src_fmt_, width_, band.height, dst_fmt_, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!band.ctx) {
+        return -1;
+    }
+    const uint8_t *src[4];
+    const uint8_t *dst[4];
+    OffsetPlanes(src_fmt_, src_, src_stride_, band.y, src);
+    OffsetPlanes(dst_fmt_, (const uint8_t *const *)dst_, dst_stride_, band.y, dst);
+    sws_scale(band.ctx, src, src_stride_, 0, band.height, (uint8_t *const *)dst, dst_stride_);
+    return 0;
+}
+// 执行器线程和调用线程都从这里领取条带，每个条带只会被一个线程转换
+void SliceScaler::RunBands(std::shared_ptr<Job> job)
+{
+    int index;
+    while ((index = job->next_band++) < job->band_count) {
+        int ret = job->scaler->ScaleBand(index);
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (ret < 0) {
+            job->failed++;
+        }
+        job->done++;
+        if (job->done == job->band_count) {
+            job->done_cond.notify_all();
+        }
+    }
+    return;
+}
+int SliceScaler::Scale(const uint8_t *const src[], const int src_stride[], AVPixelFormat src_fmt,
+                       uint8_t *const dst[], const int dst_stride[], AVPixelFormat dst_fmt, int width, int height)
+{
+    const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get(src_fmt);
+    const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get(dst_fmt);
+    if (!src_desc || !dst_desc || width <= 0 || height <= 0) {
+        return -1;
+    }
+    // 条带高度按色度行对齐，4:2:0格式每个条带从偶数行开始
+    int align = 1 << std::max(src_desc->log2_chroma_h, dst_desc->log2_chroma_h);
+    int band_count = std::min(thread_count_, std::max(1, height / SCALE_MIN_SLICE_ROWS));
+    int rows = (height + band_count - 1) / band_count;
+    rows = (rows + align - 1) / align * align;
+    int y = 0;
+    int count = 0;
+    for (; count < band_count && y < height; count++) {
+        bands_[count].y = y;
+        bands_[count].height = std::min(rows, height - y);
+        y += rows;
+    }
+
+    src_ = src;
+    src_stride_ = src_stride;
+    src_fmt_ = src_fmt;
+    dst_ = dst;
+    dst_stride_ = dst_stride;
+    dst_fmt_ = dst_fmt;
+    width_ = width;
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->scaler = this;
+    job->band_count = count;
+    for (int i = 1; i < count; i++) {
+        executor_->Post([job]() { SliceScaler::RunBands(job); });
+    }
+    RunBands(job);
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done_cond.wait(lock, [&job]() { return job->done == job->band_count; });
+    return job->failed > 0 ? -1 : 0;
+}
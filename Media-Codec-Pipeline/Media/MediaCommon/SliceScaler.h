@@ -0,0 +1,72 @@
+#ifndef SLICE_SCALER_H
+#define SLICE_SCALER_H
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+#include "ColorConvert.h"
+#include "TaskExecutor.h"
+struct SwsContext;
+// 自动选择线程数时的上限，颜色转换受内存带宽限制，线程太多没有收益
+#define SCALE_MAX_AUTO_THREADS 4
+// 每个条带的最小行数，图像太小时切分的同步开销比转换本身还大
+#define SCALE_MIN_SLICE_ROWS 64
+
+/**
+ * 宽高不变的颜色转换(YUV<->BGR、NV12->YUV420P等)，按行切分成多个条带并行转换
+ * 每个条带有自己的SwsContext，条带作为任务投递到共享的TaskExecutor，调用线程也一起领取条带，全部完成后Scale返回
+ * 执行器繁忙时调用线程会自己转换所有条带，不会因为等待执行器而卡住
+ * 条带边界按色度行对齐；条带之间色度插值互不参考，边界处和整帧转换会有一行以内的细微差异
+ * SetKernel选择SIMD时，支持的格式由SimdConvert转换，其余格式仍然使用libswscale
+ * Scale和SetKernel只能在同一个线程中调用
+ */
+class SliceScaler
+{
+public:
+    explicit SliceScaler(int thread_count = 0, TaskExecutor *executor = TaskExecutor::Instance()); // 最多并行的条带数，小于等于0时按执行器线程数选择
+    ~SliceScaler();
+    int ThreadCount() const { return thread_count_; }
+    // 选择转换实现和YUV矩阵，默认libswscale、BT.601
+    void SetKernel(ScaleKernel kernel, ColorMatrix matrix);
+    // 返回0成功
+    int Scale(const uint8_t *const src[], const int src_stride[], AVPixelFormat src_fmt,
+              uint8_t *const dst[], const int dst_stride[], AVPixelFormat dst_fmt, int width, int height);
+
+private:
+    struct Band {
+        struct SwsContext *ctx = NULL;
+        int y = 0;
+        int height = 0;
+    };
+    // 一次Scale调用，执行器中的任务持有引用，Scale返回之后才执行的任务领取不到条带，不再访问SliceScaler
+    struct Job {
+        SliceScaler *scaler = NULL;
+        int band_count = 0;
+        std::atomic<int> next_band = {0};
+        std::mutex mutex;
+        std::condition_variable done_cond;
+        int done = 0;
+        int failed = 0;
+    };
+    static void RunBands(std::shared_ptr<Job> job);
+    int ScaleBand(int index);
+
+private:
+    int thread_count_;
+    TaskExecutor *executor_;
+    ScaleKernel kernel_ = SCALE_KERNEL_SWS;
+    ColorMatrix matrix_ = COLOR_MATRIX_BT601;
+    SimdLevel simd_level_ = SIMD_LEVEL_SCALAR;
+    std::vector<Band> bands_;
+    // 当前任务
+    const uint8_t *const *src_ = NULL;
+    const int *src_stride_ = NULL;
+    AVPixelFormat src_fmt_ = AV_PIX_FMT_NONE;
+    uint8_t *const *dst_ = NULL;
+    const int *dst_stride_ = NULL;
+    AVPixelFormat dst_fmt_ = AV_PIX_FMT_NONE;
+    int width_ = 0;
+};
+#endif
@@ -0,0 +1,244 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#ifdef __linux__
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/**
+ * 等待/唤醒的序号，linux下使用futex，其他平台使用条件变量
+ * 等待方先Prepare取得序号，再检查条件，条件不满足时Wait；唤醒方修改条件之后Wake
+ */
+class SpscWaiter
+{
+public:
+    int Prepare()
+    {
+        return seq_.load(std::memory_order_acquire);
+    }
+    // timeout_ms小于0表示一直等待，返回false表示超时
+    bool Wait(int seq, int timeout_ms)
+    {
+#ifdef __linux__
+        struct timespec ts;
+        struct timespec *pts = NULL;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            pts = &ts;
+        }
+        long ret = syscall(SYS_futex, (int *)&seq_, FUTEX_WAIT_PRIVATE, seq, pts, NULL, 0);
+        return !(ret < 0 && errno == ETIMEDOUT);
+#else
+        std::unique_lock<std::mutex> guard(mutex_);
+        if (timeout_ms < 0) {
+            cond_.wait(guard, [&] { return seq_.load(std::memory_order_acquire) != seq; });
+            return true;
+        }
+        return cond_.wait_for(guard, std::chrono::milliseconds(timeout_ms), [&] { return seq_.load(std::memory_order_acquire) != seq; });
+#endif
+    }
+    void Wake()
+    {
+#ifdef __linux__
+        seq_.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, (int *)&seq_, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+#else
+        std::unique_lock<std::mutex> guard(mutex_);
+        seq_.fetch_add(1, std::memory_order_release);
+        guard.unlock();
+        cond_.notify_all();
+#endif
+        return;
+    }
+
+private:
+    std::atomic<int> seq_ = {0};
+#ifndef __linux__
+    std::mutex mutex_;
+    std::condition_variable cond_;
+#endif
+};
+
+/**
+ * 单生产者单消费者环形队列，模块内部线程之间传递数据使用(解码->转换，转换->编码)
+ * 只能有一个线程Push，一个线程Pop；读写位置分别放在不同的cache line，避免伪共享
+ * 正常情况下Push/Pop只有原子操作，只有对方在等待时才调用futex唤醒
+ * 队列满了Push等待，不丢数据；丢帧策略由模块的输入队列(BoundedQueue)负责
+ * SetCapacity和Clear只能在生产和消费线程都没有运行的时候调用
+ */
+template <typename T>
+class SpscRing
+{
+public:
+    typedef std::function<void(T &)> ReleaseFunc;
+
+    SpscRing(size_t capacity = 8)
+    {
+        SetCapacity(capacity);
+    }
+    virtual ~SpscRing()
+    {
+        Clear();
+    }
+    void SetCapacity(size_t capacity)
+    {
+        Clear();
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        capacity_ = capacity > 0 ? capacity : 1;
+        mask_ = size - 1;
+        slots_.assign(size, T());
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        return;
+    }
+    void SetReleaseFunc(ReleaseFunc func) { release_func_ = func; }
+
+    // 生产者线程调用，队列满了等待消费者取走数据；已关闭返回false，数据已经通过ReleaseFunc释放
+    bool Push(T item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        while (tail - head_.load(std::memory_order_acquire) >= capacity_) {
+            if (closed_.load(std::memory_order_acquire)) {
+                break;
+            }
+            int seq = not_full_.Prepare();
+            producer_waiting_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (tail - head_.load(std::memory_order_acquire) >= capacity_ && !closed_.load(std::memory_order_acquire)) {
+                not_full_.Wait(seq, -1);
+            }
+            producer_waiting_.store(false, std::memory_order_relaxed);
+        }
+        if (closed_.load(std::memory_order_acquire)) {
+            Release(item);
+            return false;
+        }
+        slots_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer_waiting_.load(std::memory_order_relaxed)) { // 消费者空闲时才唤醒
+            not_empty_.Wake();
+        }
+        return true;
+    }
+    // 消费者线程调用，队列为空时最多等待timeout_ms毫秒(小于0一直等待)，没有取到数据返回false
+    bool Pop(T &item, int timeout_ms)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (head == tail_.load(std::memory_order_acquire)) {
+            if (closed_.load(std::memory_order_acquire) || timeout_ms == 0) {
+                if (head == tail_.load(std::memory_order_acquire)) {
+                    return false;
+                }
+                break;
+            }
+            int wait_ms = -1;
+            if (timeout_ms > 0) {
+                // 剩余时间向上取整到毫秒，不足1ms时也等待1ms，不会提前超时
+                wait_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now() + std::chrono::microseconds(999)).count();
+                if (wait_ms <= 0) {
+                    return false;
+                }
+            }
+            int seq = not_empty_.Prepare();
+            consumer_waiting_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (head == tail_.load(std::memory_order_acquire) && !closed_.load(std::memory_order_acquire)) {
+                not_empty_.Wait(seq, wait_ms);
+            }
+            consumer_waiting_.store(false, std::memory_order_relaxed);
+        }
+        item = slots_[head & mask_];
+        slots_[head & mask_] = T(); // 不在槽位里继续持有引用
+        head_.store(head + 1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producer_waiting_.load(std::memory_order_relaxed)) {
+            not_full_.Wake();
+        }
+        return true;
+    }
+    // 唤醒等待的线程，之后不能再放入数据，Pop可以继续取出剩余的数据
+    void Close()
+    {
+        closed_.store(true, std::memory_order_release);
+        not_empty_.Wake();
+        not_full_.Wake();
+        return;
+    }
+    // 释放队列中剩余的数据
+    void Clear()
+    {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            Release(slots_[head & mask_]);
+            slots_[head & mask_] = T();
+        }
+        head_.store(head, std::memory_order_release);
+        return;
+    }
+    size_t Size()
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool Empty()
+    {
+        return Size() == 0;
+    }
+    // 已经关闭并且剩余的数据已经取完，消费线程可以退出
+    bool IsFinished()
+    {
+        return closed_.load(std::memory_order_acquire) && Empty();
+    }
+
+private:
+    void Release(T &item)
+    {
+        if (release_func_) {
+            release_func_(item);
+        }
+        return;
+    }
+
+private:
+    // 消费者写
+    std::atomic<size_t> head_ = {0};
+    std::atomic<bool> consumer_waiting_ = {false};
+    char pad0_[CACHE_LINE_SIZE];
+    // 生产者写
+    std::atomic<size_t> tail_ = {0};
+    std::atomic<bool> producer_waiting_ = {false};
+    char pad1_[CACHE_LINE_SIZE];
+    // 两边只读
+    std::atomic<bool> closed_ = {false};
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    std::vector<T> slots_;
+    ReleaseFunc release_func_;
+    char pad2_[CACHE_LINE_SIZE];
+    SpscWaiter not_empty_;
+    char pad3_[CACHE_LINE_SIZE];
+    SpscWaiter not_full_;
+};
+#endif
@@ -0,0 +1,182 @@
+#include "TaskExecutor.h"
+
+static int g_instance_threads = 0;
+static thread_local TaskExecutor *t_executor = NULL;
+static thread_local int t_worker_index = -1;
+
+TaskExecutor *TaskExecutor::Instance()
+{
+    static TaskExecutor executor(g_instance_threads);
+    return &executor;
+}
+void TaskExecutor::SetInstanceThreads(int thread_count)
+{
+    g_instance_threads = thread_count;
+    return;
+}
+bool TaskExecutor::InWorkerThread()
+{
+    return t_executor != NULL;
+}
+TaskExecutor::TaskExecutor(int thread_count)
+{
+    if (thread_count <= 0) {
+        thread_count = (int)std::thread::hardware_concurrency();
+        if (thread_count < 2) {
+            thread_count = 2;
+        }
+    }
+    for (int i = 0; i < thread_count; i++) {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (int i = 0; i < thread_count; i++) { // 队列全部创建之后再启动线程，窃取时会访问其它线程的队列
+        workers_[i]->thread = std::thread(TaskExecutor::WorkThread, this, i);
+    }
+}
+TaskExecutor::~TaskExecutor()
+{
+    {
+        std::lock_guard<std::mutex> guard(idle_mutex_);
+        abort_ = true;
+    }
+    idle_cond_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i]->thread.join();
+    }
+}
+void TaskExecutor::Post(Task task)
+{
+    int index;
+    if (t_executor == this) { // 执行器线程产生的任务放在本线程，数据更可能还在缓存中
+        index = t_worker_index;
+    } else {
+        index = (int)(next_++ % workers_.size());
+    }
+    {
+        std::lock_guard<std::mutex> guard(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    pending_++;
+    {
+        std::lock_guard<std::mutex> guard(idle_mutex_); // 加锁之后再通知，避免工作线程检查完pending_还没进入等待时漏掉通知
+    }
+    idle_cond_.notify_one();
+    return;
+}
+// 先取自己队列头部的任务，再从其它队列尾部窃取
+bool TaskExecutor::TakeTask(int index, Task &task)
+{
+    int count = (int)workers_.size();
+    for (int i = 0; i < count; i++) {
+        Worker *worker = workers_[(index + i) % count].get();
+        std::lock_guard<std::mutex> guard(worker->mutex);
+        if (worker->tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(worker->tasks.front());
+            worker->tasks.pop_front();
+        } else {
+            task = std::move(worker->tasks.back());
+            worker->tasks.pop_back();
+        }
+        pending_--;
+        return true;
+    }
+    return false;
+}
+void TaskExecutor::WorkThread(TaskExecutor *self, int index)
+{
+    t_executor = self;
+    t_worker_index = index;
+    while (1) {
+        Task task;
+        if (self->TakeTask(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(self->idle_mutex_);
+        self->idle_cond_.wait(guard, [self] { return self->pending_ > 0 || self->abort_; });
+        if (self->abort_ && self->pending_ == 0) {
+            break;
+        }
+    }
+    t_executor = NULL;
+    t_worker_index = -1;
+    return;
+}
+
+SerialTask::SerialTask(std::function<void()> func, TaskExecutor *executor)
+{
+    shared_ = std::make_shared<Shared>();
+    shared_->func = func;
+    shared_->executor = executor;
+}
+SerialTask::~SerialTask()
+{
+    std::lock_guard<std::mutex> guard(shared_->mutex);
+    shared_->closed = true;
+}
+void SerialTask::Notify()
+{
+    std::unique_lock<std::mutex> guard(shared_->mutex);
+    if (shared_->closed) {
+        return;
+    }
+    if (shared_->state == SERIAL_IDLE) {
+        shared_->state = SERIAL_SCHEDULED;
+        guard.unlock();
+        std::shared_ptr<Shared> shared = shared_;
+        shared->executor->Post([shared]() { SerialTask::Execute(shared); });
+    } else if (shared_->state == SERIAL_RUNNING) {
+        shared_->state = SERIAL_RUNNING_NOTIFIED;
+    }
+    return;
+}
+// 排队的任务开始执行，状态已经不是SCHEDULED说明被RunInline执行过了
+void SerialTask::Execute(std::shared_ptr<Shared> shared)
+{
+    {
+        std::lock_guard<std::mutex> guard(shared->mutex);
+        if (shared->closed || shared->state != SERIAL_SCHEDULED) {
+            return;
+        }
+        shared->state = SERIAL_RUNNING;
+    }
+    Run(shared);
+    return;
+}
+// 调用前状态已经改成RUNNING，保证同一时刻只有一个线程执行func
+void SerialTask::Run(std::shared_ptr<Shared> shared)
+{
+    shared->func();
+    std::unique_lock<std::mutex> guard(shared->mutex);
+    if (shared->state == SERIAL_RUNNING_NOTIFIED && !shared->closed) {
+        shared->state = SERIAL_SCHEDULED;
+        guard.unlock();
+        shared->executor->Post([shared]() { SerialTask::Execute(shared); });
+        return;
+    }
+    shared->state = SERIAL_IDLE;
+    guard.unlock();
+    shared->idle_cond.notify_all();
+    return;
+}
+bool SerialTask::RunInline()
+{
+    {
+        std::lock_guard<std::mutex> guard(shared_->mutex);
+        if (shared_->closed || shared_->state == SERIAL_RUNNING || shared_->state == SERIAL_RUNNING_NOTIFIED) {
+            return false;
+        }
+        shared_->state = SERIAL_RUNNING;
+    }
+    Run(shared_);
+    return true;
+}
+void SerialTask::Wait()
+{
+    std::unique_lock<std::mutex> guard(shared_->mutex);
+    shared_->idle_cond.wait(guard, [this] { return shared_->state == SERIAL_IDLE || shared_->closed; });
+    return;
+}
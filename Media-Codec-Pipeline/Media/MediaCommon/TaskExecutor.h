@@ -0,0 +1,91 @@
+#ifndef TASK_EXECUTOR_H
+#define TASK_EXECUTOR_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+// SerialTask一次最多处理的数据个数，处理完之后重新排队，避免一路流长时间占用工作线程
+#define SERIAL_TASK_BATCH 16
+
+/**
+ * 进程内共享的任务执行器，线程数按CPU核数而不是按流数
+ * 每个工作线程有自己的任务队列，自己的队列空了从其它线程的队列尾部窃取任务
+ * 执行器线程中投递的任务放入本线程队列，外部线程投递的任务轮流放入各个队列
+ * 任务中不要长时间阻塞；需要等待其它任务的地方应该自己执行(参考SerialTask::RunInline)
+ */
+class TaskExecutor
+{
+public:
+    typedef std::function<void()> Task;
+    // 进程共享的执行器，第一次调用时创建
+    static TaskExecutor *Instance();
+    // 设置共享执行器的线程数，必须在第一次调用Instance之前设置；小于等于0按CPU核数
+    static void SetInstanceThreads(int thread_count);
+    // 当前线程是否是某个执行器的工作线程
+    static bool InWorkerThread();
+
+    explicit TaskExecutor(int thread_count = 0);
+    ~TaskExecutor(); // 执行完已经投递的任务之后退出
+    void Post(Task task);
+    int ThreadCount() const { return (int)workers_.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+    static void WorkThread(TaskExecutor *self, int index);
+    bool TakeTask(int index, Task &task);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cond_;
+    std::atomic<int> pending_ = {0}; // 已投递还没有被取走的任务数
+    std::atomic<unsigned> next_ = {0};
+    std::atomic<bool> abort_ = {false};
+};
+
+/**
+ * 在执行器上串行执行的任务，用来代替模块中"循环取队列"的线程
+ * 数据放入模块自己的队列之后调用Notify；同一时刻只有一个线程在执行func，执行期间的Notify会让func再执行一次
+ * func每次处理一批数据，数据没有处理完时自己再调用Notify
+ */
+class SerialTask
+{
+public:
+    explicit SerialTask(std::function<void()> func, TaskExecutor *executor = TaskExecutor::Instance());
+    ~SerialTask(); // 调用者需要先Wait，析构之后不会再执行func
+    void Notify();
+    // 任务没有在其它线程执行时在当前线程执行一次，返回false表示正在其它线程执行
+    bool RunInline();
+    // 等待正在执行和已经排队的func执行完
+    void Wait();
+
+private:
+    enum State {
+        SERIAL_IDLE,
+        SERIAL_SCHEDULED,
+        SERIAL_RUNNING,
+        SERIAL_RUNNING_NOTIFIED,
+    };
+    struct Shared {
+        std::mutex mutex;
+        std::condition_variable idle_cond;
+        State state = SERIAL_IDLE;
+        bool closed = false;
+        std::function<void()> func;
+        TaskExecutor *executor = NULL;
+    };
+    static void Execute(std::shared_ptr<Shared> shared);
+    static void Run(std::shared_ptr<Shared> shared);
+
+private:
+    std::shared_ptr<Shared> shared_; // 执行器中排队的任务持有引用，析构之后不会访问已经释放的内存
+};
+#endif
@@ -0,0 +1,107 @@
+#include "VideoFrame.h"
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+VideoFrame::VideoFrame()
+{
+}
+VideoFrame::VideoFrame(const AVFrame *frame)
+{
+    if (frame) {
+        frame_ = av_frame_clone(frame); // 带引用计数的frame只增加引用
+    }
+}
+VideoFrame::VideoFrame(const VideoFrame &other)
+{
+    if (other.frame_) {
+        frame_ = av_frame_clone(other.frame_);
+    }
+}
+VideoFrame::VideoFrame(VideoFrame &&other)
+{
+    frame_ = other.frame_;
+    other.frame_ = NULL;
+}
+VideoFrame &VideoFrame::operator=(const VideoFrame &other)
+{
+    if (this != &other) {
+        Reset();
+        if (other.frame_) {
+            frame_ = av_frame_clone(other.frame_);
+        }
+    }
+    return *this;
+}
+VideoFrame &VideoFrame::operator=(VideoFrame &&other)
+{
+    if (this != &other) {
+        Reset();
+        frame_ = other.frame_;
+        other.frame_ = NULL;
+    }
+    return *this;
+}
+VideoFrame::~VideoFrame()
+{
+    Reset();
+}
+void VideoFrame::Reset()
+{
+    if (frame_) {
+        av_frame_free(&frame_);
+        frame_ = NULL;
+    }
+    return;
+}
+int VideoFrame::Width() const
+{
+    return frame_ ? frame_->width : 0;
+}
+int VideoFrame::Height() const
+{
+    return frame_ ? frame_->height : 0;
+}
+int VideoFrame::Format() const
+{
+    return frame_ ? frame_->format : -1;
+}
+uint8_t *VideoFrame::Data(int plane) const
+{
+    return (frame_ && plane >= 0 && plane < AV_NUM_DATA_POINTERS) ? frame_->data[plane] : NULL;
+}
+int VideoFrame::Stride(int plane) const
+{
+    return (frame_ && plane >= 0 && plane < AV_NUM_DATA_POINTERS) ? frame_->linesize[plane] : 0;
+}
+int64_t VideoFrame::Pts() const
+{
+    return frame_ ? frame_->pts : AV_NOPTS_VALUE;
+}
+// 每个线程缓存一个转换上下文，尺寸和格式不变时不用重新创建
+struct BGRSwsCache {
+    struct SwsContext *ctx = NULL;
+    ~BGRSwsCache()
+    {
+        if (ctx) {
+            sws_freeContext(ctx);
+        }
+    }
+};
+cv::Mat VideoFrame::ToBGR() const
+{
+    if (!frame_) {
+        return cv::Mat();
+    }
+    static thread_local BGRSwsCache cache;
+    cache.ctx = sws_getCachedContext(cache.ctx, frame_->width, frame_->height, (AVPixelFormat)frame_->format, frame_->width, frame_->height, AV_PIX_FMT_BGR24, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!cache.ctx) {
+        return cv::Mat();
+    }
+    cv::Mat bgr(frame_->height, frame_->width, CV_8UC3);
+    uint8_t *dst[4] = {bgr.data, NULL, NULL, NULL};
+    int linesize[4] = {(int)bgr.step[0], 0, 0, 0};
+    sws_scale(cache.ctx, frame_->data, frame_->linesize, 0, frame_->height, dst, linesize);
+    return bgr;
+}
@@ -0,0 +1,40 @@
+#ifndef VIDEO_FRAME_H
+#define VIDEO_FRAME_H
+#include <stdint.h>
+#include <opencv2/core.hpp>
+struct AVFrame;
+
+/**
+ * 解码器原生格式(YUV420P/NV12等)的图像，内存由AVFrame的引用计数管理
+ * 拷贝和传递只增加引用，不拷贝图像；最后一个VideoFrame析构时释放
+ * 需要BGR的使用方调用ToBGR，只有这时才做颜色转换
+ */
+class VideoFrame
+{
+public:
+    VideoFrame();
+    explicit VideoFrame(const AVFrame *frame); // 增加frame的引用计数
+    VideoFrame(const VideoFrame &other);
+    VideoFrame(VideoFrame &&other);
+    VideoFrame &operator=(const VideoFrame &other);
+    VideoFrame &operator=(VideoFrame &&other);
+    ~VideoFrame();
+
+    bool Empty() const { return frame_ == NULL; }
+    int Width() const;
+    int Height() const;
+    int Format() const; // AVPixelFormat
+    uint8_t *Data(int plane) const;
+    int Stride(int plane) const;
+    int64_t Pts() const;
+    const AVFrame *GetAVFrame() const { return frame_; }
+    // 转换成BGR，每次调用都会做一次颜色转换
+    cv::Mat ToBGR() const;
+
+private:
+    void Reset();
+
+private:
+    AVFrame *frame_ = NULL;
+};
+#endif
@@ -440,7 +440,7 @@ int Muxer::SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, i
     if (stream_index == video_index_) {
 
         if (video_type_ == VIDEO_H264) {
-            nal_type = data[0] & 0x1f;
+            nal_type = H264NalType(data);
             if (nal_type == 7 || nal_type == 5) {
                 found_idr_ = true;
             }
@@ -482,7 +482,7 @@ int Muxer::SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, i
                 pkt_.flags |= AV_PKT_FLAG_KEY;
             }
         } else if (video_type_ == VIDEO_H265) {
-            nal_type = (data[0] >> 1) & 0x3f;
+            nal_type = H265NalType(data);
             if (nal_type == 32 || nal_type == 19) {
                 found_idr_ = true;
             }
@@ -540,13 +540,10 @@ int Muxer::SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, i
             av_packet_unref(&pkt_);
             return 0;
         }
-        if (frames_video_ == 0) {
-            start_pts_video_ = pts;
-            start_dts_video_ = dts;
-        }
+        int64_t start = StartOffset(video_index_, dts);
         frames_video_++;
-        pkt_.pts = pts - start_pts_video_;
-        pkt_.dts = dts - start_dts_video_;
+        pkt_.pts = pts - start;
+        pkt_.dts = dts - start;
         if (last_pts_video_ >= pkt_.pts) {
             // log_error("video pts error last_pts_video_:{} now pts:{}",last_pts_video_,pkt.pts);
             pkt_.pts = last_pts_video_ + 1;
@@ -555,17 +552,8 @@ int Muxer::SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, i
             // log_error("video dts error last_dts_video_:{} now dts:{}",last_dts_video_,pkt.dts);
             pkt_.dts = last_dts_video_ + 1;
         }
-        if (find_first_frame_) {
-            pkt_.pts += start_media_pts_;
-            pkt_.dts += start_media_pts_;
-        }
         last_pts_video_ = pkt_.pts;
         last_dts_video_ = pkt_.dts;
-
-        if (!find_first_frame_) {
-            start_media_pts_ = pkt_.pts;
-            find_first_frame_ = true;
-        }
         int ret = av_interleaved_write_frame(fmt_ctx_, &pkt_);
         av_packet_unref(&pkt_);
         if (ret == 0) {
@@ -577,13 +565,10 @@ int Muxer::SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, i
             return -1;
         }
     } else if (stream_index == audio_index_) {
-        if (frames_audio_ == 0) {
-            start_pts_audio_ = pts;
-            start_dts_audio_ = dts;
-        }
+        int64_t start = StartOffset(audio_index_, dts);
         frames_audio_++;
-        pkt_.pts = pts - start_pts_audio_;
-        pkt_.dts = dts - start_dts_audio_;
+        pkt_.pts = pts - start;
+        pkt_.dts = dts - start;
         if (last_pts_audio_ >= pkt_.pts) {
             // log_error("audio pts error last_pts_video_:{} now pts:{}",last_pts_audio_,pkt_.pts);
             pkt_.pts = last_pts_audio_ + 1;
@@ -592,16 +577,8 @@ int Muxer::SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, i
             // log_error("audio dts error last_dts_video_:{} now dts:{}",last_dts_audio_,pkt_.dts);
             pkt_.dts = last_dts_audio_ + 1;
         }
-        if (find_first_frame_) {
-            pkt_.pts += start_media_pts_;
-            pkt_.dts += start_media_pts_;
-        }
         last_pts_audio_ = pkt_.pts;
         last_dts_audio_ = pkt_.dts;
-        if (!find_first_frame_) {
-            start_media_pts_ = pkt_.pts;
-            find_first_frame_ = true;
-        }
         auto data_copy = (uint8_t *)av_malloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
         memcpy(data_copy, data, size);
         av_packet_from_data(&pkt_, data_copy, size);
@@ -619,6 +596,145 @@ int Muxer::SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, i
     }
     return 0;
 }
+// 音视频共用一个起点：最先写入的包的dts，换算到各自的时间基之后减去，保留源的音视频偏移
+// 比起点早的包时间戳为负，由调用处的单调递增检查调整到0之后
+int64_t Muxer::StartOffset(int stream_index, int64_t dts)
+{
+    AVRational time_base = fmt_ctx_->streams[stream_index]->time_base;
+    AVRational time_base_q = {1, AV_TIME_BASE};
+    if (!start_time_set_) {
+        start_time_us_ = av_rescale_q(dts, time_base, time_base_q);
+        start_time_set_ = true;
+    }
+    return av_rescale_q(start_time_us_, time_base_q, time_base);
+}
+// 是参数集时返回true，参数集有变化时保存并重写extradata
+bool Muxer::UpdateParameterSet(unsigned char *data, int size, int nal_type)
+{
+    uint8_t **bufs = NULL;
+    int *lens = NULL;
+    int *number = NULL;
+    int max_number = 0;
+    bool change_flag = false;
+    if (video_type_ == VIDEO_H265 && nal_type == 32) {
+        change_flag = ParametersChange(data, size, NULL, -1, NULL, -1);
+        bufs = vps_buf_, lens = vps_len_, number = &vps_number_, max_number = 16;
+    } else if ((video_type_ == VIDEO_H264 && nal_type == 7) || (video_type_ == VIDEO_H265 && nal_type == 33)) {
+        change_flag = ParametersChange(NULL, -1, data, size, NULL, -1);
+        bufs = sps_buf_, lens = sps_len_, number = &sps_number_, max_number = 32;
+    } else if ((video_type_ == VIDEO_H264 && nal_type == 8) || (video_type_ == VIDEO_H265 && nal_type == 34)) {
+        change_flag = ParametersChange(NULL, -1, NULL, -1, data, size);
+        bufs = pps_buf_, lens = pps_len_, number = &pps_number_, max_number = 256;
+    } else {
+        return false;
+    }
+    if (change_flag && *number < max_number) {
+        bufs[*number] = (uint8_t *)malloc(size);
+        memcpy(bufs[*number], data, size);
+        lens[*number] = size;
+        (*number)++;
+        RewriteVideoExtraData();
+        log_debug("rewrite parameter set ok nal_type:{}", nal_type);
+    }
+    return true;
+}
+// 一帧的所有NALU作为一个packet写入，pts/dts使用源码流的时间戳，转封装时使用
+int Muxer::SendVideoFrame(unsigned char *data, int size, int64_t pts, int64_t dts)
+{
+    std::lock_guard<std::mutex> guard(mtx_);
+    if (video_index_ < 0 || size <= 0) {
+        log_warn("video stream:{} frame size:{}", video_index_, size);
+        return -1;
+    }
+    frame_nals_.clear();
+    int out_size = 0;
+    bool key_frame = false;
+    NalIterator nal_iter(data, size);
+    NalUnit nal;
+    while (nal_iter.Next(nal)) {
+        if (nal.len <= nal.start_code) {
+            continue;
+        }
+        unsigned char *nal_data = (unsigned char *)nal.data + nal.start_code;
+        int nal_size = nal.len - nal.start_code;
+        int nal_type;
+        if (video_type_ == VIDEO_H264) {
+            nal_type = H264NalType(nal_data);
+            if (nal_type == 9) { // 分隔符
+                continue;
+            }
+            if (nal_type == 5) {
+                key_frame = true;
+            }
+        } else {
+            nal_type = H265NalType(nal_data);
+            if (nal_type == 35) { // 分隔符
+                continue;
+            }
+            if (nal_type >= 16 && nal_type <= 21) { // IRAP
+                key_frame = true;
+            }
+        }
+        // mp4等格式参数集放在extradata中，不写入packet；ts等格式保留在码流中
+        if (UpdateParameterSet(nal_data, nal_size, nal_type) && global_header_) {
+            continue;
+        }
+        frame_nals_.push_back(nal);
+        out_size += 4 + nal_size;
+    }
+    if (key_frame) {
+        found_idr_ = true;
+    }
+    if (!found_idr_ || out_size == 0) {
+        return 0;
+    }
+    // 起始码统一替换成4字节：mp4为NALU长度，其他格式为00 00 00 01
+    uint8_t *data_copy = (uint8_t *)av_malloc(out_size + AV_INPUT_BUFFER_PADDING_SIZE);
+    uint8_t *dst = data_copy;
+    for (size_t i = 0; i < frame_nals_.size(); i++) {
+        int nal_size = frame_nals_[i].len - frame_nals_[i].start_code;
+        if (global_header_) {
+            dst[0] = (nal_size) >> 24;
+            dst[1] = (nal_size) >> 16;
+            dst[2] = (nal_size) >> 8;
+            dst[3] = nal_size & 0xff;
+        } else {
+            dst[0] = dst[1] = dst[2] = 0;
+            dst[3] = 1;
+        }
+        memcpy(dst + 4, frame_nals_[i].data + frame_nals_[i].start_code, nal_size);
+        dst += 4 + nal_size;
+    }
+    memset(dst, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    av_packet_from_data(&pkt_, data_copy, out_size);
+    pkt_.stream_index = video_index_;
+    pkt_.duration = 0;
+    pkt_.pos = -1;
+    if (key_frame) {
+        pkt_.flags |= AV_PKT_FLAG_KEY;
+    }
+    int64_t start = StartOffset(video_index_, dts);
+    frames_video_++;
+    pkt_.dts = dts - start;
+    pkt_.pts = pts - start; // pts和dts使用同一个起点，保留B帧的显示顺序
+    if (last_dts_video_ >= pkt_.dts) {
+        pkt_.dts = last_dts_video_ + 1;
+    }
+    if (pkt_.pts < pkt_.dts) {
+        pkt_.pts = pkt_.dts;
+    }
+    last_pts_video_ = pkt_.pts;
+    last_dts_video_ = pkt_.dts;
+    int ret = av_interleaved_write_frame(fmt_ctx_, &pkt_);
+    av_packet_unref(&pkt_);
+    if (ret != 0) {
+        char errbuf[1024] = {0};
+        av_strerror(ret, errbuf, sizeof(errbuf) - 1);
+        log_error("av_interleaved_write_frame failed:{} {} pts:{}", errbuf, ret, last_pts_video_);
+        return -1;
+    }
+    return 0;
+}
 
 int Muxer::SendTrailer()
 {
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <thread>
+#include <vector>
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -18,6 +19,7 @@ extern "C" {
 #include <libswscale/swscale.h>
 };
 #include "TypeDef.h"
+#include "NalScanner.h"
 #include "log_helpers.h"
 /**
  *   Init-> AddVideo/AddAudio->Open->SendHeader->SendPacket->SendTrailer
@@ -46,6 +48,7 @@ public:
 
     int SendHeader();
     int SendPacket(unsigned char *data, int size, int64_t pts, int64_t dts, int stream_index); // video:one NALU without startCodes
+    int SendVideoFrame(unsigned char *data, int size, int64_t pts, int64_t dts);                 // video:one access unit with startCodes
     int SendTrailer();
 
     int GetAudioStreamIndex();
@@ -57,6 +60,8 @@ private:
     void RewriteVideoExtraData();
     void AACWriteExtra(int channels, int sample_rate, int profile, AVCodecParameters *params);
     bool ParametersChange(unsigned char *vps, int vps_len, unsigned char *sps, int sps_len, unsigned char *pps, int pps_len);
+    bool UpdateParameterSet(unsigned char *data, int size, int nal_type);
+    int64_t StartOffset(int stream_index, int64_t dts); // 返回起点在这个流时间基下的值
 
 public:
     AVFormatContext *fmt_ctx_ = NULL;
@@ -66,21 +71,17 @@ public:
     AVStream *aud_stream_ = NULL;
     AudioType audio_type_;
     int frames_video_ = 0;
-    int64_t start_pts_video_ = 0;
-    int64_t start_dts_video_ = 0;
-    int64_t last_pts_video_ = 0;
-    int64_t last_dts_video_ = 0;
+    int64_t last_pts_video_ = -1; // 第一个包的时间戳调整到不小于0
+    int64_t last_dts_video_ = -1;
 
     AVStream *vid_stream_ = NULL;
     VideoType video_type_;
     int frames_audio_ = 0;
-    int64_t start_pts_audio_ = 0;
-    int64_t start_dts_audio_ = 0;
-    int64_t last_pts_audio_ = 0;
-    int64_t last_dts_audio_ = 0;
+    int64_t last_pts_audio_ = -1;
+    int64_t last_dts_audio_ = -1;
 
-    int64_t start_media_pts_ = 0;
-    bool find_first_frame_ = false;
+    int64_t start_time_us_ = 0; // 音视频共用的起点，由最先写入的流设置
+    bool start_time_set_ = false;
 
     int audio_index_ = -1;
     int video_index_ = -1;
@@ -99,6 +100,7 @@ public:
     bool found_idr_ = false;
     AVPacket pkt_;
     bool global_header_ = false;
+    std::vector<NalUnit> frame_nals_; // SendVideoFrame中一帧的NALU
 };
 
 #endif
\ No newline at end of file
@@ -1,103 +1,10 @@
 #include "MediaReader.h"
 
-
-static inline int StartCode3(unsigned char *buf)
-{
-    if (buf[0] == 0 && buf[1] == 0 && buf[2] == 1)
-        return 1;
-    else
-        return 0;
-}
-static inline int StartCode4(unsigned char *buf)
-{
-    if (buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] == 1)
-        return 1;
-    else
-        return 0;
-}
-
-/*通过指定的buf，读取一个NALU数据到frame中*/
-int GetNALUFromBuf(unsigned char **frame, struct BufSt *buf)
-{
-    int startcode;
-    unsigned char *pstart;
-    unsigned char *tmp;
-    int frame_len;
-    int bufoverflag = 1;
-
-    if (buf->pos >= buf->buf_len) {
-        buf->stat = WRITE;
-        // printf("h264buf empty\n");
-        return -1;
-    }
-
-    if (!StartCode3(buf->buf + buf->pos) && !StartCode4(buf->buf + buf->pos)) {
-        printf("statrcode err\n");
-        return -1;
-    }
-
-    if (StartCode3(buf->buf + buf->pos)) {
-        startcode = 3;
-    } else
-        startcode = 4;
-
-    pstart = buf->buf + buf->pos; // pstart跳过之前已经读取的数据指向本次NALU的起始码
-
-    tmp = pstart + startcode; // 指向NALU数据
-
-    for (int i = 0; i < buf->buf_len - buf->pos - 3; i++) // pos表示起始码的位置，所以已经读取的数据长度也应该是pos个字节
-    {
-        if (StartCode3(tmp) || StartCode4(tmp)) // 此时tmp指向下一个起始码位置
-        {
-            frame_len = tmp - pstart; // 包含起始码的NALU长度
-            bufoverflag = 0;
-            break;
-        }
-        tmp++;
-    }
-    if (bufoverflag == 1) {
-        frame_len = buf->buf_len - buf->pos;
-    }
-
-    *frame = buf->buf + buf->pos;
-
-    buf->pos += frame_len;
-    /*buf中的数据全部读取完毕，设置buf状态为WREIT*/
-    if (buf->pos >= buf->buf_len) {
-        buf->stat = WRITE;
-    }
-    return frame_len;
-}
-
-/*从buf中解析NALU数据*/
-void MediaReader::PraseFrame()
-{
-    /*frameREAD,bufferWRITE状态不可访问*/
-    if (frame_->stat == READ || buffer_->stat == WRITE) {
-        printf("stat err\n");
-        return;
-    }
-
-    /*buf处于可读状态并且frame处于可写状态*/
-    frame_->frame_len = GetNALUFromBuf(&frame_->frame, buffer_);
-
-    if (frame_->frame_len < 0) {
-        printf("GetNALUFromBuf err");
-        return;
-    }
-
-    if (StartCode3(frame_->frame))
-        frame_->startcode = 3;
-    else
-        frame_->startcode = 4;
-    frame_->stat = READ;
-    return;
-}
 static double R2d(AVRational r)
 {
     return r.den == 0 ? 0 : (double)r.num / (double)r.den;
 }
-void MediaReader::VideoInit(char *filename)
+int MediaReader::VideoInit(char *filename)
 {
     int ret;
     char errors[1024];
@@ -106,13 +13,13 @@ void MediaReader::VideoInit(char *filename)
 
         av_strerror(ret, errors, 1024);
         DEBUGPRINT("Could not open source file: %s, %d(%s)\n", filename, ret, errors);
-        exit(1);
+        return -1;
     }
 
     if ((ret = avformat_find_stream_info(format_ctx_, NULL)) < 0) {
         av_strerror(ret, errors, 1024);
         DEBUGPRINT("Could not open source file: %s, %d(%s)\n", filename, ret, errors);
-        exit(1);
+        return -1;
     }
 
     // av_dump_format(format_ctx_, 0, filename, 0);
@@ -124,7 +31,7 @@ void MediaReader::VideoInit(char *filename)
     video_index_ = av_find_best_stream(format_ctx_, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
     if (video_index_ < 0) {
         DEBUGPRINT("no video\n");
-        exit(1);
+        return -1;
     }
     AVCodecParameters *codec_parameters = format_ctx_->streams[video_index_]->codecpar;
     enum AVCodecID codec_id = codec_parameters->codec_id;
@@ -152,10 +59,16 @@ void MediaReader::VideoInit(char *filename)
     AVStream *as = format_ctx_->streams[video_index_];
     fps_ = R2d(as->avg_frame_rate);
     printf("%s:%d fps_:%d\n", __FILE__, __LINE__, fps_);
-    return;
+    if (fps_ <= 0) {
+        fps_ = 25; // 没有帧率信息的码流按25帧处理，避免读包线程除0
+    }
+    return 0;
 }
 enum VideoType MediaReader::GetVideoType()
 {
+    if (video_index_ < 0) {
+        return VIDEO_NONE;
+    }
     AVCodecParameters *codec_parameters = format_ctx_->streams[video_index_]->codecpar;
     enum AVCodecID codec_id = codec_parameters->codec_id;
     if (codec_id == AV_CODEC_ID_H264) {
@@ -178,26 +91,33 @@ enum AudioType MediaReader::GetAudioType()
     return AUDIO_NONE;
 }
 
-MediaReader::MediaReader(char *file_path)
+MediaReader::MediaReader(char *file_path, bool offline)
 {
     file_ = file_path;
+    offline_ = offline;
+    memset(&packet_, 0, sizeof(packet_));
 
-    buffer_ = (struct BufSt*)malloc(sizeof(struct BufSt));
-    buffer_->buf_len = 0;
-    buffer_->pos = 0;
-    buffer_->stat = WRITE;
-
-    frame_ = (struct FrameSt*)malloc(sizeof(struct FrameSt));
-    frame_->stat = WRITE;
-    VideoInit(file_path);
+    // 打开失败时不启动线程，由调用者通过IsOpened判断，不退出进程
+    if (VideoInit(file_path) < 0) {
+        video_index_ = -1;
+        audio_index_ = -1;
+        return;
+    }
+    opened_ = true;
 
     video_finish_ = false;
     audio_finish_ = false;
     file_finish_ = false;
+    video_list_.SetCapacity(READER_MAX_PACKETS);
+    video_list_.SetSizeFunc([](const AVPacket &pkt) { return (size_t)pkt.size; });
+    video_list_.SetReleaseFunc([](AVPacket &pkt) { av_packet_unref(&pkt); });
+    audio_list_.SetCapacity(READER_MAX_PACKETS);
+    audio_list_.SetSizeFunc([](const AVPacket &pkt) { return (size_t)pkt.size; });
+    audio_list_.SetReleaseFunc([](AVPacket &pkt) { av_packet_unref(&pkt); });
 
     th_file_ = std::thread(MediaReaderThread, this);
     th_video_ = std::thread(VideoSyncThread, this);
-    if (audio_index_ > 0) {
+    if (HaveAudio()) {
         int video_time = 1000 * 1000 / fps_;
         AVCodecParameters *codecpar = format_ctx_->streams[audio_index_]->codecpar;
         int audio_time = 1000 * 1000 / (codecpar->sample_rate / codecpar->frame_size);
@@ -236,10 +156,24 @@ void MediaReader::GetAudioCon(int &channels, int &sample_rate, int &profile, int
     bit_per_sample = format_ctx_->streams[audio_index_]->codecpar->bits_per_coded_sample;
     return;
 }
+void MediaReader::SetMetrics(StageMetrics *video_metrics, StageMetrics *audio_metrics)
+{
+    video_list_.SetMetrics(video_metrics);
+    audio_list_.SetMetrics(audio_metrics);
+    return;
+}
 void MediaReader::SetDataListner(MediaDataListner *lisnter, CloseCallbackFunc cb)
 {
     data_listner_ = lisnter;
     colse_cb_ = cb;
+    NotifyState(); // 离线模式下同步线程会等待listner设置之后才开始取包
+    return;
+}
+void MediaReader::NotifyState()
+{
+    std::unique_lock<std::mutex> guard(state_mtx_); // 加锁之后再通知，避免等待线程检查完条件还没进入等待时漏掉通知
+    guard.unlock();
+    state_cond_.notify_all();
     return;
 }
 
@@ -255,50 +189,54 @@ void *MediaReader::MediaReaderThread(void *arg)
         audio_time = 1000 * 1000 / (codecpar->sample_rate / codecpar->frame_size);
         printf("%s:%d sample_rate:%d frame_size:%d audio_time:%d video_time:%d\n", __FILE__, __LINE__, codecpar->sample_rate, codecpar->frame_size, audio_time, video_time);
     }
-    int min_sleep_time = (video_time < audio_time) ? video_time : audio_time; // 微妙
     int last_idx = -1;
     bool have_report = false;
     while (!self->abort_) {
         if (self->file_finish_ == true) {
-            if (self->video_finish_ && self->audio_finish_) {
-                if (self->colse_cb_ != NULL && !have_report) {
-                    self->colse_cb_();
-                    have_report = true;
-                }
+            // 文件读完之后等待同步线程处理完剩余的包、Reset或者退出，不再轮询
+            std::unique_lock<std::mutex> guard(self->state_mtx_);
+            self->state_cond_.wait(guard, [self, have_report] {
+                return self->abort_ || !self->file_finish_ || (!have_report && self->colse_cb_ != NULL && self->video_finish_ && self->audio_finish_);
+            });
+            guard.unlock();
+            if (self->file_finish_ && self->video_finish_ && self->audio_finish_ && self->colse_cb_ != NULL && !have_report) {
+                self->colse_cb_();
+                have_report = true;
             }
-            av_usleep(min_sleep_time / 2);
             continue;
         }
         have_report = false;
         ret = av_read_frame(self->format_ctx_, &self->packet_);
         if (ret < 0) {
-            self->file_finish_ = true;
             DEBUGPRINT("%s:%d %s file over\n", __FILE__, __LINE__, self->format_ctx_->url);
             av_packet_unref(&self->packet_); // av_read_frame返回小于0得时候也对packet_分配了缓冲区，所以要释放
-            av_usleep(min_sleep_time / 2);
+            // stream_index为-1的空包是结束标志，同步线程处理完前面的包之后置位video_finish_/audio_finish_
+            AVPacket eof_packet;
+            memset(&eof_packet, 0, sizeof(eof_packet));
+            eof_packet.stream_index = -1;
+            self->video_list_.Push(eof_packet);
+            if (self->HaveAudio()) {
+                self->audio_list_.Push(eof_packet);
+            }
+            self->file_finish_ = true;
             continue;
         }
         if (self->packet_.stream_index == self->audio_index_) {
-            if (last_idx == self->packet_.stream_index) {
+            if (!self->offline_ && last_idx == self->packet_.stream_index) {
                 av_usleep(audio_time / 2);
             }
             AVPacket audio_packet;
             av_packet_ref(&audio_packet, &self->packet_);
-            std::unique_lock<std::mutex> guard(self->audio_mtx_);
-            self->audio_list_.push_back(audio_packet);
-            guard.unlock();
-            self->audio_cond_.notify_one();
+            // 离线模式不休眠，队列满了等待同步线程消费，避免把整个文件读进内存
+            self->audio_list_.Push(audio_packet);
 
         } else if (self->packet_.stream_index == self->video_index_) {
-            if (last_idx == self->packet_.stream_index) {
+            if (!self->offline_ && last_idx == self->packet_.stream_index) {
                 av_usleep(video_time);
             }
             AVPacket video_packet;
             av_packet_ref(&video_packet, &self->packet_);
-            std::unique_lock<std::mutex> guard(self->video_mtx_);
-            self->video_list_.push_back(video_packet);
-            guard.unlock();
-            self->video_cond_.notify_one();
+            self->video_list_.Push(video_packet);
         }
         av_packet_unref(&self->packet_);
         last_idx = self->packet_.stream_index;
@@ -309,22 +247,8 @@ void *MediaReader::MediaReaderThread(void *arg)
 }
 void MediaReader::Reset()
 {
-    std::unique_lock<std::mutex> guard_video(video_mtx_);
-    while (!video_list_.empty()) {
-        AVPacket video_packet;
-        video_packet = video_list_.front();
-        video_list_.pop_front();
-        av_packet_unref(&video_packet);
-    }
-    guard_video.unlock();
-    std::unique_lock<std::mutex> guard_audio(audio_mtx_);
-    while (!audio_list_.empty()) {
-        AVPacket audio_packet;
-        audio_packet = audio_list_.front();
-        audio_list_.pop_front();
-        av_packet_unref(&audio_packet);
-    }
-    guard_audio.unlock();
+    video_list_.Clear();
+    audio_list_.Clear();
     audio_reset_ = true;
     video_reset_ = true;
     av_seek_frame(format_ctx_, -1, 0, AVSEEK_FLAG_BACKWARD);
@@ -333,133 +257,184 @@ void MediaReader::Reset()
     if (audio_index_ >= 0) {
         audio_finish_ = false;
     }
+    NotifyState();
     DEBUGPRINT("%s:%d reset ok\n", __FILE__, __LINE__);
     return;
 }
+// 一路流的时间戳状态，同步线程内使用
+struct StreamClock {
+    int64_t last_dts = AV_NOPTS_VALUE; // 文件中上一个packet的dts(微秒)
+    int64_t last_out_dts = AV_NOPTS_VALUE; // 上一次输出的dts，循环读文件时从这里接着递增
+    int64_t offset = 0;
+    bool rebase = false;
+};
+/**
+ * packet的时间戳转换成微秒(int64，不会溢出)，pts和dts缺一个时互相补齐，都没有时按上一帧加duration外推
+ * file_pts/file_dts是文件中的时间戳，用于按时间戳休眠；pts/dts加上了循环读文件的偏移，保证输出单调递增
+ */
+static void RescaleTimestamp(const AVPacket &packet, AVRational time_base, int64_t duration, StreamClock &clock,
+                             int64_t &file_pts, int64_t &file_dts, int64_t &pts, int64_t &dts)
+{
+    AVRational time_base_q = {1, AV_TIME_BASE};
+    file_pts = packet.pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : av_rescale_q(packet.pts, time_base, time_base_q);
+    file_dts = packet.dts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : av_rescale_q(packet.dts, time_base, time_base_q);
+    if (file_dts == AV_NOPTS_VALUE) {
+        file_dts = file_pts;
+    }
+    if (file_dts == AV_NOPTS_VALUE) {
+        file_dts = clock.last_dts == AV_NOPTS_VALUE ? 0 : clock.last_dts + duration;
+    }
+    if (file_pts == AV_NOPTS_VALUE) {
+        file_pts = file_dts;
+    }
+    if (clock.rebase) {
+        clock.rebase = false;
+        if (clock.last_out_dts != AV_NOPTS_VALUE) {
+            clock.offset = clock.last_out_dts + duration - file_dts;
+        }
+    }
+    clock.last_dts = file_dts;
+    pts = file_pts + clock.offset;
+    dts = file_dts + clock.offset;
+    clock.last_out_dts = dts;
+    return;
+}
 void *MediaReader::VideoSyncThread(void *arg)
 {
     MediaReader *self = (MediaReader *)arg;
     int64_t curtimestamp;
     AVRational time_base = self->format_ctx_->streams[self->video_index_]->time_base;
-    AVRational time_base_q = {1, AV_TIME_BASE};
     int64_t start_time = av_gettime();
     int64_t starttimestamp = -1;
+    int64_t frame_id = 0;
+    StreamClock clock;
+    int64_t frame_duration = AV_TIME_BASE / self->fps_;
     int ret;
     while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->video_mtx_); // std::unique_lock<std::mutex> guard方式手动解锁的时候不要使用self->video_mtx_.unlock()的方式解锁(会概率性报错)，推荐使用guard.unlock();
-        if (self->file_finish_ && self->video_list_.empty()) {
+        if (self->offline_ && !self->data_listner_) { // 离线模式下等待listner设置之后才开始取包，避免数据被丢弃
+            std::unique_lock<std::mutex> guard(self->state_mtx_);
+            self->state_cond_.wait(guard, [self] { return self->abort_ || self->data_listner_ != NULL; });
+            continue;
+        }
+        AVPacket video_packet;
+        if (!self->video_list_.Pop(video_packet, -1)) { // 析构时队列已经关闭
+            break;
+        }
+        if (video_packet.stream_index < 0) { // 文件结束标志
             self->video_finish_ = true;
-            guard.unlock();
-            av_usleep(1000 * 1000 / self->fps_);
+            self->NotifyState();
             continue;
         }
         if (self->video_reset_) {
             start_time = av_gettime();
             starttimestamp = -1;
+            clock.rebase = true;
             self->video_reset_ = !self->video_reset_;
         }
-        if (!self->video_list_.empty()) {
-            AVPacket video_packet;
-            video_packet = self->video_list_.front();
-            self->video_list_.pop_front();
-            guard.unlock();
-            curtimestamp = av_rescale_q(video_packet.dts, time_base, time_base_q); // 没有B帧的时候pts==dts，有B帧的时候pts!=dts
-            if (starttimestamp == -1) {
-                starttimestamp = curtimestamp;
-                self->video_start_timestamp_ = starttimestamp;
-            }
-            // if (self->is_mp4_) {
-            //     self->Mp4ToAnnexb(video_packet);
-            // }
-            // self->buffer_->buf = video_packet.data;
-            // self->buffer_->buf_len = video_packet.size;
-            // self->buffer_->stat = READ;
-            // self->buffer_->pos = 0;
-            int pts = av_rescale_q(video_packet.pts, time_base, time_base_q);
-            int dts = av_rescale_q(video_packet.dts, time_base, time_base_q);
-            
-            int64_t now_time = av_gettime() - start_time;
-            if (self->HaveAudio()) {
-                int diff = curtimestamp - self->audio_now_time_;
-                if (std::abs(diff) <= self->sync_threshold_) {
-                    // do nothing
-                } else {
-                    if (diff < 0) { // 视频落后音频,加快播放
-                        curtimestamp -= std::abs(diff);
-                    } else if (diff > 0) { // 视频快于音频，降低播放速度
-                        curtimestamp += std::abs(diff) / 2;
-                    }
-                }
-                if ((curtimestamp - starttimestamp) > now_time) {
-                    int sleepTime = curtimestamp - starttimestamp - now_time;
-                    // printf("%s:%d video time:%ld sleepTime:%ld\n",__FILE__, __LINE__,curtimestamp,sleepTime);
-                    av_usleep(sleepTime);
-                }
+        int64_t file_pts, pts, dts;
+        RescaleTimestamp(video_packet, time_base, frame_duration, clock, file_pts, curtimestamp, pts, dts); // 没有B帧的时候pts==dts，有B帧的时候pts!=dts
+        if (starttimestamp == -1) {
+            starttimestamp = curtimestamp;
+            self->video_start_timestamp_ = starttimestamp;
+        }
+        // if (self->is_mp4_) {
+        //     self->Mp4ToAnnexb(video_packet);
+        // }
+
+        int64_t now_time = av_gettime() - start_time;
+        if (self->offline_) {
+            // 离线模式不做音视频同步，也不按时间戳休眠
+        } else if (self->HaveAudio()) {
+            int diff = curtimestamp - self->audio_now_time_;
+            if (std::abs(diff) <= self->sync_threshold_) {
+                // do nothing
             } else {
-                if ((curtimestamp - starttimestamp) > now_time) {
-                    int sleepTime = curtimestamp - starttimestamp - now_time;
-                    // printf("%s:%d video time:%ld sleepTime:%ld\n",__FILE__, __LINE__,curtimestamp,sleepTime);
-                    av_usleep(sleepTime);
+                if (diff < 0) { // 视频落后音频,加快播放
+                    curtimestamp -= std::abs(diff);
+                } else if (diff > 0) { // 视频快于音频，降低播放速度
+                    curtimestamp += std::abs(diff) / 2;
                 }
             }
-            av_bsf_send_packet(self->bsf_ctx_, &video_packet);
-            while (!self->abort_){
-                av_packet_unref(&video_packet);
-                if(self->is_mp4_){
-                    ret = av_bsf_receive_packet(self->bsf_ctx_, &video_packet);
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF){
-                        break;
-                    }
-                    else if (ret < 0) {
-                        printf("av bsf receive pkt failed!\n");
-                        break;
-                    }
+            if ((curtimestamp - starttimestamp) > now_time) {
+                int sleepTime = curtimestamp - starttimestamp - now_time;
+                // printf("%s:%d video time:%ld sleepTime:%ld\n",__FILE__, __LINE__,curtimestamp,sleepTime);
+                av_usleep(sleepTime);
+            }
+        } else {
+            if ((curtimestamp - starttimestamp) > now_time) {
+                int sleepTime = curtimestamp - starttimestamp - now_time;
+                // printf("%s:%d video time:%ld sleepTime:%ld\n",__FILE__, __LINE__,curtimestamp,sleepTime);
+                av_usleep(sleepTime);
+            }
+        }
+        int64_t ingest_us = LatencyTracker::NowUs(); // 按时间戳休眠之后送出的时间，模拟实时流的到达时间
+        av_bsf_send_packet(self->bsf_ctx_, &video_packet);
+        while (!self->abort_){
+            av_packet_unref(&video_packet);
+            if(self->is_mp4_){
+                ret = av_bsf_receive_packet(self->bsf_ctx_, &video_packet);
+                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF){
+                    break;
                 }
-                self->buffer_->buf = video_packet.data;
-                self->buffer_->buf_len = video_packet.size;
-                self->buffer_->stat = READ;
-                self->buffer_->pos = 0;
-                while (self->buffer_->stat == READ) {
-                    self->PraseFrame();
-                    if (self->frame_->stat == WRITE) {
-                        continue;
-                    }
+                else if (ret < 0) {
+                    printf("av bsf receive pkt failed!\n");
+                    break;
+                }
+            }
+            if (self->au_mode_) { // bsf输出的packet就是完整的一帧(带起始码)，一次回调，不拆分NALU
+                if (self->data_listner_ && video_packet.size > 0) {
                     VideoData data;
-                    data.data = self->frame_->frame;         //+self->frame_->startcode;
-                    data.data_len = self->frame_->frame_len; //-self->frame_->startcode;
+                    data.data = video_packet.data;
+                    data.data_len = video_packet.size;
+                    data.buf = video_packet.buf;
                     data.pts = pts;
                     data.dts = dts;
-
-                    int type = -1;
-                    AVCodecParameters *codec_parameters = self->format_ctx_->streams[self->video_index_]->codecpar;
-                    enum AVCodecID codecId = codec_parameters->codec_id;
-                    if (codecId == AV_CODEC_ID_H264) {
-                        type = data.data[0] & 0x1f;
-                    } else if (codecId == AV_CODEC_ID_H265 || codecId == AV_CODEC_ID_HEVC) {
-                        type = (data.data[0] >> 1) & 0x3f;
+                    data.frame_id = frame_id++;
+                    data.ingest_us = ingest_us;
+                    self->data_listner_->OnVideoData(data);
+                }
+                if (!self->is_mp4_) {
+                    break;
+                }
+                continue;
+            }
+            int64_t nal_frame_id = frame_id++; // 一个packet是一帧，拆分出的NALU使用同一个序号
+            NalIterator nal_iter(video_packet.data, video_packet.size);
+            NalUnit nal;
+            while (nal_iter.Next(nal)) {
+                if (nal.len <= nal.start_code) {
+                    continue;
+                }
+                VideoData data;
+                data.data = (unsigned char *)nal.data; // 包含起始码
+                data.data_len = nal.len;
+                data.buf = video_packet.buf; // NALU在video_packet的内存中，接收方增加引用计数即可，不需要拷贝
+                data.pts = pts;
+                data.dts = dts;
+                data.frame_id = nal_frame_id;
+                data.ingest_us = ingest_us;
+
+                int type = -1;
+                AVCodecParameters *codec_parameters = self->format_ctx_->streams[self->video_index_]->codecpar;
+                enum AVCodecID codecId = codec_parameters->codec_id;
+                if (codecId == AV_CODEC_ID_H264) {
+                    type = H264NalType(nal.data + nal.start_code);
+                    if (type == 9) { // 分隔符
+                        continue;
                     }
-                    // type == 9为分隔符
-                    if (type == 9 || self->frame_->frame_len <= self->frame_->startcode) {
-                        self->frame_->stat = WRITE;
+                } else if (codecId == AV_CODEC_ID_H265 || codecId == AV_CODEC_ID_HEVC) {
+                    type = H265NalType(nal.data + nal.start_code);
+                    if (type == 35) { // 分隔符
                         continue;
                     }
+                }
 
-                    if (self->data_listner_) {
-                        self->data_listner_->OnVideoData(data);
-                    }
-                    self->frame_->stat = WRITE;
+                if (self->data_listner_) {
+                    self->data_listner_->OnVideoData(data);
                 }
             }
-            av_packet_unref(&video_packet);
-        } else {
-            auto now = std::chrono::system_clock::now();
-            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
-            self->video_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
-            double duration_millsecond = std::chrono::duration<double, std::milli>(t2 - t1).count();
-            guard.unlock();
-            continue;
         }
+        av_packet_unref(&video_packet);
     }
     DEBUGPRINT("%s:%d VideoSyncThread over\n", __FILE__, __LINE__);
     return NULL;
@@ -530,77 +505,77 @@ void *MediaReader::AudioSyncThread(void *arg)
     int64_t curtimestamp;
     int64_t starttimestamp = -1;
     AVRational time_base = self->format_ctx_->streams[self->audio_index_]->time_base;
-    AVRational time_base_q = {1, AV_TIME_BASE};
     int64_t start_time = av_gettime();
     AVCodecParameters *codecpar = self->format_ctx_->streams[self->audio_index_]->codecpar;
     int audio_time = 1000 * 1000 / (codecpar->sample_rate / codecpar->frame_size);
+    StreamClock clock;
+    int64_t frame_duration = (int64_t)codecpar->frame_size * AV_TIME_BASE / codecpar->sample_rate;
     while (!self->abort_) {
-        std::unique_lock<std::mutex> guard(self->audio_mtx_);
-        if (self->file_finish_ && self->audio_list_.empty()) {
+        if (self->offline_ && !self->data_listner_) { // 离线模式下等待listner设置之后才开始取包，避免数据被丢弃
+            std::unique_lock<std::mutex> guard(self->state_mtx_);
+            self->state_cond_.wait(guard, [self] { return self->abort_ || self->data_listner_ != NULL; });
+            continue;
+        }
+        AVPacket audio_packet;
+        if (!self->audio_list_.Pop(audio_packet, -1)) { // 析构时队列已经关闭
+            break;
+        }
+        if (audio_packet.stream_index < 0) { // 文件结束标志
             self->audio_finish_ = true;
-            guard.unlock();
-            av_usleep(audio_time);
+            self->NotifyState();
             continue;
         }
         if (self->audio_reset_) {
             start_time = av_gettime();
             starttimestamp = -1;
+            clock.rebase = true;
             self->audio_reset_ = !self->audio_reset_;
         }
-        if (!self->audio_list_.empty()) {
-            AVPacket audio_packet;
-            audio_packet = self->audio_list_.front();
-            self->audio_list_.pop_front();
-            guard.unlock();
-            curtimestamp = av_rescale_q(audio_packet.pts, time_base, time_base_q);
-            if (starttimestamp == -1) {
-                starttimestamp = curtimestamp;
-                self->audio_start_timestamp_ = starttimestamp;
-            }
-            self->audio_now_time_ = curtimestamp;
-            int64_t now_time = av_gettime() - start_time;
-            if ((curtimestamp - starttimestamp) > now_time) {
-                int sleepTime = curtimestamp - starttimestamp - now_time;
-                // printf("%s:%d audio time:%ld sleepTime:%ld\n",__FILE__, __LINE__,curtimestamp,sleepTime);
-                av_usleep(sleepTime);
-            }
-            AudioData audiodata;
-            audiodata.pts = av_rescale_q(audio_packet.pts, time_base, time_base_q);
-            audiodata.dts = av_rescale_q(audio_packet.dts, time_base, time_base_q);
-            audiodata.data_len = audio_packet.size;
-            audiodata.data = audio_packet.data;
-            audiodata.channels = self->format_ctx_->streams[self->audio_index_]->codecpar->channels;
-            audiodata.profile = self->format_ctx_->streams[self->audio_index_]->codecpar->profile;
-            audiodata.samplerate = self->format_ctx_->streams[self->audio_index_]->codecpar->sample_rate;
-            if (self->data_listner_) {
-                // 添加adts
-                int profile = get_audio_obj_type(audiodata.profile) - 1;
-                int sampling_frequency_index = get_sample_rate_index(audiodata.samplerate, audiodata.profile);
-                int channel_config = get_channel_config(audiodata.channels, audiodata.profile);
-
-                char adts_header_buf[7] = {0};
-                GenerateAdtsHeader(adts_header_buf, audiodata.data_len,
-                                profile,    // AAC编码级别
-                                sampling_frequency_index, // 采样率 Hz
-                                channel_config);
-                unsigned char buffer[4 * 1024] = {0};
-                memcpy(buffer, adts_header_buf, 7);
-                memcpy(buffer + 7, audiodata.data,  audiodata.data_len);
-
-                audiodata.data = buffer;
-                audiodata.data_len += 7;
-                self->data_listner_->OnAudioData(audiodata);
-            }
-            av_packet_unref(&audio_packet);
-        } else {
-            auto now = std::chrono::system_clock::now();
-            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
-            self->audio_cond_.wait_until(guard, now + std::chrono::milliseconds(100));
-            std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
-            double duration_millsecond = std::chrono::duration<double, std::milli>(t2 - t1).count();
-            guard.unlock();
-            continue;
+        int64_t file_dts, pts, dts;
+        RescaleTimestamp(audio_packet, time_base, frame_duration, clock, curtimestamp, file_dts, pts, dts);
+        if (starttimestamp == -1) {
+            starttimestamp = curtimestamp;
+            self->audio_start_timestamp_ = starttimestamp;
+        }
+        self->audio_now_time_ = curtimestamp;
+        int64_t now_time = av_gettime() - start_time;
+        if (!self->offline_ && (curtimestamp - starttimestamp) > now_time) {
+            int sleepTime = curtimestamp - starttimestamp - now_time;
+            // printf("%s:%d audio time:%ld sleepTime:%ld\n",__FILE__, __LINE__,curtimestamp,sleepTime);
+            av_usleep(sleepTime);
+        }
+        AudioData audiodata;
+        audiodata.pts = pts;
+        audiodata.dts = dts;
+        audiodata.data_len = audio_packet.size;
+        audiodata.data = audio_packet.data;
+        audiodata.channels = self->format_ctx_->streams[self->audio_index_]->codecpar->channels;
+        audiodata.profile = self->format_ctx_->streams[self->audio_index_]->codecpar->profile;
+        audiodata.samplerate = self->format_ctx_->streams[self->audio_index_]->codecpar->sample_rate;
+        if (self->data_listner_) {
+            // 添加adts
+            int profile = get_audio_obj_type(audiodata.profile) - 1;
+            int sampling_frequency_index = get_sample_rate_index(audiodata.samplerate, audiodata.profile);
+            int channel_config = get_channel_config(audiodata.channels, audiodata.profile);
+
+            char adts_header_buf[7] = {0};
+            GenerateAdtsHeader(adts_header_buf, audiodata.data_len,
+                            profile,    // AAC编码级别
+                            sampling_frequency_index, // 采样率 Hz
+                            channel_config);
+            // adts头和音频数据放到带引用计数的内存中，解码模块增加引用计数即可，不需要再拷贝
+            AVBufferRef *buffer = av_buffer_alloc(7 + audiodata.data_len + AV_INPUT_BUFFER_PADDING_SIZE);
+            memcpy(buffer->data, adts_header_buf, 7);
+            memcpy(buffer->data + 7, audiodata.data, audiodata.data_len);
+            memset(buffer->data + 7 + audiodata.data_len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+            audiodata.data = buffer->data;
+            audiodata.data_len += 7;
+            audiodata.buf = buffer;
+            self->data_listner_->OnAudioData(audiodata);
+            av_buffer_unref(&buffer);
         }
+        av_packet_unref(&audio_packet);
     }
     DEBUGPRINT("%s:%d AudioSyncThread over\n", __FILE__, __LINE__);
     return NULL;
@@ -609,34 +584,25 @@ MediaReader::~MediaReader()
 {
     int ret;
     abort_ = true;
-    th_file_.join();
-    th_video_.join();
-    while (!video_list_.empty()) {
-        AVPacket packet = video_list_.front();
-        video_list_.pop_front();
-        av_packet_unref(&packet);
-    }
-    if (audio_index_ > 0) {
+    video_list_.Close();
+    audio_list_.Close();
+    NotifyState();
+    if (th_file_.joinable()) {
+        th_file_.join();
+    }
+    if (th_video_.joinable()) {
+        th_video_.join();
+    }
+    if (th_audio_.joinable()) {
         th_audio_.join();
-        while (!audio_list_.empty()) {
-            AVPacket packet = video_list_.front();
-            video_list_.pop_front();
-            av_packet_unref(&packet);
-        }
     }
+    video_list_.Clear();
+    audio_list_.Clear();
     avformat_close_input(&format_ctx_);
     avformat_free_context(format_ctx_);
     av_packet_unref(&packet_);
     if(bsf_ctx_){
         av_bsf_free(&bsf_ctx_);
     }
-    if(buffer_){
-        free(buffer_);
-        buffer_ = NULL;
-    }
-    if(frame_){
-        free(frame_);
-        frame_ = NULL;
-    }
     DEBUGPRINT("~MediaReader\n");
 }
@@ -20,35 +20,20 @@ extern "C" {
 #include "TypeDef.h"
 #include "MediaInterface.h"
 #include "AAC.h"
+#include "BoundedQueue.h"
+#include "LatencyTracker.h"
+#include "NalScanner.h"
 using namespace std::chrono_literals; // 时间库由C++14支持
 static const uint64_t NANO_SECOND = UINT64_C(1000000000);
 #define DEBUGPRINT printf
-/*buf和frame的状态*/
-enum BufFrame_e {
-    READ = 1,
-    WRITE,
-    OVER, // 文件读取完毕
-};
-/*MP4缓冲区*/
-struct BufSt {
-    unsigned char *buf;
-    int buf_len;
-    int stat; // buf状态,READ表示可读 WRITE表示可写
-    int pos;  ////frame读取buf的位置记录
-};
-/*NALU数据读取*/
-struct FrameSt {
-    unsigned char *frame;
-    int frame_len;
-    int startcode;
-    int stat;
-};
+// 读包线程最多缓存的包个数，超过后等待同步线程消费
+#define READER_MAX_PACKETS 64
 
 class MediaReader
 {
 public:
     MediaReader() = delete;
-    MediaReader(char *file_path);
+    MediaReader(char *file_path, bool offline = false); // offline:不按时间戳节奏读取，以最快速度读完整个文件
     enum VideoType GetVideoType();
     enum AudioType GetAudioType();
     virtual ~MediaReader();
@@ -57,19 +42,21 @@ public:
     void GetVideoCon(int &width, int &height, int &fps);
     void GetAudioCon(int &channels, int &sample_rate, int &profile, int &bit_per_sample);
     void Reset();
+    bool IsOffline() { return offline_; }
+    bool IsOpened() { return opened_; } // 文件打开失败或者没有视频流时为false
+    void SetAccessUnitMode(bool au_mode) { au_mode_ = au_mode; } // 按帧输出：每个packet回调一次，不再拆分NALU，在SetDataListner之前调用
+    void SetMetrics(StageMetrics *video_metrics, StageMetrics *audio_metrics); // 上报读包队列的深度，指标对象在MediaReader析构之后才能释放
     
 private:
     static void *MediaReaderThread(void *arg);
     static void *VideoSyncThread(void *arg);
     static void *AudioSyncThread(void *arg);
     static void *CheckThread(void *arg);
-    void PraseFrame();
-    void VideoInit(char *filename);
+    void NotifyState(); // 结束标志、Reset、listner等状态变化之后唤醒等待的线程
+    int VideoInit(char *filename);
 
 private:
     std::string file_;
-    struct BufSt *buffer_ = NULL;
-    struct FrameSt *frame_ = NULL;
     std::thread th_file_;
     std::thread th_video_;
     std::thread th_audio_;
@@ -77,11 +64,16 @@ private:
     std::atomic<bool> video_finish_ = {false};
     std::atomic<bool> audio_finish_ = {false};
     std::atomic<bool> file_finish_ = {false};
-    bool abort_ = false;
+    std::atomic<bool> abort_ = {false};
+    bool offline_ = false;
+    bool opened_ = false;
+    bool au_mode_ = false;
     MediaDataListner *data_listner_ = NULL;
     CloseCallbackFunc colse_cb_ = NULL;
+    std::mutex state_mtx_;
+    std::condition_variable state_cond_;
 
-    AVFormatContext *format_ctx_;
+    AVFormatContext *format_ctx_ = NULL;
     AVPacket packet_;
     bool is_mp4_;
     // H264 H265
@@ -89,16 +81,12 @@ private:
     int fps_ = 25;
     AVBSFContext *bsf_ctx_ = NULL;
 
-    std::list<AVPacket> video_list_;
-    std::mutex video_mtx_;
-    std::condition_variable video_cond_;
+    BoundedQueue<AVPacket> video_list_;
     int64_t video_start_timestamp_ = -1;
 
     // AAC
     int audio_index_ = -1;
-    std::list<AVPacket> audio_list_;
-    std::mutex audio_mtx_;
-    std::condition_variable audio_cond_;
+    BoundedQueue<AVPacket> audio_list_;
     int64_t audio_start_timestamp_ = -1;
 
     std::atomic<int64_t> video_now_time_ = {0};
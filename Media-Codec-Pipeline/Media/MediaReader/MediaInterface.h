@@ -4,9 +4,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+struct AVBufferRef;
+// buf不为NULL时data指向buf引用的内存，接收方av_buffer_ref之后可以直接持有数据，不需要拷贝
 typedef struct AudioDataSt {
     unsigned char *data;
     int data_len;
+    AVBufferRef *buf = NULL;
     int64_t pts;
     int64_t dts;
     int profile;
@@ -16,13 +19,16 @@ typedef struct AudioDataSt {
 typedef struct VideoDataSt {
     unsigned char *data;
     int data_len;
+    AVBufferRef *buf = NULL;
     int64_t pts;
     int64_t dts;
+    int64_t frame_id = -1; // 输入端分配的帧序号，同一帧的所有NALU相同，用于统计端到端延时
+    int64_t ingest_us = 0; // 输入端送出这一帧的时间(steady_clock微秒)
 } VideoData;
 class MediaDataListner
 {
 public:
-    virtual void OnVideoData(VideoData data) = 0; // with startcode
+    virtual void OnVideoData(VideoData data) = 0; // with startcode，按帧输出时data包含一帧的所有NALU
     virtual void OnAudioData(AudioData data) = 0; // with adts
 };
 using CloseCallbackFunc = std::function<void(void)>;
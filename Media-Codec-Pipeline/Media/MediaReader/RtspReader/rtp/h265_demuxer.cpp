@@ -41,7 +41,7 @@ void H265Demuxer::InputData(const uint8_t* data, size_t size){
             memcpy(buffer_ + pos_buffer_, payload + 3, payload_len - 3);
             pos_buffer_ += payload_len - 3;
             if(call_back_){
-                call_back_->OnVideoData(ntohl(header->timestamp),  buffer_, pos_buffer_);
+                call_back_->OnVideoData(ntohl(header->timestamp),  buffer_, pos_buffer_, header->marker == 1);
             }
             find_start_ = false;
             pos_buffer_ = 0;
@@ -61,7 +61,7 @@ void H265Demuxer::InputData(const uint8_t* data, size_t size){
         buffer_[3] = 1;
         memcpy(buffer_ + 4, payload, payload_len);
         if(call_back_){
-            call_back_->OnVideoData(ntohl(header->timestamp),  buffer_, payload_len + 4);
+            call_back_->OnVideoData(ntohl(header->timestamp),  buffer_, payload_len + 4, header->marker == 1);
         }
     }
     return;
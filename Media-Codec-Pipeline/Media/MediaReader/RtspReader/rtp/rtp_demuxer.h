@@ -7,12 +7,13 @@
 
 class RTPDemuxerInterface {
 public:
-  virtual void OnVideoData(int64_t pts, const uint8_t* data, size_t size) = 0; //video demuxer only
+  virtual void OnVideoData(int64_t pts, const uint8_t* data, size_t size, bool au_end) = 0; //video demuxer only, au_end:RTP marker位，一帧的最后一个NALU
   virtual void OnAudioData(int64_t pts,  const uint8_t* data, size_t size) = 0; //audio demuxer only
 };
 
 class RTPDemuxer{
 public:
+  virtual ~RTPDemuxer(){} // RtspClient通过基类指针删除，重连时会释放
   virtual void InputData(const uint8_t* data, size_t size) = 0;
   void SetCallBack(RTPDemuxerInterface *call_back) {call_back_ = call_back; return;}
   void SetPayloadType(int payload){payload_ = payload; return;}
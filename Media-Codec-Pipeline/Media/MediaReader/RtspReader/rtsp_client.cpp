@@ -24,7 +24,7 @@ RtspClient::~RtspClient(){
         run_tid_ = false;
         
     }
-    if(rtsp_sd_ == -1){
+    if(rtsp_sd_ != -1){
         closeSocket(rtsp_sd_);
     }
     if(sdp_){
@@ -48,12 +48,15 @@ RtspClient::~RtspClient(){
     if(rtp_audio_demuxer_){
         delete rtp_audio_demuxer_;
     }
+#if defined(__linux__) || defined(__linux)
+    if(udp_batch_){
+        delete udp_batch_;
+    }
+#endif
     std::cout << "~RtspClient" << std::endl;
 }
 int RtspClient::Connect(const char *url){
     int ret;
-    enum MediaEnum video_type;
-    enum MediaEnum audio_type;
     rtsp_url_ = url;
     bool reslut = ParseRTSPUrl(rtsp_url_, url_info_);
     if(!reslut){
@@ -79,87 +82,12 @@ int RtspClient::Connect(const char *url){
         return -1;
     }
     while(rtsp_cmd_stat_ != RTSPCMDSTAT::RTSP_PLAYING){
-        switch (rtsp_cmd_stat_)
-        {
-            case RTSPCMDSTAT::RTSP_NONE:
-                if(SendOPTIONS(url_info_.url.c_str()) <= 0){
-                    goto faild;
-                }
-                rtsp_cmd_stat_ = RTSPCMDSTAT::RTSP_OPTIONS;
-                break;
-            case RTSPCMDSTAT::RTSP_OPTIONS:
-                if(DecodeOPTIONS(buffer_cmd_, buffer_cmd_size_) < 0){
-                    goto faild;
-                }
-                if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_DESCRIBE){
-                    if(SendDESCRIBE(url_info_.url.c_str(), NULL) <= 0){
-                        goto faild;
-                    }
-                }
-                break;
-            case RTSPCMDSTAT::RTSP_DESCRIBE:            
-                if(DecodeDESCRIBE(url_info_.url.c_str(), buffer_cmd_, buffer_cmd_size_) < 0){
-                    goto faild;
-                }
-                if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_STEUP){
-                    if(!video_url_.empty()){
-                        video_setup_ = true;
-                        if(SendSTEUP(video_url_.c_str()) <= 0){
-                            goto faild;
-                        }
-                        rtsp_cmd_stat_ = RTSPCMDSTAT::RTSP_STEUP_VIDEO;
-                    }
-                    else if(!audio_url_.empty()){
-                        audio_setup_ = true;
-                        if(SendSTEUP(audio_url_.c_str()) <= 0){
-                            goto faild;
-                        }
-                        rtsp_cmd_stat_ = RTSPCMDSTAT::RTSP_STEUP_ADUIO;
-                    }
-                    else{
-                        goto faild;
-                    }
-                }
-                break;
-            case RTSPCMDSTAT::RTSP_STEUP_VIDEO:
-                if(DecodeSTEUP(video_url_.c_str(), buffer_cmd_, buffer_cmd_size_) < 0){
-                    goto faild;
-                }
-                if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_PLAY){
-                    if(SendPLAY(url_info_.url.c_str()) <= 0){
-                        goto faild;
-                    }
-                }
-                break;
-            case RTSPCMDSTAT::RTSP_STEUP_ADUIO:
-                if(DecodeSTEUP(audio_url_.c_str(), buffer_cmd_, buffer_cmd_size_) < 0){
-                    goto faild;
-                }
-                if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_PLAY){
-                    if(SendPLAY(url_info_.url.c_str()) <= 0){
-                        goto faild;
-                    }
-                }
-                break;
-            case RTSPCMDSTAT::RTSP_PLAY:
-                if(DecodePLAY(url_info_.url.c_str(),buffer_cmd_, buffer_cmd_size_) < 0){
-                    goto faild;
-                }
-                break;
-            default:
-                break;
+        if(HandleCommand() < 0){
+            goto faild;
         }
         if(rtsp_cmd_stat_ != RTSPCMDSTAT::RTSP_PLAYING){
-            if(buffer_cmd_used_ < buffer_cmd_size_){
-                memmove(buffer_cmd_, buffer_cmd_ + buffer_cmd_used_, buffer_cmd_size_ - buffer_cmd_used_);
-                buffer_cmd_size_ -= buffer_cmd_used_;
-            }
-            else{
-                buffer_cmd_size_ = 0;
-                
-            }
-            buffer_cmd_used_ = 0;
-            ret= recvWithTimeout(rtsp_sd_, buffer_cmd_ + buffer_cmd_size_, sizeof(buffer_cmd_) - buffer_cmd_size_, 0);
+            CompactCommandBuffer();
+            ret= recvWithTimeout(rtsp_sd_, buffer_cmd_ + buffer_cmd_size_, sizeof(buffer_cmd_) - 1 - buffer_cmd_size_, 0); // 留一个字节放'\0'
             if(ret <= 0){
                 goto end;
             }
@@ -171,8 +99,110 @@ int RtspClient::Connect(const char *url){
 #endif
         }
     }
-    video_type = sdp_->GetVideoType();
-    audio_type = sdp_->GetAudioType();
+    CreateDemuxer();
+    /*create recv rtp packet pthread*/    
+	tid_=std::thread(RecvPacketThd,this);
+    connected_ = true;
+    std::cout << "Connect ok url:" << url << std::endl;
+    return 0;
+end:
+    std::cout << "recv data error ret:" << ret << std::endl;
+    connected_ = false;
+    return -1;
+faild:
+    std::cout << "CMD error" << std::endl;
+    connected_ = false;
+    return -1;
+}
+// Connect和非阻塞模式共用的命令状态机：解析当前状态的回复，发送下一条命令
+int RtspClient::HandleCommand(){
+    switch (rtsp_cmd_stat_)
+    {
+        case RTSPCMDSTAT::RTSP_NONE:
+            if(SendOPTIONS(url_info_.url.c_str()) <= 0){
+                return -1;
+            }
+            rtsp_cmd_stat_ = RTSPCMDSTAT::RTSP_OPTIONS;
+            break;
+        case RTSPCMDSTAT::RTSP_OPTIONS:
+            if(DecodeOPTIONS(buffer_cmd_, buffer_cmd_size_) < 0){
+                return -1;
+            }
+            if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_DESCRIBE){
+                if(SendDESCRIBE(url_info_.url.c_str(), NULL) <= 0){
+                    return -1;
+                }
+            }
+            break;
+        case RTSPCMDSTAT::RTSP_DESCRIBE:            
+            if(DecodeDESCRIBE(url_info_.url.c_str(), buffer_cmd_, buffer_cmd_size_) < 0){
+                return -1;
+            }
+            if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_STEUP){
+                if(!video_url_.empty()){
+                    video_setup_ = true;
+                    if(SendSTEUP(video_url_.c_str()) <= 0){
+                        return -1;
+                    }
+                    rtsp_cmd_stat_ = RTSPCMDSTAT::RTSP_STEUP_VIDEO;
+                }
+                else if(!audio_url_.empty()){
+                    audio_setup_ = true;
+                    if(SendSTEUP(audio_url_.c_str()) <= 0){
+                        return -1;
+                    }
+                    rtsp_cmd_stat_ = RTSPCMDSTAT::RTSP_STEUP_ADUIO;
+                }
+                else{
+                    return -1;
+                }
+            }
+            break;
+        case RTSPCMDSTAT::RTSP_STEUP_VIDEO:
+            if(DecodeSTEUP(video_url_.c_str(), buffer_cmd_, buffer_cmd_size_) < 0){
+                return -1;
+            }
+            if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_PLAY){
+                if(SendPLAY(url_info_.url.c_str()) <= 0){
+                    return -1;
+                }
+            }
+            break;
+        case RTSPCMDSTAT::RTSP_STEUP_ADUIO:
+            if(DecodeSTEUP(audio_url_.c_str(), buffer_cmd_, buffer_cmd_size_) < 0){
+                return -1;
+            }
+            if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_PLAY){
+                if(SendPLAY(url_info_.url.c_str()) <= 0){
+                    return -1;
+                }
+            }
+            break;
+        case RTSPCMDSTAT::RTSP_PLAY:
+            if(DecodePLAY(url_info_.url.c_str(),buffer_cmd_, buffer_cmd_size_) < 0){
+                return -1;
+            }
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+void RtspClient::CompactCommandBuffer(){
+    if(buffer_cmd_used_ < buffer_cmd_size_){
+        memmove(buffer_cmd_, buffer_cmd_ + buffer_cmd_used_, buffer_cmd_size_ - buffer_cmd_used_);
+        buffer_cmd_size_ -= buffer_cmd_used_;
+    }
+    else{
+        buffer_cmd_size_ = 0;
+        
+    }
+    buffer_cmd_used_ = 0;
+    return;
+}
+void RtspClient::CreateDemuxer(){
+    enum MediaEnum video_type = sdp_->GetVideoType();
+    enum MediaEnum audio_type = sdp_->GetAudioType();
     if(video_type == MediaEnum::H264){
         rtp_video_demuxer_ = new H264Demuxer();
     }
@@ -193,21 +223,9 @@ int RtspClient::Connect(const char *url){
         rtp_audio_demuxer_->SetCallBack(this);
         rtp_audio_demuxer_->SetPayloadType(sdp_->GetAudioPayload());
     }
-    /*create recv rtp packet pthread*/    
-	tid_=std::thread(RecvPacketThd,this);
-    connected_ = true;
-    std::cout << "Connect ok url:" << url << std::endl;
-    return 0;
-end:
-    std::cout << "recv data error ret:" << ret << std::endl;
-    connected_ = false;
-    return -1;
-faild:
-    std::cout << "CMD error" << std::endl;
-    connected_ = false;
-    return -1;
+    return;
 }
-void RtspClient::OnVideoData(int64_t pts, const uint8_t* data, size_t size){
+void RtspClient::OnVideoData(int64_t pts, const uint8_t* data, size_t size, bool au_end){
     if(GetVideoType() == MediaEnum::H264){
         int type = data[4] & 0x1f;
         if(type == 7){
@@ -224,7 +242,7 @@ void RtspClient::OnVideoData(int64_t pts, const uint8_t* data, size_t size){
         return;
     }
     if(call_back_){
-        call_back_->RtspVideoData(pts, data, size);
+        call_back_->RtspVideoData(pts, data, size, au_end);
     }
     return;
 }
@@ -396,6 +414,11 @@ int RtspClient::SendSTEUP(const char *url){
                 std::cout << "video CreateRtpSockets error" << std::endl;
                 return -1;
             }
+            int rcvbuf_size = setUdpRecvOption(rtp_sd_video_, udp_recv_buffer_size_);
+            setUdpRecvOption(rtcp_sd_video_, 0);
+#ifdef RTSP_DEBUG
+            std::cout << "video rtp SO_RCVBUF:" << rcvbuf_size << std::endl;
+#endif
             sprintf(result+strlen(result),"Transport: RTP/AVP;unicast;client_port=%d-%d\r\n",rtp_port_video_, rtcp_port_video_);
         }
         else if(std::string(url) == audio_url_){
@@ -403,6 +426,8 @@ int RtspClient::SendSTEUP(const char *url){
                 std::cout << "audio CreateRtpSockets error" << std::endl;
                 return -1;
             }
+            setUdpRecvOption(rtp_sd_audio_, udp_recv_buffer_size_);
+            setUdpRecvOption(rtcp_sd_audio_, 0);
             sprintf(result+strlen(result),"Transport: RTP/AVP;unicast;client_port=%d-%d\r\n",rtp_port_audio_, rtcp_port_audio_);
         }
         else{
@@ -567,6 +592,115 @@ int RtspClient::DecodePLAY(const char *url, const char *buffer, int len){
     rtsp_cmd_stat_ = RTSPCMDSTAT::RTSP_PLAYING;
     return 0;
 }
+#if defined(__linux__) || defined(__linux)
+// 套接字在SETUP之后就不会再变，只构造一次
+void RtspClient::InitUdpPoll(){
+    if(udp_pollfd_count_ > 0){
+        return;
+    }
+    // rtsp message(heartbeat response)
+    udp_pollfds_[udp_pollfd_count_++] = {rtsp_sd_, POLLIN, 0};
+    if(rtp_port_video_server_ != -1){ // video
+        udp_pollfds_[udp_pollfd_count_++] = {rtp_sd_video_, POLLIN, 0};
+        udp_pollfds_[udp_pollfd_count_++] = {rtcp_sd_video_, POLLIN, 0};
+    }
+    if(rtp_port_audio_server_ != -1){ // audio
+        udp_pollfds_[udp_pollfd_count_++] = {rtp_sd_audio_, POLLIN, 0};
+        udp_pollfds_[udp_pollfd_count_++] = {rtcp_sd_audio_, POLLIN, 0};
+    }
+    udp_batch_ = new UdpBatch;
+    udp_drops_report_time_ = std::chrono::steady_clock::now();
+    return;
+}
+int RtspClient::DrainUdpSocket(int index){
+    socket_t fd = udp_pollfds_[index].fd;
+    RTPDemuxer *demuxer = NULL; // rtcp丢弃
+    if(fd == rtp_sd_video_){
+        demuxer = rtp_video_demuxer_;
+    }
+    else if(fd == rtp_sd_audio_){
+        demuxer = rtp_audio_demuxer_;
+    }
+    // 一次唤醒把套接字里的数据报全部读完，收满一批说明可能还有
+    int bytes = 0;
+    int count;
+    do{
+        count = recvUdpBatch(fd, udp_batch_, &udp_socket_drops_[index], &udp_truncated_);
+        if(count < 0){
+            std::cout << rtsp_url_ << ":recvmmsg error" << std::endl;
+            return -1;
+        }
+        for(int j = 0; j < count; j++){
+            int len = udp_batch_->msgs[j].msg_len;
+            if(len <= 0){
+                continue;
+            }
+            bytes += len;
+            if(demuxer){
+                demuxer->InputData((const uint8_t*)udp_batch_->data[j], len);
+            }
+        }
+    }while(count == UDP_BATCH_SIZE);
+    return bytes;
+}
+// 套接字打开以来的累计丢包数，每秒最多打印一次
+void RtspClient::UpdateUdpDrops(){
+    uint64_t drops = 0;
+    for(int i = 1; i < udp_pollfd_count_; i++){
+        drops += udp_socket_drops_[i];
+    }
+    udp_kernel_drops_ = drops;
+    auto now = std::chrono::steady_clock::now();
+    if(drops > udp_drops_reported_ && now - udp_drops_report_time_ >= std::chrono::seconds(1)){
+        std::cout << rtsp_url_ << ":kernel dropped " << drops - udp_drops_reported_ << " udp packets, total " << drops
+            << ", truncated " << udp_truncated_ << std::endl;
+        udp_drops_reported_ = drops;
+        udp_drops_report_time_ = now;
+    }
+    return;
+}
+int RtspClient::ReadPacketUdp(){
+    InitUdpPoll();
+    int ret = poll(udp_pollfds_, udp_pollfd_count_, recv_rtp_packet_timeout_ * 1000);
+    if(ret < 0){
+        if(errno == EINTR){
+            return 0;
+        }
+        std::cout << rtsp_url_ << ":network error" << std::endl;
+        return -1;
+    }
+    else if(ret == 0){
+        std::cout << rtsp_url_ << ":poll time out" << std::endl;
+        return -1;
+    }
+    if(udp_pollfds_[0].revents){ // tcp
+        char buffer_recv[4096] = {0};
+        int recv_len = 0;
+        recv_len = recvWithTimeout(rtsp_sd_, buffer_recv, sizeof(buffer_recv), recv_rtp_packet_timeout_ * 1000);
+        if(recv_len <= 0){
+            return -1;
+        }
+        // skip heartbeat response
+#ifdef RTSP_DEBUG
+        std::cout << "heartbeat response:" << std::endl;
+        std::cout << buffer_recv << std::endl;
+#endif
+    }
+    int bytes = 0;
+    for(int i = 1; i < udp_pollfd_count_; i++){
+        if(!udp_pollfds_[i].revents){
+            continue;
+        }
+        int ret = DrainUdpSocket(i);
+        if(ret < 0){
+            return -1;
+        }
+        bytes += ret;
+    }
+    UpdateUdpDrops();
+    return bytes;
+}
+#else
 int RtspClient::ReadPacketUdp(){
     int  bytes = 0;
     unsigned char buffer[READ_SOCK_DATA_LEN] = {0};
@@ -642,72 +776,67 @@ int RtspClient::ReadPacketUdp(){
     }
     return bytes;
 }
+#endif
+// RTP over TCP: '$' + channel(1byte) + rtp_len(2bytes) + rtp packet，中间可能夹着心跳OPTIONS的回复
+// 一次recv读满缓冲区的空闲部分，完整的$帧在缓冲区中原地交给demuxer，不逐字节拷贝；不完整的部分移动到缓冲区开头等下次recv
 int RtspClient::ReadPacketTcp(){
-    int bytes = 0;
-    unsigned char buffer[READ_SOCK_DATA_LEN] = {0};
-    bytes = recvWithTimeout(rtsp_sd_, (char *)buffer, READ_SOCK_DATA_LEN, recv_rtp_packet_timeout_ * 1000);
+    int bytes = recvWithTimeout(rtsp_sd_, (char *)tcp_buffer_ + tcp_buffer_end_, RTP_TCP_BUFFER_SIZE - tcp_buffer_end_, async_ ? 0 : recv_rtp_packet_timeout_ * 1000);
+    if(async_ && bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){ // 非阻塞模式下没有数据
+        return 0;
+    }
     if (bytes <= 0) {
         std::cout << rtsp_url_ << ":recv error" << std::endl;
         return -1;
     }
-    buffer[bytes] = '\0';
-    unsigned char *ptr = buffer;
-    int pos_buffer_end = bytes;
-    while(ptr < buffer + pos_buffer_end){
-        if((stat_ == EMPTY_STATE) || (stat_ == RTSP_MESSAGE_STATE)){
-            if(*ptr == '$'){
-                buffer_header_[pos_buffer_header_++] = *ptr;
-                ptr++;
-                stat_ = RTP_TCP_HEADER_STATE;
-            }
-            else{
-                stat_ = RTSP_MESSAGE_STATE;
+    tcp_buffer_end_ += bytes;
+    int pos = 0;
+    while(pos < tcp_buffer_end_){
+        const uint8_t *ptr = tcp_buffer_ + pos;
+        int remain = tcp_buffer_end_ - pos;
+        if(ptr[0] == '$'){
+            if(remain < 4){
+                break;
             }
-        }
-        else if(stat_ == RTP_TCP_HEADER_STATE){
-            buffer_header_[pos_buffer_header_++] = *ptr;
-            ptr++;
-            if(pos_buffer_header_ == 4){
-                stat_ = RTP_TCP_CONTENT_STATE;
-                header_.channel = buffer_header_[1];
-                for(int i = 2; i <= 3; i++){
-                    header_.rtp_len16 <<= 8;
-                    header_.rtp_len16 |= buffer_header_[i];
-                } 
-                pos_buffer_header_ = 0;
+            int channel = ptr[1];
+            int rtp_len = (ptr[2] << 8) | ptr[3];
+            if(remain < 4 + rtp_len){
+                break;
             }
-        }
-        else if(stat_ == RTP_TCP_CONTENT_STATE){
-            if(header_.rtp_len16 > pos_buffer_){
-                buffer_[pos_buffer_++] = *ptr;
-                ptr++;
+            if(channel == sig0_video_ && rtp_video_demuxer_){ // video
+                rtp_video_demuxer_->InputData(ptr + 4, rtp_len);
             }
-            else{
-                if(header_.channel == sig0_video_){ // video
-                    rtp_video_demuxer_->InputData(buffer_, pos_buffer_);
-                }
-                else if(header_.channel == sig0_audio_){ // audio
-                    rtp_audio_demuxer_->InputData(buffer_, pos_buffer_);
-                }
-                pos_buffer_ = 0;
-                header_.rtp_len16 = 0;
-                stat_ = EMPTY_STATE;
+            else if(channel == sig0_audio_ && rtp_audio_demuxer_){ // audio
+                rtp_audio_demuxer_->InputData(ptr + 4, rtp_len);
             }
+            // rtcp通道不处理
+            pos += 4 + rtp_len;
+            continue;
         }
-        if(stat_ == RTSP_MESSAGE_STATE){
-            // skip rtsp message
-            ptr++;
+        int message_len = RtspMessageLength(ptr, remain);
+        if(message_len > 0){ // skip rtsp message
+            pos += message_len;
+        }
+        else if(message_len == 0 && remain < RTSP_MAX_MESSAGE_LEN){ // rtsp消息不完整，等待后续数据
+            break;
+        }
+        else{ // 不认识的数据或者过长的消息，跳到下一个'$'重新同步
+            const uint8_t *next = (const uint8_t *)memchr(ptr + 1, '$', remain - 1);
+            pos = next ? (int)(next - tcp_buffer_) : tcp_buffer_end_;
         }
     }
-    return pos_buffer_end;
+    // 剩余数据不超过一个最大的$帧，缓冲区至少还有RTP_TCP_BUFFER_SIZE - 65539字节给下次recv
+    if(pos > 0){
+        memmove(tcp_buffer_, tcp_buffer_ + pos, tcp_buffer_end_ - pos);
+        tcp_buffer_end_ -= pos;
+    }
+    return bytes;
 }
 void *RtspClient::RecvPacketThd(void *arg){
     RtspClient *self = (RtspClient*)arg;
     self->run_tid_ = true;
     auto pre_time = std::chrono::system_clock::now();
     int ret;
-    self->header_.channel = 0;
-    self->header_.rtp_len16 = 0;
+    self->tcp_buffer_end_ = 0;
     while(self->run_flag_){
         // heartbeat
         auto now_time = std::chrono::system_clock::now();
@@ -734,3 +863,209 @@ void *RtspClient::RecvPacketThd(void *arg){
     self->run_tid_ = false;
     return NULL;
 }
+#if defined(__linux__) || defined(__linux)
+int RtspClient::Open(const char *url){
+    rtsp_url_ = url;
+    async_ = true;
+    bool reslut = ParseRTSPUrl(rtsp_url_, url_info_);
+    if(!reslut){
+        SetFailed("parseRTSPUrl error");
+        return -1;
+    }
+    rtsp_sd_ = createTcpSocket();
+    if(rtsp_sd_ == INVALID_SOCKET){
+        rtsp_sd_ = -1;
+        SetFailed("createTcpSocket error");
+        return -1;
+    }
+    active_time_ = std::chrono::steady_clock::now();
+    sockets_version_++;
+    int ret = connectNonBlock(rtsp_sd_, url_info_.host.c_str(), url_info_.port);
+    if(ret < 0){
+        SetFailed("ConnectToServer error");
+        return 0;
+    }
+    if(ret == 0){
+        OnConnected();
+    }
+    else{
+        connecting_ = true;
+    }
+    return 0;
+}
+void RtspClient::OnConnected(){
+    connecting_ = false;
+    sockets_version_++; // 不再关注可写
+    active_time_ = std::chrono::steady_clock::now();
+    if(HandleCommand() < 0){ // send OPTIONS
+        SetFailed("CMD error");
+    }
+    return;
+}
+// 一次recv可能收到多条回复，也可能只收到半条；只把完整的回复交给HandleCommand
+void RtspClient::OnCommandData(){
+    int ret = recv(rtsp_sd_, buffer_cmd_ + buffer_cmd_size_, sizeof(buffer_cmd_) - 1 - buffer_cmd_size_, 0);
+    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+        return;
+    }
+    if(ret <= 0){
+        SetFailed("recv data error");
+        return;
+    }
+    buffer_cmd_size_ += ret;
+    buffer_cmd_[buffer_cmd_size_] = '\0';
+    active_time_ = std::chrono::steady_clock::now();
+#ifdef RTSP_DEBUG
+    std::cout <<  __FILE__ << __LINE__ << std::endl;
+    std::cout <<  buffer_cmd_ << std::endl;
+#endif
+    while(rtsp_cmd_stat_ != RTSPCMDSTAT::RTSP_PLAYING && RtspMessageLength((const uint8_t *)buffer_cmd_, buffer_cmd_size_) != 0){
+        if(HandleCommand() < 0){
+            SetFailed("CMD error");
+            return;
+        }
+        if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_PLAYING){
+            OnPlaying();
+            return;
+        }
+        if(buffer_cmd_used_ == 0){ // 回复还缺少需要的字段，等待后续数据
+            break;
+        }
+        CompactCommandBuffer();
+    }
+    return;
+}
+void RtspClient::OnPlaying(){
+    CreateDemuxer();
+    // RTP over TCP时PLAY回复后面可能已经跟着RTP数据，交给ReadPacketTcp接着解析
+    int remain = buffer_cmd_size_ - buffer_cmd_used_;
+    tcp_buffer_end_ = 0;
+    if(rtp_transport_ == TRANSPORT::RTP_OVER_TCP && remain > 0){
+        memcpy(tcp_buffer_, buffer_cmd_ + buffer_cmd_used_, remain);
+        tcp_buffer_end_ = remain;
+    }
+    buffer_cmd_size_ = 0;
+    buffer_cmd_used_ = 0;
+    if(rtp_transport_ == TRANSPORT::RTP_OVER_UDP){
+        InitUdpPoll();
+    }
+    sockets_version_++; // 开始监听UDP套接字
+    active_time_ = std::chrono::steady_clock::now();
+    heartbeat_time_ = active_time_;
+    connected_ = true;
+    std::cout << "Connect ok url:" << rtsp_url_ << std::endl;
+    return;
+}
+void RtspClient::OnSocketEvent(socket_t fd, bool readable, bool writable){
+    if(failed_){
+        return;
+    }
+    if(fd != rtsp_sd_){ // udp
+        for(int i = 1; i < udp_pollfd_count_; i++){
+            if(udp_pollfds_[i].fd != fd){
+                continue;
+            }
+            int ret = DrainUdpSocket(i);
+            if(ret < 0){
+                SetFailed("recvfrom error");
+                return;
+            }
+            if(ret > 0){
+                active_time_ = std::chrono::steady_clock::now();
+            }
+            UpdateUdpDrops();
+            break;
+        }
+        return;
+    }
+    if(connecting_){
+        if(!writable){
+            return;
+        }
+        if(getSocketError(rtsp_sd_) != 0){
+            SetFailed("ConnectToServer error");
+            return;
+        }
+        OnConnected();
+        return;
+    }
+    if(!readable){
+        return;
+    }
+    if(rtsp_cmd_stat_ != RTSPCMDSTAT::RTSP_PLAYING){
+        OnCommandData();
+        return;
+    }
+    if(rtp_transport_ == TRANSPORT::RTP_OVER_TCP){
+        int ret = ReadPacketTcp();
+        if(ret < 0){
+            SetFailed("recv error");
+            return;
+        }
+        if(ret > 0){
+            active_time_ = std::chrono::steady_clock::now();
+        }
+        return;
+    }
+    // udp方式下rtsp_sd_上只有心跳的回复
+    char buffer_recv[4096] = {0};
+    int recv_len = recv(rtsp_sd_, buffer_recv, sizeof(buffer_recv) - 1, 0);
+    if(recv_len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+        return;
+    }
+    if(recv_len <= 0){
+        SetFailed("rtsp connection closed");
+        return;
+    }
+    // skip heartbeat response
+#ifdef RTSP_DEBUG
+    std::cout << "heartbeat response:" << std::endl;
+    std::cout << buffer_recv << std::endl;
+#endif
+    return;
+}
+void RtspClient::OnTimer(){
+    if(failed_){
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto idle_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - active_time_).count();
+    if(rtsp_cmd_stat_ != RTSPCMDSTAT::RTSP_PLAYING){
+        if(idle_ms >= RTSP_ASYNC_CMD_TIMEOUT_MS){
+            SetFailed(connecting_ ? "connect time out" : "CMD time out");
+        }
+        return;
+    }
+    if(idle_ms >= recv_rtp_packet_timeout_ * 1000){
+        SetFailed("recv time out");
+        return;
+    }
+    // heartbeat
+    if(now - heartbeat_time_ >= std::chrono::seconds(timeout_)){
+        heartbeat_time_ = now;
+        if(SendOPTIONS(url_info_.url.c_str()) <= 0){
+            SetFailed("send heartbeat failure");
+        }
+    }
+    return;
+}
+void RtspClient::GetSockets(std::vector<socket_t> &fds){
+    fds.clear();
+    if(rtsp_sd_ == -1){
+        return;
+    }
+    fds.push_back(rtsp_sd_);
+    if(rtsp_cmd_stat_ == RTSPCMDSTAT::RTSP_PLAYING){
+        for(int i = 1; i < udp_pollfd_count_; i++){
+            fds.push_back(udp_pollfds_[i].fd);
+        }
+    }
+    return;
+}
+void RtspClient::SetFailed(const char *reason){
+    std::cout << rtsp_url_ << ":" << reason << std::endl;
+    failed_ = true;
+    connected_ = false;
+    return;
+}
+#endif
@@ -4,12 +4,22 @@
 #include <string>
 #include <atomic>
 #include <thread>
+#include <chrono>
+#include <vector>
 #include "rtsp_common.h"
 #include "socket_io.h"
 #include "sdp.h"
 #include "rtp_demuxer.h"
 #define USER_AGENT "simple-rtsp-client"
 #define READ_SOCK_DATA_LEN 1500
+// RTP over TCP的接收缓冲区，大于一次recv的数据加上一个最大的$帧(4 + 65535)
+#define RTP_TCP_BUFFER_SIZE (256 * 1024)
+// 夹在RTP数据中的RTSP消息的最大长度，超过时按错误数据跳过
+#define RTSP_MAX_MESSAGE_LEN 4096
+// 非阻塞模式下TCP连接和每条命令回复的超时，和Connect的连接超时一致
+#define RTSP_ASYNC_CMD_TIMEOUT_MS 5000
+// RTP over UDP默认的套接字接收缓冲区，码率高、突发大时太小会被内核丢包
+#define RTP_UDP_RECV_BUFFER_SIZE (4 * 1024 * 1024)
 enum TRANSPORT{
     RTP_OVER_TCP = 0,
     RTP_OVER_UDP,
@@ -27,16 +37,9 @@ enum RTSPCMDSTAT{
 };
 class RtspMediaInterface {
 public:
-  virtual void RtspVideoData(int64_t pts, const uint8_t* data, size_t size) = 0;
+  virtual void RtspVideoData(int64_t pts, const uint8_t* data, size_t size, bool au_end) = 0;
   virtual void RtspAudioData(int64_t pts,  const uint8_t* data, size_t size) = 0;
 };
-enum ParseState
-{
-    EMPTY_STATE,
-    RTP_TCP_HEADER_STATE,
-    RTP_TCP_CONTENT_STATE,
-    RTSP_MESSAGE_STATE,
-};
 
 class RtspClient : public RTPDemuxerInterface {
 public:
@@ -48,8 +51,20 @@ public:
     void SetCallBack(RtspMediaInterface *call_back){call_back_ = call_back; return;}
     void GetAudioInfo(int &sample_rate_index, int &channels, int &profile) {sdp_->GetAudioInfo(sample_rate_index, channels, profile); return;}
     bool GetOpenStat(){return connected_;}
+    void SetUdpRecvBufferSize(int bytes){udp_recv_buffer_size_ = bytes; return;} // RTP over UDP的SO_RCVBUF，<=0使用系统默认值，在Connect之前调用
+    uint64_t GetUdpKernelDrops(){return udp_kernel_drops_;} // 接收缓冲区满时内核丢弃的RTP/RTCP数据报个数(SO_RXQ_OVFL)
+#if defined(__linux__) || defined(__linux)
+    // 非阻塞模式：不调用Connect、不创建接收线程，由RtspReactor的回调推进命令交互和数据接收
+    int Open(const char *url); // 开始非阻塞连接，返回-1表示url错误或者创建套接字失败
+    void OnSocketEvent(socket_t fd, bool readable, bool writable);
+    void OnTimer(); // 连接和命令超时；播放之后发心跳、检查接收超时
+    bool HasFailed(){return failed_;} // 连接失败或者断开，需要重新创建
+    bool IsConnecting(){return connecting_;} // 正在等待TCP连接完成，rtsp_sd_需要关注可写
+    void GetSockets(std::vector<socket_t> &fds); // 需要监听的套接字，第一个是rtsp_sd_
+    int GetSocketsVersion(){return sockets_version_;} // 需要监听的套接字或者事件变化时加1
+#endif
 private:
-    void OnVideoData(int64_t pts, const uint8_t* data, size_t size);
+    void OnVideoData(int64_t pts, const uint8_t* data, size_t size, bool au_end);
     void OnAudioData(int64_t pts,  const uint8_t* data, size_t size);
 
     int SendOPTIONS(const char *url);
@@ -66,9 +81,23 @@ private:
     int SendPLAY(const char *url);
     int DecodePLAY(const char *url, const char *buffer, int len);
     
+    int HandleCommand(); // 处理buffer_cmd_中的回复并发送下一条命令，返回-1表示失败
+    void CompactCommandBuffer();
+    void CreateDemuxer();
+
     static void *RecvPacketThd(void *arg);
     int ReadPacketUdp();
     int ReadPacketTcp();
+#if defined(__linux__) || defined(__linux)
+    void InitUdpPoll();
+    int DrainUdpSocket(int index); // 读完udp_pollfds_[index]中的数据报，返回字节数，出错返回-1
+    void UpdateUdpDrops();
+
+    void OnConnected();
+    void OnCommandData();
+    void OnPlaying();
+    void SetFailed(const char *reason);
+#endif
     
 private:
     std::string rtsp_url_ = "";
@@ -120,14 +149,31 @@ private:
     RtspMediaInterface *call_back_ = NULL;
     bool video_frame_ready_ = false;
 
-    struct rtp_tcp_header header_;
-    // Cache RTP over TCP header
-    uint8_t buffer_header_[4];
-    int pos_buffer_header_ = 0;
-    // Cache RTP packets
-    uint8_t buffer_[4 * 1024 * 1024];
-    int pos_buffer_ = 0;
-    enum ParseState stat_ = EMPTY_STATE;
+    // RTP over TCP接收缓冲区，[0, tcp_buffer_end_)是还没有解析完的数据
+    uint8_t tcp_buffer_[RTP_TCP_BUFFER_SIZE];
+    int tcp_buffer_end_ = 0;
+
+    // RTP over UDP批量接收
+    int udp_recv_buffer_size_ = RTP_UDP_RECV_BUFFER_SIZE;
+    std::atomic<uint64_t> udp_kernel_drops_ = {0};
+    uint64_t udp_truncated_ = 0; // 超过UDP_BATCH_DATAGRAM_LEN被丢弃的数据报个数
+#if defined(__linux__) || defined(__linux)
+    // 第一次接收时构造，SETUP之后套接字不再变化：[0]是rtsp_sd_，后面是video/audio的rtp、rtcp
+    struct pollfd udp_pollfds_[5];
+    uint32_t udp_socket_drops_[5] = {0}; // 每个套接字SO_RXQ_OVFL带回的累计丢包数
+    int udp_pollfd_count_ = 0;
+    struct UdpBatch *udp_batch_ = NULL;
+    uint64_t udp_drops_reported_ = 0;
+    std::chrono::steady_clock::time_point udp_drops_report_time_;
+
+    // 非阻塞模式
+    bool async_ = false;
+    bool connecting_ = false;
+    bool failed_ = false;
+    int sockets_version_ = 0;
+    std::chrono::steady_clock::time_point active_time_; // 最近一次连上或者收到数据的时间
+    std::chrono::steady_clock::time_point heartbeat_time_;
+#endif
 };
 
 #endif
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "rtsp_client_proxy.h"
 extern "C" {
     #include "h264-sps.h"
@@ -5,55 +6,183 @@ extern "C" {
 }
 RtspClientProxy::RtspClientProxy(char *rtsp_url){
     rtsp_url_ = rtsp_url;
+    // 下游处理不过来时丢弃最旧的数据，不能阻塞收包线程；视频丢包之后由video_gate_丢弃到下一个关键帧
+    video_packets_.SetCapacity(RTSP_DELIVER_QUEUE_SIZE, RTSP_DELIVER_QUEUE_BYTES);
+    video_packets_.SetPolicy(QUEUE_DROP_OLDEST);
+    audio_packets_.SetCapacity(RTSP_DELIVER_QUEUE_SIZE, RTSP_DELIVER_QUEUE_BYTES);
+    audio_packets_.SetPolicy(QUEUE_DROP_OLDEST);
+    for(BoundedQueue<RtspMediaNode *> *queue : {&video_packets_, &audio_packets_}){
+        queue->SetSizeFunc([](RtspMediaNode *const &node) { return node->data.size(); });
+        queue->SetReleaseFunc([](RtspMediaNode *&node) { delete node; });
+    }
+    deliver_task_ = new SerialTask([this]() { DeliverTask(); });
     client_ =  new RtspClient(transport_); 
-    client_->Connect(rtsp_url); 
     client_->SetCallBack(this);
+#if defined(__linux__) || defined(__linux)
+    client_->Open(rtsp_url);
+    open_time_ = std::chrono::steady_clock::now();
+    RtspReactor::Instance()->Attach(this); // 套接字在第一次OnTimer中加入监听
+#else
+    client_->Connect(rtsp_url); 
     tid_ = std::thread(RtspClientProxy::ReconnectThread, this);
+#endif
 }
 RtspClientProxy::~RtspClientProxy(){
+#if defined(__linux__) || defined(__linux)
+    RtspReactor::Instance()->Detach(this); // 返回之后不会再有回调，关闭套接字时自动从epoll中移除
+#else
+    std::unique_lock<std::mutex> guard(run_mtx_);
     run_flag_ = false;
+    guard.unlock();
+    run_cond_.notify_all();
     tid_.join();
+#endif
+    delete client_;
+    // 收包线程已经停止，剩余的数据不再交给下游
+    video_packets_.Close();
+    audio_packets_.Close();
+    video_packets_.Clear();
+    audio_packets_.Clear();
+    deliver_task_->Wait();
+    delete deliver_task_;
+    deliver_task_ = NULL;
+    std::cout << "~RtspClientProxy drop video:" << video_packets_.DropCount() + video_gate_.Discarded() << " audio:" << audio_packets_.DropCount() << std::endl;
+}
+void RtspClientProxy::Reconnect(){
+    if((probe_cnt_ < PROBEFRAME) && (fps_ < 0)){
+        probe_cnt_ = 0;
+        fps_ = -1;
+    }
+    std::cout << rtsp_url_ << " Reconnect" << std::endl;
+#if defined(__linux__) || defined(__linux)
+    UnwatchClient();
+#endif
     delete client_;
-    std::cout << "~RtspClientProxy" << std::endl;
+    video_clock_.last = -1; // 新连接的RTP时间戳从随机值开始，接着之前的时间戳递增
+    audio_clock_.last = -1;
+    client_ =  new RtspClient(transport_); 
+    client_->SetCallBack(this);
+#if defined(__linux__) || defined(__linux)
+    client_->Open(rtsp_url_.c_str());
+    open_time_ = std::chrono::steady_clock::now();
+    WatchClient();
+#else
+    client_->Connect(rtsp_url_.c_str()); 
+#endif
+    return;
+}
+#if defined(__linux__) || defined(__linux)
+void RtspClientProxy::OnSocketEvent(socket_t fd, bool readable, bool writable){
+    client_->OnSocketEvent(fd, readable, writable);
+    WatchClient();
+    return;
+}
+void RtspClientProxy::OnTimer(){
+    client_->OnTimer();
+    if(client_->HasFailed() && std::chrono::steady_clock::now() - open_time_ >= std::chrono::seconds(1)){
+        Reconnect();
+        return;
+    }
+    WatchClient();
+    return;
 }
+void RtspClientProxy::WatchClient(){
+    if(client_->HasFailed()){ // 对端关闭之后套接字一直可读，失败的连接不再监听，等待重连
+        UnwatchClient();
+        return;
+    }
+    if(watch_version_ == client_->GetSocketsVersion()){
+        return;
+    }
+    watch_version_ = client_->GetSocketsVersion();
+    RtspReactor *reactor = RtspReactor::Instance();
+    std::vector<socket_t> fds;
+    client_->GetSockets(fds);
+    for(socket_t fd : watch_fds_){
+        if(std::find(fds.begin(), fds.end(), fd) == fds.end()){
+            reactor->Unwatch(this, fd);
+        }
+    }
+    for(size_t i = 0; i < fds.size(); i++){
+        reactor->Watch(this, fds[i], i == 0 && client_->IsConnecting()); // 连接完成之前rtsp_sd_关注可写
+    }
+    watch_fds_ = fds;
+    return;
+}
+void RtspClientProxy::UnwatchClient(){
+    RtspReactor *reactor = RtspReactor::Instance();
+    for(socket_t fd : watch_fds_){
+        reactor->Unwatch(this, fd);
+    }
+    watch_fds_.clear();
+    watch_version_ = -1;
+    return;
+}
+#else
 void *RtspClientProxy::ReconnectThread(void *arg){
     RtspClientProxy *self = (RtspClientProxy*)arg;
     while(self->run_flag_){
         bool stat = self->client_->GetOpenStat();
         if(stat == false){
-            if((self->probe_cnt_ < PROBEFRAME) && (self->fps_ < 0)){
-                self->probe_cnt_ = 0;
-                self->fps_ = -1;
-            }
-            std::cout << self->rtsp_url_ << " Reconnect" << std::endl;
-            delete self->client_;
-            self->client_ =  new RtspClient(self->transport_); 
-            self->client_->Connect(self->rtsp_url_.c_str()); 
-            self->client_->SetCallBack(self);
-
+            self->Reconnect();
         }
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::unique_lock<std::mutex> guard(self->run_mtx_);
+        self->run_cond_.wait_for(guard, std::chrono::seconds(1), [self] { return !self->run_flag_; });
     }
     return NULL;
 }
-int RtspClientProxy::ProbeVideoFps(){
-    while(fps_ == -1){
+#endif
+std::unique_lock<std::recursive_mutex> RtspClientProxy::LockCallback(){
+#if defined(__linux__) || defined(__linux)
+    return RtspReactor::Instance()->Lock(this);
+#else
+    return std::unique_lock<std::recursive_mutex>();
+#endif
+}
+int64_t RtspClientProxy::RtpTimeToUs(RtpClock &clock, int64_t rtp_ts, int clock_rate){
+    if(clock.last < 0){
+        clock.ext += clock.step;
+    }
+    else{
+        int32_t delta = (int32_t)(uint32_t)(rtp_ts - clock.last); // 回绕之后差值仍然正确
+        clock.ext += delta;
+        if(delta > 0){
+            clock.step = delta;
+        }
+    }
+    clock.last = rtp_ts;
+    return clock.ext * 1000000 / clock_rate;
+}
+int RtspClientProxy::ProbeVideoFps(int timeout_ms){
+    auto start = std::chrono::steady_clock::now();
+    while(true){
+        {
+            std::unique_lock<std::recursive_mutex> guard = LockCallback();
+            if(fps_ != -1){
+                video_ready_ = false;
+                return fps_;
+            }
+        }
+        if (timeout_ms >= 0 && std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(timeout_ms)) {
+            return -1; // 连不上或者一直没有视频数据
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
-    video_ready_ = false;
-    return fps_;
 }
 void RtspClientProxy::GetVideoCon(int &width, int &height, int &fps){
+    std::unique_lock<std::recursive_mutex> guard = LockCallback();
     width = width_;
     height = height_;
     fps = fps_;
     return;
 }
 void RtspClientProxy::GetAudioCon(int &sample_rate_index, int &channels, int &profile){
+    std::unique_lock<std::recursive_mutex> guard = LockCallback(); // 重连时client_会被替换
     client_->GetAudioInfo(sample_rate_index, channels, profile);
     return;
 }
 enum VideoType RtspClientProxy::GetVideoType(){
+    std::unique_lock<std::recursive_mutex> guard = LockCallback();
     if(client_->GetVideoType() == MediaEnum::H264){
         return VideoType::VIDEO_H264;
     }
@@ -64,6 +193,7 @@ enum VideoType RtspClientProxy::GetVideoType(){
     return VideoType::VIDEO_NONE;
 }
 enum AudioType RtspClientProxy::GetAudioType(){
+    std::unique_lock<std::recursive_mutex> guard = LockCallback();
     if(client_->GetAudioType() == MediaEnum::AAC){
         return AudioType::AUDIO_AAC;
     }
@@ -73,7 +203,18 @@ enum AudioType RtspClientProxy::GetAudioType(){
     return AudioType::AUDIO_NONE;
 
 }
-void RtspClientProxy::RtspVideoData(int64_t pts, const uint8_t* data, size_t size){
+void RtspClientProxy::SetDataListner(MediaDataListner *lisnter, CloseCallbackFunc cb){
+    std::unique_lock<std::recursive_mutex> guard = LockCallback(); // 反应器线程已经在回调RtspVideoData
+    data_listner_ = lisnter;
+    colse_cb_ = cb;
+    return;
+}
+void RtspClientProxy::SetAccessUnitMode(bool au_mode){
+    std::unique_lock<std::recursive_mutex> guard = LockCallback();
+    au_mode_ = au_mode;
+    return;
+}
+void RtspClientProxy::RtspVideoData(int64_t pts, const uint8_t* data, size_t size, bool au_end){
     int type;
     if(client_->GetVideoType() == MediaEnum::H264){
         // std::cout << "video type:" << (data[4] & 0x1f) << std::endl;
@@ -116,18 +257,89 @@ void RtspClientProxy::RtspVideoData(int64_t pts, const uint8_t* data, size_t siz
         }
     }
     if(!video_ready_){
+        au_buffer_.clear();
+        return;
+    }
+    if(au_mode_){
+        if(!au_buffer_.empty() && pts != au_pts_){ // 丢失了marker包，时间戳变化说明上一帧已经结束
+            OutputAccessUnit();
+        }
+        if(au_buffer_.empty()){ // 新的一帧，记录第一个包到达的时间
+            frame_id_++;
+            frame_ingest_us_ = LatencyTracker::NowUs();
+            frame_pts_us_ = RtpTimeToUs(video_clock_, pts, VIDEO_RTP_CLOCK);
+        }
+        au_pts_ = pts;
+        au_buffer_.insert(au_buffer_.end(), data, data + size);
+        if(au_end){
+            OutputAccessUnit();
+        }
         return;
     }
-    VideoData video_data;
-    video_data.data = (unsigned char *)data;
-    video_data.data_len = size;
-    video_data.pts = 0;
-    video_data.dts = 0;
-    if (data_listner_) {
-        data_listner_->OnVideoData(video_data);
+    if(frame_id_ < 0 || pts != au_pts_){ // 按NALU输出时，RTP时间戳相同的NALU属于同一帧
+        frame_id_++;
+        frame_ingest_us_ = LatencyTracker::NowUs();
+        frame_pts_us_ = RtpTimeToUs(video_clock_, pts, VIDEO_RTP_CLOCK);
+        au_pts_ = pts;
     }
-    else{
+    RtspMediaNode *node = new RtspMediaNode();
+    node->data.assign(data, data + size);
+    QueueVideo(node);
+    return;
+}
+void RtspClientProxy::OutputAccessUnit(){
+    RtspMediaNode *node = new RtspMediaNode();
+    size_t capacity = au_buffer_.capacity();
+    node->data.swap(au_buffer_); // 整帧交给下游，不拷贝
+    au_buffer_.reserve(capacity); // 下一帧一般和这一帧差不多大
+    QueueVideo(node);
+    return;
+}
+void RtspClientProxy::QueueVideo(RtspMediaNode *node){
+    if(!data_listner_){ // 设置回调之后从下一个SPS开始输出
         video_ready_ = false;
+        delete node;
+        return;
+    }
+    node->pts = frame_pts_us_;
+    node->frame_id = frame_id_;
+    node->ingest_us = frame_ingest_us_;
+    node->is_h265 = client_->GetVideoType() == MediaEnum::H265;
+    video_packets_.Push(node);
+    deliver_task_->Notify();
+    return;
+}
+// 在共享执行器上回调下游，每次最多处理SERIAL_TASK_BATCH个视频包和音频包
+void RtspClientProxy::DeliverTask(){
+    RtspMediaNode *node = NULL;
+    for(int i = 0; i < SERIAL_TASK_BATCH && video_packets_.Pop(node, 0); i++){
+        video_gate_.SetCodec(node->is_h265);
+        if(video_gate_.Admit(node->data.data(), (int)node->data.size(), video_packets_.DropCount())){
+            VideoData video_data;
+            video_data.data = node->data.data();
+            video_data.data_len = node->data.size();
+            video_data.pts = node->pts; // RTP没有dts，按到达顺序解码
+            video_data.dts = node->pts;
+            video_data.frame_id = node->frame_id;
+            video_data.ingest_us = node->ingest_us;
+            data_listner_->OnVideoData(video_data);
+        }
+        delete node;
+    }
+    for(int i = 0; i < SERIAL_TASK_BATCH && audio_packets_.Pop(node, 0); i++){
+        AudioData audio_data;
+        audio_data.data = node->data.data();
+        audio_data.data_len = node->data.size();
+        audio_data.channels = node->channels;
+        audio_data.profile = node->profile;
+        audio_data.samplerate = node->samplerate;
+        audio_data.pts = node->pts;
+        audio_data.dts = node->pts;
+        data_listner_->OnAudioData(audio_data);
+        delete node;
+    }
+    if(!video_packets_.Empty() || !audio_packets_.Empty()){
+        deliver_task_->Notify();
     }
     return;
 }
@@ -140,21 +352,22 @@ void RtspClientProxy::RtspAudioData(int64_t pts,  const uint8_t* data, size_t si
                     profile,//AAC编码级别
                     sample_rate_index,//采样率 Hz
                     channels);
-        AudioData audio_data;
-        unsigned char buffer [4 * 1024] = {0};
-        memcpy(buffer, adts_header_buf, 7);
-        memcpy(buffer + 7, data, size);
-        audio_data.data = buffer;
-        audio_data.data_len = size + 7;
-        audio_data.channels = channels;
-        audio_data.profile = profile;
         int freq_arr[13] = {
             96000, 88200, 64000, 48000, 44100, 32000,
             24000, 22050, 16000, 12000, 11025, 8000, 7350
         };
-        audio_data.samplerate = freq_arr[sample_rate_index];
+        int64_t pts_us = RtpTimeToUs(audio_clock_, pts, freq_arr[sample_rate_index]); // 音频RTP时钟频率等于采样率
         if(data_listner_){
-            data_listner_->OnAudioData(audio_data);
+            RtspMediaNode *node = new RtspMediaNode();
+            node->data.reserve(size + 7);
+            node->data.insert(node->data.end(), adts_header_buf, adts_header_buf + 7);
+            node->data.insert(node->data.end(), data, data + size);
+            node->pts = pts_us;
+            node->channels = channels;
+            node->profile = profile;
+            node->samplerate = freq_arr[sample_rate_index];
+            audio_packets_.Push(node);
+            deliver_task_->Notify();
         }
     }
     else if(client_->GetAudioType() == MediaEnum::PCMA){
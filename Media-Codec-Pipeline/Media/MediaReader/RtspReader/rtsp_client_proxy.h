@@ -5,33 +5,90 @@
 #include <mutex>
 #include <chrono>
 #include <list>
+#include <vector>
 #include <condition_variable>
 #include "rtsp_client.h"
+#include "rtsp_reactor.h"
 #include "MediaInterface.h"
 #include "TypeDef.h"
 #include "AAC.h"
+#include "LatencyTracker.h"
+#include "BoundedQueue.h"
+#include "TaskExecutor.h"
+#include "GopDropGate.h"
 #define PROBEFRAME 50 // 探测帧数，用于计算视频fps
+#define VIDEO_RTP_CLOCK 90000 // 视频RTP时间戳的时钟频率
+#define RTSP_DELIVER_QUEUE_SIZE 100 // 交给下游的队列长度，满了丢弃最旧的数据
+#define RTSP_DELIVER_QUEUE_BYTES (16 * 1024 * 1024)
+// 收包线程解析出来的一帧(或一个NALU)视频、一个ADTS音频包，在执行器线程中回调下游
+struct RtspMediaNode {
+    std::vector<uint8_t> data;
+    int64_t pts = 0; // 微秒
+    int64_t frame_id = -1;
+    int64_t ingest_us = 0;
+    bool is_h265 = false;
+    int profile = 0;
+    int samplerate = 0;
+    int channels = 0;
+};
+// 32位RTP时间戳展开成64位，回绕和重连之后继续递增
+struct RtpClock {
+    int64_t last = -1; // 上一个RTP时间戳，-1表示第一个包或者刚重连
+    int64_t ext = 0; // 从第一个包开始累计的时钟数
+    int64_t step = 0; // 最近两帧的间隔，重连后按这个间隔接上
+};
+/**
+ * Linux上由共享的RtspReactor驱动：非阻塞命令交互、RTP接收、心跳和重连都在反应器线程中完成，不为每一路创建线程
+ * 其它平台保留每一路一个接收线程和一个重连线程
+ * 收包线程只做接收和解析，拼好的数据放入本路的队列，由deliver_task_在共享执行器上回调下游(解码器创建、写文件等)
+ */
+#if defined(__linux__) || defined(__linux)
+class RtspClientProxy:public RtspMediaInterface, public RtspReactorHandler{
+#else
 class RtspClientProxy:public RtspMediaInterface{
+#endif
 public:
     RtspClientProxy(char *rtsp_url);
     ~RtspClientProxy();
-    int ProbeVideoFps();
+    int ProbeVideoFps(int timeout_ms = -1); // timeout_ms小于0时一直等待，超时返回-1
     void GetVideoCon(int &width, int &height, int &fps);
     void GetAudioCon(int &sample_rate_index, int &channels, int &profile);
     enum VideoType GetVideoType();
     enum AudioType GetAudioType();
-    void SetDataListner(MediaDataListner *lisnter, CloseCallbackFunc cb){data_listner_ = lisnter; colse_cb_ = cb; return;}
+    void SetDataListner(MediaDataListner *lisnter, CloseCallbackFunc cb);
+    void SetAccessUnitMode(bool au_mode); // 按帧输出：一帧的所有NALU合并之后回调一次，在SetDataListner之前调用
     
 private:
-    void RtspVideoData(int64_t pts, const uint8_t* data, size_t size);
+    void RtspVideoData(int64_t pts, const uint8_t* data, size_t size, bool au_end);
+    void OutputAccessUnit();
+    void QueueVideo(RtspMediaNode *node); // 收包线程调用，交给deliver_task_
+    void DeliverTask();
     void RtspAudioData(int64_t pts,  const uint8_t* data, size_t size);
+    void Reconnect(); // 删除断开的client_，重新创建并连接
+#if defined(__linux__) || defined(__linux)
+    void OnSocketEvent(socket_t fd, bool readable, bool writable);
+    void OnTimer();
+    void WatchClient(); // 按client_当前的套接字更新反应器中的监听
+    void UnwatchClient();
+#else
     static void *ReconnectThread(void *arg);
+#endif
+    std::unique_lock<std::recursive_mutex> LockCallback(); // 公有接口在调用者线程中访问回调使用的成员，先拿到反应器的锁
+    static int64_t RtpTimeToUs(RtpClock &clock, int64_t rtp_ts, int clock_rate); // 返回从第一个包开始的微秒数
 private:
     std::string rtsp_url_;
     enum TRANSPORT transport_ = TRANSPORT::RTP_OVER_TCP;
     RtspClient *client_ = NULL;
+#if defined(__linux__) || defined(__linux)
+    std::vector<socket_t> watch_fds_; // 已经加入反应器的套接字
+    int watch_version_ = -1; // 对应client_->GetSocketsVersion()
+    std::chrono::steady_clock::time_point open_time_; // 上次开始连接的时间，失败之后至少间隔1s再重连
+#else
     std::thread tid_;
     bool run_flag_ = true;
+    std::mutex run_mtx_;
+    std::condition_variable run_cond_; // 析构时唤醒重连线程，不用等满1s
+#endif
     int width_ = -1;
     int height_ = -1;
     int fps_ = -1;
@@ -43,6 +100,20 @@ private:
     int64_t last_timestamp_ = -1;
     int64_t interval_sum_ = 0;
     int probe_cnt_ = 0;
+
+    bool au_mode_ = false;
+    std::vector<uint8_t> au_buffer_; // 正在拼接的一帧数据
+    int64_t au_pts_ = -1;
+    int64_t frame_id_ = -1; // 当前帧的序号，统计端到端延时
+    int64_t frame_ingest_us_ = 0; // 当前帧第一个包到达的时间
+    int64_t frame_pts_us_ = 0; // 当前帧的时间戳(微秒)
+    RtpClock video_clock_;
+    RtpClock audio_clock_;
+
+    BoundedQueue<RtspMediaNode *> video_packets_;
+    BoundedQueue<RtspMediaNode *> audio_packets_;
+    GopDropGate video_gate_; // video_packets_丢包之后丢弃到下一个关键帧，只在deliver_task_中使用
+    SerialTask *deliver_task_ = NULL;
 };
 
 #endif
\ No newline at end of file
@@ -173,3 +173,24 @@ std::string GenerateAuthResponse(const char *username, const char *password, con
     response = res_hex;
     return response;
 }
+int RtspMessageLength(const uint8_t *buffer, int len){
+    static const char prefix[] = "RTSP/";
+    int prefix_len = strlen(prefix);
+    if(memcmp(buffer, prefix, std::min(len, prefix_len)) != 0){
+        return -1;
+    }
+    std::string message((const char *)buffer, len);
+    size_t header_end = message.find("\r\n\r\n");
+    if(header_end == std::string::npos){
+        return 0;
+    }
+    std::string header = message.substr(0, header_end);
+    std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+    int content_len = 0;
+    size_t pos = header.find("content-length:");
+    if(pos != std::string::npos){
+        content_len = atoi(header.c_str() + pos + strlen("content-length:"));
+    }
+    int message_len = (int)header_end + 4 + content_len;
+    return message_len <= len ? message_len : 0;
+}
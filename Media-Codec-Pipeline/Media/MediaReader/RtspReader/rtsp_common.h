@@ -95,4 +95,6 @@ char *GetLineFromBuf(char *buf, char *line, int buf_len);
 int ParseRTSPMessage(const std::string& rtsp_message, struct ResponseMessage &response);
 std::string GetValueByKey(const std::vector<std::pair<std::string, std::string>>& headers, std::string key);
 std::string GenerateAuthResponse(const char *username, const char *password, const char *realm, const char *nonce, const char *uri, const char * method);
+// 返回buffer开头一条完整RTSP消息(消息头+Content-Length指定的消息体)的长度，不完整返回0，不是RTSP消息返回-1
+int RtspMessageLength(const uint8_t *buffer, int len);
 #endif
@@ -0,0 +1,146 @@
+#include "rtsp_reactor.h"
+#if defined(__linux__) || defined(__linux)
+#include <iostream>
+#include <chrono>
+#include <sys/epoll.h>
+static int g_instance_threads = 0;
+
+RtspReactor *RtspReactor::Instance(){
+    static RtspReactor reactor(g_instance_threads);
+    return &reactor;
+}
+void RtspReactor::SetInstanceThreads(int thread_count){
+    g_instance_threads = thread_count;
+    return;
+}
+RtspReactor::RtspReactor(int thread_count){
+    if(thread_count <= 0){
+        thread_count = (int)std::thread::hardware_concurrency() / 4;
+        if(thread_count < 1){
+            thread_count = 1;
+        }
+    }
+    for(int i = 0; i < thread_count; i++){
+        std::unique_ptr<Loop> loop(new Loop());
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if(loop->epoll_fd < 0){
+            std::cout << "epoll_create1 error:" << errno << std::endl;
+            break;
+        }
+        loops_.push_back(std::move(loop));
+    }
+    for(auto &loop : loops_){
+        loop->thread = std::thread(RtspReactor::LoopThread, this, loop.get());
+    }
+}
+RtspReactor::~RtspReactor(){
+    abort_ = true;
+    for(auto &loop : loops_){
+        loop->thread.join();
+        close(loop->epoll_fd);
+    }
+}
+void RtspReactor::Attach(RtspReactorHandler *handler){
+    if(loops_.empty()){
+        return;
+    }
+    // 分到会话最少的线程
+    int index = 0;
+    size_t min_count = (size_t)-1;
+    for(size_t i = 0; i < loops_.size(); i++){
+        std::lock_guard<std::recursive_mutex> guard(loops_[i]->mutex);
+        if(loops_[i]->handlers.size() < min_count){
+            min_count = loops_[i]->handlers.size();
+            index = (int)i;
+        }
+    }
+    std::lock_guard<std::recursive_mutex> guard(loops_[index]->mutex);
+    handler->reactor_loop_ = index;
+    handler->reactor_id_ = next_id_++;
+    loops_[index]->handlers[handler->reactor_id_] = handler;
+    return;
+}
+void RtspReactor::Detach(RtspReactorHandler *handler){
+    if(handler->reactor_loop_ < 0){
+        return;
+    }
+    Loop *loop = loops_[handler->reactor_loop_].get();
+    std::lock_guard<std::recursive_mutex> guard(loop->mutex);
+    loop->handlers.erase(handler->reactor_id_);
+    handler->reactor_loop_ = -1;
+    return;
+}
+int RtspReactor::Watch(RtspReactorHandler *handler, socket_t fd, bool writable){
+    if(handler->reactor_loop_ < 0 || fd < 0){
+        return -1;
+    }
+    Loop *loop = loops_[handler->reactor_loop_].get();
+    struct epoll_event ev;
+    ev.events = writable ? EPOLLOUT : EPOLLIN;
+    ev.data.u64 = ((uint64_t)handler->reactor_id_ << 32) | (uint32_t)fd; // 回调前按id查找会话，已经Detach的会话的事件被丢弃
+    int ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    if(ret < 0 && errno == EEXIST){
+        ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    if(ret < 0){
+        std::cout << "epoll_ctl error fd:" << fd << " errno:" << errno << std::endl;
+    }
+    return ret;
+}
+void RtspReactor::Unwatch(RtspReactorHandler *handler, socket_t fd){
+    if(handler->reactor_loop_ < 0 || fd < 0){
+        return;
+    }
+    epoll_ctl(loops_[handler->reactor_loop_]->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    return;
+}
+std::unique_lock<std::recursive_mutex> RtspReactor::Lock(RtspReactorHandler *handler){
+    if(handler->reactor_loop_ < 0){
+        return std::unique_lock<std::recursive_mutex>();
+    }
+    return std::unique_lock<std::recursive_mutex>(loops_[handler->reactor_loop_]->mutex);
+}
+void RtspReactor::LoopThread(RtspReactor *self, Loop *loop){
+    struct epoll_event events[RTSP_REACTOR_MAX_EVENTS];
+    std::vector<uint32_t> ids;
+    auto next_tick = std::chrono::steady_clock::now();
+    while(!self->abort_){
+        int count = epoll_wait(loop->epoll_fd, events, RTSP_REACTOR_MAX_EVENTS, RTSP_REACTOR_TICK_MS);
+        if(count < 0){
+            if(errno != EINTR){
+                std::cout << "epoll_wait error:" << errno << std::endl;
+            }
+            count = 0;
+        }
+        std::lock_guard<std::recursive_mutex> guard(loop->mutex);
+        for(int i = 0; i < count; i++){
+            uint32_t id = (uint32_t)(events[i].data.u64 >> 32);
+            socket_t fd = (socket_t)(uint32_t)events[i].data.u64;
+            auto it = loop->handlers.find(id);
+            if(it == loop->handlers.end()){
+                continue;
+            }
+            bool readable = events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+            bool writable = events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP);
+            it->second->OnSocketEvent(fd, readable, writable);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if(now < next_tick){
+            continue;
+        }
+        next_tick = now + std::chrono::milliseconds(RTSP_REACTOR_TICK_MS);
+        // OnTimer中可能Detach，先取出id再逐个查找
+        ids.clear();
+        for(auto &item : loop->handlers){
+            ids.push_back(item.first);
+        }
+        for(uint32_t id : ids){
+            auto it = loop->handlers.find(id);
+            if(it != loop->handlers.end()){
+                it->second->OnTimer();
+            }
+        }
+    }
+    return;
+}
+#endif
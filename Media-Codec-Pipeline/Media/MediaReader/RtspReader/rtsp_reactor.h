@@ -0,0 +1,64 @@
+#ifndef RTSP_REACTOR
+#define RTSP_REACTOR
+#if defined(__linux__) || defined(__linux)
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "socket_io.h"
+#define RTSP_REACTOR_TICK_MS 100 // OnTimer的调用间隔
+#define RTSP_REACTOR_MAX_EVENTS 256 // 一次epoll_wait最多取出的事件个数
+
+// 由RtspReactor驱动的会话，回调都在会话所属的反应器线程中执行，同一个会话的回调不会并发
+class RtspReactorHandler {
+public:
+    virtual ~RtspReactorHandler(){}
+    virtual void OnSocketEvent(socket_t fd, bool readable, bool writable) = 0; // 水平触发，没有读完的数据下次还会回调
+    virtual void OnTimer() = 0; // 大约每RTSP_REACTOR_TICK_MS调用一次，处理超时、心跳和重连
+private:
+    friend class RtspReactor;
+    int reactor_loop_ = -1;
+    uint32_t reactor_id_ = 0;
+};
+
+/**
+ * 多路RTSP会话共享的epoll反应器，线程数固定，不随摄像头数量增加
+ * 每个线程一个epoll，会话Attach时分到会话最少的线程，之后它的套接字事件和定时回调都在这个线程中处理
+ * 回调中不要长时间阻塞，会拖慢同一个线程上的其它会话
+ */
+class RtspReactor {
+public:
+    // 进程共享的反应器，第一次调用时创建
+    static RtspReactor *Instance();
+    // 设置共享反应器的线程数，必须在第一次调用Instance之前设置；小于等于0按CPU核数的1/4，至少1个
+    static void SetInstanceThreads(int thread_count);
+
+    explicit RtspReactor(int thread_count = 0);
+    ~RtspReactor();
+    void Attach(RtspReactorHandler *handler);
+    void Detach(RtspReactorHandler *handler); // 返回之后不会再有回调；可以在回调中调用
+    int Watch(RtspReactorHandler *handler, socket_t fd, bool writable); // 已经在监听时修改关注的事件，writable为false只关注可读
+    void Unwatch(RtspReactorHandler *handler, socket_t fd); // 在关闭套接字之前调用
+    // 锁住会话所属的线程，持有期间不会有这个会话的回调；其它线程修改回调中使用的成员时调用，未Attach时返回空锁
+    std::unique_lock<std::recursive_mutex> Lock(RtspReactorHandler *handler);
+    int ThreadCount() const { return (int)loops_.size(); }
+
+private:
+    struct Loop {
+        int epoll_fd = -1;
+        std::recursive_mutex mutex; // 分发回调期间持有，Detach拿到锁说明回调已经结束
+        std::unordered_map<uint32_t, RtspReactorHandler *> handlers;
+        std::thread thread;
+    };
+    static void LoopThread(RtspReactor *self, Loop *loop);
+
+private:
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::atomic<uint32_t> next_id_ = {1};
+    std::atomic<bool> abort_ = {false};
+};
+#endif
+#endif
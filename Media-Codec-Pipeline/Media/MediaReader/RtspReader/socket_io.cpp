@@ -114,6 +114,39 @@ int connectToServer(socket_t sockfd, const char *ip, int port, int timeout/*ms*/
     }
     return -1;
 }
+int connectNonBlock(socket_t sockfd, const char *ip, int port){
+    setNonBlock(sockfd);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip);
+    if(connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) == 0){
+        return 0;
+    }
+#if defined(__linux__) || defined(__linux)
+    if(errno == EINPROGRESS){
+        return 1;
+    }
+#elif defined(_WIN32) || defined(_WIN64)
+    if(WSAGetLastError() == WSAEWOULDBLOCK){
+        return 1;
+    }
+#endif
+    return -1;
+}
+int getSocketError(socket_t sockfd){
+    int err = 0;
+#if defined(__linux__) || defined(__linux)
+    socklen_t len = sizeof(err);
+#elif defined(_WIN32) || defined(_WIN64)
+    int len = sizeof(err);
+#endif
+    if(getsockopt(sockfd, SOL_SOCKET, SO_ERROR, (char *)&err, &len) < 0){
+        return -1;
+    }
+    return err;
+}
 socket_t acceptClient(socket_t sockfd, char *ip, int *port, int timeout/*ms*/)
 {
     socket_t clientfd;
@@ -310,3 +343,58 @@ int recvUDP(socket_t sockfd, char *buffer, size_t buffer_len, char *ip, int *por
 }
 
     
+int setUdpRecvOption(socket_t sockfd, int rcvbuf_size){
+    if(rcvbuf_size > 0){
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf_size, sizeof(rcvbuf_size));
+    }
+#if defined(__linux__) || defined(__linux)
+#ifdef SO_RXQ_OVFL
+    int on = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+    socklen_t opt_len = sizeof(rcvbuf_size);
+#elif defined(_WIN32) || defined(_WIN64)
+    int opt_len = sizeof(rcvbuf_size);
+#endif
+    rcvbuf_size = 0;
+    getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (char *)&rcvbuf_size, &opt_len); // Linux上是设置值的两倍，并受net.core.rmem_max限制
+    return rcvbuf_size;
+}
+#if defined(__linux__) || defined(__linux)
+int recvUdpBatch(socket_t sockfd, struct UdpBatch *batch, uint32_t *drops, uint64_t *truncated){
+    for(int i = 0; i < UDP_BATCH_SIZE; i++){
+        batch->iovs[i].iov_base = batch->data[i];
+        batch->iovs[i].iov_len = UDP_BATCH_DATAGRAM_LEN;
+        memset(&batch->msgs[i].msg_hdr, 0, sizeof(batch->msgs[i].msg_hdr));
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->msgs[i].msg_hdr.msg_control = batch->control[i];
+        batch->msgs[i].msg_hdr.msg_controllen = sizeof(batch->control[i]);
+        batch->msgs[i].msg_len = 0;
+    }
+    int count;
+    do{
+        count = recvmmsg(sockfd, batch->msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    }while(count < 0 && errno == EINTR);
+    if(count < 0){
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    for(int i = 0; i < count; i++){
+        struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+#ifdef SO_RXQ_OVFL
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)){
+            if(drops && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL){
+                memcpy(drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+            }
+        }
+#endif
+        if(hdr->msg_flags & MSG_TRUNC){
+            batch->msgs[i].msg_len = 0;
+            if(truncated){
+                (*truncated)++;
+            }
+        }
+    }
+    return count;
+}
+#endif
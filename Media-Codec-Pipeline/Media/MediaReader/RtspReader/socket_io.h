@@ -15,6 +15,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/select.h>
+#include <poll.h>
 #elif defined(_WIN32) || defined(_WIN64)
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -39,11 +40,34 @@ void setBlock(socket_t fd);
 int bindSocketAddr(socket_t sockfd, const char *ip, int port);
 int serverListen(socket_t sockfd, int num);
 int connectToServer(socket_t sockfd, const char *ip, int port, int timeout/*ms*/);
+// 非阻塞连接，套接字保持非阻塞：返回0已经连上，1正在连接(可写之后用getSocketError检查结果)，-1失败
+int connectNonBlock(socket_t sockfd, const char *ip, int port);
+int getSocketError(socket_t sockfd); // 读取并清除SO_ERROR，0表示没有错误
 socket_t acceptClient(socket_t sockfd, char *ip, int *port, int timeout/*ms*/);
 int createRtpSockets(socket_t *fd1, socket_t *fd2, int *port1, int *port2);
 int recvWithTimeout(socket_t sockfd, char *buffer, size_t len, int timeout/*ms*/);
 int sendWithTimeout(socket_t sockfd, const char *buffer, size_t len, int timeout/*ms*/);
 int sendUDP(socket_t sockfd, const char *message, size_t length, const char *ip, int port, int timeout/*ms*/);
 int recvUDP(socket_t sockfd, char *buffer, size_t buffer_len, char *ip, int *port, int timeout/*ms*/);
+// 设置UDP接收缓冲区(rcvbuf_size<=0时不修改)，Linux上同时打开SO_RXQ_OVFL统计内核丢包；返回实际的接收缓冲区大小
+int setUdpRecvOption(socket_t sockfd, int rcvbuf_size);
+
+#if defined(__linux__) || defined(__linux)
+#define UDP_BATCH_SIZE 64 // recvmmsg一次最多接收的数据报个数
+#define UDP_BATCH_DATAGRAM_LEN 1500 // 单个数据报的最大长度，超过的数据报被截断，按丢弃处理
+// recvmmsg使用的预分配内存，结果在msgs[i].msg_len和data[i]中
+struct UdpBatch {
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iovs[UDP_BATCH_SIZE];
+    char data[UDP_BATCH_SIZE][UDP_BATCH_DATAGRAM_LEN];
+    char control[UDP_BATCH_SIZE][CMSG_SPACE(sizeof(uint32_t))];
+};
+/**
+ * 非阻塞地一次接收多个数据报，返回个数，没有数据时返回0，出错返回-1
+ * drops不为NULL时写入SO_RXQ_OVFL带回的内核累计丢包数(套接字打开以来)，没有带回时不修改
+ * truncated累加被截断的数据报个数，这些数据报的msg_len被置为0
+ */
+int recvUdpBatch(socket_t sockfd, struct UdpBatch *batch, uint32_t *drops, uint64_t *truncated);
+#endif
 
 #endif // _SOCKET_IO_H_
@@ -0,0 +1,433 @@
+#include "SyntheticSource.h"
+#include "log_helpers.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+}
+#define SYNTHETIC_TONE_HZ 440
+#define SYNTHETIC_PI 3.14159265358979
+
+// 解析正整数，失败返回false
+static bool ParsePositive(const std::string &value, int &out)
+{
+    char *end = NULL;
+    long n = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || n <= 0 || n > 100000) {
+        return false;
+    }
+    out = (int)n;
+    return true;
+}
+bool ParseSyntheticUrl(const char *url, SyntheticConfig &config)
+{
+    size_t prefix_len = strlen(SYNTHETIC_URL_PREFIX);
+    if (strncmp(url, SYNTHETIC_URL_PREFIX, prefix_len) != 0) {
+        return false;
+    }
+    std::string rest = url + prefix_len;
+    size_t query_pos = rest.find('?');
+    std::string codec = rest.substr(0, query_pos);
+    if (codec.empty() || codec == "h264") {
+        config.video_type = VIDEO_H264;
+    } else if (codec == "h265" || codec == "hevc") {
+        config.video_type = VIDEO_H265;
+    } else {
+        log_error("synthetic codec {} not support", codec);
+        return false;
+    }
+    std::string query = query_pos == std::string::npos ? "" : rest.substr(query_pos + 1);
+    size_t pos = 0;
+    while (pos < query.size()) {
+        size_t amp = query.find('&', pos);
+        std::string item = query.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+        pos = amp == std::string::npos ? query.size() : amp + 1;
+        if (item.empty()) {
+            continue;
+        }
+        size_t eq = item.find('=');
+        std::string key = item.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : item.substr(eq + 1);
+        bool ok = true;
+        if (key == "width") {
+            ok = ParsePositive(value, config.width) && config.width % 2 == 0 && config.width >= 16;
+        } else if (key == "height") {
+            ok = ParsePositive(value, config.height) && config.height % 2 == 0 && config.height >= 16;
+        } else if (key == "fps") {
+            ok = ParsePositive(value, config.fps);
+        } else if (key == "bitrate") { // kbps
+            ok = ParsePositive(value, config.bitrate_kbps);
+        } else if (key == "gop") {
+            ok = ParsePositive(value, config.gop);
+        } else if (key == "slices") {
+            ok = ParsePositive(value, config.slices);
+        } else if (key == "audio") {
+            ok = value == "0" || value == "1";
+            config.audio = value == "1";
+        } else if (key == "samplerate") {
+            ok = ParsePositive(value, config.sample_rate);
+        } else if (key == "channels") {
+            ok = ParsePositive(value, config.channels) && config.channels <= 2;
+        } else if (key == "duration") { // 秒，0表示一直输出
+            ok = value == "0" || ParsePositive(value, config.duration_s);
+            if (value == "0") {
+                config.duration_s = 0;
+            }
+        } else {
+            log_error("synthetic unknown param {}", key);
+            return false;
+        }
+        if (!ok) {
+            log_error("synthetic param {}={} invalid", key, value);
+            return false;
+        }
+    }
+    return true;
+}
+
+SyntheticSource::SyntheticSource(const char *url, bool offline)
+{
+    offline_ = offline;
+    if (!ParseSyntheticUrl(url, config_)) {
+        log_error("synthetic url error:{}", url);
+        return;
+    }
+    if (EncodeVideo() < 0) {
+        return;
+    }
+    if (config_.audio && EncodeAudio() < 0) {
+        return;
+    }
+    log_info("synthetic source {}x{}@{} {}kbps gop:{} slices:{} loop frames:{} audio frames:{} offline:{}", config_.width, config_.height,
+             config_.fps, config_.bitrate_kbps, config_.gop, config_.slices, video_frames_.size(), audio_frames_.size(), offline_);
+    opened_ = true;
+    th_output_ = std::thread(OutputThread, this);
+}
+SyntheticSource::~SyntheticSource()
+{
+    abort_ = true;
+    NotifyState();
+    if (th_output_.joinable()) {
+        th_output_.join();
+    }
+    for (auto &packet : video_frames_) {
+        av_buffer_unref(&packet.buf);
+    }
+    for (auto &packet : audio_frames_) {
+        av_buffer_unref(&packet.buf);
+    }
+    log_info("~SyntheticSource");
+}
+enum VideoType SyntheticSource::GetVideoType()
+{
+    return config_.video_type;
+}
+enum AudioType SyntheticSource::GetAudioType()
+{
+    return HaveAudio() ? AUDIO_AAC : AUDIO_NONE;
+}
+void SyntheticSource::GetVideoCon(int &width, int &height, int &fps)
+{
+    width = config_.width;
+    height = config_.height;
+    fps = config_.fps;
+    return;
+}
+void SyntheticSource::GetAudioCon(int &channels, int &sample_rate, int &profile, int &bit_per_sample)
+{
+    if (!HaveAudio()) {
+        channels = sample_rate = profile = bit_per_sample = -1;
+        return;
+    }
+    channels = config_.channels;
+    sample_rate = config_.sample_rate;
+    profile = FF_PROFILE_AAC_LOW;
+    bit_per_sample = 16;
+    return;
+}
+void SyntheticSource::SetDataListner(MediaDataListner *lisnter, CloseCallbackFunc cb)
+{
+    {
+        std::lock_guard<std::mutex> guard(state_mtx_);
+        data_listner_ = lisnter;
+        colse_cb_ = cb;
+    }
+    NotifyState(); // 输出线程等待listner设置之后才开始
+    return;
+}
+void SyntheticSource::NotifyState()
+{
+    std::unique_lock<std::mutex> guard(state_mtx_); // 加锁之后再通知，避免等待线程检查完条件还没进入等待时漏掉通知
+    guard.unlock();
+    state_cond_.notify_all();
+    return;
+}
+SyntheticPacket SyntheticSource::CopyPacket(const uint8_t *data, int len, int header_len)
+{
+    SyntheticPacket packet;
+    packet.len = header_len + len;
+    packet.buf = av_buffer_alloc(packet.len + AV_INPUT_BUFFER_PADDING_SIZE);
+    memcpy(packet.buf->data + header_len, data, len);
+    memset(packet.buf->data + packet.len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return packet;
+}
+// 8条彩条随帧向左滚动，中间一个白块从左向右移动，count帧之后回到起点，循环输出时画面连续
+static void DrawTestPattern(AVFrame *frame, int index, int count)
+{
+    static const uint8_t bars[8][3] = {{235, 128, 128}, {210, 16, 146}, {170, 166, 16}, {145, 54, 34},
+                                       {106, 202, 222}, {81, 90, 240},  {41, 240, 110}, {16, 128, 128}}; // BT601 YUV
+    int width = frame->width;
+    int height = frame->height;
+    int shift = (int)((int64_t)width * index / count);
+    int box = std::max(height / 8, 2) & ~1;
+    int box_x = (int)((int64_t)(width - box) * index / count) & ~1;
+    int box_y = (height / 2 - box / 2) & ~1;
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < width; x++) {
+            row[x] = bars[(int64_t)((x + shift) % width) * 8 / width][0];
+        }
+        if (y >= box_y && y < box_y + box) {
+            memset(row + box_x, 235, box);
+        }
+    }
+    for (int y = 0; y < height / 2; y++) {
+        uint8_t *row_u = frame->data[1] + y * frame->linesize[1];
+        uint8_t *row_v = frame->data[2] + y * frame->linesize[2];
+        for (int x = 0; x < width / 2; x++) {
+            int bar = (int64_t)((x * 2 + shift) % width) * 8 / width;
+            bool in_box = y * 2 >= box_y && y * 2 < box_y + box && x * 2 >= box_x && x * 2 < box_x + box;
+            row_u[x] = in_box ? 128 : bars[bar][1];
+            row_v[x] = in_box ? 128 : bars[bar][2];
+        }
+    }
+    return;
+}
+int SyntheticSource::EncodeVideo()
+{
+    enum AVCodecID codec_id = config_.video_type == VIDEO_H265 ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264;
+    AVCodec *codec = avcodec_find_encoder(codec_id);
+    if (!codec) {
+        log_error("synthetic source: no {} encoder", avcodec_get_name(codec_id));
+        return -1;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    ctx->codec_type = AVMEDIA_TYPE_VIDEO;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->width = config_.width;
+    ctx->height = config_.height;
+    ctx->time_base.num = 1;
+    ctx->time_base.den = config_.fps;
+    ctx->framerate.num = config_.fps;
+    ctx->framerate.den = 1;
+    ctx->gop_size = config_.gop;
+    ctx->max_b_frames = 0; // 输出顺序等于编码顺序，pts==dts，循环时不需要处理重排
+    ctx->bit_rate = (int64_t)config_.bitrate_kbps * 1000;
+    ctx->slices = config_.slices; // x265不支持按slice数切分，忽略
+    ctx->flags2 |= AV_CODEC_FLAG2_LOCAL_HEADER; // 每个IDR前都带参数集，从任意一次循环开始都能解码
+    // 只在启动时编码一次，速度优先
+    av_opt_set(ctx->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(ctx->priv_data, "tune", "zerolatency", 0);
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        log_error("synthetic source: open {} encoder failed", codec->name);
+        avcodec_free_context(&ctx);
+        return -1;
+    }
+    int loop_frames = std::min(config_.gop, SYNTHETIC_MAX_LOOP_FRAMES);
+    if (loop_frames < config_.gop) {
+        log_warn("synthetic source: gop {} too long, loop every {} frames", config_.gop, loop_frames);
+    }
+    AVFrame *frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = config_.width;
+    frame->height = config_.height;
+    av_frame_get_buffer(frame, 32);
+    AVPacket *pkt = av_packet_alloc();
+    for (int i = 0; i <= loop_frames; i++) {
+        if (i < loop_frames) {
+            av_frame_make_writable(frame);
+            DrawTestPattern(frame, i, loop_frames);
+            frame->pts = i;
+            frame->pict_type = i == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE; // 循环的第一帧必须是IDR
+            avcodec_send_frame(ctx, frame);
+        } else {
+            avcodec_send_frame(ctx, NULL);
+        }
+        while (avcodec_receive_packet(ctx, pkt) == 0) {
+            video_frames_.push_back(CopyPacket(pkt->data, pkt->size, 0));
+            av_packet_unref(pkt);
+        }
+    }
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    if (video_frames_.empty()) {
+        log_error("synthetic source: encode video failed");
+        return -1;
+    }
+    return 0;
+}
+// 正弦波编码成LC-AAC，大约1秒循环一次
+int SyntheticSource::EncodeAudio()
+{
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!codec) {
+        log_error("synthetic source: no aac encoder");
+        return -1;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    ctx->sample_rate = config_.sample_rate;
+    ctx->channels = config_.channels;
+    ctx->channel_layout = av_get_default_channel_layout(config_.channels);
+    ctx->bit_rate = 64000 * config_.channels;
+    ctx->profile = FF_PROFILE_AAC_LOW;
+    ctx->time_base.num = 1;
+    ctx->time_base.den = config_.sample_rate;
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        log_error("synthetic source: open aac encoder failed");
+        avcodec_free_context(&ctx);
+        return -1;
+    }
+    audio_frame_size_ = ctx->frame_size;
+    AVFrame *frame = av_frame_alloc();
+    frame->nb_samples = ctx->frame_size;
+    frame->format = ctx->sample_fmt;
+    frame->channels = ctx->channels;
+    frame->channel_layout = ctx->channel_layout;
+    frame->sample_rate = ctx->sample_rate;
+    av_frame_get_buffer(frame, 0);
+    AVPacket *pkt = av_packet_alloc();
+    int sample_rate_index = GetSampleRateIndex(config_.sample_rate);
+    int loop_frames = std::max(config_.sample_rate / ctx->frame_size, 1);
+    for (int i = 0; i <= loop_frames; i++) {
+        if (i < loop_frames) {
+            av_frame_make_writable(frame);
+            for (int s = 0; s < frame->nb_samples; s++) {
+                int64_t n = (int64_t)i * frame->nb_samples + s;
+                float value = (float)(0.25 * sin(2 * SYNTHETIC_PI * SYNTHETIC_TONE_HZ * n / config_.sample_rate));
+                for (int c = 0; c < ctx->channels; c++) {
+                    ((float *)frame->data[c])[s] = value;
+                }
+            }
+            frame->pts = (int64_t)i * frame->nb_samples;
+            avcodec_send_frame(ctx, frame);
+        } else {
+            avcodec_send_frame(ctx, NULL);
+        }
+        while (avcodec_receive_packet(ctx, pkt) == 0) {
+            SyntheticPacket packet = CopyPacket(pkt->data, pkt->size, 7);
+            GenerateAdtsHeader((char *)packet.buf->data, pkt->size, FF_PROFILE_AAC_LOW, sample_rate_index, config_.channels); // profile:audio_object_type - 1
+            audio_frames_.push_back(packet);
+            av_packet_unref(pkt);
+        }
+    }
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    if (audio_frames_.empty()) {
+        log_error("synthetic source: encode audio failed");
+        return -1;
+    }
+    return 0;
+}
+void SyntheticSource::SendVideo(int64_t index, int64_t pts)
+{
+    SyntheticPacket &packet = video_frames_[index % video_frames_.size()];
+    int64_t ingest_us = LatencyTracker::NowUs();
+    if (au_mode_) {
+        VideoData data;
+        data.data = packet.buf->data;
+        data.data_len = packet.len;
+        data.buf = packet.buf;
+        data.pts = pts;
+        data.dts = pts;
+        data.frame_id = index;
+        data.ingest_us = ingest_us;
+        data_listner_->OnVideoData(data);
+        return;
+    }
+    NalIterator nal_iter(packet.buf->data, packet.len);
+    NalUnit nal;
+    while (nal_iter.Next(nal)) {
+        if (nal.len <= nal.start_code) {
+            continue;
+        }
+        const uint8_t *header = nal.data + nal.start_code;
+        if ((config_.video_type == VIDEO_H264 && H264NalType(header) == 9) || (config_.video_type == VIDEO_H265 && H265NalType(header) == 35)) { // 分隔符
+            continue;
+        }
+        VideoData data;
+        data.data = (unsigned char *)nal.data; // 包含起始码
+        data.data_len = nal.len;
+        data.buf = packet.buf;
+        data.pts = pts;
+        data.dts = pts;
+        data.frame_id = index; // 同一帧的NALU使用同一个序号
+        data.ingest_us = ingest_us;
+        data_listner_->OnVideoData(data);
+    }
+    return;
+}
+void SyntheticSource::SendAudio(int64_t index, int64_t pts)
+{
+    SyntheticPacket &packet = audio_frames_[index % audio_frames_.size()];
+    AudioData data;
+    data.data = packet.buf->data;
+    data.data_len = packet.len;
+    data.buf = packet.buf;
+    data.pts = pts;
+    data.dts = pts;
+    data.profile = FF_PROFILE_AAC_LOW;
+    data.samplerate = config_.sample_rate;
+    data.channels = config_.channels;
+    data_listner_->OnAudioData(data);
+    return;
+}
+// 音视频在同一个线程中按时间戳交错输出，时间戳是从0开始的微秒
+void *SyntheticSource::OutputThread(void *arg)
+{
+    SyntheticSource *self = (SyntheticSource *)arg;
+    {
+        std::unique_lock<std::mutex> guard(self->state_mtx_);
+        self->state_cond_.wait(guard, [self] { return self->abort_ || self->data_listner_ != NULL; });
+    }
+    int64_t duration_us = (int64_t)self->config_.duration_s * AV_TIME_BASE;
+    int64_t video_index = 0;
+    int64_t audio_index = 0;
+    int64_t start_us = LatencyTracker::NowUs();
+    while (!self->abort_) {
+        int64_t video_pts = video_index * AV_TIME_BASE / self->config_.fps;
+        int64_t audio_pts = INT64_MAX;
+        if (self->HaveAudio()) {
+            audio_pts = audio_index * self->audio_frame_size_ * AV_TIME_BASE / self->config_.sample_rate;
+        }
+        bool video_end = duration_us > 0 && video_pts >= duration_us;
+        bool audio_end = audio_pts == INT64_MAX || (duration_us > 0 && audio_pts >= duration_us);
+        if (video_end && audio_end) {
+            break;
+        }
+        bool send_video = !video_end && (audio_end || video_pts <= audio_pts);
+        int64_t pts = send_video ? video_pts : audio_pts;
+        if (!self->offline_) { // 按时间戳休眠，析构时立即唤醒
+            std::unique_lock<std::mutex> guard(self->state_mtx_);
+            self->state_cond_.wait_for(guard, std::chrono::microseconds(start_us + pts - LatencyTracker::NowUs()), [self] { return self->abort_.load(); });
+        }
+        if (self->abort_) {
+            break;
+        }
+        if (send_video) {
+            self->SendVideo(video_index++, video_pts);
+        } else {
+            self->SendAudio(audio_index++, audio_pts);
+        }
+    }
+    log_info("synthetic source over, video frames:{} audio frames:{}", video_index, audio_index);
+    if (!self->abort_ && self->colse_cb_) {
+        self->colse_cb_();
+    }
+    return NULL;
+}
@@ -0,0 +1,95 @@
+#ifndef SYNTHETIC_SOURCE_H
+#define SYNTHETIC_SOURCE_H
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+#include "TypeDef.h"
+#include "MediaInterface.h"
+#include "AAC.h"
+#include "LatencyTracker.h"
+#include "NalScanner.h"
+#define SYNTHETIC_URL_PREFIX "synthetic://"
+// 循环输出的最大帧数，GOP更长时只编码这么多帧，避免启动时编码太久、占用太多内存
+#define SYNTHETIC_MAX_LOOP_FRAMES 300
+// 合成源的参数，对应url中的同名参数
+struct SyntheticConfig {
+    enum VideoType video_type = VIDEO_H264;
+    int width = 1280;
+    int height = 720;
+    int fps = 25;
+    int bitrate_kbps = 2000;
+    int gop = 50;
+    int slices = 1;
+    bool audio = true;
+    int sample_rate = 44100;
+    int channels = 2;
+    int duration_s = 10; // 0表示一直输出，直到析构
+};
+/**
+ * synthetic://h264?width=1920&height=1080&fps=30&bitrate=4000&gop=60&slices=4&audio=1&duration=60
+ * 路径部分是h264或h265，没有出现的参数使用SyntheticConfig的默认值；格式错误返回false
+ */
+bool ParseSyntheticUrl(const char *url, SyntheticConfig &config);
+
+// 编码后的一帧，buf末尾有AV_INPUT_BUFFER_PADDING_SIZE个0，len是实际数据长度
+struct SyntheticPacket {
+    AVBufferRef *buf;
+    int len;
+};
+/**
+ * 合成的音视频源，接口和MediaReader一致，不需要媒体文件就能做压力测试
+ * 构造时把测试图案编码成一个GOP的H264/H265 Annex-B、把正弦波编码成ADTS AAC，之后循环输出，时间戳连续递增
+ * 实时模式按时间戳节奏输出，offline模式以最快速度输出；都在SetDataListner之后才开始
+ */
+class SyntheticSource
+{
+public:
+    SyntheticSource() = delete;
+    SyntheticSource(const char *url, bool offline = false); // offline:不按时间戳节奏输出
+    virtual ~SyntheticSource();
+    enum VideoType GetVideoType();
+    enum AudioType GetAudioType();
+    void SetDataListner(MediaDataListner *lisnter, CloseCallbackFunc cb);
+    bool HaveAudio() { return !audio_frames_.empty(); }
+    void GetVideoCon(int &width, int &height, int &fps);
+    void GetAudioCon(int &channels, int &sample_rate, int &profile, int &bit_per_sample);
+    bool IsOffline() { return offline_; }
+    bool IsOpened() { return opened_; } // url错误或者编码器打开失败时为false
+    void SetAccessUnitMode(bool au_mode) { au_mode_ = au_mode; } // 按帧输出：每帧回调一次，不再拆分NALU，在SetDataListner之前调用
+
+private:
+    static void *OutputThread(void *arg);
+    int EncodeVideo();
+    int EncodeAudio();
+    void SendVideo(int64_t index, int64_t pts);
+    void SendAudio(int64_t index, int64_t pts);
+    static SyntheticPacket CopyPacket(const uint8_t *data, int len, int header_len); // 前面预留header_len个字节
+    void NotifyState();
+
+private:
+    SyntheticConfig config_;
+    bool offline_ = false;
+    bool opened_ = false;
+    bool au_mode_ = false;
+    std::thread th_output_;
+    std::atomic<bool> abort_ = {false};
+    std::mutex state_mtx_;
+    std::condition_variable state_cond_; // 等待listner设置、按时间戳休眠，析构时唤醒
+    MediaDataListner *data_listner_ = NULL;
+    CloseCallbackFunc colse_cb_ = NULL;
+
+    // 编码结果，接收方通过VideoData/AudioData的buf增加引用计数，不需要拷贝
+    std::vector<SyntheticPacket> video_frames_; // Annex-B，每个元素是一帧，第一帧是带参数集的IDR
+    std::vector<SyntheticPacket> audio_frames_; // 带ADTS头
+    int audio_frame_size_ = 1024; // 单通道每帧采样点个数
+};
+
+#endif
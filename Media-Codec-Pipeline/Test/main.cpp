@@ -1,4 +1,4 @@
-#include "MediaWrapper.h"
+#include "ChannelManager.h"
 #include "log_helpers.h"
 #include <iostream>
 int main(int argc, char **argv)
@@ -6,7 +6,7 @@ int main(int argc, char **argv)
     spdlog::set_level(spdlog::level::debug);
     if (argc < 3) {
         log_info("only support H264/H265 AAC");
-        log_info("./bin input ouput");
+        log_info("./bin input ouput [input2 ouput2 ...] [offline] [yuv|remux] [metrics=port] [metrics_file=path] [latency_budget=ms] [scale=sws|simd]");
         return -1;
     }
     av_log_set_level(AV_LOG_FATAL);
@@ -14,11 +14,55 @@ int main(int argc, char **argv)
     aclInit(NULL);
     hi_mpi_sys_init();
 #endif
-    MiedaWrapper *test = new MiedaWrapper(argv[1], argv[2]);
-    while (!test->OverHandle()) {
+    bool offline = false;
+    WrapperMode mode = WRAPPER_TRANSCODE;
+    std::vector<std::string> files;
+    int metrics_port = 0;
+    std::string metrics_file;
+    int latency_budget_ms = 200;
+    ScaleKernel scale_kernel = SCALE_KERNEL_SWS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "offline") == 0) { // 离线模式，以最快速度转码整个文件
+            offline = true;
+        } else if (strcmp(argv[i], "yuv") == 0) { // 解码后的YUV直接编码，不转换成BGR
+            mode = WRAPPER_TRANSCODE_YUV;
+        } else if (strcmp(argv[i], "remux") == 0) { // 只转封装，不解码不编码
+            mode = WRAPPER_REMUX;
+        } else if (strncmp(argv[i], "metrics=", 8) == 0) { // Prometheus指标，curl 127.0.0.1:port/metrics
+            metrics_port = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "metrics_file=", 13) == 0) { // 指标每秒写入文件，可以给node_exporter的textfile采集
+            metrics_file = argv[i] + 13;
+        } else if (strncmp(argv[i], "latency_budget=", 15) == 0) { // 每帧端到端延时超过预算时打印各阶段耗时，0不检查
+            latency_budget_ms = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "scale=", 6) == 0) { // 颜色转换的实现，默认libswscale，simd使用手写的SIMD转换
+            scale_kernel = strcmp(argv[i] + 6, "simd") == 0 ? SCALE_KERNEL_SIMD : SCALE_KERNEL_SWS;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    ChannelManagerOption option;
+    option.metrics_port = metrics_port;
+    option.metrics_file = metrics_file;
+    option.latency_budget_ms = latency_budget_ms;
+    option.scale_kernel = scale_kernel;
+    option.raw_prefix_by_id = files.size() > 2; // 只有一路时不会重名，裸流文件名不加前缀
+    ChannelManager *manager = new ChannelManager(option);
+    for (size_t i = 0; i + 1 < files.size(); i += 2) {
+        ChannelConfig config;
+        config.input = files[i];
+        config.output = files[i + 1];
+        config.offline = offline;
+        config.mode = mode;
+        manager->CreateChannel(std::to_string(i / 2), config);
+    }
+    while (!manager->AllOver()) {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
-    delete test;
+    for (auto &status : manager->GetAllStatus()) {
+        log_info("channel {} {} {} video:{} decoded:{} encoded:{}", status.id, ChannelStateName(status.state), status.error, status.stats.video_packets,
+                 status.stats.decoded_frames, status.stats.encoded_frames);
+    }
+    delete manager;
 #ifdef USE_DVPP_MPI
     hi_mpi_sys_exit();
     aclFinalize();
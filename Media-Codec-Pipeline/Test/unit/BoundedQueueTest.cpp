@@ -0,0 +1,118 @@
+#include "BoundedQueue.h"
+#include "UnitTest.h"
+#include <thread>
+#include <vector>
+
+// 满了之后丢弃最旧的数据，被丢弃的数据通过ReleaseFunc释放
+static void TestDropOldest()
+{
+    std::vector<int> released;
+    BoundedQueue<int> queue(4, QUEUE_DROP_OLDEST);
+    queue.SetReleaseFunc([&](int &item) { released.push_back(item); });
+    for (int i = 0; i < 10; i++) {
+        CHECK(queue.Push(i));
+    }
+    CHECK_EQ(queue.Size(), 4);
+    CHECK_EQ(queue.DropCount(), 6);
+    CHECK_EQ(released.size(), 6);
+    for (size_t i = 0; i < released.size(); i++) {
+        CHECK_EQ(released[i], i);
+    }
+    int item = -1;
+    for (int i = 6; i < 10; i++) {
+        CHECK(queue.Pop(item, 0));
+        CHECK_EQ(item, i);
+    }
+    CHECK(!queue.Pop(item, 0));
+    return;
+}
+// 满了之后丢弃新放入的数据
+static void TestDropNewest()
+{
+    std::vector<int> released;
+    BoundedQueue<int> queue(4, QUEUE_DROP_NEWEST);
+    queue.SetReleaseFunc([&](int &item) { released.push_back(item); });
+    for (int i = 0; i < 10; i++) {
+        CHECK_EQ(queue.Push(i), i < 4);
+    }
+    CHECK_EQ(queue.DropCount(), 6);
+    CHECK_EQ(released.size(), 6);
+    CHECK_EQ(released.front(), 4);
+    int item = -1;
+    CHECK(queue.Pop(item, 0));
+    CHECK_EQ(item, 0);
+    CHECK(queue.Push(10)); // 取走一个之后可以继续放入
+    CHECK_EQ(queue.Size(), 4);
+    return;
+}
+// 按字节数限制，队列为空时超过限制的单个数据也可以放入
+static void TestByteCapacity()
+{
+    BoundedQueue<int> queue(0, QUEUE_DROP_NEWEST);
+    queue.SetCapacity(0, 100);
+    queue.SetSizeFunc([](const int &item) { return (size_t)item; });
+    CHECK(queue.Push(200));
+    CHECK(!queue.Push(1));
+    int item = 0;
+    CHECK(queue.Pop(item, 0));
+    CHECK_EQ(queue.Bytes(), 0);
+    CHECK(queue.Push(60));
+    CHECK(queue.Push(40));
+    CHECK(!queue.Push(1));
+    CHECK_EQ(queue.Bytes(), 100);
+    return;
+}
+// 阻塞模式下生产者反复填满队列，消费者按顺序取出全部数据；Close之后取完剩余数据
+static void TestBlockOrder()
+{
+    const int count = 100000;
+    BoundedQueue<int> queue(3, QUEUE_BLOCK);
+    std::thread producer([&queue] {
+        for (int i = 0; i < count; i++) {
+            queue.Push(i);
+        }
+        queue.Close();
+    });
+    int expect = 0;
+    int item = -1;
+    while (queue.Pop(item, -1)) {
+        if (item != expect) {
+            break;
+        }
+        expect++;
+    }
+    producer.join();
+    CHECK_EQ(expect, count);
+    CHECK_EQ(queue.DropCount(), 0);
+    CHECK(queue.IsFinished());
+    int released = -1;
+    queue.SetReleaseFunc([&](int &item) { released = item; });
+    CHECK(!queue.Push(7)); // 已关闭
+    CHECK_EQ(released, 7);
+    return;
+}
+// Clear释放剩余的数据并唤醒等待的生产者
+static void TestClear()
+{
+    int released = 0;
+    BoundedQueue<int> queue(2, QUEUE_BLOCK);
+    queue.SetReleaseFunc([&](int &) { released++; });
+    queue.Push(1);
+    queue.Push(2);
+    std::thread producer([&queue] { queue.Push(3); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.Clear();
+    producer.join();
+    CHECK_EQ(released, 2);
+    CHECK_EQ(queue.Size(), 1);
+    return;
+}
+int main()
+{
+    TestDropOldest();
+    TestDropNewest();
+    TestByteCapacity();
+    TestBlockOrder();
+    TestClear();
+    return UNIT_TEST_RESULT();
+}
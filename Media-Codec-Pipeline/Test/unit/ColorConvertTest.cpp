@@ -0,0 +1,132 @@
+#include "ColorConvert.h"
+#include "UnitTest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define GUARD_BYTE 0xa5 // 每行有效数据之后的填充，转换不能写到这里
+
+static uint32_t g_seed = 12345;
+static uint8_t RandomByte()
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return (uint8_t)(g_seed >> 16);
+}
+// 一帧图像，每个平面的行跨度比有效宽度多出若干字节
+struct Image {
+    std::vector<uint8_t> planes[3];
+    uint8_t *data[4] = {NULL, NULL, NULL, NULL};
+    int stride[4] = {0, 0, 0, 0};
+};
+static void AllocImage(Image &image, AVPixelFormat fmt, int width, int height, bool random)
+{
+    int plane_width[3] = {0, 0, 0};
+    int plane_height[3] = {0, 0, 0};
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    if (fmt == AV_PIX_FMT_BGR24) {
+        plane_width[0] = width * 3;
+        plane_height[0] = height;
+    } else if (fmt == AV_PIX_FMT_NV12) {
+        plane_width[0] = width;
+        plane_height[0] = height;
+        plane_width[1] = cw * 2;
+        plane_height[1] = ch;
+    } else {
+        plane_width[0] = width;
+        plane_height[0] = height;
+        plane_width[1] = plane_width[2] = cw;
+        plane_height[1] = plane_height[2] = ch;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (plane_width[i] == 0) {
+            continue;
+        }
+        image.stride[i] = plane_width[i] + 13;
+        image.planes[i].assign(image.stride[i] * plane_height[i], GUARD_BYTE);
+        if (random) {
+            for (int r = 0; r < plane_height[i]; r++) {
+                for (int x = 0; x < plane_width[i]; x++) {
+                    image.planes[i][r * image.stride[i] + x] = RandomByte();
+                }
+            }
+        }
+        image.data[i] = image.planes[i].data();
+    }
+    return;
+}
+// 所有指令集的输出和标量实现逐字节一致，包括每行末尾的填充没有被改写
+static void TestBitExact(AVPixelFormat src_fmt, AVPixelFormat dst_fmt, ColorMatrix matrix, int width, int height)
+{
+    Image src;
+    AllocImage(src, src_fmt, width, height, true);
+    Image ref;
+    AllocImage(ref, dst_fmt, width, height, false);
+    CHECK_EQ(SimdConvert(src.data, src.stride, src_fmt, ref.data, ref.stride, dst_fmt, width, height, matrix, SIMD_LEVEL_SCALAR), 0);
+    for (int level = SIMD_LEVEL_SSE4; level <= DetectSimdLevel(); level++) {
+        Image out;
+        AllocImage(out, dst_fmt, width, height, false);
+        CHECK_EQ(SimdConvert(src.data, src.stride, src_fmt, out.data, out.stride, dst_fmt, width, height, matrix, (SimdLevel)level), 0);
+        for (int i = 0; i < 3; i++) {
+            if (out.planes[i] != ref.planes[i]) {
+                fprintf(stderr, "%s plane:%d src:%d dst:%d matrix:%s %dx%d\n", SimdLevelName((SimdLevel)level), i, src_fmt, dst_fmt,
+                        ColorMatrixName(matrix), width, height);
+                CHECK(false);
+            }
+        }
+    }
+    return;
+}
+// 标量实现的基本正确性：tv range的黑白灰转换成BGR
+static void TestReferenceValues()
+{
+    const uint8_t levels[3][2] = {{16, 0}, {126, 128}, {235, 255}};
+    for (int m = 0; m < 2; m++) {
+        for (int k = 0; k < 3; k++) {
+            Image src;
+            AllocImage(src, AV_PIX_FMT_YUV420P, 2, 2, false);
+            memset(src.data[0], levels[k][0], src.planes[0].size());
+            memset(src.data[1], 128, src.planes[1].size());
+            memset(src.data[2], 128, src.planes[2].size());
+            Image dst;
+            AllocImage(dst, AV_PIX_FMT_BGR24, 2, 2, false);
+            SimdConvert(src.data, src.stride, AV_PIX_FMT_YUV420P, dst.data, dst.stride, AV_PIX_FMT_BGR24, 2, 2, (ColorMatrix)m, SIMD_LEVEL_SCALAR);
+            for (int c = 0; c < 6; c++) {
+                CHECK(abs(dst.data[0][c] - levels[k][1]) <= 1);
+            }
+        }
+    }
+    return;
+}
+int main()
+{
+    const AVPixelFormat conversions[4][2] = {
+        {AV_PIX_FMT_NV12, AV_PIX_FMT_BGR24},
+        {AV_PIX_FMT_YUV420P, AV_PIX_FMT_BGR24},
+        {AV_PIX_FMT_BGR24, AV_PIX_FMT_YUV420P},
+        {AV_PIX_FMT_BGR24, AV_PIX_FMT_NV12},
+    };
+    printf("simd level:%s\n", SimdLevelName(DetectSimdLevel()));
+    TestReferenceValues();
+    // 宽度覆盖1到70的每个值和SIMD块大小附近的奇偶宽度，行尾由标量代码处理
+    std::vector<int> widths;
+    for (int w = 1; w <= 70; w++) {
+        widths.push_back(w);
+    }
+    const int wide[] = {95, 96, 97, 127, 128, 129, 255, 257};
+    widths.insert(widths.end(), wide, wide + sizeof(wide) / sizeof(wide[0]));
+    const int heights[] = {1, 2, 3, 5};
+    for (int k = 0; k < 4; k++) {
+        for (int m = 0; m < 2; m++) {
+            for (int width : widths) {
+                for (int height : heights) {
+                    TestBitExact(conversions[k][0], conversions[k][1], (ColorMatrix)m, width, height);
+                }
+            }
+        }
+    }
+    Image image;
+    AllocImage(image, AV_PIX_FMT_YUV420P, 4, 4, false);
+    CHECK_EQ(SimdConvert(image.data, image.stride, AV_PIX_FMT_YUV420P, image.data, image.stride, AV_PIX_FMT_NV12, 4, 4, COLOR_MATRIX_BT601, SIMD_LEVEL_AVX2), -1);
+    return UNIT_TEST_RESULT();
+}
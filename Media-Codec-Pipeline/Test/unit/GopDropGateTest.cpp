@@ -0,0 +1,159 @@
+#include "BoundedQueue.h"
+#include "GopDropGate.h"
+#include "UnitTest.h"
+#include <vector>
+
+// 一个ES包：若干个NALU，每个NALU是起始码+NALU头+帧序号
+typedef std::vector<uint8_t> Packet;
+static void AppendNal(Packet &packet, uint8_t header, int index)
+{
+    const uint8_t start_code[4] = {0, 0, 0, 1};
+    packet.insert(packet.end(), start_code, start_code + 4);
+    packet.push_back(header);
+    packet.push_back(0x80 | (index & 0x7f)); // 不会和起始码混淆
+    return;
+}
+// H264：GOP的第一帧是SPS PPS IDR，其余为P帧
+static Packet H264Frame(int index, int gop)
+{
+    Packet packet;
+    if (index % gop == 0) {
+        AppendNal(packet, 0x67, index);
+        AppendNal(packet, 0x68, index);
+        AppendNal(packet, 0x65, index);
+    } else {
+        AppendNal(packet, 0x41, index);
+    }
+    return packet;
+}
+static bool Admit(GopDropGate &gate, const Packet &packet, uint64_t drop_count)
+{
+    return gate.Admit(packet.data(), (int)packet.size(), drop_count);
+}
+// 没有丢包时全部放行
+static void TestNoDrop()
+{
+    GopDropGate gate;
+    for (int i = 0; i < 100; i++) {
+        CHECK(Admit(gate, H264Frame(i, 10), 0));
+    }
+    CHECK_EQ(gate.Discarded(), 0);
+    return;
+}
+// 队列容量4，一次放入13帧，丢弃最旧的9帧之后剩下9..12，9是上一个GOP的P帧，从10(IDR)开始解码
+static void TestQueueDropOldest()
+{
+    BoundedQueue<int> queue(4, QUEUE_DROP_OLDEST);
+    for (int i = 0; i < 13; i++) {
+        queue.Push(i);
+    }
+    CHECK_EQ(queue.DropCount(), 9);
+    GopDropGate gate;
+    std::vector<int> admitted;
+    int index;
+    while (queue.Pop(index, 0)) {
+        if (Admit(gate, H264Frame(index, 5), queue.DropCount())) {
+            admitted.push_back(index);
+        }
+    }
+    CHECK_EQ(admitted.size(), 3);
+    CHECK(admitted.size() == 3 && admitted[0] == 10 && admitted[1] == 11 && admitted[2] == 12);
+    CHECK_EQ(gate.Discarded(), 1);
+    return;
+}
+// 按NALU送入的H265：VPS SPS PPS各自一个包，IRAP(CRA)单独一个包；参数集在等待期间放行
+static void TestH265SeparateParams()
+{
+    GopDropGate gate;
+    gate.SetCodec(true);
+    Packet vps, sps, pps, cra, trail;
+    AppendNal(vps, 32 << 1, 0);
+    AppendNal(sps, 33 << 1, 0);
+    AppendNal(pps, 34 << 1, 0);
+    AppendNal(cra, 21 << 1, 0);
+    AppendNal(trail, 1 << 1, 0);
+    CHECK(Admit(gate, trail, 0));
+    CHECK(!Admit(gate, trail, 1)); // 丢包之后
+    CHECK(!Admit(gate, cra, 1));   // 没有SPS的关键帧不能作为起点
+    CHECK(Admit(gate, vps, 1));
+    CHECK(Admit(gate, sps, 1));
+    CHECK(Admit(gate, pps, 1));
+    CHECK(Admit(gate, cra, 1));
+    CHECK(Admit(gate, trail, 1));
+    CHECK(!Admit(gate, trail, 3)); // 又一次丢包，之前放行的SPS不再算数
+    CHECK(!Admit(gate, cra, 3));
+    CHECK_EQ(gate.Discarded(), 4);
+    return;
+}
+// 参数集和P帧在同一个包中时整个包丢弃，这个包里的SPS也不算已放行
+static void TestParamsWithNonKeySlice()
+{
+    GopDropGate gate;
+    Packet sps_p;
+    AppendNal(sps_p, 0x67, 0);
+    AppendNal(sps_p, 0x68, 0);
+    AppendNal(sps_p, 0x41, 0);
+    Packet idr;
+    AppendNal(idr, 0x65, 0);
+    CHECK(!Admit(gate, sps_p, 1));
+    CHECK(!Admit(gate, idr, 1));
+    CHECK(Admit(gate, H264Frame(0, 5), 1));
+    return;
+}
+/**
+ * 生产者一次放入随机个数的帧，消费者一次取出随机个数，队列满了丢弃最旧的
+ * 检查放行的每一帧都可以解码：P帧的前一帧已经放行，关键帧带参数集
+ */
+static void TestRandomDrops()
+{
+    uint32_t seed = 12345;
+    auto random = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+    const int gop = 12;
+    BoundedQueue<int> queue(6, QUEUE_DROP_OLDEST);
+    GopDropGate gate;
+    int next = 0;
+    int last_admitted = -1;
+    int admitted = 0;
+    int resumed = 0;
+    while (next < 20000) {
+        int push_count = 1 + random() % 8;
+        for (int i = 0; i < push_count; i++) {
+            queue.Push(next++);
+        }
+        int pop_count = 1 + random() % 7;
+        int index;
+        for (int i = 0; i < pop_count && queue.Pop(index, 0); i++) {
+            if (!Admit(gate, H264Frame(index, gop), queue.DropCount())) {
+                continue;
+            }
+            if (index % gop == 0) {
+                if (index != last_admitted + 1) {
+                    resumed++;
+                }
+            } else if (index != last_admitted + 1) {
+                fprintf(stderr, "frame %d admitted after %d\n", index, last_admitted);
+                CHECK(false);
+                return;
+            }
+            last_admitted = index;
+            admitted++;
+        }
+    }
+    CHECK(queue.DropCount() > 0);
+    CHECK(resumed > 0);
+    CHECK(admitted > 0);
+    CHECK_EQ(admitted + gate.Discarded() + queue.DropCount() + queue.Size(), next);
+    return;
+}
+int main()
+{
+    TestNoDrop();
+    TestQueueDropOldest();
+    TestH265SeparateParams();
+    TestParamsWithNonKeySlice();
+    TestRandomDrops();
+    return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+#include "NalScanner.h"
+#include "UnitTest.h"
+#include <string.h>
+#include <vector>
+
+// 逐字节比较的参考实现
+static const uint8_t *FindStartCodeRef(const uint8_t *p, const uint8_t *end)
+{
+    for (; p + 2 < end; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+    }
+    return end;
+}
+static uint32_t g_seed = 12345;
+static uint32_t Random()
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return g_seed >> 8;
+}
+// 从每个位置开始查找，结果和参考实现一致
+static int CompareAllFrom(const uint8_t *buf, const uint8_t *end)
+{
+    int mismatch = 0;
+    for (const uint8_t *p = buf; p <= end; p++) {
+        if (FindStartCode(p, end) != FindStartCodeRef(p, end)) {
+            mismatch++;
+        }
+    }
+    return mismatch;
+}
+/**
+ * 一个起始码放在每一个位置，缓冲区在不同的对齐偏移上开始
+ * 覆盖起始码跨16/32字节块边界、在块的最后两个字节、被缓冲区末尾截断的情况
+ */
+static void TestSingleStartCode()
+{
+    std::vector<uint8_t> storage(256 + 64);
+    for (int align = 0; align < 32; align++) {
+        uint8_t *buf = storage.data() + align;
+        for (int len = 0; len <= 100; len++) {
+            for (int pos = -2; pos < len; pos++) {
+                memset(storage.data(), 0xff, storage.size());
+                const uint8_t code[3] = {0, 0, 1};
+                for (int i = 0; i < 3; i++) { // pos接近开头或末尾时只写入缓冲区内的部分
+                    if (pos + i >= 0 && pos + i < len) {
+                        buf[pos + i] = code[i];
+                    }
+                }
+                if (FindStartCode(buf, buf + len) != FindStartCodeRef(buf, buf + len)) {
+                    fprintf(stderr, "align:%d len:%d pos:%d\n", align, len, pos);
+                    CHECK(false);
+                }
+            }
+        }
+    }
+    return;
+}
+// 只差一个字节的序列：00 00 02、00 01、00 00 00 00，以及紧挨着的起始码
+static void TestNearMiss()
+{
+    const uint8_t patterns[][8] = {
+        {0, 0, 2, 0, 0, 0, 0, 0},
+        {0, 1, 0, 1, 0, 0, 0, 0},
+        {0, 0, 0, 0, 0, 0, 0, 0},
+        {0, 0, 1, 0, 0, 1, 0, 0},
+        {1, 0, 0, 0, 1, 0, 0, 1},
+    };
+    std::vector<uint8_t> buf(200);
+    for (size_t k = 0; k < sizeof(patterns) / sizeof(patterns[0]); k++) {
+        for (int pos = 0; pos + 8 <= (int)buf.size(); pos++) {
+            memset(buf.data(), 0x80, buf.size());
+            memcpy(buf.data() + pos, patterns[k], 8);
+            CHECK_EQ(CompareAllFrom(buf.data(), buf.data() + buf.size()), 0);
+        }
+    }
+    return;
+}
+// 大部分是0和1的随机数据，起始码很密集
+static void TestRandomDense()
+{
+    const uint8_t values[] = {0, 0, 0, 1, 2, 0xff};
+    for (int round = 0; round < 2000; round++) {
+        std::vector<uint8_t> buf(1 + Random() % 300);
+        for (size_t i = 0; i < buf.size(); i++) {
+            buf[i] = values[Random() % sizeof(values)];
+        }
+        CHECK_EQ(CompareAllFrom(buf.data(), buf.data() + buf.size()), 0);
+    }
+    return;
+}
+// 3字节和4字节起始码混合，NalIterator返回的起始码长度和NALU边界正确
+static void TestIterator()
+{
+    std::vector<uint8_t> stream;
+    std::vector<std::vector<uint8_t>> nals;
+    std::vector<int> start_codes;
+    for (int i = 0; i < 200; i++) {
+        int start_code = Random() % 2 ? 4 : 3;
+        std::vector<uint8_t> nal(1 + Random() % 100);
+        for (size_t k = 0; k < nal.size(); k++) {
+            nal[k] = 2 + Random() % 250; // 不包含0和1，NALU内部不会出现起始码
+        }
+        if (start_code == 4) {
+            stream.push_back(0);
+        }
+        stream.push_back(0);
+        stream.push_back(0);
+        stream.push_back(1);
+        stream.insert(stream.end(), nal.begin(), nal.end());
+        nals.push_back(nal);
+        start_codes.push_back(start_code);
+    }
+    NalIterator it(stream.data(), (int)stream.size());
+    NalUnit nal;
+    size_t index = 0;
+    while (it.Next(nal)) {
+        if (index >= nals.size()) {
+            CHECK(false);
+            break;
+        }
+        CHECK_EQ(nal.start_code, start_codes[index]);
+        CHECK_EQ(nal.len, nal.start_code + (int)nals[index].size());
+        CHECK(memcmp(nal.data + nal.start_code, nals[index].data(), nals[index].size()) == 0);
+        index++;
+    }
+    CHECK_EQ(index, nals.size());
+
+    NalIterator empty(stream.data(), 2);
+    CHECK(!empty.Next(nal));
+    return;
+}
+int main()
+{
+    TestSingleStartCode();
+    TestNearMiss();
+    TestRandomDense();
+    TestIterator();
+    return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,274 @@
+#include "UnitTest.h"
+#include "rtsp_common.h"
+#if defined(__linux__) || defined(__linux)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "rtsp_client.h"
+
+static uint32_t g_seed = 12345;
+static uint32_t Random()
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return g_seed >> 8;
+}
+static int Length(const char *message)
+{
+    return RtspMessageLength((const uint8_t *)message, (int)strlen(message));
+}
+// 完整、不完整、带消息体、后面跟着$帧、不是RTSP消息
+static void TestMessageLength()
+{
+    const char *reply = "RTSP/1.0 200 OK\r\nCSeq: 3\r\n\r\n";
+    CHECK_EQ(Length(reply), strlen(reply));
+    std::string with_rtp = std::string(reply) + std::string("$\x00\x00\x04" "abcd", 8);
+    CHECK_EQ(RtspMessageLength((const uint8_t *)with_rtp.data(), (int)with_rtp.size()), strlen(reply));
+    const char *body = "RTSP/1.0 200 OK\r\nCSeq: 4\r\nContent-Length: 5\r\n\r\n$$$$$";
+    CHECK_EQ(Length(body), strlen(body));
+    CHECK_EQ(RtspMessageLength((const uint8_t *)body, (int)strlen(body) - 1), 0); // 消息体不完整
+    const char *lower = "RTSP/1.0 200 OK\r\ncontent-length: 2\r\n\r\nab$";
+    CHECK_EQ(Length(lower), strlen(lower) - 1);
+    CHECK_EQ(Length("RTSP/1.0 200 OK\r\nCSeq: 5\r\n"), 0); // 消息头不完整
+    CHECK_EQ(Length("RTS"), 0);                            // 前缀不完整
+    CHECK_EQ(Length("$\x01\x00\x10"), -1);
+    CHECK_EQ(Length("OPTIONS rtsp://a RTSP/1.0\r\n\r\n"), -1);
+    return;
+}
+
+// 按接收顺序记录视频NALU(去掉4字节起始码)
+class Receiver : public RtspMediaInterface
+{
+public:
+    void RtspVideoData(int64_t pts, const uint8_t *data, size_t size, bool au_end)
+    {
+        nals.push_back(std::vector<uint8_t>(data + 4, data + size));
+        return;
+    }
+    void RtspAudioData(int64_t pts, const uint8_t *data, size_t size)
+    {
+        audio++;
+        return;
+    }
+    std::vector<std::vector<uint8_t>> nals;
+    int audio = 0;
+};
+
+static std::string ReadRequest(int fd, std::string &buffer)
+{
+    while (true) {
+        size_t pos = buffer.find("\r\n\r\n");
+        if (pos != std::string::npos) {
+            std::string request = buffer.substr(0, pos + 4);
+            buffer.erase(0, pos + 4);
+            return request;
+        }
+        char tmp[2048];
+        int ret = recv(fd, tmp, sizeof(tmp), 0);
+        if (ret <= 0) {
+            return "";
+        }
+        buffer.append(tmp, ret);
+    }
+}
+static std::string CSeq(const std::string &request)
+{
+    size_t pos = request.find("CSeq: ");
+    return request.substr(pos + 6, request.find("\r\n", pos) - pos - 6);
+}
+static void AppendFrame(std::string &stream, int channel, const std::vector<uint8_t> &packet)
+{
+    stream.push_back('$');
+    stream.push_back((char)channel);
+    stream.push_back((char)(packet.size() >> 8));
+    stream.push_back((char)(packet.size() & 0xff));
+    stream.append((const char *)packet.data(), packet.size());
+    return;
+}
+// 单个NALU的RTP包，payload type 96
+static std::vector<uint8_t> RtpPacket(uint16_t seq, uint32_t timestamp, const std::vector<uint8_t> &nal)
+{
+    std::vector<uint8_t> packet(12, 0);
+    packet[0] = 0x80;
+    packet[1] = 0x80 | 96;
+    packet[2] = seq >> 8;
+    packet[3] = seq & 0xff;
+    packet[4] = timestamp >> 24;
+    packet[5] = timestamp >> 16;
+    packet[6] = timestamp >> 8;
+    packet[7] = timestamp & 0xff;
+    packet[11] = 1;
+    packet.insert(packet.end(), nal.begin(), nal.end());
+    return packet;
+}
+// 分成随机大小的小块发送，每块之后停顿让客户端先读走；cuts是必须拆开的位置，保证$帧头和帧尾的每个位置都被拆到
+static bool SendChunked(int fd, const std::string &data, const std::vector<size_t> &cuts)
+{
+    size_t offset = 0;
+    size_t next_cut = 0;
+    while (offset < data.size()) {
+        while (next_cut < cuts.size() && cuts[next_cut] <= offset) {
+            next_cut++;
+        }
+        size_t limit = next_cut < cuts.size() ? cuts[next_cut] : data.size();
+        size_t len = std::min<size_t>(limit - offset, Random() % 4 == 0 ? 1 + Random() % 5 : 1 + Random() % 4000);
+        int ret = send(fd, data.data() + offset, len, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            return false;
+        }
+        offset += ret;
+        usleep(500);
+    }
+    return true;
+}
+/**
+ * 回应OPTIONS/DESCRIBE/SETUP/PLAY，之后发送RTP over TCP数据
+ * PLAY的回复和前几个$帧在同一次发送中；数据中夹着RTSP回复(消息体里有'$')、RTCP帧、无法识别的数据
+ */
+static void Serve(int listen_fd, const std::vector<std::vector<uint8_t>> &nals, std::atomic<bool> &stop)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    std::string buffer;
+    std::string request;
+    while (true) {
+        request = ReadRequest(fd, buffer);
+        if (request.empty()) {
+            close(fd);
+            return;
+        }
+        std::string cseq = CSeq(request);
+        std::string reply;
+        if (request.compare(0, 7, "OPTIONS") == 0) {
+            reply = "RTSP/1.0 200 OK\r\nCSeq: " + cseq + "\r\nPublic: OPTIONS, DESCRIBE, SETUP, PLAY\r\n\r\n";
+        } else if (request.compare(0, 8, "DESCRIBE") == 0) {
+            std::string sdp = "v=0\r\no=- 0 0 IN IP4 127.0.0.1\r\ns=t\r\nt=0 0\r\na=control:*\r\nm=video 0 RTP/AVP 96\r\n"
+                              "a=rtpmap:96 H264/90000\r\na=fmtp:96 packetization-mode=1\r\na=control:track0\r\n";
+            std::string url = request.substr(9, request.find(' ', 9) - 9);
+            reply = "RTSP/1.0 200 OK\r\nCSeq: " + cseq + "\r\nContent-Base: " + url + "/\r\nContent-Type: application/sdp\r\nContent-Length: " +
+                    std::to_string(sdp.size()) + "\r\n\r\n" + sdp;
+        } else if (request.compare(0, 5, "SETUP") == 0) {
+            reply = "RTSP/1.0 200 OK\r\nCSeq: " + cseq + "\r\nSession: 1234;timeout=60\r\nTransport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n\r\n";
+        } else if (request.compare(0, 4, "PLAY") == 0) {
+            break;
+        }
+        send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+    }
+    std::string first = "RTSP/1.0 200 OK\r\nCSeq: " + CSeq(request) + "\r\nSession: 1234\r\n\r\n";
+    std::string stream;
+    std::vector<size_t> cuts;
+    for (size_t i = 0; i < nals.size(); i++) {
+        size_t frame_begin = stream.size();
+        AppendFrame(stream, 0, RtpPacket((uint16_t)i, (uint32_t)(i * 3600), nals[i]));
+        if (i >= 100 && i < 108) { // 在帧开头的第1-4个字节之后或者帧末尾的前1-4个字节处拆开
+            int k = (int)(i - 100);
+            cuts.push_back(k < 4 ? frame_begin + 1 + k : stream.size() - (k - 3));
+        }
+        if (i % 50 == 10) {
+            static const char reply[] = "RTSP/1.0 200 OK\r\nCSeq: 9\r\nContent-Length: 6\r\n\r\n$\x00\x00\x01$$";
+            stream.append(reply, sizeof(reply) - 1);
+        }
+        if (i % 30 == 20) {
+            AppendFrame(stream, 1, std::vector<uint8_t>(28, 0x81)); // RTCP
+        }
+        if (i == 77) {
+            stream += "garbage\r\n"; // 不是$帧也不是RTSP消息，跳到下一个'$'
+        }
+        if (i == 3) { // PLAY回复和前4个$帧一起发送
+            send(fd, first.data(), first.size(), MSG_MORE);
+            send(fd, stream.data(), stream.size(), MSG_NOSIGNAL);
+            stream.clear();
+            cuts.clear();
+            usleep(20000);
+        }
+    }
+    SendChunked(fd, stream, cuts);
+    while (!stop) {
+        usleep(10000);
+    }
+    close(fd);
+    return;
+}
+// 通过非阻塞接口驱动RtspClient，检查收到的NALU和发送的一致
+static void TestInterleaved()
+{
+    std::vector<std::vector<uint8_t>> nals;
+    for (int i = 0; i < 400; i++) {
+        size_t len = i % 40 == 5 ? 60000 + Random() % 5000 : 1 + Random() % 1500; // 偶尔有接近65535的$帧
+        std::vector<uint8_t> nal(len);
+        for (size_t k = 0; k < len; k++) {
+            nal[k] = (uint8_t)Random();
+        }
+        nal[0] = i == 0 ? 0x67 : 0x41; // RtspClient收到SPS之后才开始输出
+        nals.push_back(nal);
+    }
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listen_fd, 1);
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    std::atomic<bool> stop(false);
+    std::thread server(Serve, listen_fd, std::cref(nals), std::ref(stop));
+
+    Receiver receiver;
+    RtspClient *client = new RtspClient(RTP_OVER_TCP);
+    client->SetCallBack(&receiver);
+    std::string url = "rtsp://127.0.0.1:" + std::to_string(ntohs(addr.sin_port)) + "/test";
+    CHECK_EQ(client->Open(url.c_str()), 0);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (receiver.nals.size() < nals.size() && !client->HasFailed() && std::chrono::steady_clock::now() < deadline) {
+        std::vector<socket_t> fds;
+        client->GetSockets(fds);
+        if (fds.empty()) {
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = fds[0];
+        pfd.events = client->IsConnecting() ? POLLOUT : POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 100) > 0) {
+            client->OnSocketEvent(pfd.fd, pfd.revents & (POLLIN | POLLERR | POLLHUP), pfd.revents & (POLLOUT | POLLERR | POLLHUP));
+        }
+        client->OnTimer();
+    }
+    CHECK(!client->HasFailed());
+    CHECK_EQ(receiver.nals.size(), nals.size());
+    for (size_t i = 0; i < receiver.nals.size() && i < nals.size(); i++) {
+        if (receiver.nals[i] != nals[i]) {
+            fprintf(stderr, "nal %zu mismatch\n", i);
+            CHECK(false);
+            break;
+        }
+    }
+    stop = true;
+    server.join();
+    delete client;
+    close(listen_fd);
+    return;
+}
+int main()
+{
+    TestMessageLength();
+    TestInterleaved();
+    return UNIT_TEST_RESULT();
+}
+#else
+int main()
+{
+    printf("skip: RTP over TCP test uses the Linux non-blocking RtspClient\n");
+    return 0;
+}
+#endif
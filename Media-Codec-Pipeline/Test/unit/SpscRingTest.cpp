@@ -0,0 +1,109 @@
+#include "SpscRing.h"
+#include "UnitTest.h"
+#include <memory>
+#include <thread>
+
+// 单线程反复放入取出，读写位置多次绕过槽位数组的末尾
+static void TestWrapAround()
+{
+    SpscRing<int> ring(3); // 槽位数向上取整到4，容量仍然是3
+    int next_push = 0;
+    int next_pop = 0;
+    for (int round = 0; round < 1000; round++) {
+        int push_count = 1 + round % 3;
+        for (int i = 0; i < push_count; i++) {
+            CHECK(ring.Push(next_push++));
+        }
+        CHECK_EQ(ring.Size(), push_count);
+        int item = -1;
+        while (ring.Pop(item, 0)) {
+            CHECK_EQ(item, next_pop);
+            next_pop++;
+        }
+        CHECK(ring.Empty());
+    }
+    CHECK_EQ(next_pop, next_push);
+    return;
+}
+// 两个线程，生产者比消费者快时在满的队列上等待，不丢数据、不乱序
+static void TestThreadedOrder()
+{
+    const int count = 1000000;
+    SpscRing<int> ring(8);
+    std::thread producer([&ring] {
+        for (int i = 0; i < count; i++) {
+            ring.Push(i);
+        }
+        ring.Close();
+    });
+    int expect = 0;
+    int item = -1;
+    while (ring.Pop(item, -1)) {
+        if (item != expect) {
+            break;
+        }
+        expect++;
+    }
+    producer.join();
+    CHECK_EQ(expect, count);
+    CHECK(ring.IsFinished());
+    return;
+}
+// 队列为空时等待超时；Close之后还能取出剩余的数据，Push失败并释放数据
+static void TestCloseAndTimeout()
+{
+    int released = 0;
+    SpscRing<int> ring(4);
+    ring.SetReleaseFunc([&](int &) { released++; });
+    int item = -1;
+    auto start = std::chrono::steady_clock::now();
+    CHECK(!ring.Pop(item, 20));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+    ring.Push(1);
+    ring.Push(2);
+    ring.Close();
+    CHECK(!ring.Push(3));
+    CHECK_EQ(released, 1);
+    CHECK(ring.Pop(item, -1));
+    CHECK_EQ(item, 1);
+    CHECK(!ring.IsFinished());
+    CHECK(ring.Pop(item, -1));
+    CHECK_EQ(item, 2);
+    CHECK(!ring.Pop(item, -1)); // 已关闭并且取完，不会一直等待
+    CHECK(ring.IsFinished());
+    return;
+}
+// 取出之后槽位不再持有引用，Clear和析构释放剩余的数据
+static void TestRelease()
+{
+    std::shared_ptr<int> value = std::make_shared<int>(0);
+    int released = 0;
+    {
+        SpscRing<std::shared_ptr<int>> ring(2);
+        ring.SetReleaseFunc([&](std::shared_ptr<int> &) { released++; });
+        for (int i = 0; i < 5; i++) {
+            ring.Push(value);
+            std::shared_ptr<int> item;
+            CHECK(ring.Pop(item, 0));
+        }
+        CHECK_EQ(value.use_count(), 1);
+        ring.Push(value);
+        ring.Push(value);
+        CHECK_EQ(value.use_count(), 3);
+        ring.Clear();
+        CHECK_EQ(released, 2);
+        CHECK_EQ(value.use_count(), 1);
+        ring.Push(value);
+    }
+    CHECK_EQ(released, 3);
+    CHECK_EQ(value.use_count(), 1);
+    return;
+}
+int main()
+{
+    TestWrapAround();
+    TestThreadedOrder();
+    TestCloseAndTimeout();
+    TestRelease();
+    return UNIT_TEST_RESULT();
+}
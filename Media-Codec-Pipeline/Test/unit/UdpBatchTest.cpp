@@ -0,0 +1,124 @@
+#include "UnitTest.h"
+#include "socket_io.h"
+#if defined(__linux__) || defined(__linux)
+#include <string.h>
+#include <vector>
+
+static void SendTo(socket_t sockfd, int port, const std::vector<uint8_t> &data)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(sockfd, data.data(), data.size(), 0, (struct sockaddr *)&addr, sizeof(addr));
+    return;
+}
+// 第index个数据报：长度和内容都由index决定
+static std::vector<uint8_t> Datagram(int index)
+{
+    std::vector<uint8_t> data(1 + (index * 97) % UDP_BATCH_DATAGRAM_LEN);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t)(index + i);
+    }
+    return data;
+}
+// 一次最多取出UDP_BATCH_SIZE个，顺序和内容不变；超长的数据报msg_len置0并计数；没有数据返回0
+static void TestBatchOrder(socket_t sender)
+{
+    socket_t rtp_fd, rtcp_fd;
+    int rtp_port, rtcp_port;
+    CHECK_EQ(createRtpSockets(&rtp_fd, &rtcp_fd, &rtp_port, &rtcp_port), 0);
+    setUdpRecvOption(rtp_fd, 4 * 1024 * 1024);
+    UdpBatch *batch = new UdpBatch();
+    uint32_t drops = 0;
+    uint64_t truncated = 0;
+    CHECK_EQ(recvUdpBatch(rtp_fd, batch, &drops, &truncated), 0);
+
+    const int count = 150;
+    const int too_long[] = {40, 41, 120}; // 这几个发送超过UDP_BATCH_DATAGRAM_LEN的数据报
+    for (int i = 0; i < count; i++) {
+        bool is_long = i == too_long[0] || i == too_long[1] || i == too_long[2];
+        SendTo(sender, rtp_port, is_long ? std::vector<uint8_t>(UDP_BATCH_DATAGRAM_LEN + 1 + i, 0xee) : Datagram(i));
+    }
+    int index = 0;
+    int calls = 0;
+    while (index < count) {
+        int ret = recvUdpBatch(rtp_fd, batch, &drops, &truncated);
+        if (ret <= 0) {
+            CHECK(false);
+            break;
+        }
+        CHECK(ret <= UDP_BATCH_SIZE);
+        for (int i = 0; i < ret; i++, index++) {
+            bool is_long = index == too_long[0] || index == too_long[1] || index == too_long[2];
+            if (is_long) {
+                CHECK_EQ(batch->msgs[i].msg_len, 0);
+                continue;
+            }
+            std::vector<uint8_t> expect = Datagram(index);
+            CHECK_EQ(batch->msgs[i].msg_len, expect.size());
+            CHECK(memcmp(batch->data[i], expect.data(), expect.size()) == 0);
+        }
+        calls++;
+    }
+    CHECK_EQ(index, count);
+    CHECK_EQ(calls, (count + UDP_BATCH_SIZE - 1) / UDP_BATCH_SIZE);
+    CHECK_EQ(truncated, 3);
+    CHECK_EQ(drops, 0);
+    CHECK_EQ(recvUdpBatch(rtp_fd, batch, &drops, &truncated), 0);
+    delete batch;
+    closeSocket(rtp_fd);
+    closeSocket(rtcp_fd);
+    return;
+}
+// 接收缓冲区满时内核丢弃的个数由之后入队的数据报带回，收到的个数加丢弃的个数等于发送的个数
+static void TestKernelDrops(socket_t sender)
+{
+    socket_t rtp_fd, rtcp_fd;
+    int rtp_port, rtcp_port;
+    CHECK_EQ(createRtpSockets(&rtp_fd, &rtcp_fd, &rtp_port, &rtcp_port), 0);
+    setUdpRecvOption(rtp_fd, 16 * 1024);
+    const int count = 2000;
+    for (int i = 0; i < count; i++) {
+        SendTo(sender, rtp_port, std::vector<uint8_t>(1200, (uint8_t)i));
+    }
+    UdpBatch *batch = new UdpBatch();
+    uint32_t drops = 0;
+    uint64_t truncated = 0;
+    int received = 0;
+    int ret;
+    while ((ret = recvUdpBatch(rtp_fd, batch, &drops, &truncated)) > 0) {
+        received += ret;
+    }
+    SendTo(sender, rtp_port, std::vector<uint8_t>(10, 0));
+    while ((ret = recvUdpBatch(rtp_fd, batch, &drops, &truncated)) > 0) {
+        received += ret;
+    }
+    CHECK(drops > 0);
+    CHECK_EQ(received + (int)drops, count + 1);
+    CHECK_EQ(truncated, 0);
+    delete batch;
+    closeSocket(rtp_fd);
+    closeSocket(rtcp_fd);
+    return;
+}
+int main()
+{
+    socketInit();
+    socket_t sender = socket(AF_INET, SOCK_DGRAM, 0);
+    TestBatchOrder(sender);
+    TestKernelDrops(sender);
+    closeSocket(sender);
+    UdpBatch *batch = new UdpBatch();
+    CHECK_EQ(recvUdpBatch(-1, batch, NULL, NULL), -1);
+    delete batch;
+    return UNIT_TEST_RESULT();
+}
+#else
+int main()
+{
+    printf("skip: recvmmsg is Linux only\n");
+    return 0;
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef UNIT_TEST_H
+#define UNIT_TEST_H
+#include <stdio.h>
+
+/**
+ * 单元测试使用的检查宏，不依赖测试框架
+ * 检查失败时打印位置并继续执行，main最后 return UNIT_TEST_RESULT(); 有失败时返回1，ctest判定为失败
+ */
+static int g_unit_test_failures = 0;
+
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            g_unit_test_failures++;                                             \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                    \
+    do {                                                                                                  \
+        long long check_a = (long long)(a);                                                               \
+        long long check_b = (long long)(b);                                                               \
+        if (check_a != check_b) {                                                                         \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, check_a, check_b); \
+            g_unit_test_failures++;                                                                       \
+        }                                                                                                 \
+    } while (0)
+
+#define UNIT_TEST_RESULT() (g_unit_test_failures == 0 ? (printf("ok\n"), 0) : (printf("%d checks failed\n", g_unit_test_failures), 1))
+#endif
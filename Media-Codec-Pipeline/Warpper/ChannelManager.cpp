@@ -0,0 +1,163 @@
+#include "ChannelManager.h"
+
+const char *ChannelStateName(ChannelState state)
+{
+    switch (state) {
+    case CHANNEL_STARTING:
+        return "starting";
+    case CHANNEL_RUNNING:
+        return "running";
+    case CHANNEL_FINISHED:
+        return "finished";
+    case CHANNEL_FAILED:
+        return "failed";
+    default:
+        return "unknown";
+    }
+}
+ChannelManager::ChannelManager(const ChannelManagerOption &option)
+{
+    option_ = option;
+    TaskExecutor::SetInstanceThreads(option_.executor_threads);
+    channels_gauge_ = MetricsRegistry::Instance()->GetGauge("mcp_channels", "Channels managed by the process");
+    exporter_.Start(option_.metrics_port, option_.metrics_file, option_.metrics_interval_ms);
+}
+ChannelManager::~ChannelManager()
+{
+    std::map<std::string, std::shared_ptr<Channel>> channels;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        channels.swap(channels_);
+    }
+    for (auto &it : channels) {
+        ReleaseChannel(it.second);
+    }
+    channels_gauge_->Set(0);
+    exporter_.Stop();
+    log_debug("~ChannelManager");
+}
+int ChannelManager::CreateChannel(const std::string &id, const ChannelConfig &config)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (channels_.find(id) != channels_.end()) {
+        log_error("channel {} already exists", id);
+        return -1;
+    }
+    if (option_.max_channels > 0 && (int)channels_.size() >= option_.max_channels) {
+        log_error("channel {} rejected, max channels:{}", id, option_.max_channels);
+        return -1;
+    }
+    std::shared_ptr<Channel> channel = std::make_shared<Channel>();
+    channel->id = id;
+    channel->config = config;
+    channel->create_time = std::chrono::steady_clock::now();
+    channels_[id] = channel;
+    channels_gauge_->Set(channels_.size());
+    channel->start_thread = std::thread(ChannelManager::StartThread, this, channel);
+    log_info("channel {} create input:{} output:{}", id, config.input, config.output);
+    return 0;
+}
+// MiedaWrapper的构造函数会打开输入，rtsp需要等到收到视频才返回，放到单独的线程中
+void ChannelManager::StartThread(ChannelManager *self, std::shared_ptr<Channel> channel)
+{
+    WrapperOption option;
+    option.offline = channel->config.offline;
+    option.mode = channel->config.mode;
+    option.name = channel->id;
+    option.raw_prefix = self->option_.raw_prefix_by_id ? channel->id + "_" : "";
+    option.scale_threads = self->option_.scale_threads;
+    option.scale_kernel = self->option_.scale_kernel;
+    option.device_id = channel->config.device_id;
+    option.use_nv_enc = channel->config.use_nv_enc;
+    option.latency_budget_ms = self->option_.latency_budget_ms;
+    MiedaWrapper *wrapper = new MiedaWrapper(channel->config.input.c_str(), channel->config.output.c_str(), option);
+    std::lock_guard<std::mutex> guard(self->mutex_);
+    channel->wrapper = wrapper;
+    channel->started = true;
+    return;
+}
+void ChannelManager::ReleaseChannel(std::shared_ptr<Channel> channel)
+{
+    if (channel->start_thread.joinable()) {
+        channel->start_thread.join(); // 正在创建的通道等创建完成再销毁
+    }
+    if (channel->wrapper) {
+        delete channel->wrapper;
+        channel->wrapper = NULL;
+    }
+    log_info("channel {} destroyed", channel->id);
+    return;
+}
+int ChannelManager::DestroyChannel(const std::string &id)
+{
+    std::shared_ptr<Channel> channel;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto it = channels_.find(id);
+        if (it == channels_.end()) {
+            return -1;
+        }
+        channel = it->second;
+        channels_.erase(it);
+        channels_gauge_->Set(channels_.size());
+    }
+    ReleaseChannel(channel); // 析构要等待线程退出，不能持有锁
+    return 0;
+}
+ChannelStatus ChannelManager::MakeStatus(const Channel &channel)
+{
+    ChannelStatus status;
+    status.id = channel.id;
+    status.input = channel.config.input;
+    status.output = channel.config.output;
+    status.uptime_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - channel.create_time).count();
+    if (!channel.started) {
+        status.state = CHANNEL_STARTING;
+        return status;
+    }
+    MiedaWrapper *wrapper = channel.wrapper;
+    status.stats = wrapper->GetStats();
+    if (wrapper->HasError()) {
+        status.state = CHANNEL_FAILED;
+        status.error = wrapper->GetError();
+    } else if (wrapper->OverHandle()) {
+        status.state = CHANNEL_FINISHED;
+    } else {
+        status.state = CHANNEL_RUNNING;
+    }
+    return status;
+}
+bool ChannelManager::GetChannelStatus(const std::string &id, ChannelStatus &status)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = channels_.find(id);
+    if (it == channels_.end()) {
+        return false;
+    }
+    status = MakeStatus(*it->second);
+    return true;
+}
+std::vector<ChannelStatus> ChannelManager::GetAllStatus()
+{
+    std::vector<ChannelStatus> all;
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto &it : channels_) {
+        all.push_back(MakeStatus(*it.second));
+    }
+    return all;
+}
+int ChannelManager::ChannelCount()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    return (int)channels_.size();
+}
+bool ChannelManager::AllOver()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto &it : channels_) {
+        if (!it.second->started || !it.second->wrapper->OverHandle()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef CHANNEL_MANAGER_H
+#define CHANNEL_MANAGER_H
+#include "MediaWrapper.h"
+#include "Metrics.h"
+#include "TaskExecutor.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ChannelState {
+    CHANNEL_STARTING, // 正在打开输入(rtsp探测可能需要几秒)
+    CHANNEL_RUNNING,
+    CHANNEL_FINISHED, // 文件处理完成
+    CHANNEL_FAILED,   // 出错，只影响本通道，等待DestroyChannel
+};
+struct ChannelConfig {
+    std::string input;
+    std::string output;
+    bool offline = false;
+    WrapperMode mode = WRAPPER_TRANSCODE;
+    int32_t device_id = 0;
+    bool use_nv_enc = false;
+};
+struct ChannelStatus {
+    std::string id;
+    std::string input;
+    std::string output;
+    ChannelState state = CHANNEL_STARTING;
+    std::string error;
+    int64_t uptime_ms = 0;
+    WrapperStats stats;
+};
+// 所有通道共用的配置
+struct ChannelManagerOption {
+    int max_channels = 0; // 小于等于0不限制
+    // 每个通道颜色转换最多并行的条带数，条带在进程共享的TaskExecutor上执行，通道多时不会增加线程数
+    int scale_threads = 0;
+    // 共享执行器的线程数，小于等于0按CPU核数；执行器在第一个通道创建时启动，之后修改不生效
+    int executor_threads = 0;
+    ScaleKernel scale_kernel = SCALE_KERNEL_SWS; // SCALE_KERNEL_SIMD需要显式开启
+    bool raw_prefix_by_id = true; // 编码裸流文件名加上"通道ID_"前缀，避免多个通道写同一个文件
+    // 指标导出：端口大于0时在127.0.0.1上提供GET /metrics，文件路径不为空时每metrics_interval_ms覆盖写一次
+    int metrics_port = 0;
+    std::string metrics_file;
+    int metrics_interval_ms = 1000;
+    int latency_budget_ms = 200; // 每帧端到端延时的预算，见WrapperOption
+};
+
+const char *ChannelStateName(ChannelState state);
+
+/**
+ * 一个进程中运行多路MiedaWrapper，按ID创建、销毁和查询
+ * 创建在后台线程中完成，rtsp连不上不会阻塞其它通道的创建
+ * 通道出错时只把本通道置为CHANNEL_FAILED，不退出进程；出错和结束的通道由调用者销毁
+ * 日志都输出到进程的默认logger，每条通道日志带通道ID
+ */
+class ChannelManager
+{
+public:
+    explicit ChannelManager(const ChannelManagerOption &option = ChannelManagerOption());
+    ~ChannelManager(); // 销毁所有通道
+    // 返回0成功，ID已存在或者超过通道数上限返回-1
+    int CreateChannel(const std::string &id, const ChannelConfig &config);
+    // 等待通道的线程全部退出后返回，ID不存在返回-1
+    int DestroyChannel(const std::string &id);
+    bool GetChannelStatus(const std::string &id, ChannelStatus &status);
+    std::vector<ChannelStatus> GetAllStatus();
+    int ChannelCount();
+    // 所有通道都已经结束或者出错
+    bool AllOver();
+
+private:
+    struct Channel {
+        std::string id;
+        ChannelConfig config;
+        MiedaWrapper *wrapper = NULL; // 创建线程完成之后才赋值
+        bool started = false;
+        std::chrono::steady_clock::time_point create_time;
+        std::thread start_thread;
+    };
+    static void StartThread(ChannelManager *self, std::shared_ptr<Channel> channel);
+    ChannelStatus MakeStatus(const Channel &channel);
+    void ReleaseChannel(std::shared_ptr<Channel> channel);
+
+private:
+    ChannelManagerOption option_;
+    MetricsExporter exporter_;
+    std::shared_ptr<MetricGauge> channels_gauge_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Channel>> channels_;
+};
+#endif
@@ -1,268 +1,247 @@
 #include "MediaWrapper.h"
-// #define MP4MUXER
 
-#ifdef MP4MUXER
-static uint32_t find_start_code(uint8_t *buf, uint32_t zeros_in_startcode)
+// data是不带起始码的NALU，缓存写文件头需要的参数集
+void MiedaWrapper::CacheParameterSet(uint8_t *data, int data_len)
 {
-    uint32_t info;
-    uint32_t i;
-
-    info = 1;
-    if ((info = (buf[zeros_in_startcode] != 1) ? 0 : 1) == 0)
-        return 0;
-
-    for (i = 0; i < zeros_in_startcode; i++)
-        if (buf[i] != 0) {
-            info = 0;
-            break;
-        };
-
-    return info;
-}
-static uint8_t *get_nal(uint32_t *len, uint8_t **offset, uint8_t *start, uint32_t total, uint8_t *prefix_len)
-{
-    uint32_t info;
-    uint8_t *q;
-    uint8_t *p = *offset;
-    uint8_t prefix_len_z = 0;
-    *len = 0;
-    *prefix_len = 0;
-    while (1) {
-
-        if (((p - start) + 3) >= total)
-            return NULL;
-
-        info = find_start_code(p, 2);
-        if (info == 1) {
-            prefix_len_z = 2;
-            *prefix_len = prefix_len_z;
-            break;
+    uint8_t **buf = NULL;
+    int *buf_len = NULL;
+    int *len = NULL;
+    if (mux_video_type_ == VIDEO_H264) {
+        int nalu_type = H264NalType(data);
+        if (nalu_type == 7) {
+            buf = &sps_, buf_len = &sps_buffer_len_, len = &sps_len_;
+        } else if (nalu_type == 8) {
+            buf = &pps_, buf_len = &pps_buffer_len_, len = &pps_len_;
         }
-
-        if (((p - start) + 4) >= total)
-            return NULL;
-
-        info = find_start_code(p, 3);
-        if (info == 1) {
-            prefix_len_z = 3;
-            *prefix_len = prefix_len_z;
-            break;
+    } else if (mux_video_type_ == VIDEO_H265) {
+        int nalu_type = H265NalType(data);
+        if (nalu_type == 32) {
+            buf = &vps_, buf_len = &vps_buffer_len_, len = &vps_len_;
+        } else if (nalu_type == 33) {
+            buf = &sps_, buf_len = &sps_buffer_len_, len = &sps_len_;
+        } else if (nalu_type == 34) {
+            buf = &pps_, buf_len = &pps_buffer_len_, len = &pps_len_;
         }
-        p++;
-    }
-    q = p;
-    p = q + prefix_len_z + 1;
-    prefix_len_z = 0;
-    while (1) {
-        if (((p - start) + 3) >= total) {
-            *len = (start + total - q);
-            *offset = start + total;
-            return q;
-        }
-
-        info = find_start_code(p, 2);
-        if (info == 1) {
-            prefix_len_z = 2;
-            break;
-        }
-
-        if (((p - start) + 4) >= total) {
-            *len = (start + total - q);
-            *offset = start + total;
-            return q;
+    }
+    if (buf != NULL) {
+        if (*buf == NULL || (*buf_len < data_len)) {
+            *buf = (uint8_t *)realloc(*buf, data_len);
+            *buf_len = data_len;
         }
-
-        info = find_start_code(p, 3);
-        if (info == 1) {
-            prefix_len_z = 3;
-            break;
+        memcpy(*buf, data, data_len);
+        *len = data_len;
+    }
+    if (sps_len_ != 0 && pps_len_ != 0) {
+        extra_ready_ = true;
+    }
+    return;
+}
+// 参数集准备好之后添加音视频流并写文件头
+void MiedaWrapper::OpenMuxer(bool have_audio, int channels, int samplerate, int profile)
+{
+    ExtraData extra;
+    extra.vps = vps_;
+    extra.vps_len = vps_len_;
+    extra.sps = sps_;
+    extra.sps_len = sps_len_;
+    extra.pps = pps_;
+    extra.pps_len = pps_len_;
+    mp4_muxer_->AddVideo(90000, mux_video_type_, extra, width_, height_, fps_);
+    if (have_audio) {
+        mp4_muxer_->AddAudio(channels, samplerate, profile, AUDIO_AAC);
+    }
+    mp4_muxer_->Open();
+    mp4_muxer_->SendHeader();
+    audio_stream_ = mp4_muxer_->GetAudioStreamIndex();
+    video_stream_ = mp4_muxer_->GetVideoStreamIndex();
+    return;
+}
+// 两种输出都带adts，音频参数统一从adts头中获取，调用时持有mux_mtx_
+bool MiedaWrapper::CacheAudioConfig(uint8_t *data, int len)
+{
+    if (!mux_audio_ready_) {
+        struct AdtsHeader adts;
+        if (len <= 7 || ParseAdtsHeader(data, &adts) < 0 || adts.samplingFreqIndex > 0xb) {
+            return false;
         }
-
-        p++;
+        mux_channels_ = adts.channelCfg;
+        mux_samplerate_ = sampling_frequencies[adts.samplingFreqIndex];
+        mux_profile_ = adts.profile + 1; // AudioSpecificConfig中的audioObjectType
+        mux_audio_ready_ = true;
     }
-
-    *len = (p - q);
-    *offset = p;
-    return q;
+    return true;
 }
 /**
- * 编码后音视频数据
+ * 编码后音视频数据写入输出文件
  */
-int MiedaWrapper::WriteVideo2File(uint8_t *data_nalus, int len_nalus)
+int MiedaWrapper::WriteVideo2File(uint8_t *data_nalus, int len_nalus, int64_t pts, int64_t dts)
 {
-    // 这里不使用编码器传过来的时间戳，根据当前时间重新生成
-    time_now_ = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> guard(mux_mtx_);
+    // 使用编码器带出的源时间戳(微秒)，和处理速度无关；没有时按帧率生成
     nframe_counter_++;
-    if (nframe_counter_ == 1) {
-        time_pre_ = time_now_;
-        time_ts_accum_ = 0;
-    }
-    uint64_t duration_t = std::chrono::duration_cast<std::chrono::milliseconds>(time_now_ - time_pre_).count();
-    time_ts_accum_ += duration_t;
-    uint64_t pts_t = time_ts_accum_;
-    time_pre_ = time_now_;
-
-    uint8_t *p_video = NULL;
-    uint32_t nal_len;
-    uint8_t *buf_sffset = data_nalus;
-    uint8_t prefix_len = 0;
-    uint8_t *video_data = data_nalus;
-    uint32_t video_len = len_nalus;
-    p_video = get_nal(&nal_len, &buf_sffset, video_data, video_len, &prefix_len);
-    while (p_video != NULL) {
-        prefix_len = prefix_len + 1;
-        uint8_t *data = p_video;
-        int data_len = nal_len;
-        int nalu_type;
-        int start_code = 0;
-        if (data[0] == 0 && data[1] == 0 && data[2] == 1) {
-            start_code = 3;
-        } else if (data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1) {
-            start_code = 4;
-        }
-        if (video_type_ == VIDEO_H264) {
-            nalu_type = data[start_code] & 0x1f;
-            if (!extra_ready_) {
-                if (nalu_type == 7) {
-                    if (sps_ == NULL || (sps_buffer_len_ < data_len - start_code)) {
-                        sps_ = (uint8_t *)realloc(sps_, data_len - start_code);
-                        sps_buffer_len_ = data_len - start_code;
-                    }
-                    memcpy(sps_, data + start_code, data_len - start_code);
-                    sps_len_ = data_len - start_code;
-
-                } else if (nalu_type == 8) {
-                    if (pps_ == NULL || (pps_buffer_len_ < data_len - start_code)) {
-                        pps_ = (uint8_t *)realloc(pps_, data_len - start_code);
-                        pps_buffer_len_ = data_len - start_code;
-                    }
-                    memcpy(pps_, data + start_code, data_len - start_code);
-                    pps_len_ = data_len - start_code;
-                }
-            }
-
-        } else if (video_type_ == VIDEO_H265) {
-            nalu_type = (data[start_code] >> 1) & 0x3f;
-            if (!extra_ready_) {
-                if (nalu_type == 32) {
-                    if (vps_ == NULL || (vps_buffer_len_ < data_len - start_code)) {
-                        vps_ = (uint8_t *)realloc(vps_, data_len - start_code);
-                        vps_buffer_len_ = data_len - start_code;
-                    }
-                    memcpy(vps_, data + start_code, data_len - start_code);
-                    vps_len_ = data_len - start_code;
-                } else if (nalu_type == 33) {
-                    if (sps_ == NULL || (sps_buffer_len_ < data_len - start_code)) {
-                        sps_ = (uint8_t *)realloc(sps_, data_len - start_code);
-                        sps_buffer_len_ = data_len - start_code;
-                    }
-                    memcpy(sps_, data + start_code, data_len - start_code);
-                    sps_len_ = data_len - start_code;
-
-                } else if (nalu_type == 34) {
-                    if (pps_ == NULL || (pps_buffer_len_ < data_len - start_code)) {
-                        pps_ = (uint8_t *)realloc(pps_, data_len - start_code);
-                        pps_buffer_len_ = data_len - start_code;
-                    }
-                    memcpy(pps_, data + start_code, data_len - start_code);
-                    pps_len_ = data_len - start_code;
-                }
+    if (pts == AV_NOPTS_VALUE) {
+        pts = (int64_t)(nframe_counter_ - 1) * AV_TIME_BASE / fps_;
+    }
+    if (dts == AV_NOPTS_VALUE) {
+        dts = pts;
+    }
+    if (video_stream_ == -1) {
+        mux_video_type_ = VIDEO_H264; // 转码输出的是编码器的H264码流，和源格式无关
+        NalIterator nal_iter(data_nalus, len_nalus);
+        NalUnit nal;
+        while (!extra_ready_ && nal_iter.Next(nal)) { // 文件头需要参数集，拿到之前的帧丢弃
+            if (nal.len > nal.start_code) {
+                CacheParameterSet((uint8_t *)nal.data + nal.start_code, nal.len - nal.start_code);
             }
         }
-        if (sps_len_ != 0 && pps_len_ != 0) {
-            extra_ready_ = true;
-        }
         if (!extra_ready_) {
-            goto NEXT;
+            return 0;
         }
-        if (video_stream_ == -1) {
-            ExtraData extra;
-            extra.vps = vps_;
-            extra.vps_len = vps_len_;
-            extra.sps = sps_;
-            extra.sps_len = sps_len_;
-            extra.pps = pps_;
-            extra.pps_len = pps_len_;
-            mp4_muxer_->AddVideo(90000, video_type_, extra, width_, height_, fps_);
-        }
-        // 音频
-        if( ((rtsp_flag_ == true) && (rtsp_client_proxy_->GetAudioType() != AudioType::AUDIO_NONE))
-            || (reader_->GetAudioType() != AudioType::AUDIO_NONE) ){
-            if(audio_stream_ == -1){
-                int channels;
-                int samplerate;
-                int profile;
-                aac_encoder_->GetAudioCon(channels, samplerate, profile); // 获取AAC编码器输出信息
-                mp4_muxer_->AddAudio(channels, samplerate, profile, AUDIO_AAC);
-            }
+        bool have_audio = SourceAudioType() == AUDIO_AAC;
+        if (have_audio && !mux_audio_ready_) { // 等第一个编码后的音频包拿到音频参数再写文件头
+            return 0;
         }
-        if (video_stream_ == -1) {
-            mp4_muxer_->Open();
-            mp4_muxer_->SendHeader();
-            audio_stream_ = mp4_muxer_->GetAudioStreamIndex();
-            video_stream_ = mp4_muxer_->GetVideoStreamIndex();
-        }
-        AVRational time_base = mp4_muxer_->fmt_ctx_->streams[mp4_muxer_->video_index_]->time_base;
-        AVRational time_base_q = {1, AV_TIME_BASE};                             // 微妙
-        int64_t video_pts = av_rescale_q(pts_t * 1000, time_base_q, time_base); // 转换到ffmpeg时间基
-        mp4_muxer_->SendPacket(data + start_code, data_len - start_code, video_pts, video_pts, video_stream_);
-    NEXT:
-        p_video = get_nal(&nal_len, &buf_sffset, video_data, video_len, &prefix_len);
+        OpenMuxer(have_audio, mux_channels_, mux_samplerate_, mux_profile_);
     }
-
+    // 整帧写入，B帧的pts/dts由编码器给出，不能按NALU逐个强制递增
+    AVRational time_base = mp4_muxer_->fmt_ctx_->streams[mp4_muxer_->video_index_]->time_base;
+    AVRational time_base_q = {1, AV_TIME_BASE}; // 微妙
+    mux_metrics_->Input(len_nalus);
+    StageTimer timer(mux_metrics_);
+    mp4_muxer_->SendVideoFrame(data_nalus, len_nalus, av_rescale_q(pts, time_base_q, time_base), av_rescale_q(dts, time_base_q, time_base));
+    mux_metrics_->Output(len_nalus);
     return 0;
 }
 int MiedaWrapper::WriteAudio2File(uint8_t *data, int len)
 {
-    if (audio_stream_ == -1) {
+    std::lock_guard<std::mutex> guard(mux_mtx_);
+    nframe_counter_1_++; // 写文件头之前丢弃的包也要计数，否则音频时间轴整体提前
+    if (!CacheAudioConfig(data, len) || audio_stream_ == -1) {
         return 0;
     }
-#if 0
-    struct AdtsHeader res;
-    ParseAdtsHeader((uint8_t*)data, &res);
-    log_info("channelCfg:{} rate:{}",res.channelCfg,sampling_frequencies[res.samplingFreqIndex]);
-#endif
-    time_now_1_ = std::chrono::steady_clock::now();
-    nframe_counter_1_++;
-    if (nframe_counter_1_ == 1) {
-        time_pre_1_ = time_now_1_;
-        time_ts_accum_1_ = 0;
-    }
-    uint64_t duration_t = std::chrono::duration_cast<std::chrono::milliseconds>(time_now_1_ - time_pre_1_).count();
-    time_ts_accum_1_ += duration_t;
-    uint64_t pts_t = time_ts_accum_1_;
-    // 模拟实时流，所以这里面的pts重新生成
-    time_pre_1_ = time_now_1_;
+    // AAC编码器不带出时间戳，从第一个音频包的源时间戳开始按采样点个数生成，和视频在同一个时间轴上
+    int64_t pts = audio_start_pts_ + (int64_t)(nframe_counter_1_ - 1) * 1024 * AV_TIME_BASE / mux_samplerate_;
 
     AVRational time_base = mp4_muxer_->fmt_ctx_->streams[mp4_muxer_->audio_index_]->time_base;
-    AVRational time_base_q = {1, AV_TIME_BASE};                             // 微妙
-    int64_t audio_pts = av_rescale_q(pts_t * 1000, time_base_q, time_base); // 转换到ffmpeg时间基
+    AVRational time_base_q = {1, AV_TIME_BASE};                  // 微妙
+    int64_t audio_pts = av_rescale_q(pts, time_base_q, time_base); // 转换到ffmpeg时间基
+    mux_metrics_->Input(len);
+    StageTimer timer(mux_metrics_);
     mp4_muxer_->SendPacket(data + 7, len - 7, audio_pts, audio_pts, audio_stream_);
+    mux_metrics_->Output(len - 7);
     return 0;
 }
-#endif
-MiedaWrapper::MiedaWrapper(char *input, char *ouput)
+MiedaWrapper::MiedaWrapper(char *input, char *ouput, bool offline, WrapperMode mode)
 {
-#ifdef MP4MUXER
+    offline_ = offline;
+    mode_ = mode;
+    Start(input, ouput);
+}
+MiedaWrapper::MiedaWrapper(const char *input, const char *ouput, const WrapperOption &option)
+{
+    offline_ = option.offline;
+    mode_ = option.mode;
+    name_ = option.name;
+    raw_prefix_ = option.raw_prefix;
+    scale_threads_ = option.scale_threads;
+    scale_kernel_ = option.scale_kernel;
+    device_id_ = option.device_id;
+    use_nv_enc_flag_ = option.use_nv_enc;
+    latency_budget_ms_ = option.latency_budget_ms;
+    Start(input, ouput);
+}
+// 打开输入之后数据回调就开始了，所有配置必须在这之前设置好
+void MiedaWrapper::Start(const char *input, const char *ouput)
+{
+    demux_video_metrics_ = new StageMetrics(name_, "demux_video");
+    demux_audio_metrics_ = new StageMetrics(name_, "demux_audio");
+    latency_ = new LatencyTracker(name_, latency_budget_ms_);
+    mux_metrics_ = new StageMetrics(name_, "mux"); // 转封装和转码都输出到ouput
     mp4_muxer_ = new Muxer();
-    mp4_muxer_->Init(ouput);
-#endif
+    if (mp4_muxer_->Init((char *)ouput) < 0) { // 输出格式由文件扩展名决定
+        SetError("unsupported output");
+        return;
+    }
     if( memcmp("rtsp://", input, strlen("rtsp://")) == 0 ){ // rtsp
         rtsp_flag_ = true;
-        rtsp_client_proxy_ = new RtspClientProxy(input);
-        rtsp_client_proxy_->ProbeVideoFps(); // 必须在SetDataListner之前调用ProbeVideoFps,否则在RtspClientProxy::RtspVideoData调用data_listner_的时候会阻塞
+        offline_ = false; // 实时流不支持离线模式
+        rtsp_client_proxy_ = new RtspClientProxy((char *)input);
+        // 必须在SetDataListner之前调用ProbeVideoFps,否则在RtspClientProxy::RtspVideoData调用data_listner_的时候会阻塞
+        if (rtsp_client_proxy_->ProbeVideoFps(WRAPPER_RTSP_PROBE_TIMEOUT_MS) < 0) {
+            SetError("rtsp probe timeout");
+            return;
+        }
         rtsp_client_proxy_->GetVideoCon(width_, height_, fps_);
+        rtsp_client_proxy_->SetAccessUnitMode(true); // 解码器按帧输入，减少队列操作和send_packet次数
         rtsp_client_proxy_->SetDataListner(static_cast<MediaDataListner *>(this), [this]() {
             return this->MediaOverhandle();
         });
     }
+    else if (memcmp(SYNTHETIC_URL_PREFIX, input, strlen(SYNTHETIC_URL_PREFIX)) == 0) { // 合成源，offline时不按时间戳节奏输出
+        synthetic_source_ = new SyntheticSource(input, offline_);
+        if (!synthetic_source_->IsOpened()) {
+            SetError("open synthetic source failed");
+            return;
+        }
+        synthetic_source_->GetVideoCon(width_, height_, fps_);
+        synthetic_source_->SetAccessUnitMode(true); // 解码器按帧输入，减少队列操作和send_packet次数
+        synthetic_source_->SetDataListner(static_cast<MediaDataListner *>(this), [this]() {
+            return this->MediaOverhandle();
+        });
+    }
     else{ // file
-        reader_ = new MediaReader(input);
+        reader_ = new MediaReader((char *)input, offline_);
+        if (!reader_->IsOpened()) {
+            SetError("open input failed");
+            return;
+        }
         reader_->GetVideoCon(width_, height_, fps_);
+        reader_->SetAccessUnitMode(true); // 解码器按帧输入，减少队列操作和send_packet次数
+        reader_->SetMetrics(demux_video_metrics_, demux_audio_metrics_);
         reader_->SetDataListner(static_cast<MediaDataListner *>(this), [this]() {
             return this->MediaOverhandle();
         });
     }
+    return;
+}
+enum VideoType MiedaWrapper::SourceVideoType()
+{
+    if (rtsp_flag_) {
+        return rtsp_client_proxy_->GetVideoType();
+    }
+    return synthetic_source_ ? synthetic_source_->GetVideoType() : reader_->GetVideoType();
+}
+enum AudioType MiedaWrapper::SourceAudioType()
+{
+    if (rtsp_flag_) {
+        return rtsp_client_proxy_->GetAudioType();
+    }
+    return synthetic_source_ ? synthetic_source_->GetAudioType() : reader_->GetAudioType();
+}
+void MiedaWrapper::SetError(const std::string &msg)
+{
+    std::lock_guard<std::mutex> guard(error_mtx_);
+    if (!error_flag_) {
+        log_error("[{}] {}", name_, msg);
+        error_msg_ = msg;
+        error_flag_ = true;
+    }
+    over_flag_ = true;
+    return;
+}
+std::string MiedaWrapper::GetError()
+{
+    std::lock_guard<std::mutex> guard(error_mtx_);
+    return error_msg_;
+}
+WrapperStats MiedaWrapper::GetStats()
+{
+    WrapperStats stats;
+    stats.video_packets = video_packets_;
+    stats.audio_packets = audio_packets_;
+    stats.decoded_frames = decoded_frames_;
+    stats.encoded_frames = encoded_frames_;
+    return stats;
 }
 void MiedaWrapper::MediaOverhandle()
 {
@@ -275,28 +254,50 @@ void MiedaWrapper::MediaOverhandle()
 // with startcode
 void MiedaWrapper::OnVideoData(VideoData data)
 {
-    if(rtsp_flag_ == true){ // rtsp
-        video_type_ = rtsp_client_proxy_->GetVideoType();
-        if (video_type_ == VIDEO_NONE) {
-            log_error("only support H264/H265");
-            exit(1);
-        }
+    if (error_flag_) { // 出错的通道丢弃后续数据，等待被销毁
+        return;
     }
-    else{ // file 
-        video_type_ = reader_->GetVideoType();
-        if (video_type_ == VIDEO_NONE) {
-            log_error("only support H264/H265");
-            exit(1);
-        }
+    video_type_ = SourceVideoType();
+    if (video_type_ == VIDEO_NONE) {
+        SetError("only support H264/H265");
+        return;
+    }
+    video_packets_++;
+    demux_video_metrics_->Output(data.data_len);
+    if (latency_->Ingest(data.frame_id, data.ingest_us, data.pts)) { // 按NALU输出时只在一帧的第一个NALU记录解封装耗时
+        latency_->Mark(data.frame_id, LATENCY_DEMUX);
+    }
+    if (mode_ == WRAPPER_REMUX) { // 不创建解码器
+        RemuxVideo(data);
+        return;
     }
     if (!hard_decoder_) {
         log_debug("video_type:{} width:{} height:{} fps_:{}", video_type_ == VIDEO_H264 ? "VIDEO_H264" : "VIDEO_H265", width_, height_, fps_);
+#if defined(USE_FFMPEG_SOFT) || defined(USE_FFMPEG_NVIDIA)
+        // 离线转码追求吞吐量，用帧级多线程；实时流保持低延时
+        hard_decoder_ = new HardVideoDecoder(video_type_ == VIDEO_H264 ? false : true, offline_ ? DecThreadPresetThroughput() : DecThreadPresetLowDelay());
+#else
         hard_decoder_ = new HardVideoDecoder(video_type_ == VIDEO_H264 ? false : true);
+#endif
         hard_decoder_->SetFrameFetchCallback(static_cast<DecDataCallListner *>(this));
+        hard_decoder_->SetOfflineMode(offline_);
+        video_dec_metrics_ = new StageMetrics(name_, "video_decode");
+        hard_decoder_->SetMetrics(video_dec_metrics_);
+#if defined(USE_FFMPEG_SOFT) || defined(USE_FFMPEG_NVIDIA)
+        if (mode_ == WRAPPER_TRANSCODE_YUV) { // 解码输出原生YUV，由OnVideoFrame交给编码器
+            hard_decoder_->SetOutputType(DEC_OUTPUT_YUV);
+        }
+        hard_decoder_->SetScaleThreads(scale_threads_);
+        hard_decoder_->SetScaleKernel(scale_kernel_);
+#endif
 #if defined(USE_DVPP_MPI) || defined(USE_NVIDIA_X86)
         hard_decoder_->Init(device_id_, width_, height_); // dvpp nvidia
 #endif
     }
+    if (hard_decoder_->HasError()) {
+        SetError("video decoder init failed");
+        return;
+    }
     // int type;
     // if(video_type_ == VIDEO_H264){
     //     type = data.data[4] & 0x1f;
@@ -304,62 +305,181 @@ void MiedaWrapper::OnVideoData(VideoData data)
     // else{
     //     type = (data.data[4] >> 1) & 0x3f;
     // }
-    hard_decoder_->InputVideoData(data.data, data.data_len, 0, 0); // 实时解码，不需要传递pts
+    video_dec_metrics_->Input(data.data_len);
+    // 源pts随解码后的图像输出，再传给编码器和封装器；data.buf不为NULL时不拷贝数据
+    hard_decoder_->InputVideoData(data.data, data.data_len, 0, data.pts, data.buf);
     return;
 }
 // width adts
 void MiedaWrapper::OnAudioData(AudioData data)
 {
-    if(rtsp_flag_ == true){
-        audio_type_ = rtsp_client_proxy_->GetAudioType();
-        if (audio_type_ != AUDIO_AAC) {
-            log_error("only support AAC");
-            exit(1);
-        }
+    if (error_flag_) {
+        return;
     }
-    else{
-        audio_type_ = reader_->GetAudioType();
-        if (audio_type_ != AUDIO_AAC) {
-            log_error("only support AAC");
-            exit(1);
-        }
+    audio_type_ = SourceAudioType();
+    if (audio_type_ != AUDIO_AAC) {
+        SetError("only support AAC");
+        return;
+    }
+    if (audio_packets_ == 0) {
+        audio_start_pts_ = data.pts;
+    }
+    audio_packets_++;
+    demux_audio_metrics_->Output(data.data_len);
+    if (mode_ == WRAPPER_REMUX) {
+        RemuxAudio(data);
+        return;
     }
     if (aac_decoder_ == NULL) {
         log_debug("audio_type:AAC profile:{} samplerate:{} channels:{}", data.profile, data.samplerate, data.channels);
         aac_decoder_ = new AACDecoder();
         aac_decoder_->SetResampleArg(AV_SAMPLE_FMT_S16, 2, 44100); // 重采样输出格式，解码器会把解码后的PCM数据重采样成设定的格式
         aac_decoder_->SetCallback(static_cast<DecDataCallListner *>(this));
+        aac_decoder_->SetOfflineMode(offline_);
+        audio_dec_metrics_ = new StageMetrics(name_, "audio_decode");
+        aac_decoder_->SetMetrics(audio_dec_metrics_);
     }
-    aac_decoder_->InputAACData(data.data, data.data_len); // 实时解码，不需要传递pts
+    if (aac_decoder_->HasError()) { // 打开失败或者重采样失败
+        SetError("audio decoder failed");
+        return;
+    }
+    audio_dec_metrics_->Input(data.data_len);
+    aac_decoder_->InputAACData(data.data, data.data_len, data.buf); // 音频时间戳在写文件时按采样点个数生成，不需要传递pts
     return;
 }
 
 /**
- * 解码后音视频数据
+ * 转封装，源码流直接写入文件
  */
-void MiedaWrapper::OnRGBData(cv::Mat frame)
+void MiedaWrapper::RemuxVideo(VideoData &data)
 {
-    // 拿到解码后的图像就可以根据自己的业务需求进行处理，例如：AI识别、opencv检测、图像渲染等。
-    // 之后再把处理后的图像进行编码
-    if (!hard_encoder_) {
-#if defined(USE_NVIDIA_X86)
-        if(use_nv_enc_flag_){
-            hard_encoder_ = new NVHardVideoEncoder();
+    std::lock_guard<std::mutex> guard(mux_mtx_);
+    if (video_stream_ == -1) {
+        mux_video_type_ = video_type_;
+        NalIterator nal_iter(data.data, data.data_len);
+        NalUnit nal;
+        while (!extra_ready_ && nal_iter.Next(nal)) {
+            if (nal.len > nal.start_code) {
+                CacheParameterSet((uint8_t *)nal.data + nal.start_code, nal.len - nal.start_code);
+            }
+        }
+        if (!extra_ready_) {
+            return;
         }
-        else{
-            hard_encoder_ =  new NVSoftVideoEncoder();
+        bool have_audio = SourceAudioType() == AUDIO_AAC;
+        if (have_audio && !mux_audio_ready_) { // 等第一个音频包拿到音频参数再写文件头
+            return;
         }
-        hard_encoder_->SetDevice(device_id_);
+        OpenMuxer(have_audio, mux_channels_, mux_samplerate_, mux_profile_);
+    }
+    // 源时间戳的单位是微秒，rtsp的时间戳由RTP时间戳转换
+    AVRational time_base = mp4_muxer_->fmt_ctx_->streams[mp4_muxer_->video_index_]->time_base;
+    AVRational time_base_q = {1, AV_TIME_BASE};
+    mux_metrics_->Input(data.data_len);
+    StageTimer timer(mux_metrics_);
+    mp4_muxer_->SendVideoFrame(data.data, data.data_len, av_rescale_q(data.pts, time_base_q, time_base), av_rescale_q(data.dts, time_base_q, time_base));
+    mux_metrics_->Output(data.data_len);
+    if (data.frame_id >= 0) {
+        latency_->Mark(data.frame_id, LATENCY_OUTPUT);
+    }
+    return;
+}
+void MiedaWrapper::RemuxAudio(AudioData &data)
+{
+    std::lock_guard<std::mutex> guard(mux_mtx_);
+    if (!CacheAudioConfig(data.data, data.data_len)) {
+        return;
+    }
+    if (audio_stream_ == -1) {
+        return;
+    }
+    AVRational time_base = mp4_muxer_->fmt_ctx_->streams[mp4_muxer_->audio_index_]->time_base;
+    AVRational time_base_q = {1, AV_TIME_BASE};
+    int64_t audio_pts = av_rescale_q(data.pts, time_base_q, time_base);
+    mux_metrics_->Input(data.data_len);
+    StageTimer timer(mux_metrics_);
+    mp4_muxer_->SendPacket(data.data + 7, data.data_len - 7, audio_pts, audio_pts, audio_stream_);
+    mux_metrics_->Output(data.data_len - 7);
+    return;
+}
+
+/**
+ * 解码后音视频数据
+ */
+int MiedaWrapper::CreateVideoEncoder(cv::Mat init_frame)
+{
+#if defined(USE_NVIDIA_X86)
+    if(use_nv_enc_flag_){
+        hard_encoder_ = new NVHardVideoEncoder();
+    }
+    else{
+        hard_encoder_ =  new NVSoftVideoEncoder();
+    }
+    hard_encoder_->SetDevice(device_id_);
 #elif defined(USE_DVPP_MPI)
-        hard_encoder_ = new HardVideoEncoder();
-        hard_encoder_->SetDevice(device_id_);
+    hard_encoder_ = new HardVideoEncoder();
+    hard_encoder_->SetDevice(device_id_);
 #else
-        hard_encoder_ = new HardVideoEncoder();
+    hard_encoder_ = new HardVideoEncoder();
 #endif
-        hard_encoder_->Init(frame, fps_);
-        hard_encoder_->SetDataCallback(static_cast<EncDataCallListner *>(this));
+    if (hard_encoder_->Init(init_frame, fps_, offline_ ? ENC_PROFILE_OFFLINE : ENC_PROFILE_LOW_LATENCY) < 0) { // 离线转码用吞吐量优先的配置
+        SetError("video encoder init failed");
+        return -1;
     }
-    hard_encoder_->AddVideoFrame(frame);
+    hard_encoder_->SetDataCallback(static_cast<EncDataCallListner *>(this));
+    hard_encoder_->SetOfflineMode(offline_);
+    video_enc_metrics_ = new StageMetrics(name_, "video_encode");
+    hard_encoder_->SetMetrics(video_enc_metrics_);
+#ifndef USE_DVPP_MPI
+    hard_encoder_->SetScaleThreads(scale_threads_);
+    hard_encoder_->SetScaleKernel(scale_kernel_);
+#endif
+    return 0;
+}
+void MiedaWrapper::OnRGBData(cv::Mat frame)
+{
+    OnRGBData(frame, AV_NOPTS_VALUE);
+    return;
+}
+void MiedaWrapper::OnRGBData(cv::Mat frame, int64_t pts)
+{
+    if (error_flag_) { // 出错的通道丢弃解码后的数据
+        return;
+    }
+    decoded_frames_++;
+    int64_t frame_id = latency_->Mark(latency_->FrameIdByPts(pts), LATENCY_DECODE); // 没有带回时间戳时按顺序匹配
+    size_t frame_bytes = frame.total() * frame.elemSize();
+    video_dec_metrics_->Output(frame_bytes);
+    // 拿到解码后的图像就可以根据自己的业务需求进行处理，例如：AI识别、opencv检测、图像渲染等。
+    // 之后再把处理后的图像进行编码
+    if (!hard_encoder_ && CreateVideoEncoder(frame) < 0) {
+        return;
+    }
+    if (frame_id >= 0) { // 上一阶段没有匹配到的帧不再按顺序匹配，避免错位
+        latency_->Mark(frame_id, LATENCY_PROCESS);
+    }
+    video_enc_metrics_->Input(frame_bytes);
+    hard_encoder_->AddVideoFrame(frame, pts);
+    return;
+}
+void MiedaWrapper::OnVideoFrame(VideoFrame frame)
+{
+    if (error_flag_) {
+        return;
+    }
+    // 不需要处理图像时解码输出直接编码，格式和尺寸一致时编码器只增加引用计数
+    decoded_frames_++;
+    int64_t frame_id = latency_->Mark(latency_->FrameIdByPts(frame.Pts()), LATENCY_DECODE);
+    size_t frame_bytes = (size_t)frame.Width() * frame.Height() * 3 / 2; // 4:2:0
+    video_dec_metrics_->Output(frame_bytes);
+    if (!hard_encoder_ && CreateVideoEncoder(frame.ToBGR()) < 0) { // 编码器按第一帧的尺寸初始化，只转换这一帧
+        return;
+    }
+    if (frame_id >= 0) { // 上一阶段没有匹配到的帧不再按顺序匹配，避免错位
+        latency_->Mark(frame_id, LATENCY_PROCESS);
+    }
+    video_enc_metrics_->Input(frame_bytes);
+    hard_encoder_->AddVideoFrame(frame, frame.Pts());
     return;
 }
 // FILE *fp_file = NULL;
@@ -368,12 +488,21 @@ void MiedaWrapper::OnPCMData(unsigned char **data, int data_len)
 {
     // 拿到解码后的PCM音频根据自己的业务需求进行处理，例如语音识别、语音合成等。
     // 之后再把处理后的音频进行编码
+    if (error_flag_) {
+        return;
+    }
     if (aac_encoder_ == NULL) {
         aac_encoder_ = new AACEncoder();
         // aac编码模块只接受packed模式的pcm数据
         // 和 aac_decoder_->SetResampleArg(AV_SAMPLE_FMT_S16,2,44100)保持一致即可，但如果aac_decoder_->SetResampleArg中指定了AV_SAMPLE_FMT_S16P,这里使用AV_SAMPLE_FMT_S16，数据就要转换成packed模型在送入队列
-        aac_encoder_->Init(AV_SAMPLE_FMT_S16, 2 , 44100, data_len); // 输入格式，编码器会把PCM数据重采样成AAC编码器需要的格式然后进行编码
+        if (aac_encoder_->Init(AV_SAMPLE_FMT_S16, 2 , 44100, data_len) < 0) { // 输入格式，编码器会把PCM数据重采样成AAC编码器需要的格式然后进行编码
+            SetError("audio encoder init failed");
+            return;
+        }
         aac_encoder_->SetCallback(static_cast<EncDataCallListner *>(this));
+        aac_encoder_->SetOfflineMode(offline_);
+        audio_enc_metrics_ = new StageMetrics(name_, "audio_encode");
+        aac_encoder_->SetMetrics(audio_enc_metrics_);
     }
     
     // 转换成packed在传送给aac编码模块
@@ -395,6 +524,8 @@ void MiedaWrapper::OnPCMData(unsigned char **data, int data_len)
     } else { // packed,dst_linesize=data_len*out_spb*out_channels
         memcpy(buffer_pcm_, data[0], data_len * out_spb * dst_nb_channels);
     }
+    audio_dec_metrics_->Output(buf_len);
+    audio_enc_metrics_->Input(buf_len);
     aac_encoder_->AddPCMFrame(buffer_pcm_, buf_len);
     // if (fp_file == NULL) {
     //     fp_file = fopen("test.pcm", "wb+");
@@ -403,29 +534,39 @@ void MiedaWrapper::OnPCMData(unsigned char **data, int data_len)
     return;
 }
 static const char *enc_h264_filename = "out.h264";
-static FILE *enc_h264_fd = NULL;
 void MiedaWrapper::OnVideoEncData(unsigned char *data, int data_len, int64_t pts)
 {
-    if (enc_h264_fd == NULL) {
-        enc_h264_fd = fopen(enc_h264_filename, "wb");
+    OnVideoEncData(data, data_len, pts, pts); // 旧接口没有dts，用pts代替，不单调时由Muxer修正
+    return;
+}
+void MiedaWrapper::OnVideoEncData(unsigned char *data, int data_len, int64_t pts, int64_t dts)
+{
+    encoded_frames_++;
+    video_enc_metrics_->Output(data_len);
+    int64_t frame_id = latency_->Mark(latency_->FrameIdByPts(pts), LATENCY_ENCODE);
+    if (enc_h264_fd_ == NULL) {
+        enc_h264_fd_ = fopen((raw_prefix_ + enc_h264_filename).c_str(), "wb");
+    }
+    if (enc_h264_fd_ != NULL) {
+        fwrite(data, 1, data_len, enc_h264_fd_);
+    }
+    WriteVideo2File(data, data_len, pts, dts);
+    if (frame_id >= 0) {
+        latency_->Mark(frame_id, LATENCY_OUTPUT);
     }
-    fwrite(data, 1, data_len, enc_h264_fd);
-#ifdef MP4MUXER
-    WriteVideo2File(data, data_len);
-#endif
     return;
 }
 static const char *enc_aac_filename = "out.aac";
-static FILE *enc_aac_fd = NULL;
 void MiedaWrapper::OnAudioEncData(unsigned char *data, int data_len)
 {
-    if (enc_aac_fd == NULL) {
-        enc_aac_fd = fopen(enc_aac_filename, "wb");
+    audio_enc_metrics_->Output(data_len);
+    if (enc_aac_fd_ == NULL) {
+        enc_aac_fd_ = fopen((raw_prefix_ + enc_aac_filename).c_str(), "wb");
+    }
+    if (enc_aac_fd_ != NULL) {
+        fwrite(data, 1, data_len, enc_aac_fd_);
     }
-    fwrite(data, 1, data_len, enc_aac_fd);
-#ifdef MP4MUXER
     WriteAudio2File(data, data_len);
-#endif
     return;
 }
 MiedaWrapper::~MiedaWrapper()
@@ -439,6 +580,10 @@ MiedaWrapper::~MiedaWrapper()
         delete rtsp_client_proxy_;
         rtsp_client_proxy_ = NULL;
     }
+    if (synthetic_source_) {
+        delete synthetic_source_;
+        synthetic_source_ = NULL;
+    }
     if (hard_decoder_) {
         delete hard_decoder_;
         hard_decoder_ = NULL;
@@ -456,7 +601,9 @@ MiedaWrapper::~MiedaWrapper()
         aac_encoder_ = NULL;
     }
     if (mp4_muxer_) {
-        mp4_muxer_->SendTrailer();
+        if (video_stream_ != -1) { // 没有写文件头时不能写文件尾
+            mp4_muxer_->SendTrailer();
+        }
         delete mp4_muxer_;
         mp4_muxer_ = NULL;
     }
@@ -476,5 +623,25 @@ MiedaWrapper::~MiedaWrapper()
         free(buffer_pcm_);
         buffer_pcm_ = NULL;
     }
-    log_debug("~MiedaWrapper");
+    if (enc_h264_fd_) {
+        fclose(enc_h264_fd_);
+        enc_h264_fd_ = NULL;
+    }
+    if (enc_aac_fd_) {
+        fclose(enc_aac_fd_);
+        enc_aac_fd_ = NULL;
+    }
+    StageMetrics **metrics[] = {&demux_video_metrics_, &demux_audio_metrics_, &video_dec_metrics_, &audio_dec_metrics_,
+                                &video_enc_metrics_,   &audio_enc_metrics_,   &mux_metrics_};
+    for (StageMetrics **m : metrics) {
+        if (*m) {
+            delete *m;
+            *m = NULL;
+        }
+    }
+    if (latency_) {
+        delete latency_;
+        latency_ = NULL;
+    }
+    log_debug("~MiedaWrapper {}", name_);
 }
\ No newline at end of file
@@ -6,17 +6,48 @@
 #include "DecEncInterface.h"
 #include "H264HardEncoder.h"
 #include "HardDecoder.h"
+#include "LatencyTracker.h"
 #include "MediaInterface.h"
 #include "MediaMuxer.h"
 #include "MediaReader.h"
+#include "Metrics.h"
 #include "log_helpers.h"
 #include "rtsp_client_proxy.h"
+#include "SyntheticSource.h"
 #include <opencv2/opencv.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+// rtsp等待第一帧视频的最长时间，超时后通道进入错误状态
+#define WRAPPER_RTSP_PROBE_TIMEOUT_MS 10000
+enum WrapperMode {
+    WRAPPER_TRANSCODE,     // 解码->BGR->编码，可以在OnRGBData中处理图像
+    WRAPPER_TRANSCODE_YUV, // 解码后的YUV直接送给编码器，不转换成BGR(FFmpeg解码时有效)
+    WRAPPER_REMUX,         // 不解码不编码，源码流直接写入输出文件，参数集从源码流中获取
+};
+struct WrapperOption {
+    bool offline = false; // 文件输入时以最快速度转码，不丢帧
+    WrapperMode mode = WRAPPER_TRANSCODE;
+    std::string name;       // 日志中区分通道
+    std::string raw_prefix; // 编码后的裸流文件名前缀，多个通道在同一目录下输出时区分文件
+    int scale_threads = 0;  // 颜色转换线程数，小于等于0时自动选择
+    ScaleKernel scale_kernel = SCALE_KERNEL_SWS;
+    int32_t device_id = 0;  // NPU GPU
+    bool use_nv_enc = false;
+    int latency_budget_ms = 200; // 每帧从输入到输出的延时预算，超过时计数并打印各阶段耗时；小于等于0不检查
+};
+struct WrapperStats {
+    uint64_t video_packets = 0;  // 收到的视频包(帧)
+    uint64_t audio_packets = 0;  // 收到的音频包
+    uint64_t decoded_frames = 0; // 解码输出的图像
+    uint64_t encoded_frames = 0; // 编码输出的视频帧
+};
 class MiedaWrapper : public MediaDataListner, public DecDataCallListner, public EncDataCallListner
 {
 public:
     MiedaWrapper() = delete;
-    MiedaWrapper(char *input, char *ouput);
+    MiedaWrapper(char *input, char *ouput, bool offline = false, WrapperMode mode = WRAPPER_TRANSCODE); // offline:文件输入时以最快速度转码，不丢帧
+    MiedaWrapper(const char *input, const char *ouput, const WrapperOption &option);
     virtual ~MiedaWrapper();
     // 音视频解封装接口
     void OnVideoData(VideoData data);
@@ -25,14 +56,20 @@ public:
 
     // 解码后数据接口
     void OnRGBData(cv::Mat frame);
+    void OnRGBData(cv::Mat frame, int64_t pts);
     void OnPCMData(unsigned char **data, int data_len);
+    void OnVideoFrame(VideoFrame frame);
 
     // 编码后的数据接口
     void OnVideoEncData(unsigned char *data, int data_len, int64_t pts);
+    void OnVideoEncData(unsigned char *data, int data_len, int64_t pts, int64_t dts);
     void OnAudioEncData(unsigned char *data, int data_len);
 
-    bool OverHandle() { return over_flag_; }
-    int WriteVideo2File(uint8_t *data, int len);
+    bool OverHandle() { return over_flag_; } // 正常结束或者出错
+    bool HasError() { return error_flag_; }
+    std::string GetError();
+    WrapperStats GetStats();
+    int WriteVideo2File(uint8_t *data, int len, int64_t pts, int64_t dts); // pts/dts是源时间戳(微秒)，AV_NOPTS_VALUE时按帧率生成
     int WriteAudio2File(uint8_t *data, int len);
 
     // for nvpp nvidia
@@ -40,22 +77,56 @@ public:
     // for nvidia
     void UseNVEnc() {use_nv_enc_flag_ = true; return;}
 
+private:
+    void Start(const char *input, const char *ouput);
+    void SetError(const std::string &msg); // 只结束本通道，不退出进程
+    enum VideoType SourceVideoType(); // 当前输入(文件、rtsp、合成源)的音视频格式
+    enum AudioType SourceAudioType();
+    int CreateVideoEncoder(cv::Mat init_frame); // 编码器初始化失败时设置错误并返回-1
+    void CacheParameterSet(uint8_t *data, int data_len);
+    void OpenMuxer(bool have_audio, int channels, int samplerate, int profile);
+    bool CacheAudioConfig(uint8_t *data, int len); // 从adts头中取音频参数，拿到之后返回true
+    void RemuxVideo(VideoData &data);
+    void RemuxAudio(AudioData &data);
+
 public:
-    bool over_flag_ = false;
+    std::atomic<bool> over_flag_ = {false};
+    std::atomic<bool> error_flag_ = {false};
+    std::mutex error_mtx_;
+    std::string error_msg_;
+    std::string name_;
+    std::string raw_prefix_;
+    int scale_threads_ = 0;
+    ScaleKernel scale_kernel_ = SCALE_KERNEL_SWS;
+    std::atomic<uint64_t> video_packets_ = {0};
+    std::atomic<uint64_t> audio_packets_ = {0};
+    std::atomic<uint64_t> decoded_frames_ = {0};
+    std::atomic<uint64_t> encoded_frames_ = {0};
+    // 各阶段的指标，标签channel为name_；模块创建时创建，模块销毁之后再释放
+    StageMetrics *demux_video_metrics_ = NULL;
+    StageMetrics *demux_audio_metrics_ = NULL;
+    StageMetrics *video_dec_metrics_ = NULL;
+    StageMetrics *audio_dec_metrics_ = NULL;
+    StageMetrics *video_enc_metrics_ = NULL;
+    StageMetrics *audio_enc_metrics_ = NULL;
+    StageMetrics *mux_metrics_ = NULL;
+    // 每帧的端到端延时，frame_id由输入端分配，解码器和编码器带回源时间戳，再查回frame_id
+    LatencyTracker *latency_ = NULL;
+    int latency_budget_ms_ = 200;
+    FILE *enc_h264_fd_ = NULL;
+    FILE *enc_aac_fd_ = NULL;
     // video
-    std::chrono::steady_clock::time_point time_now_;
-    std::chrono::steady_clock::time_point time_pre_;
     uint64_t nframe_counter_ = 0;
-    uint64_t time_ts_accum_ = 0;
     // audio
-    std::chrono::steady_clock::time_point time_now_1_;
-    std::chrono::steady_clock::time_point time_pre_1_;
     uint64_t nframe_counter_1_ = 0;
-    uint64_t time_ts_accum_1_ = 0;
+    int64_t audio_start_pts_ = 0; // 第一个音频包的源时间戳，编码后的音频从这里按采样点个数递增
 
     MediaReader *reader_ = NULL;
     RtspClientProxy *rtsp_client_proxy_ = NULL;
+    SyntheticSource *synthetic_source_ = NULL;
     bool rtsp_flag_ = false;
+    bool offline_ = false;
+    WrapperMode mode_ = WRAPPER_TRANSCODE;
     int width_;
     int height_;
     int fps_ = 25;
@@ -83,6 +154,13 @@ public:
     Muxer *mp4_muxer_ = NULL;
     int video_stream_ = -1;
     int audio_stream_ = -1;
+    // 封装：转封装和转码输出共用
+    std::mutex mux_mtx_; // 音视频回调在不同线程，保护写文件头之前的状态
+    enum VideoType mux_video_type_ = VIDEO_H264; // 输出文件的视频格式，参数集按这个格式解析
+    bool mux_audio_ready_ = false;
+    int mux_channels_ = 0;
+    int mux_samplerate_ = 0;
+    int mux_profile_ = 0;
 
     // NPU GPU
     int32_t device_id_ = 0;